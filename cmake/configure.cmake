@@ -132,6 +132,20 @@ else ()
    list ( APPEND DYNAMIPS_DEFINITIONS "-DHAS_RFC2553=0" )
 endif ()
 
+# ENABLE_TIMER_WHEEL
+option ( ENABLE_TIMER_WHEEL "use a hierarchical timing wheel for timer queues" ON )
+print_variables ( ENABLE_TIMER_WHEEL )
+if ( ENABLE_TIMER_WHEEL )
+   list ( APPEND DYNAMIPS_DEFINITIONS "-DTIMER_WHEEL" )
+endif ()
+
+# MTS_CACHE_BITS, MTS_CACHE_WAYS
+set ( MTS_CACHE_BITS 12 CACHE STRING "log2 of the number of MTS cache sets (unstable)" )
+set ( MTS_CACHE_WAYS 2 CACHE STRING "MTS cache associativity: 1, 2 or 4 (unstable)" )
+print_variables ( MTS_CACHE_BITS MTS_CACHE_WAYS )
+list ( APPEND DYNAMIPS_DEFINITIONS "-DMTS_CACHE_BITS=${MTS_CACHE_BITS}" )
+list ( APPEND DYNAMIPS_DEFINITIONS "-DMTS_CACHE_WAYS=${MTS_CACHE_WAYS}" )
+
 # target system
 if ( "SunOS" STREQUAL "${CMAKE_SYSTEM_NAME}" )
    list ( APPEND DYNAMIPS_DEFINITIONS "-DSUNOS" "-DINADDR_NONE=0xFFFFFFFF" )
@@ -202,6 +216,8 @@ macro ( print_summary )
       set ( _ipv6 "no, missing headers or functions" )
    endif ()
    message ( "  IPv6 support (RFC 2553)            : ${_ipv6}" )
+   message ( "  Timing wheel (timer queues)        : ENABLE_TIMER_WHEEL=${ENABLE_TIMER_WHEEL}" )
+   message ( "  MTS cache (unstable)               : 2^${MTS_CACHE_BITS} sets, ${MTS_CACHE_WAYS} ways" )
 endmacro ( print_summary )
 
 message ( STATUS "configure - END" )
@@ -0,0 +1,193 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Host CPU affinity and NUMA memory placement.
+ *
+ * The memory policy is set with the set_mempolicy() system call directly,
+ * so that libnuma is not needed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "affinity.h"
+
+/* Memory policies (see set_mempolicy(2)) */
+#define AFFINITY_MPOL_DEFAULT    0
+#define AFFINITY_MPOL_PREFERRED  1
+
+/* Add a CPU to a set */
+static inline void affinity_add_cpu(affinity_set_t *set,u_int cpu)
+{
+   set->mask[cpu >> 6] |= 1ULL << (cpu & 0x3f);
+}
+
+/* Check if a CPU is in a set */
+static inline int affinity_has_cpu(affinity_set_t *set,u_int cpu)
+{
+   return((set->mask[cpu >> 6] >> (cpu & 0x3f)) & 1);
+}
+
+/* Parse a CPU list ("0-3,8,10-11") */
+int affinity_parse(affinity_set_t *set,char *str)
+{
+   u_long first,last,i;
+   char *p,*end;
+
+   memset(set,0,sizeof(*set));
+
+   for(p=str;*p;) {
+      first = strtoul(p,&end,10);
+
+      if (end == p)
+         return(-1);
+
+      last = first;
+
+      if (*end == '-') {
+         p = end + 1;
+         last = strtoul(p,&end,10);
+
+         if ((end == p) || (last < first))
+            return(-1);
+      }
+
+      if (last >= AFFINITY_MAX_CPUS)
+         return(-1);
+
+      for(i=first;i<=last;i++)
+         affinity_add_cpu(set,i);
+
+      if (*end == ',')
+         end++;
+      else if (*end != 0)
+         return(-1);
+
+      p = end;
+   }
+
+   return(affinity_is_empty(set) ? -1 : 0);
+}
+
+/* Check if a CPU set is empty */
+int affinity_is_empty(affinity_set_t *set)
+{
+   u_int i;
+
+   for(i=0;i<AFFINITY_MAX_CPUS/64;i++)
+      if (set->mask[i])
+         return(FALSE);
+
+   return(TRUE);
+}
+
+/* Check if two CPU sets are equal */
+int affinity_is_equal(affinity_set_t *a,affinity_set_t *b)
+{
+   return(!memcmp(a->mask,b->mask,sizeof(a->mask)));
+}
+
+/* Bind a thread to a CPU set */
+int affinity_set_thread(pthread_t thread,affinity_set_t *set)
+{
+#ifdef __linux__
+   cpu_set_t cpus;
+   u_int i;
+
+   CPU_ZERO(&cpus);
+
+   for(i=0;(i<AFFINITY_MAX_CPUS) && (i<CPU_SETSIZE);i++)
+      if (affinity_has_cpu(set,i))
+         CPU_SET(i,&cpus);
+
+   return(pthread_setaffinity_np(thread,sizeof(cpus),&cpus) ? -1 : 0);
+#else
+   return(-1);
+#endif
+}
+
+/* Get the NUMA node of a host CPU */
+static int affinity_get_cpu_node(u_int cpu)
+{
+   struct dirent *entry;
+   char path[64];
+   int node = -1;
+   DIR *dir;
+
+   snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu%u",cpu);
+
+   if (!(dir = opendir(path)))
+      return(-1);
+
+   while((entry = readdir(dir)) != NULL) {
+      if (!strncmp(entry->d_name,"node",4) &&
+          (sscanf(entry->d_name+4,"%d",&node) == 1))
+         break;
+
+      node = -1;
+   }
+
+   closedir(dir);
+   return(node);
+}
+
+/*
+ * Get the NUMA node of the CPUs of a set.
+ * Returns -1 if the set is empty or spread on several nodes.
+ */
+int affinity_get_node(affinity_set_t *set)
+{
+   int node = -1,cpu_node;
+   u_int i;
+
+   for(i=0;i<AFFINITY_MAX_CPUS;i++) {
+      if (!affinity_has_cpu(set,i))
+         continue;
+
+      cpu_node = affinity_get_cpu_node(i);
+
+      if ((cpu_node == -1) || ((node != -1) && (cpu_node != node)))
+         return(-1);
+
+      node = cpu_node;
+   }
+
+   return(node);
+}
+
+/*
+ * Set the preferred NUMA node for the memory allocated by the calling
+ * thread and the threads it creates (-1: default policy).
+ */
+int affinity_set_mem_node(int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+   unsigned long mask;
+
+   if (node < 0)
+      return(syscall(SYS_set_mempolicy,AFFINITY_MPOL_DEFAULT,NULL,0));
+
+   if (node >= (int)(sizeof(mask) * 8)) {
+      errno = EINVAL;
+      return(-1);
+   }
+
+   mask = 1UL << node;
+   return(syscall(SYS_set_mempolicy,AFFINITY_MPOL_PREFERRED,
+                  &mask,(sizeof(mask) * 8) + 1));
+#else
+   return((node < 0) ? 0 : -1);
+#endif
+}
@@ -0,0 +1,47 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Host CPU affinity and NUMA memory placement.
+ */
+
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include <pthread.h>
+#include "utils.h"
+
+/* Maximum number of host CPUs handled in a CPU set */
+#define AFFINITY_MAX_CPUS  1024
+
+/* Host CPU set */
+typedef struct affinity_set affinity_set_t;
+struct affinity_set {
+   m_uint64_t mask[AFFINITY_MAX_CPUS/64];
+};
+
+/* Parse a CPU list ("0-3,8,10-11") */
+int affinity_parse(affinity_set_t *set,char *str);
+
+/* Check if a CPU set is empty */
+int affinity_is_empty(affinity_set_t *set);
+
+/* Check if two CPU sets are equal */
+int affinity_is_equal(affinity_set_t *a,affinity_set_t *b);
+
+/* Bind a thread to a CPU set */
+int affinity_set_thread(pthread_t thread,affinity_set_t *set);
+
+/*
+ * Get the NUMA node of the CPUs of a set.
+ * Returns -1 if the set is empty or spread on several nodes.
+ */
+int affinity_get_node(affinity_set_t *set);
+
+/*
+ * Set the preferred NUMA node for the memory allocated by the calling
+ * thread and the threads it creates (-1: default policy).
+ */
+int affinity_set_mem_node(int node);
+
+#endif
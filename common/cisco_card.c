@@ -119,8 +119,11 @@ void cisco_card_enable_all_nio(vm_instance_t *vm,struct cisco_card *card)
    struct cisco_nio_binding *nb;
 
    if (card && card->driver && card->drv_info)      
-      for(nb=card->nio_list;nb;nb=nb->next)
+      for(nb=card->nio_list;nb;nb=nb->next) {
+         /* Keep the RX processing of the NIO of a VM on the same worker */
+         nb->nio->rxl_group = vm;
          card->driver->card_set_nio(vm,card,nb->port_id,nb->nio);
+      }
 }
 
 /* Disable all NIO for the specified card */
@@ -130,8 +133,10 @@ void cisco_card_disable_all_nio(vm_instance_t *vm,struct cisco_card *card)
    struct cisco_nio_binding *nb;
 
    if (card && card->driver && card->drv_info)
-      for(nb=card->nio_list;nb;nb=nb->next)
+      for(nb=card->nio_list;nb;nb=nb->next) {
+         nb->nio->rxl_group = NULL;
          card->driver->card_unset_nio(vm,card,nb->port_id);
+      }
 }
 
 /* Initialize a card */
@@ -581,7 +586,14 @@ int vm_slot_enable_nio(vm_instance_t *vm,u_int slot_id,u_int port_id)
    if (!rc->driver || !rc->drv_info)
       return(-1);
 
-   return(rc->driver->card_set_nio(vm,rc,real_port_id,nb->nio));
+   /* Keep the RX processing of the NIO of a VM on the same worker */
+   nb->nio->rxl_group = vm;
+
+   if (rc->driver->card_set_nio(vm,rc,real_port_id,nb->nio) == -1)
+      return(-1);
+
+   vm_apply_affinity(vm);
+   return(0);
 }
 
 /* Disable Network IO descriptor for the specified slot */
@@ -608,6 +620,7 @@ int vm_slot_disable_nio(vm_instance_t *vm,u_int slot_id,u_int port_id)
    if (!rc->driver || !rc->drv_info)
       return(-1);
 
+   nb->nio->rxl_group = NULL;
    return(rc->driver->card_unset_nio(vm,rc,real_port_id));
 }
 
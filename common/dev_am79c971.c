@@ -406,6 +406,10 @@ static void am79c971_rdp_access(cpu_gen_t *cpu,struct am79c971_data *d,
                am79c971_update_rx_tx_on_bits(d);
             }
 
+            /* Transmit Demand: scan the TX ring at once */
+            if (*data & AM79C971_CSR0_TDMD)
+               ptask_kick(d->tx_tid);
+
             /* Update IRQ status */
             am79c971_update_irq_status(d);
          }
@@ -918,7 +922,7 @@ static int am79c971_handle_txring_single(struct am79c971_data *d)
    return(TRUE);
 }
 
-/* Handle the TX ring */
+/* Handle the TX ring (returns TRUE if packets were sent) */
 static int am79c971_handle_txring(struct am79c971_data *d)
 {
    int i;
@@ -931,7 +935,7 @@ static int am79c971_handle_txring(struct am79c971_data *d)
 
    netio_clear_bw_stat(d->nio);
    AM79C971_UNLOCK(d);
-   return(TRUE);
+   return(i > 0);
 }
 
 /*
@@ -1010,6 +1014,75 @@ static void pci_am79c971_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* Am79c971 state saved in VM snapshots */
+struct am79c971_snapshot_state {
+   m_int32_t rx_tx_clear_count;
+   m_uint32_t rap;
+   m_uint32_t csr[256],bcr[256];
+   m_uint32_t rx_start,tx_start;
+   m_uint32_t rx_l2len,tx_l2len;
+   m_uint32_t rx_len,tx_len;
+   m_uint32_t rx_pos,tx_pos;
+   m_uint16_t mii_regs[32][32];
+   n_eth_addr_t mac_addr;
+};
+
+/* Save the controller state (VM snapshot) */
+static int dev_am79c971_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct am79c971_data *d = dev->priv_data;
+   struct am79c971_snapshot_state st;
+
+   memset(&st,0,sizeof(st));
+
+   AM79C971_LOCK(d);
+   st.rx_tx_clear_count = d->rx_tx_clear_count;
+   st.rap      = d->rap;
+   memcpy(st.csr,d->csr,sizeof(st.csr));
+   memcpy(st.bcr,d->bcr,sizeof(st.bcr));
+   st.rx_start = d->rx_start;
+   st.tx_start = d->tx_start;
+   st.rx_l2len = d->rx_l2len;
+   st.tx_l2len = d->tx_l2len;
+   st.rx_len   = d->rx_len;
+   st.tx_len   = d->tx_len;
+   st.rx_pos   = d->rx_pos;
+   st.tx_pos   = d->tx_pos;
+   memcpy(st.mii_regs,d->mii_regs,sizeof(st.mii_regs));
+   st.mac_addr = d->mac_addr;
+   AM79C971_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the controller state (VM snapshot) */
+static int dev_am79c971_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct am79c971_data *d = dev->priv_data;
+   struct am79c971_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   AM79C971_LOCK(d);
+   d->rx_tx_clear_count = st.rx_tx_clear_count;
+   d->rap      = st.rap;
+   memcpy(d->csr,st.csr,sizeof(d->csr));
+   memcpy(d->bcr,st.bcr,sizeof(d->bcr));
+   d->rx_start = st.rx_start;
+   d->tx_start = st.tx_start;
+   d->rx_l2len = st.rx_l2len;
+   d->tx_l2len = st.tx_l2len;
+   d->rx_len   = st.rx_len;
+   d->tx_len   = st.tx_len;
+   d->rx_pos   = st.rx_pos;
+   d->tx_pos   = st.tx_pos;
+   memcpy(d->mii_regs,st.mii_regs,sizeof(d->mii_regs));
+   d->mac_addr = st.mac_addr;
+   AM79C971_UNLOCK(d);
+   return(0);
+}
+
 /* 
  * dev_am79c971_init()
  *
@@ -1060,6 +1133,8 @@ dev_am79c971_init(vm_instance_t *vm,char *name,int interface_type,
    dev->phys_len  = 0x4000;
    dev->handler   = dev_am79c971_access;
    dev->priv_data = d;
+   dev->save_state = dev_am79c971_save_state;
+   dev->load_state = dev_am79c971_load_state;
    return(d);
 
  err_dev:
@@ -1089,7 +1164,8 @@ int dev_am79c971_set_nio(struct am79c971_data *d,netio_desc_t *nio)
       return(-1);
 
    d->nio = nio;
-   d->tx_tid = ptask_add((ptask_callback)am79c971_handle_txring,d,NULL);
+   d->tx_tid = ptask_add_ext((ptask_callback)am79c971_handle_txring,d,NULL,
+                             d->vm,PTASK_ADAPTIVE);
    netio_rxl_add(nio,(netio_rx_handler_t)am79c971_handle_rxring,d,NULL);
    return(0);
 }
@@ -452,6 +452,70 @@ void *dev_bootflash_access(cpu_gen_t *cpu,struct vdevice *dev,
    return NULL;
 }
 
+/* Flash command state saved in VM snapshots */
+struct flash_snapshot_state {
+   m_uint32_t state,status_reg;
+   m_uint32_t wb_offset,wb_count,wb_remain;
+   m_uint32_t wbuf[FLASH_BUF_SIZE];
+};
+
+/* Save the command state of the flash chips (VM snapshot) */
+static int dev_bootflash_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct flashset_data *d = dev->priv_data;
+   struct flash_snapshot_state st;
+   struct flash_data *flash;
+   u_int i,j;
+
+   for(i=0;i<d->nr_flash_count;i++) {
+      flash = &d->flash[i];
+
+      st.state      = flash->state;
+      st.status_reg = flash->status_reg;
+      st.wb_offset  = flash->wb_offset;
+      st.wb_count   = flash->wb_count;
+      st.wb_remain  = flash->wb_remain;
+
+      for(j=0;j<FLASH_BUF_SIZE;j++)
+         st.wbuf[j] = flash->wbuf[j];
+
+      if (fwrite(&st,sizeof(st),1,fd) != 1)
+         return(-1);
+   }
+
+   return(0);
+}
+
+/* Restore the command state of the flash chips (VM snapshot) */
+static int dev_bootflash_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct flashset_data *d = dev->priv_data;
+   struct flash_snapshot_state st;
+   struct flash_data *flash;
+   u_int i,j;
+
+   if (len != (d->nr_flash_count * sizeof(st)))
+      return(-1);
+
+   for(i=0;i<d->nr_flash_count;i++) {
+      if ((fread(&st,sizeof(st),1,fd) != 1) ||
+          (st.wb_count > FLASH_BUF_SIZE))
+         return(-1);
+
+      flash = &d->flash[i];
+      flash->state      = st.state;
+      flash->status_reg = st.status_reg;
+      flash->wb_offset  = st.wb_offset;
+      flash->wb_count   = st.wb_count;
+      flash->wb_remain  = st.wb_remain;
+
+      for(j=0;j<FLASH_BUF_SIZE;j++)
+         flash->wbuf[j] = st.wbuf[j];
+   }
+
+   return(0);
+}
+
 /* Shutdown a bootflash device */
 void dev_bootflash_shutdown(vm_instance_t *vm,struct flashset_data *d)
 {
@@ -514,6 +578,8 @@ int dev_bootflash_init(vm_instance_t *vm,char *name,char *model,
    d->dev.fd        = memzone_create_file(d->filename,d->dev.phys_len,&ptr);
    d->dev.host_addr = (m_iptr_t)ptr;
    d->dev.flags     = VDEVICE_FLAG_NO_MTS_MMAP;
+   d->dev.save_state = dev_bootflash_save_state;
+   d->dev.load_state = dev_bootflash_load_state;
 
    if (d->dev.fd == -1) {
       vm_error(vm,"bootflash: unable to map file '%s'\n",d->filename);
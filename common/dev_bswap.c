@@ -106,6 +106,7 @@ int dev_bswap_init(vm_instance_t *vm,char *name,
    d->dev.phys_len  = len;
    d->dev.handler   = dev_bswap_access;
    d->dev.priv_data = d;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
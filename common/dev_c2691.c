@@ -25,6 +25,7 @@
 #include "dev_c2691.h"
 #include "dev_c2691_iofpga.h"
 #include "dev_vtty.h"
+#include "vm_snapshot.h"
 #include "registry.h"
 #include "fs_nvram.h"
 
@@ -472,11 +473,13 @@ static int c2691_init_platform(c2691_t *router)
 
    /* PCMCIA Slot 0 */
    dev_pcmcia_disk_init(vm,"slot0",C2691_SLOT0_ADDR,0x200000,
-                        vm->pcmcia_disk_size[0],1);
+                        vm->pcmcia_disk_size[0],
+                        vm->pcmcia_disk_base[0],1);
 
    /* PCMCIA Slot 1 */
    dev_pcmcia_disk_init(vm,"slot1",C2691_SLOT1_ADDR,0x200000,
-                        vm->pcmcia_disk_size[1],1);
+                        vm->pcmcia_disk_size[1],
+                        vm->pcmcia_disk_base[1],1);
 
    /* Initialize Network Modules */
    if (vm_slot_init_all(vm) == -1)
@@ -509,10 +512,17 @@ static int c2691_boot_ios(c2691_t *router)
    cpu = CPU_MIPS64(vm->boot_cpu);
    mips64_reset(cpu);
 
-   /* Load IOS image */
-   if (mips64_load_elf_image(cpu,vm->ios_image,
-                             (vm->ghost_status == VM_GHOST_RAM_USE),
-                             &vm->ios_entry_point) < 0) 
+   /* Resume from a snapshot, or load IOS image */
+   if (vm->snapshot_file != NULL) {
+      if (vm_snapshot_load(vm) == -1) {
+         vm_error(vm,"failed to restore snapshot '%s'.\n",
+                  vm->snapshot_file);
+         return(-1);
+      }
+   }
+   else if (mips64_load_elf_image(cpu,vm->ios_image,
+                                  (vm->ghost_status == VM_GHOST_RAM_USE),
+                                  &vm->ios_entry_point) < 0)
    {
       vm_error(vm,"failed to load Cisco IOS image '%s'.\n",vm->ios_image);
       return(-1);
@@ -25,6 +25,7 @@
 #include "dev_c3600_iofpga.h"
 #include "dev_c3600_bay.h"
 #include "dev_vtty.h"
+#include "vm_snapshot.h"
 #include "registry.h"
 #include "fs_nvram.h"
 
@@ -691,10 +692,17 @@ static int c3600_boot_ios(c3600_t *router)
    cpu = CPU_MIPS64(vm->boot_cpu);
    mips64_reset(cpu);
 
-   /* Load IOS image */
-   if (mips64_load_elf_image(cpu,vm->ios_image,
-                             (vm->ghost_status == VM_GHOST_RAM_USE),
-                             &vm->ios_entry_point) < 0) 
+   /* Resume from a snapshot, or load IOS image */
+   if (vm->snapshot_file != NULL) {
+      if (vm_snapshot_load(vm) == -1) {
+         vm_error(vm,"failed to restore snapshot '%s'.\n",
+                  vm->snapshot_file);
+         return(-1);
+      }
+   }
+   else if (mips64_load_elf_image(cpu,vm->ios_image,
+                                  (vm->ghost_status == VM_GHOST_RAM_USE),
+                                  &vm->ios_entry_point) < 0)
    {
       vm_error(vm,"failed to load Cisco IOS image '%s'.\n",vm->ios_image);
       return(-1);
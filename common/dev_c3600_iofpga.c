@@ -767,6 +767,48 @@ dev_c3600_iofpga_shutdown(vm_instance_t *vm,struct c3600_iofpga_data *d)
    }
 }
 
+/* IO FPGA state saved in VM snapshots */
+struct iofpga_snapshot_state {
+   m_uint32_t eeprom_slot,io_mask,sel;
+   m_uint32_t net_irq_status[2];
+};
+
+/* Save the IO FPGA state (VM snapshot) */
+static int dev_c3600_iofpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct c3600_iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+   int i;
+
+   st.eeprom_slot = d->eeprom_slot;
+   st.io_mask     = d->io_mask;
+   st.sel         = d->sel;
+
+   for(i=0;i<2;i++)
+      st.net_irq_status[i] = d->net_irq_status[i];
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the IO FPGA state (VM snapshot) */
+static int dev_c3600_iofpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct c3600_iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->eeprom_slot = st.eeprom_slot;
+   d->io_mask     = st.io_mask;
+   d->sel         = st.sel;
+
+   for(i=0;i<2;i++)
+      d->net_irq_status[i] = st.net_irq_status[i];
+   return(0);
+}
+
 /*
  * dev_c3600_iofpga_init()
  */
@@ -795,6 +837,8 @@ int dev_c3600_iofpga_init(c3600_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c3600_iofpga_save_state;
+   d->dev.load_state = dev_c3600_iofpga_load_state;
 
    switch(router->chassis_driver->chassis_id) {
       case 3620:
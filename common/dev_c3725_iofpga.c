@@ -465,6 +465,57 @@ dev_c3725_iofpga_shutdown(vm_instance_t *vm,struct c3725_iofpga_data *d)
    }
 }
 
+/* IO FPGA state saved in VM snapshots */
+struct iofpga_snapshot_state {
+   m_uint32_t intr_mask,wic_select,wic_cmd_pos,wic_cmd_valid;
+   m_uint32_t net_irq_status[2];
+   m_uint32_t wic_cmd[2];
+};
+
+/* Save the IO FPGA state (VM snapshot) */
+static int dev_c3725_iofpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct c3725_iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+   int i;
+
+   st.intr_mask     = d->intr_mask;
+   st.wic_select    = d->wic_select;
+   st.wic_cmd_pos   = d->wic_cmd_pos;
+   st.wic_cmd_valid = d->wic_cmd_valid;
+
+   for(i=0;i<2;i++)
+      st.net_irq_status[i] = d->net_irq_status[i];
+
+   for(i=0;i<2;i++)
+      st.wic_cmd[i] = d->wic_cmd[i];
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the IO FPGA state (VM snapshot) */
+static int dev_c3725_iofpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct c3725_iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->intr_mask     = st.intr_mask;
+   d->wic_select    = st.wic_select;
+   d->wic_cmd_pos   = st.wic_cmd_pos;
+   d->wic_cmd_valid = st.wic_cmd_valid;
+
+   for(i=0;i<2;i++)
+      d->net_irq_status[i] = st.net_irq_status[i];
+
+   for(i=0;i<2;i++)
+      d->wic_cmd[i] = st.wic_cmd[i];
+   return(0);
+}
+
 /*
  * dev_c3725_iofpga_init()
  */
@@ -495,6 +546,8 @@ int dev_c3725_iofpga_init(c3725_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c3725_iofpga_save_state;
+   d->dev.load_state = dev_c3725_iofpga_load_state;
    d->dev.handler   = dev_c3725_iofpga_access;
 
    /* Map this device to the VM */
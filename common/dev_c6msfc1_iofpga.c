@@ -405,6 +405,47 @@ void dev_c6msfc1_iofpga_shutdown(vm_instance_t *vm,struct iofpga_data *d)
    }
 }
 
+/* IO FPGA state saved in VM snapshots */
+struct iofpga_snapshot_state {
+   m_uint32_t duart_isr,duart_imr,duart_irq_seq,io_ctrl_reg,mux;
+};
+
+/* Save the IO FPGA state (VM snapshot) */
+static int dev_c6msfc1_iofpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+
+   IOFPGA_LOCK(d);
+   st.duart_isr     = d->duart_isr;
+   st.duart_imr     = d->duart_imr;
+   st.duart_irq_seq = d->duart_irq_seq;
+   st.io_ctrl_reg   = d->io_ctrl_reg;
+   st.mux           = d->mux;
+   IOFPGA_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the IO FPGA state (VM snapshot) */
+static int dev_c6msfc1_iofpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   IOFPGA_LOCK(d);
+   d->duart_isr     = st.duart_isr;
+   d->duart_imr     = st.duart_imr;
+   d->duart_irq_seq = st.duart_irq_seq;
+   d->io_ctrl_reg   = st.io_ctrl_reg;
+   d->mux           = st.mux;
+   IOFPGA_UNLOCK(d);
+   return(0);
+}
+
 /*
  * dev_c6msfc1_iofpga_init()
  */
@@ -440,6 +481,8 @@ int dev_c6msfc1_iofpga_init(c6msfc1_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_c6msfc1_iofpga_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c6msfc1_iofpga_save_state;
+   d->dev.load_state = dev_c6msfc1_iofpga_load_state;
 
    /* Set console and AUX port notifying functions */
    vm->vtty_con->priv_data = d;
@@ -448,8 +491,8 @@ int dev_c6msfc1_iofpga_init(c6msfc1_t *router,m_uint64_t paddr,m_uint32_t len)
    vm->vtty_aux->read_notifier = tty_aux_input;
 
    /* Trigger periodically a dummy IRQ to flush buffers */
-   d->duart_irq_tid = ptask_add((ptask_callback)tty_trigger_dummy_irq,
-                                d,NULL);
+   d->duart_irq_tid = ptask_add_ext((ptask_callback)tty_trigger_dummy_irq,
+                                    d,NULL,vm,0);
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
@@ -152,6 +152,37 @@ dev_c6msfc1_mpfpga_shutdown(vm_instance_t *vm,struct c6msfc1_mpfpga_data *d)
    }
 }
 
+/* MP FPGA state saved in VM snapshots */
+struct mpfpga_snapshot_state {
+   m_uint32_t irq_status,intr_enable;
+};
+
+/* Save the MP FPGA state (VM snapshot) */
+static int dev_c6msfc1_mpfpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct c6msfc1_mpfpga_data *d = dev->priv_data;
+   struct mpfpga_snapshot_state st;
+
+   st.irq_status  = d->irq_status;
+   st.intr_enable = d->intr_enable;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the MP FPGA state (VM snapshot) */
+static int dev_c6msfc1_mpfpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct c6msfc1_mpfpga_data *d = dev->priv_data;
+   struct mpfpga_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->irq_status  = st.irq_status;
+   d->intr_enable = st.intr_enable;
+   return(0);
+}
+
 /* 
  * dev_c6msfc1_mpfpga_init()
  */
@@ -180,6 +211,8 @@ int dev_c6msfc1_mpfpga_init(c6msfc1_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_c6msfc1_mpfpga_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c6msfc1_mpfpga_save_state;
+   d->dev.load_state = dev_c6msfc1_mpfpga_load_state;
 
    /* Map this device to the VM */
    vm_bind_device(router->vm,&d->dev);
@@ -373,6 +373,75 @@ void dev_c6sup1_iofpga_shutdown(vm_instance_t *vm,struct iofpga_data *d)
    }
 }
 
+/* IO FPGA state saved in VM snapshots */
+struct iofpga_snapshot_state {
+   m_uint32_t duart_isr,duart_imr,duart_irq_seq,io_ctrl_reg;
+   m_uint32_t temp_clk_low,temp_cmd,temp_cmd_pos,temp_data;
+   m_uint32_t temp_data_pos,mux;
+   m_uint32_t temp_cfg_reg[C6SUP1_TEMP_SENSORS];
+   m_uint32_t temp_deg_reg[C6SUP1_TEMP_SENSORS];
+};
+
+/* Save the IO FPGA state (VM snapshot) */
+static int dev_c6sup1_iofpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+   int i;
+
+   IOFPGA_LOCK(d);
+   st.duart_isr     = d->duart_isr;
+   st.duart_imr     = d->duart_imr;
+   st.duart_irq_seq = d->duart_irq_seq;
+   st.io_ctrl_reg   = d->io_ctrl_reg;
+   st.temp_clk_low  = d->temp_clk_low;
+   st.temp_cmd      = d->temp_cmd;
+   st.temp_cmd_pos  = d->temp_cmd_pos;
+   st.temp_data     = d->temp_data;
+   st.temp_data_pos = d->temp_data_pos;
+   st.mux           = d->mux;
+
+   for(i=0;i<C6SUP1_TEMP_SENSORS;i++)
+      st.temp_cfg_reg[i] = d->temp_cfg_reg[i];
+
+   for(i=0;i<C6SUP1_TEMP_SENSORS;i++)
+      st.temp_deg_reg[i] = d->temp_deg_reg[i];
+   IOFPGA_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the IO FPGA state (VM snapshot) */
+static int dev_c6sup1_iofpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   IOFPGA_LOCK(d);
+   d->duart_isr     = st.duart_isr;
+   d->duart_imr     = st.duart_imr;
+   d->duart_irq_seq = st.duart_irq_seq;
+   d->io_ctrl_reg   = st.io_ctrl_reg;
+   d->temp_clk_low  = st.temp_clk_low;
+   d->temp_cmd      = st.temp_cmd;
+   d->temp_cmd_pos  = st.temp_cmd_pos;
+   d->temp_data     = st.temp_data;
+   d->temp_data_pos = st.temp_data_pos;
+   d->mux           = st.mux;
+
+   for(i=0;i<C6SUP1_TEMP_SENSORS;i++)
+      d->temp_cfg_reg[i] = st.temp_cfg_reg[i];
+
+   for(i=0;i<C6SUP1_TEMP_SENSORS;i++)
+      d->temp_deg_reg[i] = st.temp_deg_reg[i];
+   IOFPGA_UNLOCK(d);
+   return(0);
+}
+
 /*
  * dev_c6sup1_iofpga_init()
  */
@@ -408,6 +477,8 @@ int dev_c6sup1_iofpga_init(c6sup1_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_c6sup1_iofpga_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c6sup1_iofpga_save_state;
+   d->dev.load_state = dev_c6sup1_iofpga_load_state;
 
    /* Set console and AUX port notifying functions */
    vm->vtty_con->priv_data = d;
@@ -416,8 +487,8 @@ int dev_c6sup1_iofpga_init(c6sup1_t *router,m_uint64_t paddr,m_uint32_t len)
    vm->vtty_aux->read_notifier = tty_aux_input;
 
    /* Trigger periodically a dummy IRQ to flush buffers */
-   d->duart_irq_tid = ptask_add((ptask_callback)tty_trigger_dummy_irq,
-                                d,NULL);
+   d->duart_irq_tid = ptask_add_ext((ptask_callback)tty_trigger_dummy_irq,
+                                    d,NULL,vm,0);
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
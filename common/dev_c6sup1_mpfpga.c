@@ -450,6 +450,48 @@ void c6sup1_init_eeprom_groups(c6sup1_t *router)
                      cisco_eeprom_find_c6k("C6K-LC-WS-X6248"));
 }
 
+/* MP FPGA state saved in VM snapshots */
+struct mpfpga_snapshot_state {
+   m_uint32_t irq_status,intr_enable,slot_sel;
+   m_uint32_t slot_status[C6SUP1_MAX_SLOTS];
+};
+
+/* Save the MP FPGA state (VM snapshot) */
+static int dev_c6sup1_mpfpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct c6sup1_mpfpga_data *d = dev->priv_data;
+   struct mpfpga_snapshot_state st;
+   int i;
+
+   st.irq_status  = d->irq_status;
+   st.intr_enable = d->intr_enable;
+   st.slot_sel    = d->slot_sel;
+
+   for(i=0;i<C6SUP1_MAX_SLOTS;i++)
+      st.slot_status[i] = d->slot_status[i];
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the MP FPGA state (VM snapshot) */
+static int dev_c6sup1_mpfpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct c6sup1_mpfpga_data *d = dev->priv_data;
+   struct mpfpga_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->irq_status  = st.irq_status;
+   d->intr_enable = st.intr_enable;
+   d->slot_sel    = st.slot_sel;
+
+   for(i=0;i<C6SUP1_MAX_SLOTS;i++)
+      d->slot_status[i] = st.slot_status[i];
+   return(0);
+}
+
 /* 
  * dev_c6sup1_mpfpga_init()
  */
@@ -478,6 +520,8 @@ int dev_c6sup1_mpfpga_init(c6sup1_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_c6sup1_mpfpga_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c6sup1_mpfpga_save_state;
+   d->dev.load_state = dev_c6sup1_mpfpga_load_state;
 
    /* Map this device to the VM */
    vm_bind_device(router->vm,&d->dev);
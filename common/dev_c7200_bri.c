@@ -516,12 +516,16 @@ static inline int m32_tx_scan(struct m32_data *d,u_int chan_id)
 }
 
 /* Scan the all channel TX rings */
-static void m32_tx_scan_all_channels(struct m32_data *d)
+static int m32_tx_scan_all_channels(struct m32_data *d)
 {
+   int busy = FALSE;
    u_int i;
 
    for(i=0;i<M32_NR_CHANNELS;i++)
-      m32_tx_scan(d,i);
+      if (m32_tx_scan(d,i))
+         busy = TRUE;
+
+   return(busy);
 }
 
 /* 
@@ -577,6 +581,10 @@ static int m32_action_req(struct m32_data *d,m_uint32_t action)
          m32_post_interrupt(d,M32_II_ARACK);
    }
 
+   /* Channels may have been (re)started: scan the TX rings at once */
+   if (action & (M32_AS_IN|M32_AS_ICO|M32_AS_RES))
+      ptask_kick(d->tx_tid);
+
    return(0);
 }
 
@@ -779,6 +787,62 @@ static void pci_munich32_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* Munich32 state saved in VM snapshots */
+struct m32_snapshot_state {
+   m_uint32_t iq_base_addr,iq_cur_addr,iq_size;
+   m_uint32_t timeslots[M32_NR_TIMESLOTS];
+   struct m32_channel channels[M32_NR_CHANNELS];
+   m_uint32_t cfg_mem[MUNICH32_MEM_SIZE/4];
+};
+
+/* Save the Munich32 state (VM snapshot) */
+static int dev_pa_4b_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pa_4b_data *d = dev->priv_data;
+   struct m32_data *m32 = &d->m32_data;
+   struct m32_snapshot_state *st;
+   int res;
+
+   if (!(st = malloc(sizeof(*st))))
+      return(-1);
+
+   st->iq_base_addr = m32->iq_base_addr;
+   st->iq_cur_addr  = m32->iq_cur_addr;
+   st->iq_size      = m32->iq_size;
+   memcpy(st->timeslots,m32->timeslots,sizeof(st->timeslots));
+   memcpy(st->channels,m32->channels,sizeof(st->channels));
+   memcpy(st->cfg_mem,m32->cfg_mem,sizeof(st->cfg_mem));
+
+   res = (fwrite(st,sizeof(*st),1,fd) == 1) ? 0 : -1;
+   free(st);
+   return(res);
+}
+
+/* Restore the Munich32 state (VM snapshot) */
+static int dev_pa_4b_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pa_4b_data *d = dev->priv_data;
+   struct m32_data *m32 = &d->m32_data;
+   struct m32_snapshot_state *st;
+
+   if ((len != sizeof(*st)) || !(st = malloc(sizeof(*st))))
+      return(-1);
+
+   if (fread(st,sizeof(*st),1,fd) != 1) {
+      free(st);
+      return(-1);
+   }
+
+   m32->iq_base_addr = st->iq_base_addr;
+   m32->iq_cur_addr  = st->iq_cur_addr;
+   m32->iq_size      = st->iq_size;
+   memcpy(m32->timeslots,st->timeslots,sizeof(m32->timeslots));
+   memcpy(m32->channels,st->channels,sizeof(m32->channels));
+   memcpy(m32->cfg_mem,st->cfg_mem,sizeof(m32->cfg_mem));
+   free(st);
+   return(0);
+}
+
 /*
  * dev_c7200_bri_init()
  *
@@ -832,6 +896,8 @@ int dev_c7200_pa_bri_init(vm_instance_t *vm,struct cisco_card *card)
 
    dev->phys_len = 0x800000;
    dev->handler  = pa_4b_access;
+   dev->save_state = dev_pa_4b_save_state;
+   dev->load_state = dev_pa_4b_load_state;
 
    /* Store device info */
    dev->priv_data = d;
@@ -879,8 +945,8 @@ int dev_c7200_pa_bri_set_nio(vm_instance_t *vm,struct cisco_card *card,
    d->nio = nio;
 
    /* TEST */
-   d->m32_data.tx_tid = ptask_add((ptask_callback)m32_tx_scan_all_channels,
-                                  &d->m32_data,NULL);
+   d->m32_data.tx_tid = ptask_add_ext((ptask_callback)m32_tx_scan_all_channels,
+                                      &d->m32_data,NULL,vm,PTASK_ADAPTIVE);
 
    //netio_rxl_add(nio,(netio_rx_handler_t)dev_pa_4b_handle_rxring,d,NULL);
    return(0);
@@ -680,6 +680,54 @@ void dev_c7200_iofpga_shutdown(vm_instance_t *vm,struct iofpga_data *d)
    }
 }
 
+/* IO FPGA state saved in VM snapshots */
+struct iofpga_snapshot_state {
+   m_uint32_t duart_isr,duart_imr,duart_irq_seq,io_ctrl_reg,mux;
+   m_uint32_t envm_r0,envm_r1,envm_r2;
+};
+
+/* Save the IO FPGA state (VM snapshot) */
+static int dev_c7200_iofpga_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+
+   IOFPGA_LOCK(d);
+   st.duart_isr   = d->duart_isr;
+   st.duart_imr   = d->duart_imr;
+   st.duart_irq_seq = d->duart_irq_seq;
+   st.io_ctrl_reg = d->io_ctrl_reg;
+   st.mux         = d->mux;
+   st.envm_r0     = d->envm_r0;
+   st.envm_r1     = d->envm_r1;
+   st.envm_r2     = d->envm_r2;
+   IOFPGA_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the IO FPGA state (VM snapshot) */
+static int dev_c7200_iofpga_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct iofpga_data *d = dev->priv_data;
+   struct iofpga_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   IOFPGA_LOCK(d);
+   d->duart_isr   = st.duart_isr;
+   d->duart_imr   = st.duart_imr;
+   d->duart_irq_seq = st.duart_irq_seq;
+   d->io_ctrl_reg = st.io_ctrl_reg;
+   d->mux         = st.mux;
+   d->envm_r0     = st.envm_r0;
+   d->envm_r1     = st.envm_r1;
+   d->envm_r2     = st.envm_r2;
+   IOFPGA_UNLOCK(d);
+   return(0);
+}
+
 /*
  * dev_c7200_iofpga_init()
  */
@@ -715,6 +763,8 @@ int dev_c7200_iofpga_init(c7200_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_c7200_iofpga_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_c7200_iofpga_save_state;
+   d->dev.load_state = dev_c7200_iofpga_load_state;
 
    /* If we have an I/O slot, we use the I/O slot DUART */
    if (c7200_slot0_iocard_present(router)) {
@@ -727,8 +777,8 @@ int dev_c7200_iofpga_init(c7200_t *router,m_uint64_t paddr,m_uint32_t len)
       vm->vtty_aux->read_notifier = tty_aux_input;
 
       /* Trigger periodically a dummy IRQ to flush buffers */
-      d->duart_irq_tid = ptask_add((ptask_callback)tty_trigger_dummy_irq,
-                                   d,NULL);
+      d->duart_irq_tid = ptask_add_ext((ptask_callback)tty_trigger_dummy_irq,
+                                       d,NULL,vm,0);
    }
 
    /* Map this device to the VM */
@@ -467,6 +467,7 @@ int dev_c7200_mpfpga_init(c7200_t *router,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_c7200_mpfpga_access;
    d->dev.priv_data = d;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
 
    /* Map this device to the VM */
    vm_bind_device(router->vm,&d->dev);
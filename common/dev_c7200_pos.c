@@ -247,8 +247,13 @@ static void *dev_pos_tx_access(cpu_gen_t *cpu,struct vdevice *dev,
       case 0x08:
          if (op_type == MTS_READ)
             *data = d->tx_current;
-         else
+         else {
             d->tx_current = *data;
+
+            /* The TX ring pointer is moved: scan the ring at once */
+            if (d->nio != NULL)
+               ptask_kick(d->tx_tid);
+         }
          break;
 
 #if DEBUG_UNKNOWN
@@ -662,6 +667,100 @@ static void pci_pos_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* RX/TX ring state saved in VM snapshots */
+struct pos_ring_snapshot_state {
+   m_uint32_t start,end,current;
+};
+
+/* Card status state saved in VM snapshots */
+struct pos_cs_snapshot_state {
+   m_uint32_t irq_clearing_count,ctrl_reg1,crc_size;
+};
+
+/* Save the RX ring state (VM snapshot) */
+static int dev_pos_rx_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pos_oc3_data *d = dev->priv_data;
+   struct pos_ring_snapshot_state st;
+
+   st.start   = d->rx_start;
+   st.end     = d->rx_end;
+   st.current = d->rx_current;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the RX ring state (VM snapshot) */
+static int dev_pos_rx_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pos_oc3_data *d = dev->priv_data;
+   struct pos_ring_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->rx_start   = st.start;
+   d->rx_end     = st.end;
+   d->rx_current = st.current;
+   return(0);
+}
+
+/* Save the TX ring state (VM snapshot) */
+static int dev_pos_tx_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pos_oc3_data *d = dev->priv_data;
+   struct pos_ring_snapshot_state st;
+
+   st.start   = d->tx_start;
+   st.end     = d->tx_end;
+   st.current = d->tx_current;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the TX ring state (VM snapshot) */
+static int dev_pos_tx_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pos_oc3_data *d = dev->priv_data;
+   struct pos_ring_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->tx_start   = st.start;
+   d->tx_end     = st.end;
+   d->tx_current = st.current;
+   return(0);
+}
+
+/* Save the card status state (VM snapshot) */
+static int dev_pos_cs_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pos_oc3_data *d = dev->priv_data;
+   struct pos_cs_snapshot_state st;
+
+   st.irq_clearing_count = d->irq_clearing_count;
+   st.ctrl_reg1          = d->ctrl_reg1;
+   st.crc_size           = d->crc_size;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the card status state (VM snapshot) */
+static int dev_pos_cs_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pos_oc3_data *d = dev->priv_data;
+   struct pos_cs_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->irq_clearing_count = st.irq_clearing_count;
+   d->ctrl_reg1          = st.ctrl_reg1;
+   d->crc_size           = st.crc_size;
+   return(0);
+}
+
 /*
  * dev_c7200_pa_pos_init()
  *
@@ -695,6 +794,8 @@ int dev_c7200_pa_pos_init(vm_instance_t *vm,struct cisco_card *card)
    d->rx_dev.name      = d->rx_name;
    d->rx_dev.priv_data = d;
    d->rx_dev.handler   = dev_pos_rx_access;
+   d->rx_dev.save_state = dev_pos_rx_save_state;
+   d->rx_dev.load_state = dev_pos_rx_load_state;
 
    /* Initialize TX device */
    d->tx_name = dyn_sprintf("%s_TX",card->dev_name);
@@ -702,6 +803,8 @@ int dev_c7200_pa_pos_init(vm_instance_t *vm,struct cisco_card *card)
    d->tx_dev.name      = d->tx_name;
    d->tx_dev.priv_data = d;
    d->tx_dev.handler   = dev_pos_tx_access;
+   d->tx_dev.save_state = dev_pos_tx_save_state;
+   d->tx_dev.load_state = dev_pos_tx_load_state;
 
    /* Initialize CS device */
    d->cs_name = dyn_sprintf("%s_CS",card->dev_name);
@@ -709,6 +812,8 @@ int dev_c7200_pa_pos_init(vm_instance_t *vm,struct cisco_card *card)
    d->cs_dev.name      = d->cs_name;
    d->cs_dev.priv_data = d;
    d->cs_dev.handler   = dev_pos_cs_access;
+   d->cs_dev.save_state = dev_pos_cs_save_state;
+   d->cs_dev.load_state = dev_pos_cs_load_state;
 
    /* Initialize PLX9060 for RX part */
    d->rx_obj = dev_plx9060_init(vm,d->rx_name,card->pci_bus,0,&d->rx_dev);
@@ -725,6 +830,7 @@ int dev_c7200_pa_pos_init(vm_instance_t *vm,struct cisco_card *card)
    d->dev.priv_data = d;
    d->dev.phys_len  = 0x10000;
    d->dev.handler   = dev_pos_access;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
 
    d->pci_dev = pci_dev_add(card->pci_bus,card->dev_name,0,0,3,0,
                             c7200_net_irq_for_slot_port(slot,0),
@@ -778,7 +884,8 @@ int dev_c7200_pa_pos_set_nio(vm_instance_t *vm,struct cisco_card *card,
       return(-1);
 
    d->nio = nio;
-   d->tx_tid = ptask_add((ptask_callback)dev_pos_oc3_handle_txring,d,NULL);
+   d->tx_tid = ptask_add_ext((ptask_callback)dev_pos_oc3_handle_txring,d,NULL,
+                             vm,PTASK_ADAPTIVE);
    netio_rxl_add(nio,(netio_rx_handler_t)dev_pos_oc3_handle_rxring,d,NULL);
    return(0);
 }
@@ -162,6 +162,31 @@ static void *dev_clpd6729_io_access(cpu_gen_t *cpu,struct vdevice *dev,
    return NULL;
 }
 
+/* Save the base registers (VM snapshot) */
+static int dev_clpd6729_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct clpd6729_data *d = dev->priv_data;
+
+   if ((fwrite(&d->base_index,sizeof(d->base_index),1,fd) != 1) ||
+       (fwrite(d->base_regs,sizeof(d->base_regs),1,fd) != 1))
+      return(-1);
+
+   return(0);
+}
+
+/* Restore the base registers (VM snapshot) */
+static int dev_clpd6729_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct clpd6729_data *d = dev->priv_data;
+
+   if ((len != sizeof(d->base_index) + sizeof(d->base_regs)) ||
+       (fread(&d->base_index,sizeof(d->base_index),1,fd) != 1) ||
+       (fread(d->base_regs,sizeof(d->base_regs),1,fd) != 1))
+      return(-1);
+
+   return(0);
+}
+
 /* Shutdown a CLPD6729 device */
 void dev_clpd6729_shutdown(vm_instance_t *vm,struct clpd6729_data *d)
 {
@@ -202,6 +227,8 @@ int dev_clpd6729_init(vm_instance_t *vm,
    dev_init(&d->dev);
    d->dev.name = "clpd6729";
    d->dev.priv_data = d;
+   d->dev.save_state = dev_clpd6729_save_state;
+   d->dev.load_state = dev_clpd6729_load_state;
 
    d->pci_io_dev = pci_io_add(pci_io_data,io_start,io_end,&d->dev,
                               dev_clpd6729_io_access);
@@ -222,22 +249,26 @@ int dev_clpd6729_init(vm_instance_t *vm,
    /* PCMCIA disk test */
    if (vm->pcmcia_disk_size[0])
       d->slot_obj[0] = dev_pcmcia_disk_init(vm,"disk0",0x40000000ULL,0x200000,
-                                            vm->pcmcia_disk_size[0],0);
+                                            vm->pcmcia_disk_size[0],
+                                            vm->pcmcia_disk_base[0],0);
 
    if (vm->pcmcia_disk_size[1])
       d->slot_obj[1] = dev_pcmcia_disk_init(vm,"disk1",0x44000000ULL,0x200000,
-                                            vm->pcmcia_disk_size[1],0);
+                                            vm->pcmcia_disk_size[1],
+                                            vm->pcmcia_disk_base[1],0);
 #endif
 
 #if 0
    /* PCMCIA disk test */
    if (vm->pcmcia_disk_size[0])
       d->slot_obj[0] = dev_pcmcia_disk_init(vm,"disk0",0xd8000000ULL,0x200000,
-                                            vm->pcmcia_disk_size[0],0);
+                                            vm->pcmcia_disk_size[0],
+                                            vm->pcmcia_disk_base[0],0);
 
    if (vm->pcmcia_disk_size[1])
       d->slot_obj[1] = dev_pcmcia_disk_init(vm,"disk1",0xdc000000ULL,0x200000,
-                                            vm->pcmcia_disk_size[1],0);
+                                            vm->pcmcia_disk_size[1],
+                                            vm->pcmcia_disk_base[1],0);
 #endif
 
    return(0);
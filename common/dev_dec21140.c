@@ -180,6 +180,9 @@ struct dec21140_data {
    /* NetIO descriptor */
    netio_desc_t *nio;
 
+   /* Packets built by the TX ring scanner, sent in a single batch */
+   netio_tx_batch_t tx_batch;
+
    /* TX ring scanner task id */
    ptask_id_t tx_tid;
 };
@@ -465,6 +468,10 @@ void *dev_dec21140_access(cpu_gen_t *cpu,struct vdevice *dev,
             d->csr[reg] = *data;
             d->rx_current = d->csr[reg];
             break;
+         case 1:
+            /* Transmit Poll Demand */
+            ptask_kick(d->tx_tid);
+            break;
          case 4:
             d->csr[reg] = *data;
             d->tx_current = d->csr[reg];
@@ -735,7 +742,7 @@ static void txdesc_set_next(struct dec21140_data *d,struct tx_desc *txd)
 /* Handle the TX ring (single packet) */
 static int dev_dec21140_handle_txring_single(struct dec21140_data *d)
 {   
-   u_char pkt[DEC21140_MAX_PKT_SIZE],*pkt_ptr;
+   u_char *pkt,*pkt_ptr;
    u_char setup_frame[DEC21140_SETUP_FRAME_SIZE];
    m_uint32_t tx_start,len1,len2,clen,tot_len;
    struct tx_desc txd0,ctxd,*ptxd;
@@ -788,6 +795,7 @@ static int dev_dec21140_handle_txring_single(struct dec21140_data *d)
 #endif
 
    /* Empty packet for now */
+   pkt = netio_tx_batch_get_buffer(d->nio,&d->tx_batch);
    pkt_ptr = pkt;
    tot_len = 0;
 
@@ -846,8 +854,8 @@ static int dev_dec21140_handle_txring_single(struct dec21140_data *d)
       /* rewrite ISL header if required */
       cisco_isl_rewrite(pkt,tot_len);
 
-      /* send it on wire */
-      netio_send(d->nio,pkt,tot_len);
+      /* queue it for transmission */
+      netio_tx_batch_queue(&d->tx_batch,tot_len);
    }
 
  clear_txd0_own_bit:
@@ -863,7 +871,7 @@ static int dev_dec21140_handle_txring_single(struct dec21140_data *d)
    return(TRUE);
 }
 
-/* Handle the TX ring */
+/* Handle the TX ring (returns TRUE if packets were sent) */
 static int dev_dec21140_handle_txring(struct dec21140_data *d)
 {  
    int i;
@@ -872,8 +880,11 @@ static int dev_dec21140_handle_txring(struct dec21140_data *d)
       if (!dev_dec21140_handle_txring_single(d))
          break;
 
+   /* send the packets on wire */
+   netio_tx_batch_flush(d->nio,&d->tx_batch);
+
    netio_clear_bw_stat(d->nio);
-   return(TRUE);
+   return(i > 0);
 }
 
 /*
@@ -924,6 +935,62 @@ static void pci_dec21140_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* DEC21140 state saved in VM snapshots */
+struct dec21140_snapshot_state {
+   m_uint32_t rx_current,tx_current;
+   m_uint32_t csr[DEC21140_CSR_NR];
+   m_uint32_t mii_state,mii_phy,mii_reg,mii_data,mii_outbits;
+   m_uint16_t mii_regs[32][32];
+   n_eth_addr_t mac_addr[16];
+   m_uint32_t mac_addr_count;
+};
+
+/* Save the controller state (VM snapshot) */
+static int dev_dec21140_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct dec21140_data *d = dev->priv_data;
+   struct dec21140_snapshot_state st;
+
+   memset(&st,0,sizeof(st));
+   st.rx_current  = d->rx_current;
+   st.tx_current  = d->tx_current;
+   memcpy(st.csr,d->csr,sizeof(st.csr));
+   st.mii_state   = d->mii_state;
+   st.mii_phy     = d->mii_phy;
+   st.mii_reg     = d->mii_reg;
+   st.mii_data    = d->mii_data;
+   st.mii_outbits = d->mii_outbits;
+   memcpy(st.mii_regs,d->mii_regs,sizeof(st.mii_regs));
+   memcpy(st.mac_addr,d->mac_addr,sizeof(st.mac_addr));
+   st.mac_addr_count = d->mac_addr_count;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the controller state (VM snapshot) */
+static int dev_dec21140_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct dec21140_data *d = dev->priv_data;
+   struct dec21140_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1) ||
+       (st.mac_addr_count > 16))
+      return(-1);
+
+   d->rx_current  = st.rx_current;
+   d->tx_current  = st.tx_current;
+   memcpy(d->csr,st.csr,sizeof(d->csr));
+   d->mii_state   = st.mii_state;
+   d->mii_phy     = st.mii_phy;
+   d->mii_reg     = st.mii_reg;
+   d->mii_data    = st.mii_data;
+   d->mii_outbits = st.mii_outbits;
+   memcpy(d->mii_regs,st.mii_regs,sizeof(d->mii_regs));
+   memcpy(d->mac_addr,st.mac_addr,sizeof(d->mac_addr));
+   d->mac_addr_count = st.mac_addr_count;
+   return(0);
+}
+
 /* 
  * dev_dec21140_init()
  *
@@ -962,6 +1029,13 @@ struct dec21140_data *dev_dec21140_init(vm_instance_t *vm,char *name,
       goto err_dev;
    }
 
+   if (netio_tx_batch_init(&d->tx_batch,DEC21140_TXRING_PASS_COUNT,
+                           DEC21140_MAX_PKT_SIZE) == -1)
+   {
+      fprintf(stderr,"%s (DEC21140): unable to create TX batch.\n",name);
+      goto err_tx_batch;
+   }
+
    d->name     = name;
    d->vm       = vm;
    d->pci_dev  = pci_dev;
@@ -976,8 +1050,12 @@ struct dec21140_data *dev_dec21140_init(vm_instance_t *vm,char *name,
    dev->phys_len  = 0x20000;
    dev->handler   = dev_dec21140_access;
    dev->priv_data = d;
+   dev->save_state = dev_dec21140_save_state;
+   dev->load_state = dev_dec21140_load_state;
    return(d);
 
+ err_tx_batch:
+   free(dev);
  err_dev:
    pci_dev_remove(pci_dev);
  err_pci_dev:
@@ -992,6 +1070,7 @@ void dev_dec21140_remove(struct dec21140_data *d)
       pci_dev_remove(d->pci_dev);
       vm_unbind_device(d->vm,d->dev);
       cpu_group_rebuild_mts(d->vm->cpu_group);
+      netio_tx_batch_free(&d->tx_batch);
       free(d->dev);
       free(d);
    }
@@ -1005,7 +1084,8 @@ int dev_dec21140_set_nio(struct dec21140_data *d,netio_desc_t *nio)
       return(-1);
 
    d->nio = nio;
-   d->tx_tid = ptask_add((ptask_callback)dev_dec21140_handle_txring,d,NULL);
+   d->tx_tid = ptask_add_ext((ptask_callback)dev_dec21140_handle_txring,d,NULL,
+                             d->vm,PTASK_ADAPTIVE);
    netio_rxl_add(nio,(netio_rx_handler_t)dev_dec21140_handle_rxring,d,NULL);
    return(0);
 }
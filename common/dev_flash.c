@@ -220,6 +220,28 @@ int dev_flash_copy_data(vm_obj_t *obj,m_uint32_t offset,
    return(0);
 }
 
+/* Save the command state of the flash (VM snapshot) */
+static int dev_flash_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct flash_data *d = dev->priv_data;
+   m_uint32_t state = d->state;
+
+   return((fwrite(&state,sizeof(state),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the command state of the flash (VM snapshot) */
+static int dev_flash_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct flash_data *d = dev->priv_data;
+   m_uint32_t state;
+
+   if ((len != sizeof(state)) || (fread(&state,sizeof(state),1,fd) != 1))
+      return(-1);
+
+   d->state = state;
+   return(0);
+}
+
 /* Shutdown a flash device */
 void dev_flash_shutdown(vm_instance_t *vm,struct flash_data *d)
 {
@@ -268,6 +290,8 @@ vm_obj_t *dev_flash_init(vm_instance_t *vm,char *name,
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.handler   = dev_flash_access;
+   d->dev.save_state = dev_flash_save_state;
+   d->dev.load_state = dev_flash_load_state;
    d->dev.fd        = memzone_create_file(d->filename,d->dev.phys_len,&ptr);
    d->dev.host_addr = (m_iptr_t)ptr;
    d->dev.flags     = VDEVICE_FLAG_NO_MTS_MMAP;
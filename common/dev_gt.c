@@ -211,6 +211,9 @@ struct mpsc_channel {
 #define GT_ETH_PORTS     2
 #define GT_MAX_PKT_SIZE  2048
 
+/* Maximum packets sent from a TX queue per scanner pass */
+#define GT_TXQUEUE_PASS_COUNT  16
+
 /* SMI register */
 #define GT_SMIR_DATA_MASK      0x0000FFFF
 #define GT_SMIR_PHYAD_MASK     0x001F0000    /* PHY Device Address */
@@ -348,6 +351,9 @@ enum {
 struct eth_port {
    netio_desc_t *nio;
 
+   /* Packets built from the TX queues, sent in a single batch */
+   netio_tx_batch_t tx_batch;
+
    /* First and Current RX descriptors (4 queues) */
    m_uint32_t rx_start[4],rx_current[4];
 
@@ -1780,6 +1786,9 @@ static int gt_eth_access(cpu_gen_t *cpu,struct vdevice *dev,
                port->sdcmr &= ~GT_SDCMR_STDL;
             }
 
+            if (*data & (GT_SDCMR_TXDH|GT_SDCMR_TXDL))
+               ptask_kick(d->eth_tx_tid);
+
             /* Stop TX High */
             if (*data & GT_SDCMR_STDH) {
                port->sdcmr &= ~GT_SDCMR_TXDH;
@@ -2157,7 +2166,7 @@ void *dev_gt96100_access(cpu_gen_t *cpu,struct vdevice *dev,m_uint32_t offset,
 static int gt_eth_handle_port_txqueue(struct gt_data *d,struct eth_port *port,
                                       int queue)
 {   
-   u_char pkt[GT_MAX_PKT_SIZE],*pkt_ptr;
+   u_char *pkt,*pkt_ptr;
    struct sdma_desc ctxd;
    m_uint32_t tx_current;
    m_uint32_t len,tot_len;
@@ -2196,6 +2205,7 @@ static int gt_eth_handle_port_txqueue(struct gt_data *d,struct eth_port *port,
    }
 
    /* Empty packet for now */
+   pkt = netio_tx_batch_get_buffer(port->nio,&port->tx_batch);
    pkt_ptr = pkt;
    tot_len = 0;
 
@@ -2249,8 +2259,8 @@ static int gt_eth_handle_port_txqueue(struct gt_data *d,struct eth_port *port,
       /* rewrite ISL header if required */
       cisco_isl_rewrite(pkt,tot_len);
 
-      /* send it on wire */
-      netio_send(port->nio,pkt,tot_len);
+      /* queue it for transmission */
+      netio_tx_batch_queue(&port->tx_batch,tot_len);
 
       /* Update MIB counters */
       port->tx_bytes += tot_len;
@@ -2293,24 +2303,43 @@ static int gt_eth_handle_port_txqueue(struct gt_data *d,struct eth_port *port,
 }
 
 /* Handle TX ring of the specified port */
-static void gt_eth_handle_port_txqueues(struct gt_data *d,u_int port)
+static int gt_eth_handle_port_txqueues(struct gt_data *d,u_int port)
 {
-   gt_eth_handle_port_txqueue(d,&d->eth_ports[port],0);  /* TX Low */
-   gt_eth_handle_port_txqueue(d,&d->eth_ports[port],1);  /* TX High */
+   int i,j;
+
+   /* TX Low */
+   for(i=0;i<GT_TXQUEUE_PASS_COUNT;i++)
+      if (!gt_eth_handle_port_txqueue(d,&d->eth_ports[port],0))
+         break;
+
+   /* TX High */
+   for(j=0;j<GT_TXQUEUE_PASS_COUNT;j++)
+      if (!gt_eth_handle_port_txqueue(d,&d->eth_ports[port],1))
+         break;
+
+   return(i + j);
 }
 
 /* Handle all TX rings of all Ethernet ports */
 static int gt_eth_handle_txqueues(struct gt_data *d)
 {
-   int i;
+   struct eth_port *port;
+   int i,count = 0;
 
    GT_LOCK(d);
 
    for(i=0;i<GT_ETH_PORTS;i++)
-      gt_eth_handle_port_txqueues(d,i);
+      count += gt_eth_handle_port_txqueues(d,i);
 
    GT_UNLOCK(d);
-   return(TRUE);
+
+   /* Send the packets on wire */
+   for(i=0;i<GT_ETH_PORTS;i++) {
+      port = &d->eth_ports[i];
+      netio_tx_batch_flush(port->nio,&port->tx_batch);
+   }
+
+   return(count > 0);
 }
 
 /* Inverse a nibble */
@@ -2611,6 +2640,8 @@ static int gt_eth_handle_rx_pkt(netio_desc_t *nio,
 /* Shutdown a GT system controller */
 void dev_gt_shutdown(vm_instance_t *vm,struct gt_data *d)
 {
+   u_int i;
+
    if (d != NULL) {
       /* Stop the Ethernet TX ring scanner */
       ptask_remove(d->eth_tx_tid);
@@ -2621,11 +2652,181 @@ void dev_gt_shutdown(vm_instance_t *vm,struct gt_data *d)
       /* Remove the PCI device */
       pci_dev_remove(d->pci_dev);
 
+      /* Free the Ethernet TX batches */
+      for(i=0;i<GT_ETH_PORTS;i++)
+         netio_tx_batch_free(&d->eth_ports[i].tx_batch);
+
       /* Free the structure itself */
       free(d);
    }
 }
 
+/* MPSC channel registers saved in VM snapshots */
+struct gt_mpsc_snapshot_state {
+   m_uint32_t mmcrl,mmcrh,mpcr;
+   m_uint32_t chr[10];
+};
+
+/* Ethernet port registers saved in VM snapshots */
+struct gt_eth_snapshot_state {
+   m_uint32_t rx_start[4],rx_current[4];
+   m_uint32_t tx_current[2];
+   m_uint32_t pcr,pcxr,pcmr,psr;
+   m_uint32_t sdcr,sdcmr;
+   m_uint32_t icr,imr;
+   m_uint32_t ht_addr;
+   m_uint32_t rx_bytes,tx_bytes,rx_frames,tx_frames;
+};
+
+/* Controller state saved in VM snapshots */
+struct gt_snapshot_state {
+   struct dma_channel dma[GT_DMA_CHANNELS];
+   m_uint32_t int_cause_reg,int_high_cause_reg,int_mask_reg;
+   m_uint32_t int0_main_mask_reg,int0_high_mask_reg;
+   m_uint32_t int1_main_mask_reg,int1_high_mask_reg;
+   m_uint32_t ser_cause_reg,serint0_mask_reg,serint1_mask_reg;
+   m_uint32_t sgcr,sdma_cause_reg,sdma_mask_reg;
+   m_uint32_t smi_reg;
+   m_uint16_t mii_regs[32][32];
+   struct sdma_channel sdma[GT_SDMA_GROUPS][GT_SDMA_CHANNELS];
+   struct gt_mpsc_snapshot_state mpsc[GT_MPSC_CHANNELS];
+   struct gt_eth_snapshot_state eth_ports[GT_ETH_PORTS];
+};
+
+/* Save the registers of an Ethernet port (VM snapshot) */
+static void gt_eth_save_state(struct eth_port *port,
+                              struct gt_eth_snapshot_state *st)
+{
+   memcpy(st->rx_start,port->rx_start,sizeof(st->rx_start));
+   memcpy(st->rx_current,port->rx_current,sizeof(st->rx_current));
+   memcpy(st->tx_current,port->tx_current,sizeof(st->tx_current));
+   st->pcr       = port->pcr;
+   st->pcxr      = port->pcxr;
+   st->pcmr      = port->pcmr;
+   st->psr       = port->psr;
+   st->sdcr      = port->sdcr;
+   st->sdcmr     = port->sdcmr;
+   st->icr       = port->icr;
+   st->imr       = port->imr;
+   st->ht_addr   = port->ht_addr;
+   st->rx_bytes  = port->rx_bytes;
+   st->tx_bytes  = port->tx_bytes;
+   st->rx_frames = port->rx_frames;
+   st->tx_frames = port->tx_frames;
+}
+
+/* Restore the registers of an Ethernet port (VM snapshot) */
+static void gt_eth_load_state(struct eth_port *port,
+                              struct gt_eth_snapshot_state *st)
+{
+   memcpy(port->rx_start,st->rx_start,sizeof(port->rx_start));
+   memcpy(port->rx_current,st->rx_current,sizeof(port->rx_current));
+   memcpy(port->tx_current,st->tx_current,sizeof(port->tx_current));
+   port->pcr       = st->pcr;
+   port->pcxr      = st->pcxr;
+   port->pcmr      = st->pcmr;
+   port->psr       = st->psr;
+   port->sdcr      = st->sdcr;
+   port->sdcmr     = st->sdcmr;
+   port->icr       = st->icr;
+   port->imr       = st->imr;
+   port->ht_addr   = st->ht_addr;
+   port->rx_bytes  = st->rx_bytes;
+   port->tx_bytes  = st->tx_bytes;
+   port->rx_frames = st->rx_frames;
+   port->tx_frames = st->tx_frames;
+}
+
+/* Save the controller state (VM snapshot) */
+static int dev_gt_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct gt_data *d = dev->priv_data;
+   struct gt_snapshot_state st;
+   u_int i;
+
+   GT_LOCK(d);
+   memcpy(st.dma,d->dma,sizeof(st.dma));
+   st.int_cause_reg      = d->int_cause_reg;
+   st.int_high_cause_reg = d->int_high_cause_reg;
+   st.int_mask_reg       = d->int_mask_reg;
+   st.int0_main_mask_reg = d->int0_main_mask_reg;
+   st.int0_high_mask_reg = d->int0_high_mask_reg;
+   st.int1_main_mask_reg = d->int1_main_mask_reg;
+   st.int1_high_mask_reg = d->int1_high_mask_reg;
+   st.ser_cause_reg      = d->ser_cause_reg;
+   st.serint0_mask_reg   = d->serint0_mask_reg;
+   st.serint1_mask_reg   = d->serint1_mask_reg;
+   st.sgcr               = d->sgcr;
+   st.sdma_cause_reg     = d->sdma_cause_reg;
+   st.sdma_mask_reg      = d->sdma_mask_reg;
+   st.smi_reg            = d->smi_reg;
+   memcpy(st.mii_regs,d->mii_regs,sizeof(st.mii_regs));
+   memcpy(st.sdma,d->sdma,sizeof(st.sdma));
+
+   for(i=0;i<GT_MPSC_CHANNELS;i++) {
+      st.mpsc[i].mmcrl = d->mpsc[i].mmcrl;
+      st.mpsc[i].mmcrh = d->mpsc[i].mmcrh;
+      st.mpsc[i].mpcr  = d->mpsc[i].mpcr;
+      memcpy(st.mpsc[i].chr,d->mpsc[i].chr,sizeof(st.mpsc[i].chr));
+   }
+
+   for(i=0;i<GT_ETH_PORTS;i++)
+      gt_eth_save_state(&d->eth_ports[i],&st.eth_ports[i]);
+   GT_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the controller state (VM snapshot) */
+static int dev_gt_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct gt_data *d = dev->priv_data;
+   struct gt_snapshot_state st;
+   u_int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   GT_LOCK(d);
+   memcpy(d->dma,st.dma,sizeof(d->dma));
+   d->int_cause_reg      = st.int_cause_reg;
+   d->int_high_cause_reg = st.int_high_cause_reg;
+   d->int_mask_reg       = st.int_mask_reg;
+   d->int0_main_mask_reg = st.int0_main_mask_reg;
+   d->int0_high_mask_reg = st.int0_high_mask_reg;
+   d->int1_main_mask_reg = st.int1_main_mask_reg;
+   d->int1_high_mask_reg = st.int1_high_mask_reg;
+   d->ser_cause_reg      = st.ser_cause_reg;
+   d->serint0_mask_reg   = st.serint0_mask_reg;
+   d->serint1_mask_reg   = st.serint1_mask_reg;
+   d->sgcr               = st.sgcr;
+   d->sdma_cause_reg     = st.sdma_cause_reg;
+   d->sdma_mask_reg      = st.sdma_mask_reg;
+   d->smi_reg            = st.smi_reg;
+   memcpy(d->mii_regs,st.mii_regs,sizeof(d->mii_regs));
+
+   for(i=0;i<GT_SDMA_CHANNELS;i++) {
+      d->sdma[0][i] = st.sdma[0][i];
+      d->sdma[1][i] = st.sdma[1][i];
+      d->sdma[0][i].id = i;
+      d->sdma[1][i].id = i;
+   }
+
+   for(i=0;i<GT_MPSC_CHANNELS;i++) {
+      d->mpsc[i].mmcrl = st.mpsc[i].mmcrl;
+      d->mpsc[i].mmcrh = st.mpsc[i].mmcrh;
+      d->mpsc[i].mpcr  = st.mpsc[i].mpcr;
+      memcpy(d->mpsc[i].chr,st.mpsc[i].chr,sizeof(d->mpsc[i].chr));
+   }
+
+   for(i=0;i<GT_ETH_PORTS;i++)
+      gt_eth_load_state(&d->eth_ports[i],&st.eth_ports[i]);
+
+   d->gt_update_irq_status(d);
+   GT_UNLOCK(d);
+   return(0);
+}
+
 /* Create a new GT64010 controller */
 int dev_gt64010_init(vm_instance_t *vm,char *name,
                      m_uint64_t paddr,m_uint32_t len,u_int irq)
@@ -2654,6 +2855,8 @@ int dev_gt64010_init(vm_instance_t *vm,char *name,
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.handler   = dev_gt64010_access;
+   d->dev.save_state = dev_gt_save_state;
+   d->dev.load_state = dev_gt_load_state;
 
    /* Add the controller as a PCI device */
    if (!pci_dev_lookup(d->bus[0],0,0,0)) {
@@ -2718,6 +2921,8 @@ int dev_gt64120_init(vm_instance_t *vm,char *name,
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.handler   = dev_gt64120_access;
+   d->dev.save_state = dev_gt_save_state;
+   d->dev.load_state = dev_gt_load_state;
 
    /* Add the controller as a PCI device */
    if (!pci_dev_lookup(d->bus[0],0,0,0)) {
@@ -2797,6 +3002,8 @@ int dev_gt96100_init(vm_instance_t *vm,char *name,
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.handler   = dev_gt96100_access;
+   d->dev.save_state = dev_gt_save_state;
+   d->dev.load_state = dev_gt_load_state;
 
    /* Add the controller as a PCI device */
    if (!pci_dev_lookup(d->bus[0],0,0,0)) {
@@ -2809,8 +3016,19 @@ int dev_gt96100_init(vm_instance_t *vm,char *name,
       }
    }
 
+   /* Allocate the Ethernet TX batches */
+   for(i=0;i<GT_ETH_PORTS;i++) {
+      if (netio_tx_batch_init(&d->eth_ports[i].tx_batch,
+                              GT_TXQUEUE_PASS_COUNT * 2,GT_MAX_PKT_SIZE) == -1)
+      {
+         fprintf(stderr,"gt96100: unable to create TX batch.\n");
+         return(-1);
+      }
+   }
+
    /* Start the Ethernet TX ring scanner */
-   d->eth_tx_tid = ptask_add((ptask_callback)gt_eth_handle_txqueues,d,NULL);
+   d->eth_tx_tid = ptask_add_ext((ptask_callback)gt_eth_handle_txqueues,d,NULL,
+                                 vm,PTASK_ADAPTIVE);
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
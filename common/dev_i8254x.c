@@ -305,8 +305,8 @@ struct i8254x_data {
    /* RX/TX descriptor head and tail */
    m_uint32_t rdh,rdt,tdh,tdt;
 
-   /* TX packet buffer */
-   m_uint8_t tx_buffer[I8254X_MAX_PKT_SIZE];
+   /* TX packet buffers (packets are sent in a single batch) */
+   netio_tx_batch_t tx_batch;
 
    /* RX IRQ count */
    m_uint32_t rx_irq_cnt;
@@ -757,10 +757,12 @@ void *dev_i8254x_access(cpu_gen_t *cpu,struct vdevice *dev,
       /* TX Descriptor Tail */
       case I82542_REG_TDT:
       case I8254X_REG_TDT:
-         if (op_type == MTS_WRITE)
+         if (op_type == MTS_WRITE) {
             d->tdt = *data & 0xFFFF;
-         else
+            ptask_kick(d->tx_tid);
+         } else {
             *data = d->tdt;
+         }
          break;
 
       /* Flow Control Address Low */
@@ -837,7 +839,7 @@ static int dev_i8254x_handle_txring_single(struct i8254x_data *d)
    m_uint32_t buf_len,tot_len;
    m_uint32_t norm_len,icr;
    struct tx_desc txd;
-   m_uint8_t *pkt_ptr;
+   m_uint8_t *pkt,*pkt_ptr;
 
    /* If Head is at same position than Tail, the ring is empty */
    if (d->tdh == d->tdt)
@@ -848,7 +850,8 @@ static int dev_i8254x_handle_txring_single(struct i8254x_data *d)
       return(FALSE);
 
    /* Empty packet for now */
-   pkt_ptr = d->tx_buffer;
+   pkt = netio_tx_batch_get_buffer(d->nio,&d->tx_batch);
+   pkt_ptr = pkt;
    tot_len = 0;
    icr = 0;
 
@@ -885,9 +888,9 @@ static int dev_i8254x_handle_txring_single(struct i8254x_data *d)
       if (txd.tdes[2] & I8254X_TXDESC_EOP) {
 #if DEBUG_TRANSMIT
          LVG_LOG(d,"sending packet of %u bytes\n",tot_len);
-         mem_dump(log_file,d->tx_buffer,tot_len);
+         mem_dump(log_file,pkt,tot_len);
 #endif
-         netio_send(d->nio,d->tx_buffer,tot_len);
+         netio_tx_batch_queue(&d->tx_batch,tot_len);
          break;
       }
    }
@@ -919,8 +922,9 @@ static int dev_i8254x_handle_txring(struct i8254x_data *d)
          break;
    }
 
+   netio_tx_batch_flush(d->nio,&d->tx_batch);
    netio_clear_bw_stat(d->nio);
-   return(TRUE);
+   return(i > 0);
 }
 
 /* Read a RX descriptor */
@@ -1081,6 +1085,102 @@ static void pci_i8254x_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* i8254x state saved in VM snapshots */
+struct i8254x_snapshot_state {
+   m_uint32_t icr,imr,ctrl,ctrl_ext;
+   m_uint32_t fcal,fcah,fct,rdtr;
+   m_uint32_t rctl,tctl,rx_buf_size;
+   m_uint64_t rx_addr,tx_addr;
+   m_uint32_t rdlen,tdlen;
+   m_uint32_t rdh,rdt,tdh,tdt;
+   m_uint32_t rx_irq_cnt;
+   m_uint32_t mii_state,mii_bit,mii_opcode,mii_phy,mii_reg;
+   m_uint32_t mii_data_pos,mii_data;
+   m_uint32_t mii_regs[32][32];
+};
+
+/* Save the controller state (VM snapshot) */
+static int dev_i8254x_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct i8254x_data *d = dev->priv_data;
+   struct i8254x_snapshot_state st;
+
+   LVG_LOCK(d);
+   st.icr          = d->icr;
+   st.imr          = d->imr;
+   st.ctrl         = d->ctrl;
+   st.ctrl_ext     = d->ctrl_ext;
+   st.fcal         = d->fcal;
+   st.fcah         = d->fcah;
+   st.fct          = d->fct;
+   st.rdtr         = d->rdtr;
+   st.rctl         = d->rctl;
+   st.tctl         = d->tctl;
+   st.rx_buf_size  = d->rx_buf_size;
+   st.rx_addr      = d->rx_addr;
+   st.tx_addr      = d->tx_addr;
+   st.rdlen        = d->rdlen;
+   st.tdlen        = d->tdlen;
+   st.rdh          = d->rdh;
+   st.rdt          = d->rdt;
+   st.tdh          = d->tdh;
+   st.tdt          = d->tdt;
+   st.rx_irq_cnt   = d->rx_irq_cnt;
+   st.mii_state    = d->mii_state;
+   st.mii_bit      = d->mii_bit;
+   st.mii_opcode   = d->mii_opcode;
+   st.mii_phy      = d->mii_phy;
+   st.mii_reg      = d->mii_reg;
+   st.mii_data_pos = d->mii_data_pos;
+   st.mii_data     = d->mii_data;
+   memcpy(st.mii_regs,d->mii_regs,sizeof(st.mii_regs));
+   LVG_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the controller state (VM snapshot) */
+static int dev_i8254x_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct i8254x_data *d = dev->priv_data;
+   struct i8254x_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   LVG_LOCK(d);
+   d->icr          = st.icr;
+   d->imr          = st.imr;
+   d->ctrl         = st.ctrl;
+   d->ctrl_ext     = st.ctrl_ext;
+   d->fcal         = st.fcal;
+   d->fcah         = st.fcah;
+   d->fct          = st.fct;
+   d->rdtr         = st.rdtr;
+   d->rctl         = st.rctl;
+   d->tctl         = st.tctl;
+   d->rx_buf_size  = st.rx_buf_size;
+   d->rx_addr      = st.rx_addr;
+   d->tx_addr      = st.tx_addr;
+   d->rdlen        = st.rdlen;
+   d->tdlen        = st.tdlen;
+   d->rdh          = st.rdh;
+   d->rdt          = st.rdt;
+   d->tdh          = st.tdh;
+   d->tdt          = st.tdt;
+   d->rx_irq_cnt   = st.rx_irq_cnt;
+   d->mii_state    = st.mii_state;
+   d->mii_bit      = st.mii_bit;
+   d->mii_opcode   = st.mii_opcode;
+   d->mii_phy      = st.mii_phy;
+   d->mii_reg      = st.mii_reg;
+   d->mii_data_pos = st.mii_data_pos;
+   d->mii_data     = st.mii_data;
+   memcpy(d->mii_regs,st.mii_regs,sizeof(d->mii_regs));
+   LVG_UNLOCK(d);
+   return(0);
+}
+
 /*
  * dev_i8254x_init()
  */
@@ -1118,6 +1218,13 @@ dev_i8254x_init(vm_instance_t *vm,char *name,int interface_type,
       goto err_dev;
    }
 
+   if (netio_tx_batch_init(&d->tx_batch,I8254X_TXRING_PASS_COUNT,
+                           I8254X_MAX_PKT_SIZE) == -1)
+   {
+      fprintf(stderr,"%s (i8254x): unable to create TX batch.\n",name);
+      goto err_tx_batch;
+   }
+
    d->name     = name;
    d->vm       = vm;
    d->pci_dev  = pci_dev;
@@ -1126,9 +1233,13 @@ dev_i8254x_init(vm_instance_t *vm,char *name,int interface_type,
    dev->phys_addr = 0;
    dev->phys_len  = 0x10000;
    dev->handler   = dev_i8254x_access;
+   dev->save_state = dev_i8254x_save_state;
+   dev->load_state = dev_i8254x_load_state;
    dev->priv_data = d;
    return(d);
 
+ err_tx_batch:
+   free(dev);
  err_dev:
    pci_dev_remove(pci_dev);
  err_pci_dev:
@@ -1143,6 +1254,7 @@ void dev_i8254x_remove(struct i8254x_data *d)
       pci_dev_remove(d->pci_dev);
       vm_unbind_device(d->vm,d->dev);
       cpu_group_rebuild_mts(d->vm->cpu_group);
+      netio_tx_batch_free(&d->tx_batch);
       free(d->dev);
       free(d);
    }
@@ -1156,7 +1268,8 @@ int dev_i8254x_set_nio(struct i8254x_data *d,netio_desc_t *nio)
       return(-1);
 
    d->nio = nio;
-   d->tx_tid = ptask_add((ptask_callback)dev_i8254x_handle_txring,d,NULL);
+   d->tx_tid = ptask_add_ext((ptask_callback)dev_i8254x_handle_txring,d,NULL,
+                             d->vm,PTASK_ADAPTIVE);
    netio_rxl_add(nio,(netio_rx_handler_t)dev_i8254x_handle_rxring,d,NULL);
    return(0);
 }
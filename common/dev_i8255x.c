@@ -964,6 +964,79 @@ static void pci_i8255x_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* i8255x state saved in VM snapshots */
+struct i8255x_snapshot_state {
+   m_uint32_t cu_state,ru_state;
+   m_uint32_t cu_base,ru_base,cu_offset,ru_offset;
+   m_uint32_t scb_gptr,scb_ic,scb_stat_ack,stat_cnt_addr;
+   m_uint32_t mii_ctrl;
+   m_uint32_t mii_regs[32][32];
+   n_eth_addr_t iaddr;
+   m_uint32_t config_data[I8255X_CONFIG_SIZE];
+   m_uint32_t microcode[I8255X_UCODE_SIZE];
+   m_uint32_t stat_counters[I8255X_STAT_CNT_SIZE];
+};
+
+/* Save the controller state (VM snapshot) */
+static int dev_i8255x_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct i8255x_data *d = dev->priv_data;
+   struct i8255x_snapshot_state st;
+
+   memset(&st,0,sizeof(st));
+
+   EEPRO_LOCK(d);
+   st.cu_state      = d->cu_state;
+   st.ru_state      = d->ru_state;
+   st.cu_base       = d->cu_base;
+   st.ru_base       = d->ru_base;
+   st.cu_offset     = d->cu_offset;
+   st.ru_offset     = d->ru_offset;
+   st.scb_gptr      = d->scb_gptr;
+   st.scb_ic        = d->scb_ic;
+   st.scb_stat_ack  = d->scb_stat_ack;
+   st.stat_cnt_addr = d->stat_cnt_addr;
+   st.mii_ctrl      = d->mii_ctrl;
+   memcpy(st.mii_regs,d->mii_regs,sizeof(st.mii_regs));
+   memcpy(&st.iaddr,&d->iaddr,sizeof(st.iaddr));
+   memcpy(st.config_data,d->config_data,sizeof(st.config_data));
+   memcpy(st.microcode,d->microcode,sizeof(st.microcode));
+   memcpy(st.stat_counters,d->stat_counters,sizeof(st.stat_counters));
+   EEPRO_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the controller state (VM snapshot) */
+static int dev_i8255x_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct i8255x_data *d = dev->priv_data;
+   struct i8255x_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   EEPRO_LOCK(d);
+   d->cu_state      = st.cu_state;
+   d->ru_state      = st.ru_state;
+   d->cu_base       = st.cu_base;
+   d->ru_base       = st.ru_base;
+   d->cu_offset     = st.cu_offset;
+   d->ru_offset     = st.ru_offset;
+   d->scb_gptr      = st.scb_gptr;
+   d->scb_ic        = st.scb_ic;
+   d->scb_stat_ack  = st.scb_stat_ack;
+   d->stat_cnt_addr = st.stat_cnt_addr;
+   d->mii_ctrl      = st.mii_ctrl;
+   memcpy(d->mii_regs,st.mii_regs,sizeof(d->mii_regs));
+   memcpy(&d->iaddr,&st.iaddr,sizeof(d->iaddr));
+   memcpy(d->config_data,st.config_data,sizeof(d->config_data));
+   memcpy(d->microcode,st.microcode,sizeof(d->microcode));
+   memcpy(d->stat_counters,st.stat_counters,sizeof(d->stat_counters));
+   EEPRO_UNLOCK(d);
+   return(0);
+}
+
 /*
  * dev_i8255x_init()
  */
@@ -1009,6 +1082,8 @@ dev_i8255x_init(vm_instance_t *vm,char *name,int interface_type,
    dev->phys_addr = 0;
    dev->phys_len  = 0x10000;
    dev->handler   = dev_i8255x_access;
+   dev->save_state = dev_i8255x_save_state;
+   dev->load_state = dev_i8255x_load_state;
    dev->priv_data = d;
    return(d);
 
@@ -328,9 +328,13 @@ void dev_mueslix_chan_access(cpu_gen_t *cpu,struct mueslix_channel *channel,
          break;
 
       case 0x80: /* TX start */
-         if (op_type == MTS_WRITE)
+         if (op_type == MTS_WRITE) {
             channel->tx_start = channel->tx_current = *data;
-         else
+
+            /* A new ring is given: scan it at once */
+            if (channel->nio != NULL)
+               ptask_kick(channel->tx_tid);
+         } else
             *data = channel->tx_start;
          break;
 
@@ -922,7 +926,7 @@ static int dev_mueslix_handle_txring(struct mueslix_channel *channel)
    }
 
    netio_clear_bw_stat(channel->nio);
-   return(TRUE);
+   return(i > 0);
 }
 
 /* pci_mueslix_read() */
@@ -955,6 +959,110 @@ static void pci_mueslix_write(cpu_gen_t *cpu,struct pci_device *dev,
    }
 }
 
+/* Channel registers saved in VM snapshots */
+struct mueslix_channel_snapshot_state {
+   m_uint32_t status,clk_shift,clk_div,clk_rate;
+   m_uint32_t crc_ctrl_reg,crc_size;
+   m_uint32_t rx_start,rx_end,tx_start,tx_end;
+   m_uint32_t rx_current,tx_current;
+};
+
+/* Mueslix state saved in VM snapshots */
+struct mueslix_snapshot_state {
+   m_uint32_t irq_status,irq_mask,irq_clearing_count;
+   m_uint32_t tpu_options,channel_enable_mask;
+   struct mueslix_channel_snapshot_state channel[MUESLIX_NR_CHANNELS];
+   u_char ucode[MUESLIX_UCODE_LEN];
+   u_char xmem[MUESLIX_XYMEM_LEN];
+   u_char ymem[MUESLIX_XYMEM_LEN];
+};
+
+/* Save the Mueslix state (VM snapshot) */
+static int dev_mueslix_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct mueslix_data *d = dev->priv_data;
+   struct mueslix_channel_snapshot_state *cs;
+   struct mueslix_channel *channel;
+   struct mueslix_snapshot_state st;
+   int i;
+
+   MUESLIX_LOCK(d);
+   st.irq_status          = d->irq_status;
+   st.irq_mask            = d->irq_mask;
+   st.irq_clearing_count  = d->irq_clearing_count;
+   st.tpu_options         = d->tpu_options;
+   st.channel_enable_mask = d->channel_enable_mask;
+
+   for(i=0;i<MUESLIX_NR_CHANNELS;i++) {
+      channel = &d->channel[i];
+      cs = &st.channel[i];
+
+      cs->status       = channel->status;
+      cs->clk_shift    = channel->clk_shift;
+      cs->clk_div      = channel->clk_div;
+      cs->clk_rate     = channel->clk_rate;
+      cs->crc_ctrl_reg = channel->crc_ctrl_reg;
+      cs->crc_size     = channel->crc_size;
+      cs->rx_start     = channel->rx_start;
+      cs->rx_end       = channel->rx_end;
+      cs->tx_start     = channel->tx_start;
+      cs->tx_end       = channel->tx_end;
+      cs->rx_current   = channel->rx_current;
+      cs->tx_current   = channel->tx_current;
+   }
+
+   memcpy(st.ucode,d->ucode,sizeof(st.ucode));
+   memcpy(st.xmem,d->xmem,sizeof(st.xmem));
+   memcpy(st.ymem,d->ymem,sizeof(st.ymem));
+   MUESLIX_UNLOCK(d);
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the Mueslix state (VM snapshot) */
+static int dev_mueslix_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct mueslix_data *d = dev->priv_data;
+   struct mueslix_channel_snapshot_state *cs;
+   struct mueslix_channel *channel;
+   struct mueslix_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   MUESLIX_LOCK(d);
+   d->irq_status          = st.irq_status;
+   d->irq_mask            = st.irq_mask;
+   d->irq_clearing_count  = st.irq_clearing_count;
+   d->tpu_options         = st.tpu_options;
+   d->channel_enable_mask = st.channel_enable_mask;
+
+   for(i=0;i<MUESLIX_NR_CHANNELS;i++) {
+      channel = &d->channel[i];
+      cs = &st.channel[i];
+
+      channel->status       = cs->status;
+      channel->clk_shift    = cs->clk_shift;
+      channel->clk_div      = cs->clk_div;
+      channel->clk_rate     = cs->clk_rate;
+      channel->crc_ctrl_reg = cs->crc_ctrl_reg;
+      channel->crc_size     = cs->crc_size;
+      channel->rx_start     = cs->rx_start;
+      channel->rx_end       = cs->rx_end;
+      channel->tx_start     = cs->tx_start;
+      channel->tx_end       = cs->tx_end;
+      channel->rx_current   = cs->rx_current;
+      channel->tx_current   = cs->tx_current;
+   }
+
+   memcpy(d->ucode,st.ucode,sizeof(d->ucode));
+   memcpy(d->xmem,st.xmem,sizeof(d->xmem));
+   memcpy(d->ymem,st.ymem,sizeof(d->ymem));
+   MUESLIX_UNLOCK(d);
+   return(0);
+}
+
 /* Initialize a Mueslix chip */
 struct mueslix_data *
 dev_mueslix_init(vm_instance_t *vm,char *name,int chip_mode,
@@ -1004,6 +1112,8 @@ dev_mueslix_init(vm_instance_t *vm,char *name,int chip_mode,
    dev->phys_addr = 0;
    dev->phys_len  = 0x4000;
    dev->handler   = dev_mueslix_access;
+   dev->save_state = dev_mueslix_save_state;
+   dev->load_state = dev_mueslix_load_state;
    dev->priv_data = d;
 
    /* Store device info */
@@ -1041,8 +1151,8 @@ int dev_mueslix_set_nio(struct mueslix_data *d,u_int channel_id,
 
    /* define the new NIO */
    channel->nio = nio;
-   channel->tx_tid = ptask_add((ptask_callback)dev_mueslix_handle_txring,
-                               channel,NULL);
+   channel->tx_tid = ptask_add_ext((ptask_callback)dev_mueslix_handle_txring,
+                                   channel,NULL,d->vm,PTASK_ADAPTIVE);
    netio_rxl_add(nio,(netio_rx_handler_t)dev_mueslix_handle_rxring,
                  channel,NULL);
    return(0);
@@ -1530,26 +1530,28 @@ static int mv64460_eth_handle_port_txqueue(struct mv64460_data *d,
 }
 
 /* Handle all TX queues of the specified port */
-static void mv64460_eth_handle_port_txqueues(struct mv64460_data *d,u_int port)
+static int mv64460_eth_handle_port_txqueues(struct mv64460_data *d,u_int port)
 {
-   int i;
+   int i,count = 0;
 
    for(i=0;i<MV64460_ETH_TX_QUEUES;i++)
-      mv64460_eth_handle_port_txqueue(d,&d->eth_ports[port],i);
+      count += mv64460_eth_handle_port_txqueue(d,&d->eth_ports[port],i);
+
+   return(count);
 }
 
 /* Handle all TX queues of all Ethernet ports */
 static int mv64460_eth_handle_txqueues(struct mv64460_data *d)
 {
-   int i;
+   int i,count = 0;
 
    MV64460_LOCK(d);
 
    for(i=0;i<MV64460_ETH_PORTS;i++)
-      mv64460_eth_handle_port_txqueues(d,i);
+      count += mv64460_eth_handle_port_txqueues(d,i);
 
    MV64460_UNLOCK(d);
-   return(TRUE);
+   return(count > 0);
 }
 
 /* Put a packet in buffer of a descriptor */
@@ -2050,12 +2052,13 @@ static int mv64460_eth_access(cpu_gen_t *cpu,struct vdevice *dev,
          if (op_type == MTS_READ) {
             *data = port->tqc;
          } else {
-            int i;
+            int i,kick = FALSE;
 
             for(i=0;i<MV64460_ETH_TX_QUEUES;i++) {
                if (*data & MV64460_ETH_TQC_ENQ(i)) {
                   port->tqc |= MV64460_ETH_TQC_ENQ(i);
                   port->tqc &= ~MV64460_ETH_TQC_DISQ(i);
+                  kick = TRUE;
                }
 
                if (*data & MV64460_ETH_TQC_DISQ(i)) {
@@ -2063,6 +2066,10 @@ static int mv64460_eth_access(cpu_gen_t *cpu,struct vdevice *dev,
                   port->tqc |= MV64460_ETH_TQC_DISQ(i);
                }
             }
+
+            /* Transmit demand: scan the TX queues at once */
+            if (kick)
+               ptask_kick(mv_data->eth_tx_tid);
          }
          break;
 
@@ -2669,8 +2676,8 @@ int dev_mv64460_init(vm_instance_t *vm,char *name,
                0,0,-1,d,NULL,pci_mv64460_read,NULL);
 
    /* Start the Ethernet TX ring scanner */
-   d->eth_tx_tid = ptask_add((ptask_callback)mv64460_eth_handle_txqueues,
-                             d,NULL);
+   d->eth_tx_tid = ptask_add_ext((ptask_callback)mv64460_eth_handle_txqueues,
+                                 d,NULL,vm,PTASK_ADAPTIVE);
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
@@ -1485,6 +1485,9 @@ void *dev_bcm5605_access(cpu_gen_t *cpu,struct vdevice *dev,m_uint32_t offset,
 #if DEBUG_TRANSMIT
             BCM_LOG(d,"tx_ring_addr = 0x%8.8x\n",d->tx_ring_addr);
 #endif
+
+            /* A new ring is given: scan it at once */
+            ptask_kick(d->tx_tid);
          }
          break;
 
@@ -2436,6 +2439,192 @@ int dev_nm_16esw_burn_mac_addr(vm_instance_t *vm,u_int nm_bay,
    return(0);
 }
 
+/* 
+ * BCM5600 state saved in VM snapshots. It is followed by the registers
+ * (address/value pairs) and by the content of the tables.
+ */
+struct bcm5600_snapshot_state {
+   m_uint32_t schan_cmd,schan_cmd_res;
+   m_uint32_t dw[BCM5600_DW_MAX];
+   m_uint32_t intr_mask;
+   m_uint16_t mii_regs[64][32];
+   m_uint32_t mii_input,mii_output,mii_intr;
+   m_uint32_t rx_ring_addr,tx_ring_addr;
+   m_uint32_t tx_current,tx_end_scan;
+   m_uint32_t rx_current,rx_end_scan;
+   m_uint32_t tx_bufsize;
+   u_char tx_buffer[BCM5600_MAX_PKT_SIZE];
+   m_uint32_t mirror_dst_port,mirror_egress_ports;
+   m_uint32_t trunk_last_egress_port[BCM5600_MAX_TRUNKS];
+   m_uint32_t reg_count;
+};
+
+/* Get the array of a table, NULL if already given by a previous table */
+static m_uint32_t *bcm5600_table_snapshot_array(struct nm_16esw_data *d,int i)
+{
+   int j;
+
+   for(j=0;j<i;j++)
+      if (bcm5600_tables[j].offset == bcm5600_tables[i].offset)
+         return NULL;
+
+   return(*(PTR_ADJUST(m_uint32_t **,d,bcm5600_tables[i].offset)));
+}
+
+/* Get the size of the tables in a VM snapshot */
+static size_t bcm5600_table_snapshot_size(struct nm_16esw_data *d)
+{
+   size_t len = 0;
+   int i;
+
+   for(i=0;bcm5600_tables[i].name;i++)
+      if (bcm5600_table_snapshot_array(d,i) != NULL)
+         len += bcm5600_table_get_size(&bcm5600_tables[i]) * sizeof(m_uint32_t);
+
+   return(len);
+}
+
+/* Save the BCM5600 state (VM snapshot) */
+static int dev_bcm5605_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct nm_16esw_data *d = dev->priv_data;
+   struct bcm5600_snapshot_state *st;
+   struct bcm5600_reg *reg;
+   m_uint32_t rv[2],*array;
+   int i,res = -1;
+
+   if (!(st = malloc(sizeof(*st))))
+      return(-1);
+
+   memset(st,0,sizeof(*st));
+
+   BCM_LOCK(d);
+   st->schan_cmd     = d->schan_cmd;
+   st->schan_cmd_res = d->schan_cmd_res;
+   memcpy(st->dw,d->dw,sizeof(st->dw));
+   st->intr_mask     = d->intr_mask;
+   memcpy(st->mii_regs,d->mii_regs,sizeof(st->mii_regs));
+   st->mii_input     = d->mii_input;
+   st->mii_output    = d->mii_output;
+   st->mii_intr      = d->mii_intr;
+   st->rx_ring_addr  = d->rx_ring_addr;
+   st->tx_ring_addr  = d->tx_ring_addr;
+   st->tx_current    = d->tx_current;
+   st->tx_end_scan   = d->tx_end_scan;
+   st->rx_current    = d->rx_current;
+   st->rx_end_scan   = d->rx_end_scan;
+   st->tx_bufsize    = d->tx_bufsize;
+   memcpy(st->tx_buffer,d->tx_buffer,sizeof(st->tx_buffer));
+   st->mirror_dst_port     = d->mirror_dst_port;
+   st->mirror_egress_ports = d->mirror_egress_ports;
+
+   for(i=0;i<BCM5600_MAX_TRUNKS;i++)
+      st->trunk_last_egress_port[i] = d->trunk_last_egress_port[i];
+
+   for(i=0;i<BCM5600_REG_HASH_SIZE;i++)
+      for(reg=d->reg_hash_table[i];reg;reg=reg->next)
+         st->reg_count++;
+
+   if (fwrite(st,sizeof(*st),1,fd) != 1)
+      goto done;
+
+   for(i=0;i<BCM5600_REG_HASH_SIZE;i++)
+      for(reg=d->reg_hash_table[i];reg;reg=reg->next) {
+         rv[0] = reg->addr;
+         rv[1] = reg->value;
+
+         if (fwrite(rv,sizeof(rv),1,fd) != 1)
+            goto done;
+      }
+
+   for(i=0;bcm5600_tables[i].name;i++) {
+      if (!(array = bcm5600_table_snapshot_array(d,i)))
+         continue;
+
+      if (fwrite(array,sizeof(m_uint32_t),
+                 bcm5600_table_get_size(&bcm5600_tables[i]),fd) !=
+          bcm5600_table_get_size(&bcm5600_tables[i]))
+         goto done;
+   }
+
+   res = 0;
+ done:
+   BCM_UNLOCK(d);
+   free(st);
+   return(res);
+}
+
+/* Restore the BCM5600 state (VM snapshot) */
+static int dev_bcm5605_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct nm_16esw_data *d = dev->priv_data;
+   struct bcm5600_snapshot_state *st;
+   m_uint32_t rv[2],*array;
+   int res = -1;
+   u_int i;
+
+   if ((len < sizeof(*st)) || !(st = malloc(sizeof(*st))))
+      return(-1);
+
+   if ((fread(st,sizeof(*st),1,fd) != 1) ||
+       (st->tx_bufsize > sizeof(st->tx_buffer)) ||
+       (len != sizeof(*st) + (st->reg_count * sizeof(rv)) +
+        bcm5600_table_snapshot_size(d)))
+   {
+      free(st);
+      return(-1);
+   }
+
+   BCM_LOCK(d);
+   d->schan_cmd     = st->schan_cmd;
+   d->schan_cmd_res = st->schan_cmd_res;
+   memcpy(d->dw,st->dw,sizeof(d->dw));
+   d->intr_mask     = st->intr_mask;
+   memcpy(d->mii_regs,st->mii_regs,sizeof(d->mii_regs));
+   d->mii_input     = st->mii_input;
+   d->mii_output    = st->mii_output;
+   d->mii_intr      = st->mii_intr;
+   d->rx_ring_addr  = st->rx_ring_addr;
+   d->tx_ring_addr  = st->tx_ring_addr;
+   d->tx_current    = st->tx_current;
+   d->tx_end_scan   = st->tx_end_scan;
+   d->rx_current    = st->rx_current;
+   d->rx_end_scan   = st->rx_end_scan;
+   d->tx_bufsize    = st->tx_bufsize;
+   memcpy(d->tx_buffer,st->tx_buffer,sizeof(d->tx_buffer));
+   d->mirror_dst_port     = st->mirror_dst_port;
+   d->mirror_egress_ports = st->mirror_egress_ports;
+
+   for(i=0;i<BCM5600_MAX_TRUNKS;i++)
+      d->trunk_last_egress_port[i] = st->trunk_last_egress_port[i];
+
+   /* Replace the registers by the saved ones */
+   bcm5600_reg_free(d);
+   memset(d->reg_hash_table,0,sizeof(d->reg_hash_table));
+
+   for(i=0;i<st->reg_count;i++) {
+      if ((fread(rv,sizeof(rv),1,fd) != 1) ||
+          (bcm5600_reg_write(d,rv[0],rv[1]) == -1))
+         goto done;
+   }
+
+   for(i=0;bcm5600_tables[i].name;i++) {
+      if (!(array = bcm5600_table_snapshot_array(d,i)))
+         continue;
+
+      if (fread(array,sizeof(m_uint32_t),
+                bcm5600_table_get_size(&bcm5600_tables[i]),fd) !=
+          bcm5600_table_get_size(&bcm5600_tables[i]))
+         goto done;
+   }
+
+   res = 0;
+ done:
+   BCM_UNLOCK(d);
+   free(st);
+   return(res);
+}
+
 /* Initialize a NM-16ESW module */
 struct nm_16esw_data *
 dev_nm_16esw_init(vm_instance_t *vm,char *name,u_int nm_bay,
@@ -2503,14 +2692,16 @@ dev_nm_16esw_init(vm_instance_t *vm,char *name,u_int nm_bay,
    dev->phys_addr = 0;
    dev->phys_len  = 0x200000;
    dev->handler   = dev_bcm5605_access;
+   dev->save_state = dev_bcm5605_save_state;
+   dev->load_state = dev_bcm5605_load_state;
 
    /* Store device info */
    dev->priv_data = data;
    data->dev = dev;
 
    /* Create the TX ring scanner */
-   data->tx_tid = ptask_add((ptask_callback)dev_bcm5600_handle_txring,
-                            data,NULL);
+   data->tx_tid = ptask_add_ext((ptask_callback)dev_bcm5600_handle_txring,
+                                data,NULL,vm,PTASK_ADAPTIVE);
 
    /* Start the MAC address ager */
    data->ager_tid = timer_create_entry(15000,FALSE,10,
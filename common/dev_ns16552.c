@@ -338,6 +338,57 @@ void *dev_ns16552_access(cpu_gen_t *cpu,struct vdevice *dev,m_uint32_t offset,
    return NULL;
 }
 
+/* DUART state saved in VM snapshots */
+struct ns16552_snapshot_state {
+   m_uint32_t ier[2],output[2],managed_flush[2];
+   m_uint32_t duart_irq_seq;
+   m_uint32_t line_control_reg,div_latch,baud_divisor;
+};
+
+/* Save the DUART state (VM snapshot) */
+static int dev_ns16552_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct ns16552_data *d = dev->priv_data;
+   struct ns16552_snapshot_state st;
+   int i;
+
+   for(i=0;i<2;i++) {
+      st.ier[i]    = d->channel[i].ier;
+      st.output[i] = d->channel[i].output;
+      st.managed_flush[i] = d->channel[i].vtty->managed_flush;
+   }
+
+   st.duart_irq_seq    = d->duart_irq_seq;
+   st.line_control_reg = d->line_control_reg;
+   st.div_latch        = d->div_latch;
+   st.baud_divisor     = d->baud_divisor;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the DUART state (VM snapshot) */
+static int dev_ns16552_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct ns16552_data *d = dev->priv_data;
+   struct ns16552_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   for(i=0;i<2;i++) {
+      d->channel[i].ier    = st.ier[i];
+      d->channel[i].output = st.output[i];
+      d->channel[i].vtty->managed_flush = st.managed_flush[i];
+   }
+
+   d->duart_irq_seq    = st.duart_irq_seq;
+   d->line_control_reg = st.line_control_reg;
+   d->div_latch        = st.div_latch;
+   d->baud_divisor     = st.baud_divisor;
+   return(0);
+}
+
 /* Shutdown a NS16552 device */
 void dev_ns16552_shutdown(vm_instance_t *vm,struct ns16552_data *d)
 {
@@ -390,6 +441,8 @@ int dev_ns16552_init(vm_instance_t *vm,m_uint64_t paddr,m_uint32_t len,
    d->dev.phys_len  = len;
    d->dev.handler   = dev_ns16552_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_ns16552_save_state;
+   d->dev.load_state = dev_ns16552_load_state;
 
    vtty_A->priv_data = d;
    vtty_B->priv_data = d;
@@ -397,7 +450,7 @@ int dev_ns16552_init(vm_instance_t *vm,m_uint64_t paddr,m_uint32_t len,
    vtty_B->read_notifier = tty_aux_input;
 
    /* Trigger periodically a dummy IRQ to flush buffers */
-   d->tid = ptask_add((ptask_callback)tty_trigger_dummy_irq,d,NULL);
+   d->tid = ptask_add_ext((ptask_callback)tty_trigger_dummy_irq,d,NULL,vm,0);
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);   
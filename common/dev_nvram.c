@@ -110,6 +110,33 @@ void *dev_nvram_access(cpu_gen_t *cpu,struct vdevice *dev,
    return((void *)(dev->host_addr + offset));
 }
 
+/* Save the calendar state (VM snapshot) */
+static int dev_nvram_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct nvram_data *d = dev->priv_data;
+   m_uint64_t st[3];
+
+   st[0] = d->cal_state;
+   st[1] = d->cal_read;
+   st[2] = d->cal_write;
+   return((fwrite(st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the calendar state (VM snapshot) */
+static int dev_nvram_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct nvram_data *d = dev->priv_data;
+   m_uint64_t st[3];
+
+   if ((len != sizeof(st)) || (fread(st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->cal_state = st[0];
+   d->cal_read  = st[1];
+   d->cal_write = st[2];
+   return(0);
+}
+
 /* Set appropriately the config register if the NVRAM is empty */
 static void set_config_register(struct vdevice *dev,u_int *conf_reg)
 {
@@ -179,6 +206,8 @@ int dev_nvram_init(vm_instance_t *vm,char *name,
    d->dev.host_addr = (m_iptr_t)ptr;
    d->dev.flags     = VDEVICE_FLAG_NO_MTS_MMAP|VDEVICE_FLAG_SYNC;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_nvram_save_state;
+   d->dev.load_state = dev_nvram_load_state;
 
    if (d->dev.fd == -1) {
       fprintf(stderr,"NVRAM: unable to map file '%s'\n",d->filename);
@@ -402,10 +402,16 @@ void *dev_pa_a1_access(cpu_gen_t *cpu,struct vdevice *dev,m_uint32_t offset,
 
    /* Control Memory access */
    if (offset < TI1570_CTRL_MEM_SIZE) {
-      if (op_type == MTS_READ)
+      if (op_type == MTS_READ) {
          *data = d->ctrl_mem_ptr[offset >> 2];
-      else
+      } else {
          d->ctrl_mem_ptr[offset >> 2] = *data;
+
+         /* A TX DMA channel is (re)started: scan the TX tables now */
+         if ((offset >= TI1570_TX_DMA_TABLE_OFFSET) &&
+             (offset < TI1570_RX_DMA_TABLE_OFFSET) && d->nio)
+            ptask_kick(d->tx_tid);
+      }
       return NULL;
    }
 
@@ -928,20 +934,23 @@ static int ti1570_scan_tx_dma_entry_single(struct pa_a1_data *d,
    return(TRUE);
 }
 
-/* Analyze a TX DMA state table entry */
-static void ti1570_scan_tx_dma_entry(struct pa_a1_data *d,m_uint32_t index)
+/* Analyze a TX DMA state table entry (returns the number of cells sent) */
+static int ti1570_scan_tx_dma_entry(struct pa_a1_data *d,m_uint32_t index)
 {
    int i;
 
    for(i=0;i<TI1570_TXDMA_PASS_COUNT;i++)
       if (!ti1570_scan_tx_dma_entry_single(d,index))
          break;
+
+   return(i);
 }
 
-/* Analyze the TX schedule table */
-static void ti1570_scan_tx_sched_table(struct pa_a1_data *d)
+/* Analyze the TX schedule table (returns TRUE if cells were sent) */
+static int ti1570_scan_tx_sched_table(struct pa_a1_data *d)
 {
    m_uint32_t cw,index0,index1;
+   int busy = FALSE;
    u_int i;
 
    for(i=0;i<TI1570_TX_SCHED_ENTRY_COUNT>>1;i++) {
@@ -952,9 +961,11 @@ static void ti1570_scan_tx_sched_table(struct pa_a1_data *d)
       index1 = (cw >> TI1570_TX_SCHED_E1_SHIFT) & TI1570_TX_SCHED_ENTRY_MASK;
 
       /* Scan the two entries (null entry => nothing to do) */
-      if (index0) ti1570_scan_tx_dma_entry(d,index0);
-      if (index1) ti1570_scan_tx_dma_entry(d,index1);
+      if (index0 && ti1570_scan_tx_dma_entry(d,index0)) busy = TRUE;
+      if (index1 && ti1570_scan_tx_dma_entry(d,index1)) busy = TRUE;
    }
+
+   return(busy);
 }
 
 /*
@@ -1540,6 +1551,60 @@ static void ti1570_reset(struct pa_a1_data *d,int clear_ctrl_mem)
       memset(d->ctrl_mem_ptr,0,TI1570_CTRL_MEM_SIZE);
 }
 
+/* TI1570 registers saved in VM snapshots (followed by the control memory) */
+struct ti1570_snapshot_state {
+   m_uint32_t irq_clear_count;
+   m_uint8_t txfifo_cell[ATM_CELL_SIZE];
+   m_uint32_t txfifo_avail,txfifo_pos;
+   m_uint32_t tcr_wi_pos,tcr_woi_pos;
+   m_uint32_t rcr_wi_pos,rcr_woi_pos;
+};
+
+/* Save the TI1570 state (VM snapshot) */
+static int dev_pa_a1_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pa_a1_data *d = dev->priv_data;
+   struct ti1570_snapshot_state st;
+
+   st.irq_clear_count = d->irq_clear_count;
+   memcpy(st.txfifo_cell,d->txfifo_cell,sizeof(st.txfifo_cell));
+   st.txfifo_avail    = d->txfifo_avail;
+   st.txfifo_pos      = d->txfifo_pos;
+   st.tcr_wi_pos      = d->tcr_wi_pos;
+   st.tcr_woi_pos     = d->tcr_woi_pos;
+   st.rcr_wi_pos      = d->rcr_wi_pos;
+   st.rcr_woi_pos     = d->rcr_woi_pos;
+
+   if ((fwrite(&st,sizeof(st),1,fd) != 1) ||
+       (fwrite(d->ctrl_mem_ptr,TI1570_CTRL_MEM_SIZE,1,fd) != 1))
+      return(-1);
+
+   return(0);
+}
+
+/* Restore the TI1570 state (VM snapshot) */
+static int dev_pa_a1_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pa_a1_data *d = dev->priv_data;
+   struct ti1570_snapshot_state st;
+
+   if ((len != sizeof(st) + TI1570_CTRL_MEM_SIZE) ||
+       (fread(&st,sizeof(st),1,fd) != 1) ||
+       (st.txfifo_pos > ATM_CELL_SIZE) ||
+       (fread(d->ctrl_mem_ptr,TI1570_CTRL_MEM_SIZE,1,fd) != 1))
+      return(-1);
+
+   d->irq_clear_count = st.irq_clear_count;
+   memcpy(d->txfifo_cell,st.txfifo_cell,sizeof(d->txfifo_cell));
+   d->txfifo_avail    = st.txfifo_avail;
+   d->txfifo_pos      = st.txfifo_pos;
+   d->tcr_wi_pos      = st.tcr_wi_pos;
+   d->tcr_woi_pos     = st.tcr_woi_pos;
+   d->rcr_wi_pos      = st.rcr_wi_pos;
+   d->rcr_woi_pos     = st.rcr_woi_pos;
+   return(0);
+}
+
 /*
  * dev_c7200_pa_a1_init()
  *
@@ -1626,6 +1691,8 @@ int dev_c7200_pa_a1_init(vm_instance_t *vm,struct cisco_card *card)
    dev->phys_addr = 0;
    dev->phys_len  = 0x200000;
    dev->handler   = dev_pa_a1_access;
+   dev->save_state = dev_pa_a1_save_state;
+   dev->load_state = dev_pa_a1_load_state;
 
    /* Store device info */
    dev->priv_data = d;
@@ -1675,7 +1742,8 @@ int dev_c7200_pa_a1_set_nio(vm_instance_t *vm,struct cisco_card *card,
       return(-1);
 
    d->nio = nio;
-   d->tx_tid = ptask_add((ptask_callback)ti1570_scan_tx_sched_table,d,NULL);
+   d->tx_tid = ptask_add_ext((ptask_callback)ti1570_scan_tx_sched_table,d,NULL,
+                             vm,PTASK_ADAPTIVE);
    netio_rxl_add(nio,(netio_rx_handler_t)ti1570_handle_rx_cell,d,NULL);
    return(0);
 }
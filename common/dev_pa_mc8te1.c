@@ -129,6 +129,26 @@ static void *dev_ssram_access(cpu_gen_t *cpu,struct vdevice *dev,
    return NULL;
 }
 
+/* Save the SSRAM content (VM snapshot) */
+static int dev_ssram_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pa_mc_data *d = dev->priv_data;
+
+   return((fwrite(d->ssram_data,sizeof(d->ssram_data),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the SSRAM content (VM snapshot) */
+static int dev_ssram_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pa_mc_data *d = dev->priv_data;
+
+   if ((len != sizeof(d->ssram_data)) ||
+       (fread(d->ssram_data,sizeof(d->ssram_data),1,fd) != 1))
+      return(-1);
+
+   return(0);
+}
+
 /* Callback when PLX9054 PCI-to-Local register is written */
 static void plx9054_doorbell_callback(struct plx_data *plx_data,
                                       struct pa_mc_data *pa_data,
@@ -262,6 +282,8 @@ int dev_c7200_pa_mc8te1_init(vm_instance_t *vm,struct cisco_card *card)
    d->ssram_dev.name      = d->ssram_name;
    d->ssram_dev.priv_data = d;
    d->ssram_dev.handler   = dev_ssram_access;
+   d->ssram_dev.save_state = dev_ssram_save_state;
+   d->ssram_dev.load_state = dev_ssram_load_state;
 
    /* Create the PLX9054 */
    d->plx_name = dyn_sprintf("%s_plx",card->dev_name);
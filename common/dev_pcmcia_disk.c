@@ -5,6 +5,7 @@
  * PCMCIA ATA Flash emulation.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include "cpu.h"
@@ -35,6 +37,9 @@
 /* Size (in bytes) of a sector */
 #define SECTOR_SIZE  512
 
+/* Minimum size of blocks copied from a base image to the disk file */
+#define DISK_BLOCK_SIZE  4096
+
 /* ATA commands */
 #define ATA_CMD_NOP           0x00
 #define ATA_CMD_READ_SECTOR   0x20
@@ -203,6 +208,21 @@ struct pcmcia_disk_data {
    char *filename;
    int fd;
 
+   /* Mapping of the disk file (NULL if not mapped) */
+   m_uint8_t *disk_map;
+   size_t disk_len;
+
+   /* 
+    * Base image, shared by all disks using it: the disk file only holds
+    * the blocks written by the guest, the bitmap tells which ones.
+    */
+   char *base_filename;
+   int base_fd;
+   m_uint8_t *base_map;
+   size_t base_len;
+   size_t blk_size;
+   m_uint8_t *blk_bitmap;
+
    /* Disk parameters (C/H/S) */
    u_int nr_heads;
    u_int nr_cylinders;
@@ -229,6 +249,9 @@ struct pcmcia_disk_data {
    m_uint32_t data_offset;
    u_int data_pos;
    m_uint8_t data_buffer[SECTOR_SIZE];
+
+   /* Current sector data (in disk mappings or data buffer) */
+   m_uint8_t *sect_buffer;
 };
 
 /* Convert a CHS reference to an LBA reference */
@@ -280,10 +303,66 @@ static int disk_format(struct pcmcia_disk_data *d)
    return(0);
 }
 
+/* Open the base image and find the blocks already present in disk file */
+static int disk_open_base(struct pcmcia_disk_data *d)
+{
+   struct stat fprop;
+   off_t fsize,data,hole;
+   size_t blk,blk_end,nr_blocks;
+
+#ifdef SEEK_DATA
+   if ((d->base_fd = memzone_open_file_ro(d->base_filename,&d->base_map,
+                                          &fsize)) == -1)
+   {
+      vm_error(d->vm,"PCMCIA: unable to map base image '%s' (%s)\n",
+               d->base_filename,strerror(errno));
+      return(-1);
+   }
+
+   d->base_len = fsize;
+
+   /* 
+    * The filesystem allocates blocks of the disk file with its own block
+    * size, so copy the base image by blocks of at least that size.
+    */
+   if ((fstat(d->fd,&fprop) == -1) || (fprop.st_blksize < DISK_BLOCK_SIZE))
+      d->blk_size = DISK_BLOCK_SIZE;
+   else
+      d->blk_size = fprop.st_blksize;
+
+   nr_blocks = (d->disk_len + d->blk_size - 1) / d->blk_size;
+
+   if (!(d->blk_bitmap = calloc((nr_blocks + 7) / 8,1)))
+      return(-1);
+
+   /* Holes of the sparse disk file are blocks not written yet */
+   for(data=0;;data=hole) {
+      if ((data = lseek(d->fd,data,SEEK_DATA)) == -1)
+         break;
+
+      if ((hole = lseek(d->fd,data,SEEK_HOLE)) == -1)
+         hole = d->disk_len;
+
+      blk_end = (hole + d->blk_size - 1) / d->blk_size;
+      
+      for(blk=data/d->blk_size;(blk<blk_end)&&(blk<nr_blocks);blk++)
+         d->blk_bitmap[blk >> 3] |= 1 << (blk & 0x07);
+   }
+
+   vm_log(d->vm,d->dev.name,"using base image '%s' (%lu bytes)\n",
+          d->base_filename,(u_long)d->base_len);
+   return(0);
+#else
+   vm_error(d->vm,"PCMCIA: base images are not supported on this host.\n");
+   return(-1);
+#endif
+}
+
 /* Create the virtual disk */
 static int disk_create(struct pcmcia_disk_data *d)
 {
    off_t disk_len;
+   int new_disk = FALSE;
 
    if ((d->fd = open(d->filename,O_CREAT|O_EXCL|O_RDWR,0600)) < 0) {
       /* already exists? */
@@ -293,34 +372,129 @@ static int disk_create(struct pcmcia_disk_data *d)
       }
    }
    else {
-      /* new disk */
-      if (disk_format(d)) {
+      /* new disk (with a base image, it starts as an empty overlay) */
+      if (!d->base_filename && disk_format(d)) {
          return(-1);
       }
+
+      new_disk = TRUE;
    }
 
    disk_len = d->nr_heads * d->nr_cylinders * d->sects_per_track * SECTOR_SIZE;
    ftruncate(d->fd,disk_len);
+
+   /* 
+    * Map the disk file, so multi-sector commands only copy the data
+    * between the guest and the page cache. Dirty pages are written back
+    * by the kernel, out of the CPU thread.
+    */
+   if (!(d->disk_map = memzone_map_file(d->fd,disk_len))) {
+      vm_log(d->vm,d->dev.name,"unable to map disk file, using file I/O\n");
+
+      /* base images need the mappings, give the new disk a filesystem */
+      if (new_disk && d->base_filename) {
+         vm_error(d->vm,"PCMCIA: ignoring base image for '%s'.\n",
+                  d->filename);
+         return(disk_format(d));
+      }
+      return(0);
+   }
+
+   d->disk_len = disk_len;
+
+   if (d->base_filename && (disk_open_base(d) == -1)) {
+      vm_error(d->vm,"PCMCIA: ignoring base image for '%s'.\n",d->filename);
+
+      if (d->base_map != NULL) {
+         memzone_unmap(d->base_map,d->base_len);
+         d->base_map = NULL;
+      }
+
+      if (d->base_fd != -1) {
+         close(d->base_fd);
+         d->base_fd = -1;
+      }
+
+      /* the new disk is not an overlay anymore */
+      if (new_disk && disk_format(d))
+         return(-1);
+   }
+
    return(0);
 }
 
+/* Copy a block of the base image to the disk file */
+static void disk_copy_block(struct pcmcia_disk_data *d,size_t blk)
+{
+   size_t offset = blk * d->blk_size;
+   size_t len = d->blk_size;
+
+   if (offset + len > d->disk_len)
+      len = d->disk_len - offset;
+
+   /* Beyond the end of the base image, the sparse disk file is zeroed */
+   if (offset < d->base_len) {
+      if (offset + len > d->base_len)
+         len = d->base_len - offset;
+
+      memcpy(d->disk_map + offset,d->base_map + offset,len);
+   }
+
+   d->blk_bitmap[blk >> 3] |= 1 << (blk & 0x07);
+}
+
+/* 
+ * Get a pointer to a sector in the disk mappings, copying it from the base
+ * image if it is going to be modified. Returns NULL if the sector must be
+ * accessed with file I/O.
+ */
+static m_uint8_t *disk_get_sector(struct pcmcia_disk_data *d,m_uint32_t sect,
+                                  int write)
+{
+   size_t offset = (size_t)sect * SECTOR_SIZE;
+   size_t blk;
+
+   if (!d->disk_map || (offset + SECTOR_SIZE > d->disk_len))
+      return NULL;
+
+   if (d->base_map) {
+      blk = offset / d->blk_size;
+
+      if (!(d->blk_bitmap[blk >> 3] & (1 << (blk & 0x07)))) {
+         if (!write && (offset + SECTOR_SIZE <= d->base_len))
+            return(d->base_map + offset);
+
+         disk_copy_block(d,blk);
+      }
+   }
+
+   return(d->disk_map + offset);
+}
+
+/* Announce the sectors used by a multi-sector command */
+static void disk_prefetch(struct pcmcia_disk_data *d,m_uint32_t sect,
+                          u_int count)
+{
+   size_t offset = ((size_t)sect * SECTOR_SIZE) & ~(VM_PAGE_SIZE - 1);
+   size_t end = ((size_t)sect + count) * SECTOR_SIZE;
+
+   if (d->disk_map && (offset < d->disk_len))
+      madvise(d->disk_map + offset,m_min(end,d->disk_len) - offset,
+              MADV_WILLNEED);
+
+   if (d->base_map && (offset < d->base_len))
+      madvise(d->base_map + offset,m_min(end,d->base_len) - offset,
+              MADV_WILLNEED);
+}
+
 /* Read a sector from disk file */
 static int disk_read_sector(struct pcmcia_disk_data *d,m_uint32_t sect,
                             m_uint8_t *buffer)
 {
    off_t disk_offset = (off_t)sect * SECTOR_SIZE;
 
-#if DEBUG_READ
-   vm_log(d->vm,d->dev.name,"reading sector 0x%8.8x\n",sect);
-#endif
-
-   if (lseek(d->fd,disk_offset,SEEK_SET) == -1) {
-      perror("read_sector: lseek");
-      return(-1);
-   }
-   
-   if (read(d->fd,buffer,SECTOR_SIZE) != SECTOR_SIZE) {
-      perror("read_sector: read");
+   if (pread(d->fd,buffer,SECTOR_SIZE,disk_offset) != SECTOR_SIZE) {
+      perror("read_sector: pread");
       return(-1);
    }
 
@@ -333,23 +507,38 @@ static int disk_write_sector(struct pcmcia_disk_data *d,m_uint32_t sect,
 {  
    off_t disk_offset = (off_t)sect * SECTOR_SIZE;
 
-#if DEBUG_WRITE
-   vm_log(d->vm,d->dev.name,"writing sector 0x%8.8x\n",sect);
-#endif
-
-   if (lseek(d->fd,disk_offset,SEEK_SET) == -1) {
-      perror("write_sector: lseek");
-      return(-1);
-   }
-   
-   if (write(d->fd,buffer,SECTOR_SIZE) != SECTOR_SIZE) {
-      perror("write_sector: write");
+   if (pwrite(d->fd,buffer,SECTOR_SIZE,disk_offset) != SECTOR_SIZE) {
+      perror("write_sector: pwrite");
       return(-1);
    }
 
    return(0);
 }
 
+/* Select the current sector for the guest to read */
+static void ata_read_sector(struct pcmcia_disk_data *d)
+{
+#if DEBUG_READ
+   vm_log(d->vm,d->dev.name,"reading sector 0x%8.8x\n",d->sect_pos);
+#endif
+
+   if (!(d->sect_buffer = disk_get_sector(d,d->sect_pos,FALSE))) {
+      d->sect_buffer = d->data_buffer;
+      disk_read_sector(d,d->sect_pos,d->data_buffer);
+   }
+}
+
+/* Select the current sector for the guest to write */
+static void ata_write_sector(struct pcmcia_disk_data *d)
+{
+#if DEBUG_WRITE
+   vm_log(d->vm,d->dev.name,"writing sector 0x%8.8x\n",d->sect_pos);
+#endif
+
+   if (!(d->sect_buffer = disk_get_sector(d,d->sect_pos,TRUE)))
+      d->sect_buffer = d->data_buffer;
+}
+
 /* Identify PCMCIA device (ATA command 0xEC) */
 static void ata_identify_device(struct pcmcia_disk_data *d)
 {
@@ -461,15 +650,17 @@ static void ata_cmd_read_callback(struct pcmcia_disk_data *d)
 
    /* Read the next sector */
    d->sect_pos++;
-   disk_read_sector(d,d->sect_pos,d->data_buffer);
+   ata_read_sector(d);
    d->ata_status = ATA_STATUS_RDY|ATA_STATUS_DSC|ATA_STATUS_DRQ;
 }
 
 /* ATA write sector callback */
 static void ata_cmd_write_callback(struct pcmcia_disk_data *d)
 {
-   /* Write the sector */
-   disk_write_sector(d,d->sect_pos,d->data_buffer);
+   /* Write the sector (already done if it is mapped) */
+   if (d->sect_buffer == d->data_buffer)
+      disk_write_sector(d,d->sect_pos,d->data_buffer);
+
    d->ata_status = ATA_STATUS_RDY|ATA_STATUS_DSC|ATA_STATUS_DRQ;
    d->sect_pos++;
 
@@ -477,7 +668,10 @@ static void ata_cmd_write_callback(struct pcmcia_disk_data *d)
 
    if (!d->sect_remaining) {
       d->ata_status = ATA_STATUS_RDY|ATA_STATUS_DSC;
+      return;
    }
+
+   ata_write_sector(d);
 }
 
 /* Handle an ATA command */
@@ -492,6 +686,7 @@ static void ata_handle_cmd(struct pcmcia_disk_data *d)
    switch(d->ata_cmd) {
       case ATA_CMD_IDENT_DEVICE:
          ata_identify_device(d);
+         d->sect_buffer = d->data_buffer;
          d->ata_cmd_callback = ata_cmd_ident_device_callback;
          d->ata_status = ATA_STATUS_RDY|ATA_STATUS_DSC|ATA_STATUS_DRQ;
          break;
@@ -503,7 +698,8 @@ static void ata_handle_cmd(struct pcmcia_disk_data *d)
             d->sect_remaining = 256;
 
          ata_set_sect_pos(d);
-         disk_read_sector(d,d->sect_pos,d->data_buffer);
+         disk_prefetch(d,d->sect_pos,d->sect_remaining);
+         ata_read_sector(d);
          d->ata_cmd_callback = ata_cmd_read_callback;
          d->ata_status = ATA_STATUS_RDY|ATA_STATUS_DSC|ATA_STATUS_DRQ;
          break;
@@ -515,6 +711,8 @@ static void ata_handle_cmd(struct pcmcia_disk_data *d)
             d->sect_remaining = 256;
 
          ata_set_sect_pos(d);
+         disk_prefetch(d,d->sect_pos,d->sect_remaining);
+         ata_write_sector(d);
          d->ata_cmd_callback = ata_cmd_write_callback;
          d->ata_status = ATA_STATUS_RDY|ATA_STATUS_DSC|ATA_STATUS_DRQ;
          break;
@@ -597,11 +795,11 @@ void *dev_pcmcia_disk_access_0(cpu_gen_t *cpu,struct vdevice *dev,
              (offset < d->data_offset + (SECTOR_SIZE/2)))
          {
             if (op_type == MTS_READ) {
-               *data =  d->data_buffer[(d->data_pos << 1)];
-               *data += d->data_buffer[(d->data_pos << 1)+1] << 8;
+               *data =  d->sect_buffer[(d->data_pos << 1)];
+               *data += d->sect_buffer[(d->data_pos << 1)+1] << 8;
             } else {
-               d->data_buffer[(d->data_pos << 1)]   = *data & 0xFF;
-               d->data_buffer[(d->data_pos << 1)+1] = *data >> 8;
+               d->sect_buffer[(d->data_pos << 1)]   = *data & 0xFF;
+               d->sect_buffer[(d->data_pos << 1)+1] = *data >> 8;
             }
             
             d->data_pos++;
@@ -674,11 +872,11 @@ void *dev_pcmcia_disk_access_1(cpu_gen_t *cpu,struct vdevice *dev,
 
       case 0x08:   /* Data */
          if (op_type == MTS_READ) {
-            *data =  d->data_buffer[(d->data_pos << 1)];
-            *data += d->data_buffer[(d->data_pos << 1)+1] << 8;
+            *data =  d->sect_buffer[(d->data_pos << 1)];
+            *data += d->sect_buffer[(d->data_pos << 1)+1] << 8;
          } else {
-            d->data_buffer[(d->data_pos << 1)]   = *data & 0xFF;
-            d->data_buffer[(d->data_pos << 1)+1] = *data >> 8;
+            d->sect_buffer[(d->data_pos << 1)]   = *data & 0xFF;
+            d->sect_buffer[(d->data_pos << 1)+1] = *data >> 8;
          }
 
          d->data_pos++;
@@ -706,8 +904,17 @@ void dev_pcmcia_disk_shutdown(vm_instance_t *vm,struct pcmcia_disk_data *d)
       /* Remove the device */
       dev_remove(vm,&d->dev);
 
-      /* Close disk file */
+      /* Unmap and close disk file and base image */
+      if (d->disk_map != NULL)
+         memzone_unmap(d->disk_map,d->disk_len);
+
+      if (d->base_map != NULL)
+         memzone_unmap(d->base_map,d->base_len);
+
       if (d->fd != -1) close(d->fd);
+      if (d->base_fd != -1) close(d->base_fd);
+
+      free(d->blk_bitmap);
 
       /* Free filename */
       free(d->filename);
@@ -717,10 +924,75 @@ void dev_pcmcia_disk_shutdown(vm_instance_t *vm,struct pcmcia_disk_data *d)
    }
 }
 
+/* ATA registers saved in VM snapshots */
+struct pcmcia_disk_snapshot_state {
+   m_uint32_t ata_cmd,ata_status;
+   m_uint32_t cyl_low,cyl_high,head,sect_no,sect_count;
+   m_uint32_t sect_pos,sect_remaining;
+};
+
+/* 
+ * Save the ATA registers (VM snapshot). The disk content is in the disk
+ * file: a sector transfer in progress cannot be saved, since the data
+ * buffer may point into the disk mappings.
+ */
+static int dev_pcmcia_disk_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct pcmcia_disk_data *d = dev->priv_data;
+   struct pcmcia_disk_snapshot_state st;
+
+   if (d->ata_status & ATA_STATUS_DRQ) {
+      vm_error(d->vm,"%s: ATA transfer in progress, retry later.\n",
+               dev->name);
+      return(-1);
+   }
+
+   memset(&st,0,sizeof(st));
+   st.ata_cmd        = d->ata_cmd;
+   st.ata_status     = d->ata_status;
+   st.cyl_low        = d->cyl_low;
+   st.cyl_high       = d->cyl_high;
+   st.head           = d->head;
+   st.sect_no        = d->sect_no;
+   st.sect_count     = d->sect_count;
+   st.sect_pos       = d->sect_pos;
+   st.sect_remaining = d->sect_remaining;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the ATA registers (VM snapshot) */
+static int dev_pcmcia_disk_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct pcmcia_disk_data *d = dev->priv_data;
+   struct pcmcia_disk_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->ata_cmd        = st.ata_cmd;
+   d->ata_status     = st.ata_status & ~ATA_STATUS_DRQ;
+   d->cyl_low        = st.cyl_low;
+   d->cyl_high       = st.cyl_high;
+   d->head           = st.head;
+   d->sect_no        = st.sect_no;
+   d->sect_count     = st.sect_count;
+   d->sect_pos       = st.sect_pos;
+   d->sect_remaining = st.sect_remaining;
+
+   /* No transfer in progress */
+   d->ata_cmd_in_progress = 0;
+   d->ata_cmd_callback = NULL;
+   d->sect_buffer = d->data_buffer;
+   d->data_pos = 0;
+   return(0);
+}
+
 /* Initialize a PCMCIA disk */
 vm_obj_t *dev_pcmcia_disk_init(vm_instance_t *vm,char *name,
                                m_uint64_t paddr,m_uint32_t len,
-                               u_int disk_size,int mode)
+                               u_int disk_size,char *base_filename,
+                               int mode)
 {
    struct pcmcia_disk_data *d;
    m_uint32_t tot_sect;
@@ -738,6 +1010,9 @@ vm_obj_t *dev_pcmcia_disk_init(vm_instance_t *vm,char *name,
    d->vm_obj.data = d;
    d->vm_obj.shutdown = (vm_shutdown_t)dev_pcmcia_disk_shutdown;
    d->fd = -1;
+   d->base_fd = -1;
+   d->base_filename = base_filename;
+   d->sect_buffer = d->data_buffer;
 
    if (!(d->filename = vm_build_filename(vm,name))) {
       fprintf(stderr,"PCMCIA: unable to create filename.\n");
@@ -759,21 +1034,24 @@ vm_obj_t *dev_pcmcia_disk_init(vm_instance_t *vm,char *name,
           d->nr_cylinders,d->nr_heads,d->sects_per_track);
 
    /* Create the disk file */
-   if (disk_create(d) == -1)
-      goto err_disk_create;
-
    dev_init(&d->dev);
    d->dev.name      = name;
    d->dev.priv_data = d;
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.flags     = VDEVICE_FLAG_CACHING;
+   d->dev.save_state = dev_pcmcia_disk_save_state;
+   d->dev.load_state = dev_pcmcia_disk_load_state;
 
    if (mode == 0)
       d->dev.handler = dev_pcmcia_disk_access_0;
    else
       d->dev.handler = dev_pcmcia_disk_access_1;
 
+   /* Create the disk file */
+   if (disk_create(d) == -1)
+      goto err_disk_create;
+
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
    vm_object_add(vm,&d->vm_obj);
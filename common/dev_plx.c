@@ -290,6 +290,54 @@ void dev_plx_shutdown(vm_instance_t *vm,struct plx_data *d)
    }
 }
 
+/* PLX state saved in VM snapshots (local bases are given by the PCI BARs) */
+struct plx_snapshot_state {
+   m_uint32_t range[PLX_LOCSPC_MAX];
+   m_uint32_t pci2loc_doorbell_reg,loc2pci_doorbell_reg;
+};
+
+/* Save the PLX state (VM snapshot) */
+static int dev_plx_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct plx_data *d = dev->priv_data;
+   struct plx_snapshot_state st;
+   int i;
+
+   for(i=0;i<PLX_LOCSPC_MAX;i++)
+      st.range[i] = d->lspc[i].range;
+
+   st.pci2loc_doorbell_reg = d->pci2loc_doorbell_reg;
+   st.loc2pci_doorbell_reg = d->loc2pci_doorbell_reg;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the PLX state (VM snapshot) */
+static int dev_plx_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct plx_data *d = dev->priv_data;
+   struct plx_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   for(i=0;i<PLX_LOCSPC_MAX;i++) {
+      if (d->lspc[i].range == st.range[i])
+         continue;
+
+      /* Remap the local space with its restored size */
+      d->lspc[i].range = st.range[i];
+
+      if (d->lspc[i].lbaddr != 0)
+         plx_map_space(d,i);
+   }
+
+   d->pci2loc_doorbell_reg = st.pci2loc_doorbell_reg;
+   d->loc2pci_doorbell_reg = st.loc2pci_doorbell_reg;
+   return(0);
+}
+
 /* Create a generic PLX device */
 struct plx_data *dev_plx_init(vm_instance_t *vm,char *name)
 {
@@ -320,6 +368,8 @@ struct plx_data *dev_plx_init(vm_instance_t *vm,char *name)
    d->plx_dev.phys_addr = 0;
    d->plx_dev.phys_len  = 0x1000;
    d->plx_dev.handler   = dev_plx_access;
+   d->plx_dev.save_state = dev_plx_save_state;
+   d->plx_dev.load_state = dev_plx_load_state;
    return(d);
 }
 
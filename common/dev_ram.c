@@ -5,12 +5,15 @@
  * RAM emulation.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "cpu.h"
 #include "vm.h"
@@ -18,18 +21,211 @@
 #include "memory.h"
 #include "device.h"
 
+/* Maximum number of pending prefault requests */
+#define RAM_PREFAULT_MAX   32
+
+/* Size of a prefault step (the worker checks for shutdown in between) */
+#define RAM_PREFAULT_STEP  (2 * 1048576)
+
+/* RAM prefaulted for an image, relative to its size */
+#define RAM_PREFAULT_IMAGE_RATIO  4
+
+/* Prefault request */
+struct ram_prefault {
+   u_char *ptr;
+   size_t len;
+   int write;
+};
+
 /* RAM private data */
 struct ram_data {
    vm_obj_t vm_obj;
    struct vdevice *dev;
    char *filename;
    int delete_file;
+
+   /* Prefault worker, populating memory in background */
+   pthread_t pf_thread;
+   pthread_mutex_t pf_lock;
+   pthread_cond_t pf_cond;
+   struct ram_prefault pf_queue[RAM_PREFAULT_MAX];
+   u_int pf_head,pf_count;
+   int pf_running,pf_stop;
 };
 
+/* Populate a memory zone without changing its content */
+static void dev_ram_populate(u_char *ptr,size_t len,int write)
+{
+   volatile int *p;
+   size_t i;
+
+   if (write) {
+#ifdef MADV_POPULATE_WRITE
+      if (!madvise(ptr,len,MADV_POPULATE_WRITE))
+         return;
+#endif
+      /* Atomic no-op write: the CPU may modify the page at the same time */
+      for(i=0;i<len;i+=VM_PAGE_SIZE) {
+         p = (volatile int *)(ptr + i);
+         __sync_fetch_and_or(p,0);
+      }
+   } else {
+#ifdef MADV_POPULATE_READ
+      if (!madvise(ptr,len,MADV_POPULATE_READ))
+         return;
+#endif
+      madvise(ptr,len,MADV_WILLNEED);
+   }
+}
+
+/* Prefault worker thread */
+static void *dev_ram_prefault_thread(void *arg)
+{
+   struct ram_data *d = arg;
+   struct ram_prefault *req;
+   size_t len;
+
+   pthread_mutex_lock(&d->pf_lock);
+
+   while(!d->pf_stop) {
+      if (!d->pf_count) {
+         pthread_cond_wait(&d->pf_cond,&d->pf_lock);
+         continue;
+      }
+
+      /* Process the current request by steps */
+      req = &d->pf_queue[d->pf_head];
+      len = m_min(req->len,RAM_PREFAULT_STEP);
+
+      pthread_mutex_unlock(&d->pf_lock);
+      dev_ram_populate(req->ptr,len,req->write);
+      pthread_mutex_lock(&d->pf_lock);
+
+      req->ptr += len;
+      req->len -= len;
+
+      if (!req->len) {
+         d->pf_head = (d->pf_head + 1) % RAM_PREFAULT_MAX;
+         d->pf_count--;
+      }
+   }
+
+   pthread_mutex_unlock(&d->pf_lock);
+   return NULL;
+}
+
+/* Queue a prefault request */
+static int dev_ram_prefault_queue(struct ram_data *d,m_iptr_t start,
+                                  m_iptr_t end,int write)
+{
+   struct ram_prefault *req;
+
+   /* Align the zone on pages */
+   start &= VM_PAGE_MASK;
+   end = (end + VM_PAGE_IMASK) & VM_PAGE_MASK;
+
+   if (end <= start)
+      return(-1);
+
+   pthread_mutex_lock(&d->pf_lock);
+
+   if (!d->pf_running) {
+      if (pthread_create(&d->pf_thread,NULL,dev_ram_prefault_thread,d)) {
+         pthread_mutex_unlock(&d->pf_lock);
+         return(-1);
+      }
+
+      d->pf_running = TRUE;
+   }
+
+   /* This is only a hint, so drop the request if the queue is full */
+   if (d->pf_count == RAM_PREFAULT_MAX) {
+      pthread_mutex_unlock(&d->pf_lock);
+      return(-1);
+   }
+
+   req = &d->pf_queue[(d->pf_head + d->pf_count) % RAM_PREFAULT_MAX];
+   req->ptr = (u_char *)start;
+   req->len = end - start;
+   req->write = write;
+   d->pf_count++;
+
+   pthread_cond_signal(&d->pf_cond);
+   pthread_mutex_unlock(&d->pf_lock);
+   return(0);
+}
+
+/* 
+ * Populate in background a zone of anonymous host memory of a VM (chunk
+ * of host pages for sparse memory). The content is not changed, so the
+ * zone may be used meanwhile.
+ */
+int dev_ram_prefault(vm_instance_t *vm,void *ptr,size_t len)
+{
+   vm_obj_t *obj;
+
+   if (!(obj = vm_object_find(vm,"ram")))
+      return(-1);
+
+   return(dev_ram_prefault_queue(obj->data,(m_iptr_t)ptr,
+                                 (m_iptr_t)ptr + len,TRUE));
+}
+
+/* 
+ * Populate in background the RAM used by an image loaded at host address
+ * "ptr": the image and the area following it, where IOS decompresses 
+ * itself and puts its heap. Pages of files (ghost images, memory-mapped
+ * RAM) are only read in, not copied or dirtied. Sparse memory is left
+ * alone, as its pages are allocated by the CPU thread.
+ */
+int dev_ram_prefault_image(vm_instance_t *vm,void *ptr,size_t len)
+{
+   m_iptr_t start,end,dev_end;
+   struct ram_data *d;
+   vm_obj_t *obj;
+
+   if (!(obj = vm_object_find(vm,"ram")))
+      return(-1);
+
+   d = obj->data;
+
+   if (d->dev->sparse_map || !d->dev->host_addr)
+      return(-1);
+
+   start = (m_iptr_t)ptr;
+   dev_end = d->dev->host_addr + d->dev->phys_len;
+
+   if ((start < d->dev->host_addr) || (start >= dev_end))
+      return(-1);
+
+   end = start + m_min((m_iptr_t)len * RAM_PREFAULT_IMAGE_RATIO,
+                       dev_end - start);
+
+   return(dev_ram_prefault_queue(d,start,end,(d->dev->fd == -1)));
+}
+
+/* Stop the prefault worker */
+static void dev_ram_prefault_stop(struct ram_data *d)
+{
+   pthread_mutex_lock(&d->pf_lock);
+   d->pf_stop = TRUE;
+   pthread_cond_signal(&d->pf_cond);
+   pthread_mutex_unlock(&d->pf_lock);
+
+   if (d->pf_running)
+      pthread_join(d->pf_thread,NULL);
+
+   pthread_cond_destroy(&d->pf_cond);
+   pthread_mutex_destroy(&d->pf_lock);
+}
+
 /* Shutdown a RAM device */
 void dev_ram_shutdown(vm_instance_t *vm,struct ram_data *d)
 {
    if (d != NULL) {
+      /* The worker must not touch memory anymore */
+      dev_ram_prefault_stop(d);
+
       /* Remove the device */
       dev_remove(vm,d->dev);
       free(d->dev);
@@ -61,6 +257,8 @@ int dev_ram_init(vm_instance_t *vm,char *name,int use_mmap,int delete_file,
 
    memset(d,0,sizeof(*d));
    d->delete_file = delete_file;
+   pthread_mutex_init(&d->pf_lock,NULL);
+   pthread_cond_init(&d->pf_cond,NULL);
 
    vm_object_init(&d->vm_obj);
    d->vm_obj.name = name;
@@ -108,6 +306,8 @@ int dev_ram_ghost_init(vm_instance_t *vm,char *name,int sparse,char *filename,
 
    memset(d,0,sizeof(*d));
    d->delete_file = FALSE;
+   pthread_mutex_init(&d->pf_lock,NULL);
+   pthread_cond_init(&d->pf_cond,NULL);
 
    if (!(d->filename = strdup(filename)))
       goto err_filename;
@@ -287,6 +287,50 @@ void dev_remote_control_shutdown(vm_instance_t *vm,struct remote_data *d)
    }
 }
 
+/* Remote control state saved in VM snapshots */
+struct remote_snapshot_state {
+   char con_buffer[512];
+   char var_buffer[512];
+   m_uint32_t con_buf_pos,var_buf_pos,var_status,cookie_pos;
+};
+
+/* Save the remote control state (VM snapshot) */
+static int dev_remote_control_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct remote_data *d = dev->priv_data;
+   struct remote_snapshot_state st;
+
+   memcpy(st.con_buffer,d->con_buffer,sizeof(st.con_buffer));
+   memcpy(st.var_buffer,d->var_buffer,sizeof(st.var_buffer));
+   st.con_buf_pos = d->con_buf_pos;
+   st.var_buf_pos = d->var_buf_pos;
+   st.var_status  = d->var_status;
+   st.cookie_pos  = d->cookie_pos;
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the remote control state (VM snapshot) */
+static int dev_remote_control_load_state(struct vdevice *dev,FILE *fd,
+                                         size_t len)
+{
+   struct remote_data *d = dev->priv_data;
+   struct remote_snapshot_state st;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1) ||
+       (st.con_buf_pos >= sizeof(d->con_buffer)) ||
+       (st.var_buf_pos >= sizeof(d->var_buffer)))
+      return(-1);
+
+   memcpy(d->con_buffer,st.con_buffer,sizeof(d->con_buffer));
+   memcpy(d->var_buffer,st.var_buffer,sizeof(d->var_buffer));
+   d->con_buf_pos = st.con_buf_pos;
+   d->var_buf_pos = st.var_buf_pos;
+   d->var_status  = st.var_status;
+   d->cookie_pos  = st.cookie_pos;
+   return(0);
+}
+
 /* remote control device */
 int dev_remote_control_init(vm_instance_t *vm,m_uint64_t paddr,m_uint32_t len)
 {
@@ -310,6 +354,8 @@ int dev_remote_control_init(vm_instance_t *vm,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_len  = len;
    d->dev.handler   = dev_remote_control_access;
    d->dev.priv_data = d;
+   d->dev.save_state = dev_remote_control_save_state;
+   d->dev.load_state = dev_remote_control_load_state;
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
@@ -100,7 +100,7 @@ int dev_rom_init(vm_instance_t *vm,char *name,m_uint64_t paddr,m_uint32_t len,
    d->dev.priv_data = d;
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
-   d->dev.flags     = VDEVICE_FLAG_CACHING;
+   d->dev.flags     = VDEVICE_FLAG_CACHING|VDEVICE_FLAG_NO_STATE;
    d->dev.handler   = dev_rom_access;
 
    /* Map this device to the VM */
@@ -109,6 +109,7 @@ int dev_sb1_init(vm_instance_t *vm)
    d->dev.phys_addr = 0x10000000ULL;
    d->dev.phys_len  = 0x60000;
    d->dev.handler   = dev_sb1_access;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);  
@@ -281,6 +281,53 @@ void dev_sb1_io_shutdown(vm_instance_t *vm,struct sb1_io_data *d)
 }
 
 
+/* SB-1 I/O state saved in VM snapshots */
+struct sb1_io_snapshot_state {
+   m_uint32_t duart_irq_seq,duart_isr,duart_imr;
+   m_uint32_t mode[2],cmd[2];
+};
+
+/* Save the SB-1 I/O state (VM snapshot) */
+static int dev_sb1_io_save_state(struct vdevice *dev,FILE *fd)
+{
+   struct sb1_io_data *d = dev->priv_data;
+   struct sb1_io_snapshot_state st;
+   int i;
+
+   st.duart_irq_seq = d->duart_irq_seq;
+   st.duart_isr     = d->duart_isr;
+   st.duart_imr     = d->duart_imr;
+
+   for(i=0;i<2;i++) {
+      st.mode[i] = d->duart_chan[i].mode;
+      st.cmd[i]  = d->duart_chan[i].cmd;
+   }
+
+   return((fwrite(&st,sizeof(st),1,fd) == 1) ? 0 : -1);
+}
+
+/* Restore the SB-1 I/O state (VM snapshot) */
+static int dev_sb1_io_load_state(struct vdevice *dev,FILE *fd,size_t len)
+{
+   struct sb1_io_data *d = dev->priv_data;
+   struct sb1_io_snapshot_state st;
+   int i;
+
+   if ((len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   d->duart_irq_seq = st.duart_irq_seq;
+   d->duart_isr     = st.duart_isr;
+   d->duart_imr     = st.duart_imr;
+
+   for(i=0;i<2;i++) {
+      d->duart_chan[i].mode = st.mode[i];
+      d->duart_chan[i].cmd  = st.cmd[i];
+   }
+
+   return(0);
+}
+
 /* Create SB-1 I/O devices */
 int dev_sb1_io_init(vm_instance_t *vm,u_int duart_irq)
 {   
@@ -308,6 +355,8 @@ int dev_sb1_io_init(vm_instance_t *vm,u_int duart_irq)
    d->dev.phys_addr = 0x10060000ULL;
    d->dev.phys_len  = 0x10000;
    d->dev.handler   = dev_sb1_io_access;
+   d->dev.save_state = dev_sb1_io_save_state;
+   d->dev.load_state = dev_sb1_io_load_state;
 
    /* Set console and AUX port notifying functions */
    vm->vtty_con->priv_data = d;
@@ -316,7 +365,8 @@ int dev_sb1_io_init(vm_instance_t *vm,u_int duart_irq)
    vm->vtty_aux->read_notifier = tty_aux_input;
 
    /* Trigger periodically a dummy IRQ to flush buffers */
-   d->duart_irq_tid = ptask_add((ptask_callback)tty_trigger_dummy_irq,d,NULL);
+   d->duart_irq_tid = ptask_add_ext((ptask_callback)tty_trigger_dummy_irq,
+                                    d,NULL,vm,0);
 
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);  
@@ -132,6 +132,7 @@ int dev_sb1_pci_init(vm_instance_t *vm,char *name,m_uint64_t paddr)
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = 1 << 24;
    d->dev.handler   = dev_sb1_pci_access;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
 
    /* PCI configuration header on Bus 0, Device 0 */
    d->pci_cfg_dev = pci_dev_add(d->pci_bus,"sb1_pci_cfg",
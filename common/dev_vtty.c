@@ -39,6 +39,7 @@
 
 #ifdef USE_UNSTABLE
 #include "tcb.h"
+#include "tc_cache.h"
 #endif
 
 #ifndef SOL_TCP
@@ -268,7 +269,11 @@ static int vtty_tcp_conn_accept(vtty_t *vtty, int nsock)
       return(-1);
    }
 
-   /* Register the new FD */
+   /* 
+    * Register the new FD. Output is held until the replay is done, so the
+    * new connection gets the text once, in order.
+    */
+   VTTY_OUT_LOCK(vtty);
    *fd_slot = fd;
 
    vm_log(vtty->vm,"VTTY","%s is now connected (accept_fd=%d,conn_fd=%d)\n",
@@ -305,8 +310,10 @@ static int vtty_tcp_conn_accept(vtty_t *vtty, int nsock)
       /* warn if not running */
       if (vtty->vm->status != VM_STATUS_RUNNING)
          fd_printf(fd,0,"\r\n!!! WARNING - VM is not running, will be unresponsive (status=%d) !!!\r\n",vtty->vm->status);
-      vtty_flush(vtty);
    }
+
+   VTTY_OUT_UNLOCK(vtty);
+   vtty_flush(vtty);
    return(0);
 }
 
@@ -504,6 +511,7 @@ vtty_t *vtty_create(vm_instance_t *vm,char *name,int type,int tcp_port,
    vtty->vm   = vm;
    vtty->fd_count = 0;
    pthread_mutex_init(&vtty->lock,NULL);
+   pthread_mutex_init(&vtty->out_lock,NULL);
    vtty->terminal_support = 1;
    vtty->input_state = VTTY_INPUT_TEXT;
    fd_pool_init(&vtty->fd_pool);
@@ -572,6 +580,8 @@ void vtty_delete(vtty_t *vtty)
          VTTY_LIST_UNLOCK();
       }
 
+      vtty_flush(vtty);
+
       switch(vtty->type) {
            case VTTY_TYPE_TCP:
                
@@ -858,6 +868,7 @@ static void remote_control(vtty_t *vtty,u_char c)
 #endif
 #ifdef USE_UNSTABLE
          tsg_show_stats();
+         tc_cache_show_stats();
 #endif
          break;
 
@@ -1087,23 +1098,29 @@ int vtty_is_char_avail(vtty_t *vtty)
    return(res);
 }
 
-/* Put char to vtty */
-void vtty_put_char(vtty_t *vtty, char ch)
+/* Send the pending output (called with the output lock held) */
+static void vtty_flush_output(vtty_t *vtty)
 {
+   u_int len = vtty->out_count;
+   u_int chunk;
+
+   if (!len)
+      return;
+
    switch(vtty->type) {
       case VTTY_TYPE_NONE:
          break;
 
       case VTTY_TYPE_TERM:
       case VTTY_TYPE_SERIAL:
-         if (write(vtty->fd_array[0],&ch,1) != 1) {
-            vm_log(vtty->vm,"VTTY","%s: put char 0x%x failed (%s)\n",
-                   vtty->name,(int)ch,strerror(errno));
+         if (write(vtty->fd_array[0],vtty->out_buffer,len) != len) {
+            vm_log(vtty->vm,"VTTY","%s: put %u chars failed (%s)\n",
+                   vtty->name,len,strerror(errno));
          }
          break;
 
       case VTTY_TYPE_TCP:
-         fd_pool_send(&vtty->fd_pool,&ch,1,0);
+         fd_pool_send(&vtty->fd_pool,vtty->out_buffer,len,0);
          break;
 
       default:
@@ -1111,21 +1128,43 @@ void vtty_put_char(vtty_t *vtty, char ch)
          exit(1);
    }
 
-   /* store char for replay */
-   vtty->replay_buffer[vtty->replay_ptr] = ch;
+   /* store text for replay */
+   chunk = m_min(len,VTTY_BUFFER_SIZE - vtty->replay_ptr);
+   memcpy(&vtty->replay_buffer[vtty->replay_ptr],vtty->out_buffer,chunk);
+   memcpy(vtty->replay_buffer,&vtty->out_buffer[chunk],len - chunk);
 
-   ++vtty->replay_ptr;
-   if (vtty->replay_ptr == VTTY_BUFFER_SIZE)
-      vtty->replay_ptr = 0;
+   vtty->replay_ptr = (vtty->replay_ptr + len) % VTTY_BUFFER_SIZE;
+   vtty->out_count = 0;
+}
+
+/* Put char to vtty */
+void vtty_put_char(vtty_t *vtty, char ch)
+{
+   VTTY_OUT_LOCK(vtty);
+   vtty->out_buffer[vtty->out_count++] = ch;
+
+   if ((ch == '\n') || (vtty->out_count == VTTY_OUT_BUFFER_SIZE))
+      vtty_flush_output(vtty);
+   VTTY_OUT_UNLOCK(vtty);
 }
 
 /* Put a buffer to vtty */
 void vtty_put_buffer(vtty_t *vtty,char *buf,size_t len)
 {
-   size_t i;
-
-   for(i=0;i<len;i++)
-      vtty_put_char(vtty,buf[i]);
+   size_t chunk;
+
+   VTTY_OUT_LOCK(vtty);
+   while(len > 0) {
+      chunk = m_min(len,VTTY_OUT_BUFFER_SIZE - vtty->out_count);
+      memcpy(&vtty->out_buffer[vtty->out_count],buf,chunk);
+      vtty->out_count += chunk;
+      buf += chunk;
+      len -= chunk;
+
+      if (vtty->out_count == VTTY_OUT_BUFFER_SIZE)
+         vtty_flush_output(vtty);
+   }
+   VTTY_OUT_UNLOCK(vtty);
    
    vtty_flush(vtty);
 }
@@ -1133,6 +1172,10 @@ void vtty_put_buffer(vtty_t *vtty,char *buf,size_t len)
 /* Flush VTTY output */
 void vtty_flush(vtty_t *vtty)
 {
+   VTTY_OUT_LOCK(vtty);
+   vtty_flush_output(vtty);
+   VTTY_OUT_UNLOCK(vtty);
+
    switch(vtty->type) {
       case VTTY_TYPE_TERM:
       case VTTY_TYPE_SERIAL:
@@ -1154,6 +1197,7 @@ static void *vtty_thread_main(void *arg)
    vtty_t *vtty;
    struct timeval tv;
    int fd_max,fd_tcp,res;
+   int out_pending;
    fd_set rfds;
    int i;
 
@@ -1163,7 +1207,10 @@ static void *vtty_thread_main(void *arg)
       /* Build the FD set */
       FD_ZERO(&rfds);
       fd_max = -1;
+      out_pending = FALSE;
       for(vtty=vtty_list;vtty;vtty=vtty->next) {
+          if (vtty->out_count)
+              out_pending = TRUE;
 
           switch(vtty->type) {
               case VTTY_TYPE_TCP:
@@ -1189,9 +1236,13 @@ static void *vtty_thread_main(void *arg)
       }
       VTTY_LIST_UNLOCK();
 
-      /* Wait for incoming data */
+      /* Wait for incoming data (shorter while some output is buffered) */
       tv.tv_sec  = 0;
-      tv.tv_usec = 50 * 1000;  /* 50 ms */
+
+      if (out_pending)
+         tv.tv_usec = VTTY_FLUSH_DELAY * 1000;
+      else
+         tv.tv_usec = 50 * 1000;  /* 50 ms */
       res = select(fd_max+1,&rfds,NULL,NULL,&tv);
 
       if (res == -1) {
@@ -1236,11 +1287,15 @@ static void *vtty_thread_main(void *arg)
             if (vtty->read_notifier != NULL)
                vtty->read_notifier(vtty);
 
+            /* Wake up an idle CPU, whatever IRQ the console uses */
+            if (vtty->vm && vtty->vm->boot_cpu)
+               cpu_idle_break_wait(vtty->vm->boot_cpu);
+
             vtty->input_pending = FALSE;
          }
 
          /* Flush any pending output */
-         if (!vtty->managed_flush)
+         if (!vtty->managed_flush || vtty->out_count)
             vtty_flush(vtty);
       }
       VTTY_LIST_UNLOCK();
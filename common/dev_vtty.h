@@ -17,6 +17,12 @@
 /* 4 Kb should be enough for a keyboard buffer */
 #define VTTY_BUFFER_SIZE  4096
 
+/* Output buffer, flushed on newline, when full or by the VTTY thread */
+#define VTTY_OUT_BUFFER_SIZE  1024
+
+/* Maximum delay before buffered output is flushed (in ms) */
+#define VTTY_FLUSH_DELAY  10
+
 /* Maximum listening socket number */
 #define VTTY_MAX_FD   10
 
@@ -86,6 +92,11 @@ struct virtual_tty {
    /* Read notification */
    void (*read_notifier)(vtty_t *);
 
+   /* Pending output */
+   u_char out_buffer[VTTY_OUT_BUFFER_SIZE];
+   u_int out_count;
+   pthread_mutex_t out_lock;
+
    /* Old text for replay */
    u_char replay_buffer[VTTY_BUFFER_SIZE];
    u_int replay_ptr;
@@ -94,6 +105,9 @@ struct virtual_tty {
 #define VTTY_LOCK(tty) pthread_mutex_lock(&(tty)->lock);
 #define VTTY_UNLOCK(tty) pthread_mutex_unlock(&(tty)->lock);
 
+#define VTTY_OUT_LOCK(tty) pthread_mutex_lock(&(tty)->out_lock);
+#define VTTY_OUT_UNLOCK(tty) pthread_mutex_unlock(&(tty)->out_lock);
+
 /* create a virtual tty */
 vtty_t *vtty_create(vm_instance_t *vm,char *name,int type,int tcp_port,
                     const vtty_serial_option_t *option);
@@ -158,6 +158,7 @@ dev_wic_serial_init(vm_instance_t *vm,char *name,u_int model,
    d->dev.priv_data = d;
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
 
    switch(model) {
       case WIC_SERIAL_MODEL_1T:
@@ -66,6 +66,7 @@ int dev_zero_init(vm_instance_t *vm,char *name,m_uint64_t paddr,m_uint32_t len)
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = len;
    d->dev.handler   = dev_zero_access;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
    
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <assert.h>
 
@@ -154,9 +155,16 @@ void dev_remove(vm_instance_t *vm,struct vdevice *dev)
 
       close(dev->fd);
    } else {
-      /* Use of malloc'ed host memory: free it */
-      if (dev->host_addr)
-         free((void *)dev->host_addr);
+      /* Use of malloc'ed or anonymously mapped host memory: free it */
+      if (dev->host_addr) {
+         if (dev->flags & VDEVICE_FLAG_HUGE)
+            memzone_unmap((void *)dev->host_addr,
+                          MEMZONE_HUGE_ROUND(dev->phys_len));
+         else if (dev->flags & VDEVICE_FLAG_LAZY)
+            memzone_unmap((void *)dev->host_addr,dev->phys_len);
+         else
+            free((void *)dev->host_addr);
+      }
    }
 
    /* reinitialize the device to a clean state */
@@ -254,8 +262,16 @@ struct vdevice *dev_create_ram(vm_instance_t *vm,char *name,
          }
       
          dev->host_addr = (m_iptr_t)ram_ptr;
+
+         if (vm->huge_pages != MEMZONE_HUGE_NONE)
+            memzone_advise_huge(ram_ptr,dev->phys_len);
+      } else if (vm->huge_pages != MEMZONE_HUGE_NONE) {
+         ram_ptr = memzone_map_huge(dev->phys_len,FALSE,vm->huge_pages);
+         dev->host_addr = (m_iptr_t)ram_ptr;
+         dev->flags |= VDEVICE_FLAG_HUGE;
       } else {
-         dev->host_addr = (m_iptr_t)m_memalign(4096,dev->phys_len);
+         dev->host_addr = (m_iptr_t)memzone_map_lazy(dev->phys_len);
+         dev->flags |= VDEVICE_FLAG_LAZY;
       }
    
       if (!dev->host_addr) {
@@ -297,6 +313,9 @@ dev_create_ghost_ram(vm_instance_t *vm,char *name,int sparse,char *filename,
          free(dev);
          return NULL;
       }
+
+      if (vm->huge_pages != MEMZONE_HUGE_NONE)
+         memzone_advise_huge(ram_ptr,dev->phys_len);
    } else {
       if (vm_ghost_image_get(filename,&ram_ptr,&dev->fd) == -1) {
          free(dev);
@@ -445,6 +464,274 @@ m_iptr_t dev_sparse_get_host_addr(vm_instance_t *vm,struct vdevice *dev,
    return(ptr_new);
 }
 
+#ifdef __linux__
+/* 
+ * Count pages of a private file mapping which have been copied on write,
+ * using /proc/self/pagemap (anonymous pages, present or swapped).
+ * If "map" is not NULL, it is filled with one flag per page.
+ */
+static int dev_ghost_scan_cow_pages(struct vdevice *dev,u_int *private,
+                                    u_char *map)
+{
+   m_uint64_t entries[512],e;
+   u_int i,j,nr_pages,count;
+   off_t pos;
+   int fd;
+
+   if ((fd = open("/proc/self/pagemap",O_RDONLY)) == -1)
+      return(-1);
+
+   nr_pages = dev->phys_len >> VM_PAGE_SHIFT;
+   pos = (dev->host_addr / getpagesize()) * sizeof(m_uint64_t);
+   *private = 0;
+
+   for(i=0;i<nr_pages;i+=count) {
+      count = m_min(nr_pages - i,512);
+
+      if (pread(fd,entries,count*sizeof(m_uint64_t),pos) != 
+          (ssize_t)(count*sizeof(m_uint64_t)))
+      {
+         close(fd);
+         return(-1);
+      }
+
+      for(j=0;j<count;j++) {
+         e = entries[j];
+
+         /* Present or swapped, but not a file page */
+         if ((e & (3ULL << 62)) && !(e & (1ULL << 61))) {
+            (*private)++;
+            if (map) map[i+j] = TRUE;
+         } else {
+            if (map) map[i+j] = FALSE;
+         }
+      }
+
+      pos += count * sizeof(m_uint64_t);
+   }
+
+   close(fd);
+   return(0);
+}
+#endif
+
+/* 
+ * Get page sharing statistics of a RAM device: pages still backed by the
+ * ghost image (shared between VMs using it), private pages, and pages
+ * never allocated (sparse memory).
+ */
+int dev_ghost_page_stats(struct vdevice *dev,u_int *shared,u_int *private,
+                         u_int *unalloc)
+{
+   u_int i,nr_pages;
+
+   nr_pages = dev->phys_len >> VM_PAGE_SHIFT;
+   *shared = *private = *unalloc = 0;
+
+   if (dev->sparse_map) {
+      for(i=0;i<nr_pages;i++) {
+         if (dev->sparse_map[i] & VDEVICE_PTE_DIRTY)
+            (*private)++;
+         else if (dev->host_addr)
+            (*shared)++;
+         else
+            (*unalloc)++;
+      }
+      return(0);
+   }
+
+   if (!(dev->flags & VDEVICE_FLAG_GHOST)) {
+      *private = nr_pages;
+      return(0);
+   }
+
+#ifdef __linux__
+   if (dev_ghost_scan_cow_pages(dev,private,NULL) == -1)
+      return(-1);
+
+   *shared = nr_pages - *private;
+   return(0);
+#else
+   return(-1);
+#endif
+}
+
+/* 
+ * Give back to the ghost image the private pages of a RAM device which
+ * have the same content. CPU and device activity must be suspended, and
+ * the MTS caches rebuilt afterwards (host addresses of pages are changed).
+ * Returns the number of pages released.
+ */
+int dev_ghost_reshare(vm_instance_t *vm,struct vdevice *dev)
+{
+   u_char buffer[VM_PAGE_SIZE];
+   u_int i,nr_pages,count = 0;
+   u_char *cow_map = NULL;
+   m_iptr_t base,ptr;
+
+   if (!(dev->flags & VDEVICE_FLAG_GHOST))
+      return(0);
+
+   nr_pages = dev->phys_len >> VM_PAGE_SHIFT;
+
+   if (!dev->sparse_map) {
+#ifdef __linux__
+      /* Only look at pages which have been copied on write */
+      if (!(cow_map = malloc(nr_pages)) ||
+          (dev_ghost_scan_cow_pages(dev,&count,cow_map) == -1))
+      {
+         free(cow_map);
+         return(-1);
+      }
+      count = 0;
+#else
+      return(0);
+#endif
+   }
+
+   for(i=0;i<nr_pages;i++) {
+      if (dev->sparse_map) {
+         /* Sparse memory: the ghost image is directly mapped */
+         ptr  = dev->sparse_map[i];
+         base = dev->host_addr + (i << VM_PAGE_SHIFT);
+
+         if (!(ptr & VDEVICE_PTE_DIRTY))
+            continue;
+
+         ptr &= VM_PAGE_MASK;
+
+         if (memcmp((void *)ptr,(void *)base,VM_PAGE_SIZE) != 0)
+            continue;
+
+         dev->sparse_map[i] = base;
+         vm_free_host_page(vm,(void *)ptr);
+      } else {
+         /* 
+          * Private file mapping: discarding the page gives back the
+          * file content.
+          */
+         ptr = dev->host_addr + (i << VM_PAGE_SHIFT);
+
+         if (!cow_map[i] ||
+             (pread(dev->fd,buffer,VM_PAGE_SIZE,(off_t)i << VM_PAGE_SHIFT) 
+              != VM_PAGE_SIZE) ||
+             (memcmp((void *)ptr,buffer,VM_PAGE_SIZE) != 0))
+            continue;
+
+         if (madvise((void *)ptr,VM_PAGE_SIZE,MADV_DONTNEED) == -1)
+            continue;
+      }
+
+      count++;
+   }
+
+   free(cow_map);
+   return(count);
+}
+
+/* Check if a page contains only zeroes */
+static int dev_page_is_zero(void *ptr)
+{
+   m_uint64_t *p = ptr;
+   u_int i;
+
+   for(i=0;i<VM_PAGE_SIZE/sizeof(m_uint64_t);i++)
+      if (p[i] != 0)
+         return(FALSE);
+
+   return(TRUE);
+}
+
+/*
+ * Give back to the host the RAM pages which contain only zeroes (IOS
+ * clears the memory it frees): they are allocated again, zeroed, on next
+ * access. Only resident pages are looked at, to avoid populating the RAM.
+ * Ghosted RAM is ignored: a discarded page would get back the content
+ * of the ghost image (use dev_ghost_reshare instead).
+ *
+ * CPU and device activity must be suspended, and the MTS caches rebuilt
+ * afterwards for sparse devices. Returns the number of pages released.
+ */
+int dev_ram_reclaim(vm_instance_t *vm,struct vdevice *dev)
+{
+   u_int i,nr_pages,count = 0;
+   m_iptr_t ptr;
+   int advice;
+
+   if (dev->flags & (VDEVICE_FLAG_GHOST|VDEVICE_FLAG_REMAP))
+      return(0);
+
+   nr_pages = dev->phys_len >> VM_PAGE_SHIFT;
+
+   if (dev->sparse_map) {
+      for(i=0;i<nr_pages;i++) {
+         ptr = dev->sparse_map[i];
+
+         if (!(ptr & VDEVICE_PTE_DIRTY) || 
+             !dev_page_is_zero((void *)(ptr & VM_PAGE_MASK)))
+            continue;
+
+         dev->sparse_map[i] = 0;
+         vm_free_host_page(vm,(void *)(ptr & VM_PAGE_MASK));
+         count++;
+      }
+      return(count);
+   }
+
+   if (!dev->host_addr)
+      return(0);
+
+   /* 
+    * Anonymous memory is simply discarded. Holes are punched in shared 
+    * memory-mapped files.
+    */
+   if (dev->fd == -1) {
+      advice = MADV_DONTNEED;
+   } else {
+#ifdef MADV_REMOVE
+      advice = MADV_REMOVE;
+#else
+      return(0);
+#endif
+   }
+
+#ifdef __linux__
+   {
+      u_char vec[512];
+      size_t len;
+      u_int j;
+
+      for(i=0;i<nr_pages;i+=512) {
+         len = m_min(nr_pages - i,512) << VM_PAGE_SHIFT;
+         ptr = dev->host_addr + ((m_iptr_t)i << VM_PAGE_SHIFT);
+
+         if (mincore((void *)ptr,len,vec) == -1)
+            return(-1);
+
+         for(j=0;j<(len >> VM_PAGE_SHIFT);j++) {
+            if (!(vec[j] & 1) || 
+                !dev_page_is_zero((void *)(ptr + (j << VM_PAGE_SHIFT))))
+               continue;
+
+            if (!madvise((void *)(ptr + (j << VM_PAGE_SHIFT)),VM_PAGE_SIZE,
+                         advice))
+               count++;
+         }
+      }
+   }
+#else
+   for(i=0;i<nr_pages;i++) {
+      ptr = dev->host_addr + ((m_iptr_t)i << VM_PAGE_SHIFT);
+
+      if (dev_page_is_zero((void *)ptr) &&
+          !madvise((void *)ptr,VM_PAGE_SIZE,advice))
+         count++;
+   }
+#endif
+
+   return(count);
+}
+
 /* Get virtual address space used on host for the specified device */
 size_t dev_get_vspace_size(struct vdevice *dev)
 {
@@ -491,6 +778,7 @@ int dev_create_dummy_console(vm_instance_t *vm)
    dev->phys_addr = 0x1e840000; /* 0x1f000000; */
    dev->phys_len  = 4096;
    dev->handler = dummy_console_handler;
+   dev->flags   = VDEVICE_FLAG_NO_STATE;
 
    vm_bind_device(vm,dev);
    return(0);
@@ -6,6 +6,7 @@
 #ifndef __DEVICE_H__
 #define __DEVICE_H__
 
+#include <stdio.h>
 #include <sys/types.h>
 #include "utils.h"
 #include "cpu.h"
@@ -19,6 +20,9 @@
 #define VDEVICE_FLAG_SYNC         0x08  /* Forced sync */
 #define VDEVICE_FLAG_SPARSE       0x10  /* Sparse device */
 #define VDEVICE_FLAG_GHOST        0x20  /* Ghost device */
+#define VDEVICE_FLAG_HUGE         0x40  /* Memory mapped with huge pages */
+#define VDEVICE_FLAG_LAZY         0x80  /* Memory populated on demand */
+#define VDEVICE_FLAG_NO_STATE     0x100 /* No private state (VM snapshots) */
 
 #define VDEVICE_PTE_DIRTY  0x01
 
@@ -26,6 +30,10 @@ typedef void *(*dev_handler_t)(cpu_gen_t *cpu,struct vdevice *dev,
                                m_uint32_t offset,u_int op_size,u_int op_type,
                                m_uint64_t *data);
 
+/* Device state save/restore handlers (VM snapshots) */
+typedef int (*dev_save_state_t)(struct vdevice *dev,FILE *fd);
+typedef int (*dev_load_state_t)(struct vdevice *dev,FILE *fd,size_t len);
+
 /* Virtual Device */
 struct vdevice {
    char *name;
@@ -38,6 +46,8 @@ struct vdevice {
    int fd;
    dev_handler_t handler;
    m_iptr_t *sparse_map;
+   dev_save_state_t save_state;
+   dev_load_state_t load_state;
    struct vdevice *next,**pprev;
 };
 
@@ -158,6 +168,16 @@ int dev_sparse_shutdown(struct vdevice *dev);
 m_iptr_t dev_sparse_get_host_addr(vm_instance_t *vm,struct vdevice *dev,
                                   m_uint64_t paddr,u_int op_type,int *cow);
 
+/* Get page sharing statistics of a RAM device */
+int dev_ghost_page_stats(struct vdevice *dev,u_int *shared,u_int *private,
+                         u_int *unalloc);
+
+/* Give back to the ghost image the private pages with the same content */
+int dev_ghost_reshare(vm_instance_t *vm,struct vdevice *dev);
+
+/* Give back to the host the RAM pages containing only zeroes */
+int dev_ram_reclaim(vm_instance_t *vm,struct vdevice *dev);
+
 /* Get virtual address space used on host for the specified device */
 size_t dev_get_vspace_size(struct vdevice *dev);
 
@@ -177,6 +197,12 @@ int dev_ram_init(vm_instance_t *vm,char *name,int use_mmap,int delete_file,
                  char *alternate_name,int sparse,
                  m_uint64_t paddr,m_uint32_t len);
 
+/* Populate a host memory zone of a VM in background */
+int dev_ram_prefault(vm_instance_t *vm,void *ptr,size_t len);
+
+/* Populate in background the RAM used by an image loaded at "ptr" */
+int dev_ram_prefault_image(vm_instance_t *vm,void *ptr,size_t len);
+
 /* Initialize a ghosted RAM zone */
 int dev_ram_ghost_init(vm_instance_t *vm,char *name,int sparse,char *filename,
                        m_uint64_t paddr,m_uint32_t len);
@@ -252,7 +278,8 @@ int dev_c7200_sram_init(vm_instance_t *vm,char *name,
 /* Initialize a PCMCIA disk */
 vm_obj_t *dev_pcmcia_disk_init(vm_instance_t *vm,char *name,
                                m_uint64_t paddr,m_uint32_t len,
-                               u_int disk_size,int mode);
+                               u_int disk_size,char *base_filename,
+                               int mode);
 
 /* Get the device associated with a PCMCIA disk object */
 struct vdevice *dev_pcmcia_disk_get_device(vm_obj_t *obj);
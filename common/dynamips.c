@@ -191,8 +191,10 @@ static void show_usage(vm_instance_t *vm,int argc,char *argv[])
           "(default: 7200)\n\n"
           "  -l <log_file>      : Set logging file (default is %s)\n"
           "  -j                 : Disable the JIT compiler, very slow\n"
-          "  --idle-pc <pc>     : Set the idle PC (default: disabled)\n"
+          "  --idle-pc <pc>     : Set the idle PC, or \"auto\" to detect it\n"
+          "                       (default: disabled)\n"
           "  --timer-itv <val>  : Timer IRQ interval check (default: %u)\n"
+          "  --timer-vclock     : Compute timer IRQs from host time in CPUs\n"
           "\n"
           "  -i <instance>      : Set instance ID\n"
           "  -r <ram_size>      : Set the virtual RAM size (default: %u Mb)\n"
@@ -208,6 +210,8 @@ static void show_usage(vm_instance_t *vm,int argc,char *argv[])
           "  -G <ghost_file>    : Use a ghost file to simulate RAM\n"
           "  -g <ghost_file>    : Generate a ghost RAM file\n"
           "  --sparse-mem       : Use sparse memory\n"
+          "  --huge-pages <mode>: Use huge pages for RAM and JIT (0: none,\n"
+          "                       1: transparent, 2: hugetlbfs) (default: 0)\n"
           "  -R <rom_file>      : Load an alternate ROM (default: embedded)\n"
           "  -k <clock_div>     : Set the clock divisor (default: %d)\n"
           "\n"
@@ -223,6 +227,13 @@ static void show_usage(vm_instance_t *vm,int argc,char *argv[])
           "(default: %u Mb)\n"
           "  --disk1 <size>     : Set PCMCIA ATA disk1: size "
           "(default: %u Mb)\n"
+          "  --disk0-base <file>: Share a base image for PCMCIA ATA disk0\n"
+          "  --disk1-base <file>: Share a base image for PCMCIA ATA disk1\n"
+          "\n"
+          "  --cpu-affinity <cpus> : Run the VM threads on host CPUs <cpus>\n"
+          "                       (ex: 0-3,8)\n"
+          "  --numa-node <node> : Allocate the VM memory on NUMA node <node>\n"
+          "                       (default: node of the affinity CPUs)\n"
           "\n"
           "  --noctrl           : Disable ctrl+] monitor console\n"
           "  --notelnetmsg      : Disable message when using tcp console/aux\n"
@@ -232,6 +243,11 @@ static void show_usage(vm_instance_t *vm,int argc,char *argv[])
           vm->ram_size,vm->rom_size,vm->nvram_size,vm->conf_reg_setup,
           vm->clock_divisor,vm->pcmcia_disk_size[0],vm->pcmcia_disk_size[1]);
 
+#ifdef USE_UNSTABLE
+   printf("  --tc-cache <file>  : Use a persistent JIT translation cache\n"
+          "\n");
+#endif
+
    if (vm->platform->cli_show_options != NULL)
       vm->platform->cli_show_options(vm);
 
@@ -361,11 +377,20 @@ static vm_platform_t *cli_get_platform_type(int argc,char *argv[])
 static struct option cmd_line_lopts[] = {
    { "disk0"      , 1, NULL, OPT_DISK0_SIZE },
    { "disk1"      , 1, NULL, OPT_DISK1_SIZE },
+   { "disk0-base" , 1, NULL, OPT_DISK0_BASE },
+   { "disk1-base" , 1, NULL, OPT_DISK1_BASE },
+   { "cpu-affinity", 1, NULL, OPT_CPU_AFFINITY },
+   { "numa-node"  , 1, NULL, OPT_NUMA_NODE },
+   { "huge-pages" , 1, NULL, OPT_HUGE_PAGES },
    { "idle-pc"    , 1, NULL, OPT_IDLE_PC },
    { "timer-itv"  , 1, NULL, OPT_TIMER_ITV },
+   { "timer-vclock", 0, NULL, OPT_TIMER_VCLOCK },
    { "vm-debug"   , 1, NULL, OPT_VM_DEBUG },
    { "iomem-size" , 1, NULL, OPT_IOMEM_SIZE },
    { "sparse-mem" , 0, NULL, OPT_SPARSE_MEM },
+#ifdef USE_UNSTABLE
+   { "tc-cache"   , 1, NULL, OPT_TC_CACHE },
+#endif
    { "noctrl"     , 0, NULL, OPT_NOCTRL },
    { "notelnetmsg", 0, NULL, OPT_NOTELMSG },
    { "filepid"    , 1, NULL, OPT_FILEPID },
@@ -476,6 +501,43 @@ static int parse_std_cmd_line(int argc,char *argv[])
                    vm->pcmcia_disk_size[1]);
             break;
 
+         /* PCMCIA disk0 base image */
+         case OPT_DISK0_BASE:
+            free(vm->pcmcia_disk_base[0]);
+            vm->pcmcia_disk_base[0] = strdup(optarg);
+            break;
+
+         /* PCMCIA disk1 base image */
+         case OPT_DISK1_BASE:
+            free(vm->pcmcia_disk_base[1]);
+            vm->pcmcia_disk_base[1] = strdup(optarg);
+            break;
+
+         /* Host CPU affinity */
+         case OPT_CPU_AFFINITY:
+            if (vm_set_cpu_affinity(vm,optarg) == -1) {
+               fprintf(stderr,"Invalid CPU list '%s'.\n",optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         /* NUMA node for memory */
+         case OPT_NUMA_NODE:
+            vm->numa_node = atoi(optarg);
+            break;
+
+         /* Huge pages */
+         case OPT_HUGE_PAGES:
+            vm->huge_pages = atoi(optarg);
+
+            if ((vm->huge_pages < MEMZONE_HUGE_NONE) ||
+                (vm->huge_pages > MEMZONE_HUGE_TLB))
+            {
+               fprintf(stderr,"Invalid huge page mode %d.\n",vm->huge_pages);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
          case OPT_NOCTRL:
             vtty_set_ctrlhandler(0); /* Ignore ctrl ] */
             printf("Block ctrl+] access to monitor console.\n");
@@ -522,6 +584,13 @@ static int parse_std_cmd_line(int argc,char *argv[])
             vm->sparse_mem = TRUE;
             break;
 
+#ifdef USE_UNSTABLE
+         /* Persistent translation cache */
+         case OPT_TC_CACHE:
+            vm_set_tc_cache(vm,optarg);
+            break;
+#endif
+
          /* Alternate ROM */
          case 'R':
             free(vm->rom_filename);
@@ -544,6 +613,12 @@ static int parse_std_cmd_line(int argc,char *argv[])
 			
          /* Idle PC */
          case OPT_IDLE_PC:
+            if (!strcmp(optarg,"auto")) {
+               vm->idle_pc_auto = TRUE;
+               printf("Idle PC detected automatically.\n");
+               break;
+            }
+
             vm->idle_pc = strtoull(optarg,NULL,0);
             printf("Idle PC set to 0x%llx.\n",vm->idle_pc);
             break;
@@ -553,6 +628,11 @@ static int parse_std_cmd_line(int argc,char *argv[])
             vm->timer_irq_check_itv = atoi(optarg);
             break;
 
+         /* Timer IRQs computed from host time */
+         case OPT_TIMER_VCLOCK:
+            vm->timer_vclock = TRUE;
+            break;
+
          /* Clock divisor */
          case 'k':
             vm->clock_divisor = atoi(optarg);
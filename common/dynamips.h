@@ -71,6 +71,13 @@ extern char *binding_addr;
 #define OPT_VM_DEBUG    0x105
 #define OPT_IOMEM_SIZE  0x106
 #define OPT_SPARSE_MEM  0x107
+#define OPT_TC_CACHE    0x108
+#define OPT_DISK0_BASE  0x109
+#define OPT_DISK1_BASE  0x10a
+#define OPT_CPU_AFFINITY 0x10b
+#define OPT_NUMA_NODE   0x10c
+#define OPT_HUGE_PAGES  0x10d
+#define OPT_TIMER_VCLOCK 0x10e
 #define OPT_NOCTRL      0x120
 #define OPT_NOTELMSG    0x121
 #define OPT_FILEPID     0x122
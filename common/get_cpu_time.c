@@ -13,6 +13,7 @@
 #include <sys/resource.h>
 #include <sys/times.h>
 #include <time.h>
+#include <pthread.h>
 
 #else
 #error "Unable to define get_cpu_time() for an unknown OS."
@@ -98,3 +99,22 @@ double get_cpu_time()
 
 	return -1.0;		/* Failed. */
 }
+
+/**
+ * Returns the amount of CPU time used by a thread of the current process,
+ * in seconds, or -1.0 if an error occurred.
+ */
+double get_thread_cpu_time(pthread_t thread)
+{
+#if defined(_POSIX_THREAD_CPUTIME) && (_POSIX_THREAD_CPUTIME >= 0)
+	clockid_t id;
+	struct timespec ts;
+
+	if ( pthread_getcpuclockid( thread, &id ) == 0 &&
+		clock_gettime( id, &ts ) != -1 )
+		return (double)ts.tv_sec +
+			(double)ts.tv_nsec / 1000000000.0;
+#endif
+
+	return -1.0;		/* Failed. */
+}
@@ -7,7 +7,10 @@
 #ifndef __GET_CPU_TIME_H__
 #define __GET_CPU_TIME_H__
 
+#include <pthread.h>
+
 double get_cpu_time();
+double get_thread_cpu_time(pthread_t thread);
 
 #endif
 
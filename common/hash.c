@@ -91,8 +91,9 @@ static hash_node_t *hash_node_alloc(hash_table_t *ht,void *key,void *value)
 {
    hash_node_t *node;
 
-   node = malloc(sizeof(*node));
-   assert(node!=NULL);
+   if (!(node = malloc(sizeof(*node))))
+      return NULL;
+
    node->key = key;
    node->value = value;
    node->next = NULL;
@@ -156,7 +157,9 @@ int hash_table_insert(hash_table_t *ht,void *key,void *value)
          return(0);
       }
 
-   node = hash_node_alloc(ht,key,value);
+   if (!(node = hash_node_alloc(ht,key,value)))
+      return(-1);
+
    node->next = ht->nodes[hash_val];
    ht->nodes[hash_val] = node;
    ht->nnodes++;
@@ -217,6 +217,29 @@ static int cmd_create_linux_eth(hypervisor_conn_t *conn,int argc,char *argv[])
    hypervisor_send_reply(conn,HSC_INFO_OK,1,"NIO '%s' created",argv[0]);
    return(0);
 }
+
+/* 
+ * Create a linux raw ethernet NIO with memory-mapped packet rings
+ *
+ * Parameters: <nio_name> <eth_device>
+ */
+static int cmd_create_linux_eth_ring(hypervisor_conn_t *conn,
+                                     int argc,char *argv[])
+{
+   netio_desc_t *nio;
+
+   nio = netio_desc_create_lnxeth_ring(argv[0],argv[1]);
+
+   if (!nio) {
+      hypervisor_send_reply(conn,HSC_ERR_CREATE,1,
+                            "unable to create Linux raw ethernet ring NIO");
+      return(-1);
+   }
+
+   netio_release(argv[0]);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"NIO '%s' created",argv[0]);
+   return(0);
+}
 #endif
 
 /* 
@@ -481,6 +504,55 @@ static int cmd_set_bandwidth(hypervisor_conn_t *conn,int argc,char *argv[])
    return(0);
 }
 
+/* Set the number of RX listener workers */
+static int cmd_set_rxl_workers(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   u_int count = atoi(argv[0]);
+
+   if (netio_rxl_set_workers(count) == -1) {
+      hypervisor_send_reply(conn,HSC_ERR_INV_PARAM,1,
+                            "unable to set %u RX listener workers "
+                            "(current: %u, max: %u)",
+                            count,netio_rxl_get_workers(),
+                            NETIO_RXL_MAX_WORKERS);
+      return(-1);
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Show statistics of RX listener workers */
+static int cmd_show_rxl_workers(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   m_uint64_t wakeups,pkts;
+   u_int i,nio_count;
+
+   for(i=0;netio_rxl_get_worker_stats(i,&nio_count,&wakeups,&pkts)!=-1;i++) {
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%u %u %llu %llu",
+                            i,nio_count,wakeups,pkts);
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Show the packet buffer pool statistics */
+static int cmd_show_pkt_pool(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   netio_pkt_stats_t stats;
+   u_int i;
+
+   for(i=0;netio_pkt_get_stats(i,&stats)!=-1;i++) {
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%lu %u %u %llu %llu",
+                            (u_long)stats.size,stats.in_use,stats.cached,
+                            stats.alloc_count,stats.free_count);
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
 /* Show info about a NIO object */
 static void cmd_show_nio_list(registry_entry_t *entry,void *opt,int *err)
 {
@@ -510,6 +582,7 @@ static hypervisor_cmd_t nio_cmd_array[] = {
 #endif
 #ifdef LINUX_ETH
    { "create_linux_eth", 2, 2, cmd_create_linux_eth, NULL },
+   { "create_linux_eth_ring", 2, 2, cmd_create_linux_eth_ring, NULL },
 #endif
    { "create_null", 1, 1, cmd_create_null, NULL },
    { "create_fifo", 1, 1, cmd_create_fifo, NULL },
@@ -523,6 +596,9 @@ static hypervisor_cmd_t nio_cmd_array[] = {
    { "get_stats", 1, 1, cmd_get_stats },
    { "reset_stats", 1, 1, cmd_reset_stats },
    { "set_bandwidth", 2, 2, cmd_set_bandwidth },
+   { "set_rxl_workers", 1, 1, cmd_set_rxl_workers, NULL },
+   { "show_rxl_workers", 0, 0, cmd_show_rxl_workers, NULL },
+   { "show_pkt_pool", 0, 0, cmd_show_pkt_pool, NULL },
    { "list", 0, 0, cmd_nio_list, NULL },
    { NULL, -1, -1, NULL, NULL },
 };
@@ -8,6 +8,9 @@
 #ifndef __HYPERVISOR_H__
 #define __HYPERVISOR_H__
 
+#include "parser.h"
+#include "hash.h"
+
 /* Default TCP port */
 #define HYPERVISOR_TCP_PORT 7200
 
@@ -17,6 +20,28 @@
 /* Maximum tokens per line */
 #define HYPERVISOR_MAX_TOKENS  16
 
+/* Maximum size of a command line chunk given to the tokenizer */
+#define HYPERVISOR_LINE_SIZE   512
+
+/* Size of the input buffer of a connection */
+#define HYPERVISOR_IN_BUF_SIZE 8192
+
+/* Pending replies above which commands of a connection are not read */
+#define HYPERVISOR_OUT_MAX     (256 * 1024)
+
+/* Maximum number of events handled per event loop iteration */
+#define HYPERVISOR_MAX_EVENTS  64
+
+/* Hash table sizes for modules and commands of a module */
+#define HYPERVISOR_MOD_HASH_SIZE  64
+#define HYPERVISOR_CMD_HASH_SIZE  256
+
+/* Maximum number of commands in a batch */
+#define HYPERVISOR_BATCH_MAX   8192
+
+/* Hash table size for the objects recorded before a batch */
+#define HYPERVISOR_BATCH_OBJ_HASH_SIZE  1024
+
 /* Hypervisor status codes */
 #define HSC_INFO_OK         100  /* ok */
 #define HSC_INFO_MSG        101  /* informative message */
@@ -41,14 +66,35 @@
 typedef struct hypervisor_conn hypervisor_conn_t;
 typedef struct hypervisor_cmd hypervisor_cmd_t;
 typedef struct hypervisor_module hypervisor_module_t;
+typedef struct hypervisor_batch_cmd hypervisor_batch_cmd_t;
+
+/* Command queued in a batch */
+struct hypervisor_batch_cmd {
+   int argc;
+   char **argv;
+   hypervisor_batch_cmd_t *next;
+};
 
 /* Hypervisor connection */
 struct hypervisor_conn {
-   pthread_t tid;                    /* Thread identifier */
-   volatile int active;              /* Connection is active ? */
+   int active;                       /* Connection is active ? */
    int client_fd;                    /* Client FD */
-   FILE *in,*out;                    /* I/O buffered streams */
+   parser_context_t ctx;             /* Tokenizer state */
+   char in_buf[HYPERVISOR_IN_BUF_SIZE]; /* Pending input */
+   size_t in_len;
+   char *out_buf;                    /* Pending replies */
+   size_t out_len,out_size;
+   int out_wait;                     /* Waiting for socket to be writable */
+   int in_wait;                      /* Waiting for commands */
    hypervisor_module_t *cur_module;  /* Module of current command */
+
+   /* Batch of commands (queued between batch_start and batch_end) */
+   int batch_active,batch_exec,batch_error;
+   hypervisor_batch_cmd_t *batch_head,**batch_tail;
+   u_int batch_count;
+   int batch_code;                   /* Status of current batch command */
+   char batch_msg[HYPERVISOR_LINE_SIZE]; /* Error of current batch command */
+
    hypervisor_conn_t *next,**pprev;
 };
 
@@ -69,6 +115,7 @@ struct hypervisor_module {
    char *name;
    void *opt;
    hypervisor_cmd_t *cmd_list;
+   hash_table_t *cmd_hash;
    hypervisor_module_t *next;
 };
 
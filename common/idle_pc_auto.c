@@ -0,0 +1,295 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Automatic idle PC: online detection of the idle loop of the guest, from
+ * the PC values seen at timer ticks.
+ *
+ * The PC is sampled at each timer tick taken by the CPU loop. A PC
+ * collecting a large share of the samples for several windows in a row is
+ * a candidate idle loop. It is applied as idle PC only if its code is a
+ * real spin loop without side effect, as checked by the CPU specific code:
+ * a short backward branch to the candidate, polling a fixed address or a
+ * system register, with no store out of the stack frame, no call and no
+ * system instruction. The idle PC is reverted if its code changes, if it
+ * is not reached anymore for some time (e.g. after a reload, or if the
+ * guest stays busy: it is detected again when the guest gets back to its
+ * idle loop), or if it keeps being reached while no IRQ is taken: the
+ * guest is then polling a device with IRQs masked, and putting it to 
+ * sleep would only delay it. Such a loop is not elected again.
+ *
+ * The host CPU use of the CPU thread is measured on each window, for
+ * statistics only: on a loaded host, a spinning CPU may not get a full core.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cpu.h"
+#include "get_cpu_time.h"
+#include "idle_pc_auto.h"
+
+/* Get the CPU time used by the current thread (usec) */
+static m_tmcnt_t idle_pc_auto_cpu_time(void)
+{
+   double t;
+
+   if ((t = get_thread_cpu_time(pthread_self())) < 0)
+      return(0);
+
+   return((m_tmcnt_t)(t * 1000000.0));
+}
+
+/* Start a new window */
+static void idle_pc_auto_reset_window(idle_pc_auto_t *ia)
+{
+   memset(ia->samples,0,sizeof(ia->samples));
+   ia->sample_count = 0;
+   ia->hits = 0;
+   ia->irqs = 0;
+   ia->start_time = m_gettime_usec();
+   ia->start_cpu_time = idle_pc_auto_cpu_time();
+}
+
+/* Go back to profiling */
+static void idle_pc_auto_profile(idle_pc_auto_t *ia)
+{
+   ia->state = IDLE_PC_AUTO_PROFILE;
+   ia->candidate = 0;
+   ia->confirm = 0;
+   idle_pc_auto_reset_window(ia);
+}
+
+/* Record a PC sample */
+static void idle_pc_auto_record(idle_pc_auto_t *ia,m_uint64_t pc)
+{
+   struct idle_pc_auto_sample *s;
+   u_int i,hash;
+
+   hash = (pc >> 2) & (IDLE_PC_AUTO_HASH_SIZE - 1);
+
+   /* Samples not fitting in the table are dropped */
+   for(i=0;i<8;i++) {
+      s = &ia->samples[(hash + i) & (IDLE_PC_AUTO_HASH_SIZE - 1)];
+
+      if (!s->count || (s->pc == pc)) {
+         s->pc = pc;
+         s->count++;
+         return;
+      }
+   }
+}
+
+/* Apply an idle PC */
+static void idle_pc_auto_apply(cpu_gen_t *cpu,idle_pc_auto_t *ia)
+{
+   m_uint32_t sum;
+
+   /* The code may have changed since the candidate was checked */
+   if ((cpu->idle_pc_check(cpu,ia->candidate,&sum) == -1) ||
+       (sum != ia->candidate_sum))
+   {
+      ia->candidate = 0;
+      ia->confirm = 0;
+      return;
+   }
+
+   cpu->set_idle_pc(cpu,ia->candidate);
+   cpu->idle_count = 0;
+
+   ia->state = IDLE_PC_AUTO_ACTIVE;
+   ia->idle_pc = ia->candidate;
+   ia->idle_sum = sum;
+   ia->stale = 0;
+   ia->no_irq = 0;
+   ia->applied++;
+
+   cpu_log(cpu,"IDLE_PC","idle PC 0x%llx applied (%u%% of host CPU).\n",
+           ia->idle_pc,ia->host_usage);
+}
+
+/* Revert the applied idle PC */
+static void idle_pc_auto_revert(cpu_gen_t *cpu,idle_pc_auto_t *ia,
+                                char *reason)
+{
+   cpu->set_idle_pc(cpu,0);
+   ia->reverted++;
+
+   cpu_log(cpu,"IDLE_PC","idle PC 0x%llx reverted (%s).\n",
+           ia->idle_pc,reason);
+
+   ia->idle_pc = 0;
+}
+
+/* End of a profiling window: elect a candidate */
+static void idle_pc_auto_elect(cpu_gen_t *cpu,idle_pc_auto_t *ia,
+                               m_uint64_t idle_pc)
+{
+   struct idle_pc_auto_sample *s,*best = NULL,*cur = NULL;
+   m_uint32_t sum;
+   u_int i,min;
+
+   /* Nothing to do with a user idle PC */
+   if (idle_pc) {
+      ia->confirm = 0;
+      return;
+   }
+
+   for(i=0;i<IDLE_PC_AUTO_HASH_SIZE;i++) {
+      s = &ia->samples[i];
+
+      if (!s->count)
+         continue;
+
+      if (!best || (s->count > best->count))
+         best = s;
+
+      if (s->pc == ia->candidate)
+         cur = s;
+   }
+
+   /* 
+    * An idle loop spanning several blocks shares the samples between them:
+    * the current candidate keeps its place while it gets enough samples.
+    */
+   min = (IDLE_PC_AUTO_MIN_SHARE * ia->sample_count) / 100;
+
+   if (cur && (cur->count >= min))
+      best = cur;
+
+   if (!best || (best->count < min) || (best->pc == ia->banned_pc)) {
+      ia->confirm = 0;
+      return;
+   }
+
+   /* New candidate: check its code once */
+   if (best->pc != ia->candidate) {
+      ia->candidate = best->pc;
+      ia->confirm = 0;
+
+      if (cpu->idle_pc_check(cpu,ia->candidate,&sum) == -1) {
+         cpu_log(cpu,"IDLE_PC","candidate 0x%llx rejected "
+                 "(not a spin loop or side effects).\n",ia->candidate);
+         ia->rejected++;
+         ia->candidate_sum = 0;
+         return;
+      }
+
+      ia->candidate_sum = sum;
+      ia->confirm = 1;
+   } else if (ia->confirm) {
+      ia->confirm++;
+   }
+
+   if (ia->confirm >= IDLE_PC_AUTO_CONFIRM)
+      idle_pc_auto_apply(cpu,ia);
+}
+
+/* End of a window with an applied idle PC: check it is still valid */
+static void idle_pc_auto_check(cpu_gen_t *cpu,idle_pc_auto_t *ia)
+{
+   m_uint32_t sum;
+
+   if ((cpu->idle_pc_check(cpu,ia->idle_pc,&sum) == -1) ||
+       (sum != ia->idle_sum))
+   {
+      idle_pc_auto_revert(cpu,ia,"code changed");
+      idle_pc_auto_profile(ia);
+      return;
+   }
+
+   if (ia->hits) {
+      ia->stale = 0;
+
+      /* The idle loop must be left on IRQs */
+      if (ia->irqs) {
+         ia->no_irq = 0;
+      } else if (++ia->no_irq >= IDLE_PC_AUTO_NO_IRQ) {
+         ia->banned_pc = ia->idle_pc;
+         idle_pc_auto_revert(cpu,ia,"not left on IRQ");
+         idle_pc_auto_profile(ia);
+      }
+      return;
+   }
+
+   if (++ia->stale >= IDLE_PC_AUTO_STALE) {
+      idle_pc_auto_revert(cpu,ia,"not reached anymore");
+      idle_pc_auto_profile(ia);
+   }
+}
+
+/*
+ * Sample the PC of a CPU at a timer tick. Called by the CPU thread, with
+ * the current idle PC of the CPU.
+ */
+void idle_pc_auto_tick(cpu_gen_t *cpu,m_uint64_t pc,m_uint64_t idle_pc)
+{
+   idle_pc_auto_t *ia = &cpu->idle_auto;
+   m_tmcnt_t wall,used;
+
+   if (likely(ia->state == IDLE_PC_AUTO_OFF)) {
+      if (likely(!ia->enabled) || !cpu->idle_pc_check)
+         return;
+
+      idle_pc_auto_profile(ia);
+   }
+
+   if (!ia->enabled) {
+      if (ia->state == IDLE_PC_AUTO_ACTIVE)
+         idle_pc_auto_revert(cpu,ia,"disabled");
+
+      ia->state = IDLE_PC_AUTO_OFF;
+      return;
+   }
+
+   /* The idle PC has been changed by the user */
+   if ((ia->state == IDLE_PC_AUTO_ACTIVE) && (idle_pc != ia->idle_pc)) {
+      cpu_log(cpu,"IDLE_PC","idle PC 0x%llx replaced by user.\n",ia->idle_pc);
+      ia->idle_pc = 0;
+      idle_pc_auto_profile(ia);
+      return;
+   }
+
+   if (ia->state == IDLE_PC_AUTO_ACTIVE) {
+      if (pc == ia->idle_pc)
+         ia->hits++;
+   } else {
+      idle_pc_auto_record(ia,pc);
+   }
+
+   if (++ia->sample_count < IDLE_PC_AUTO_WINDOW)
+      return;
+
+   /* Host CPU use of this CPU during the window */
+   wall = m_gettime_usec() - ia->start_time;
+   used = idle_pc_auto_cpu_time() - ia->start_cpu_time;
+
+   if (!ia->start_cpu_time || (used >= wall))
+      ia->host_usage = 100;
+   else
+      ia->host_usage = (used * 100) / wall;
+
+   if (ia->state == IDLE_PC_AUTO_ACTIVE)
+      idle_pc_auto_check(cpu,ia);
+   else
+      idle_pc_auto_elect(cpu,ia,idle_pc);
+
+   idle_pc_auto_reset_window(ia);
+}
+
+/* Get the name of an automatic idle PC state */
+char *idle_pc_auto_get_state_str(int state)
+{
+   switch(state) {
+      case IDLE_PC_AUTO_OFF:
+         return "off";
+      case IDLE_PC_AUTO_PROFILE:
+         return "profiling";
+      case IDLE_PC_AUTO_ACTIVE:
+         return "active";
+      default:
+         return "unknown";
+   }
+}
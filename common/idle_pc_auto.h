@@ -0,0 +1,93 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Automatic idle PC: online detection of the idle loop of the guest, from
+ * the PC values seen at timer ticks.
+ */
+
+#ifndef __IDLE_PC_AUTO_H__
+#define __IDLE_PC_AUTO_H__
+
+#include "utils.h"
+
+/* Profiling window (in timer ticks) */
+#define IDLE_PC_AUTO_WINDOW     256
+
+/* Size of the PC hash table (power of two) */
+#define IDLE_PC_AUTO_HASH_SIZE  64
+
+/* Minimum share of the samples (percent) for an idle PC candidate */
+#define IDLE_PC_AUTO_MIN_SHARE  25
+
+/* Windows in a row a candidate must win before being applied */
+#define IDLE_PC_AUTO_CONFIRM    2
+
+/* Windows without hit at the idle PC before reverting it */
+#define IDLE_PC_AUTO_STALE      8
+
+/* 
+ * Windows in a row where the idle PC is reached but no IRQ is taken 
+ * before reverting it: the loop is not left on an IRQ, the guest is 
+ * polling something and must not be put to sleep.
+ */
+#define IDLE_PC_AUTO_NO_IRQ     4
+
+/* Maximum number of instructions checked at an idle PC */
+#define IDLE_PC_AUTO_MAX_INSNS  32
+
+/* Automatic idle PC states */
+enum {
+   IDLE_PC_AUTO_OFF = 0,
+   IDLE_PC_AUTO_PROFILE,
+   IDLE_PC_AUTO_ACTIVE,
+};
+
+/* PC sample */
+struct idle_pc_auto_sample {
+   m_uint64_t pc;
+   u_int count;
+};
+
+/* Automatic idle PC state of a CPU */
+typedef struct idle_pc_auto idle_pc_auto_t;
+struct idle_pc_auto {
+   /* Requested by the user, state is only changed by the CPU thread */
+   volatile int enabled;
+   int state;
+
+   /* Candidate and number of windows it has won */
+   m_uint64_t candidate;
+   m_uint32_t candidate_sum;
+   u_int confirm;
+
+   /* Applied idle PC and checksum of its code */
+   m_uint64_t idle_pc;
+   m_uint32_t idle_sum;
+   u_int stale,no_irq;
+
+   /* Last idle PC reverted because it was not left on an IRQ */
+   m_uint64_t banned_pc;
+
+   /* Current window */
+   struct idle_pc_auto_sample samples[IDLE_PC_AUTO_HASH_SIZE];
+   u_int sample_count,hits;
+
+   /* IRQs taken during the window (counted by the CPU code) */
+   u_int irqs;
+   m_tmcnt_t start_time,start_cpu_time;
+
+   /* Host CPU use during the last window (percent) */
+   u_int host_usage;
+
+   /* Statistics */
+   u_int applied,reverted,rejected;
+};
+
+/* Sample the PC of a CPU at a timer tick */
+void idle_pc_auto_tick(cpu_gen_t *cpu,m_uint64_t pc,m_uint64_t idle_pc);
+
+/* Get the name of an automatic idle PC state */
+char *idle_pc_auto_get_state_str(int state);
+
+#endif
@@ -27,10 +27,12 @@
 #include <pthread.h>
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <netinet/if_ether.h>
 #include <linux/if.h>
 #include <linux/if_packet.h>
 
+#include "dynamips_common.h"
 #include "linux_eth.h"
 
 /* Get interface index of specified device */
@@ -116,3 +118,302 @@ ssize_t lnx_eth_recv(int sck,char *buffer,size_t len)
 {
    return(recv(sck,buffer,len,0));
 }
+
+/*
+ * =========================================================================
+ * Memory-mapped rings (TPACKET_V3)
+ * =========================================================================
+ */
+
+/* Offset of frame data in a TX ring frame */
+#define LNX_ETH_RING_TX_DATA_OFFSET \
+   TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+/* Create a raw socket with memory-mapped RX/TX rings */
+lnx_eth_ring_t *lnx_eth_ring_create(char *device)
+{
+   struct tpacket_req3 rx_req,tx_req;
+   lnx_eth_ring_t *r;
+   int version = TPACKET_V3;
+   size_t rx_size;
+
+   if (!(r = malloc(sizeof(*r))))
+      return NULL;
+
+   memset(r,0,sizeof(*r));
+
+   if ((r->fd = lnx_eth_init_socket(device)) == -1)
+      goto err_socket;
+
+   r->dev_id = lnx_eth_get_dev_index(device);
+
+   if (setsockopt(r->fd,SOL_PACKET,PACKET_VERSION,
+                  &version,sizeof(version)) == -1)
+   {
+      fprintf(stderr,"eth_ring_create: PACKET_VERSION: %s\n",strerror(errno));
+      goto err_ring;
+   }
+
+   /* RX ring: blocks are handed to user space when full or on timeout */
+   memset(&rx_req,0,sizeof(rx_req));
+   rx_req.tp_block_size = LNX_ETH_RING_BLOCK_SIZE;
+   rx_req.tp_block_nr   = LNX_ETH_RING_RX_BLOCKS;
+   rx_req.tp_frame_size = LNX_ETH_RING_TX_FRAME;
+   rx_req.tp_frame_nr   = (rx_req.tp_block_size * rx_req.tp_block_nr) /
+      rx_req.tp_frame_size;
+   rx_req.tp_retire_blk_tov = LNX_ETH_RING_RETIRE_TMO;
+
+   if (setsockopt(r->fd,SOL_PACKET,PACKET_RX_RING,
+                  &rx_req,sizeof(rx_req)) == -1)
+   {
+      fprintf(stderr,"eth_ring_create: PACKET_RX_RING: %s\n",strerror(errno));
+      goto err_ring;
+   }
+
+   /* TX ring: fixed-size frames */
+   memset(&tx_req,0,sizeof(tx_req));
+   tx_req.tp_block_size = LNX_ETH_RING_BLOCK_SIZE;
+   tx_req.tp_block_nr   = LNX_ETH_RING_TX_BLOCKS;
+   tx_req.tp_frame_size = LNX_ETH_RING_TX_FRAME;
+   tx_req.tp_frame_nr   = (tx_req.tp_block_size * tx_req.tp_block_nr) /
+      tx_req.tp_frame_size;
+
+   if (setsockopt(r->fd,SOL_PACKET,PACKET_TX_RING,
+                  &tx_req,sizeof(tx_req)) == -1)
+   {
+      fprintf(stderr,"eth_ring_create: PACKET_TX_RING: %s\n",strerror(errno));
+      goto err_ring;
+   }
+
+   /* Both rings are mapped with a single mmap(), RX ring first */
+   rx_size = rx_req.tp_block_size * rx_req.tp_block_nr;
+   r->map_size = rx_size + (tx_req.tp_block_size * tx_req.tp_block_nr);
+   r->map = mmap(NULL,r->map_size,PROT_READ|PROT_WRITE,
+                 MAP_SHARED|MAP_LOCKED,r->fd,0);
+
+   if (r->map == MAP_FAILED) {
+      /* MAP_LOCKED may fail due to RLIMIT_MEMLOCK */
+      r->map = mmap(NULL,r->map_size,PROT_READ|PROT_WRITE,
+                    MAP_SHARED,r->fd,0);
+   }
+
+   if (r->map == MAP_FAILED) {
+      fprintf(stderr,"eth_ring_create: mmap: %s\n",strerror(errno));
+      goto err_ring;
+   }
+
+   r->rx_ring = r->map;
+   r->tx_ring = r->map + rx_size;
+   r->tx_frame_nr = tx_req.tp_frame_nr;
+   r->ref_count = 1;
+   return r;
+
+ err_ring:
+   close(r->fd);
+ err_socket:
+   free(r);
+   return NULL;
+}
+
+/* Release a reference on the rings, free them with the last one */
+static void lnx_eth_ring_unref(lnx_eth_ring_t *r)
+{
+   if (__sync_sub_and_fetch(&r->ref_count,1) != 0)
+      return;
+
+   munmap(r->map,r->map_size);
+   close(r->fd);
+   free(r);
+}
+
+/* 
+ * Free a raw socket with memory-mapped rings. The rings are kept until
+ * the frames lent by reference are released.
+ */
+void lnx_eth_ring_free(lnx_eth_ring_t *r)
+{
+   if (r != NULL)
+      lnx_eth_ring_unref(r);
+}
+
+/* Ask the kernel to transmit the frames of the TX ring */
+static void lnx_eth_ring_kick(lnx_eth_ring_t *r)
+{
+   if ((sendto(r->fd,NULL,0,MSG_DONTWAIT,NULL,0) == -1) && (errno != EAGAIN))
+      fprintf(stderr,"eth_ring_kick: sendto: %s\n",strerror(errno));
+}
+
+/* 
+ * Send ethernet frames through the TX ring (single kick).
+ *
+ * Frames too large for a ring slot are sent with a regular sendto().
+ * Returns the number of frames sent (frames are dropped if the ring is full).
+ */
+int lnx_eth_ring_send(lnx_eth_ring_t *r,struct iovec *vec,u_int count)
+{
+   struct tpacket3_hdr *hdr;
+   u_int i,pending = 0;
+   int sent = 0;
+
+   for(i=0;i<count;i++) {
+      if (vec[i].iov_len > (LNX_ETH_RING_TX_FRAME - 
+                            LNX_ETH_RING_TX_DATA_OFFSET))
+      {
+         if (pending) {
+            lnx_eth_ring_kick(r);
+            pending = 0;
+         }
+
+         if (lnx_eth_send(r->fd,r->dev_id,vec[i].iov_base,vec[i].iov_len) > 0)
+            sent++;
+         continue;
+      }
+
+      hdr = (struct tpacket3_hdr *)
+         (r->tx_ring + (r->tx_frame * LNX_ETH_RING_TX_FRAME));
+
+      if (hdr->tp_status != TP_STATUS_AVAILABLE)
+         break;
+
+      memcpy((u_char *)hdr + LNX_ETH_RING_TX_DATA_OFFSET,
+             vec[i].iov_base,vec[i].iov_len);
+      hdr->tp_len = vec[i].iov_len;
+      hdr->tp_snaplen = vec[i].iov_len;
+      hdr->tp_next_offset = 0;
+      __sync_synchronize();
+      hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+      if (++r->tx_frame == r->tx_frame_nr)
+         r->tx_frame = 0;
+
+      pending++;
+      sent++;
+   }
+
+   if (pending)
+      lnx_eth_ring_kick(r);
+
+   return(sent);
+}
+
+/* 
+ * Release a reference on a RX block. The last one gives back the block 
+ * to the kernel: the block is marked as not busy only after that, so that
+ * the reader doesn't consume its old frames again.
+ */
+static void lnx_eth_ring_block_unref(lnx_eth_ring_t *r,u_int block)
+{
+   struct tpacket_block_desc *bd;
+
+   if (__sync_sub_and_fetch(&r->rx_refs[block],1) != 0)
+      return;
+
+   bd = (struct tpacket_block_desc *)
+      (r->rx_ring + (block * LNX_ETH_RING_BLOCK_SIZE));
+
+   __sync_synchronize();
+   bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+   __sync_synchronize();
+   r->rx_busy[block] = FALSE;
+}
+
+/* Release the reference of the reader on the current RX block */
+static void lnx_eth_ring_release_block(lnx_eth_ring_t *r)
+{
+   u_int block = r->rx_block;
+
+   r->rx_bd = NULL;
+   r->rx_left = 0;
+
+   if (++r->rx_block == LNX_ETH_RING_RX_BLOCKS)
+      r->rx_block = 0;
+
+   lnx_eth_ring_block_unref(r,block);
+}
+
+/* Get the next RX frames of the current block */
+static int lnx_eth_ring_recv_frames(lnx_eth_ring_t *r,struct iovec *vec,
+                                    u_int count)
+{
+   struct tpacket_block_desc *bd;
+   struct tpacket3_hdr *hdr;
+   u_int n = 0;
+
+   for(;;) {
+      /* Release the block consumed by the previous call */
+      if ((r->rx_bd != NULL) && !r->rx_left)
+         lnx_eth_ring_release_block(r);
+
+      if (r->rx_bd != NULL)
+         break;
+
+      /* Frames of this block are still lent by reference */
+      if (r->rx_busy[r->rx_block])
+         return(0);
+
+      bd = (struct tpacket_block_desc *)
+         (r->rx_ring + (r->rx_block * LNX_ETH_RING_BLOCK_SIZE));
+
+      if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+         return(0);
+
+      __sync_synchronize();
+      r->rx_busy[r->rx_block] = TRUE;
+      r->rx_refs[r->rx_block] = 1;
+      r->rx_bd   = bd;
+      r->rx_left = bd->hdr.bh1.num_pkts;
+      r->rx_hdr  = (u_char *)bd + bd->hdr.bh1.offset_to_first_pkt;
+
+      if (r->rx_left != 0)
+         break;
+   }
+
+   while((n < count) && (r->rx_left > 0)) {
+      hdr = r->rx_hdr;
+      vec[n].iov_base = (u_char *)hdr + hdr->tp_mac;
+      vec[n].iov_len  = hdr->tp_snaplen;
+      n++;
+
+      r->rx_hdr = (u_char *)hdr + hdr->tp_next_offset;
+      r->rx_left--;
+   }
+
+   return(n);
+}
+
+/* 
+ * Get received ethernet frames directly from the RX ring.
+ *
+ * The frames stay valid until the next call: the block they belong to is
+ * only given back to the kernel once fully consumed by the caller.
+ */
+int lnx_eth_ring_recv(lnx_eth_ring_t *r,struct iovec *vec,u_int count)
+{
+   return(lnx_eth_ring_recv_frames(r,vec,count));
+}
+
+/* 
+ * Get received ethernet frames by reference. The frames all belong to the
+ * returned block, and stay valid until they are released with 
+ * lnx_eth_ring_put_block() (once per frame), even after the next call.
+ */
+int lnx_eth_ring_recv_ref(lnx_eth_ring_t *r,struct iovec *vec,u_int count,
+                          u_int *block)
+{
+   int n;
+
+   if ((n = lnx_eth_ring_recv_frames(r,vec,count)) > 0) {
+      *block = r->rx_block;
+      __sync_fetch_and_add(&r->rx_refs[*block],n);
+      __sync_fetch_and_add(&r->ref_count,n);
+   }
+
+   return(n);
+}
+
+/* Release a frame obtained by reference */
+void lnx_eth_ring_put_block(lnx_eth_ring_t *r,u_int block)
+{
+   lnx_eth_ring_block_unref(r,block);
+   lnx_eth_ring_unref(r);
+}
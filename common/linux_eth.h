@@ -11,6 +11,39 @@
 #define __LINUX_ETH_H__  1
 
 #include <sys/types.h>
+#include <sys/uio.h>
+
+/* Memory-mapped packet rings (PACKET_RX_RING/PACKET_TX_RING, TPACKET_V3) */
+#define LNX_ETH_RING_BLOCK_SIZE   (1 << 17)
+#define LNX_ETH_RING_RX_BLOCKS    32
+#define LNX_ETH_RING_TX_BLOCKS    8
+#define LNX_ETH_RING_TX_FRAME     2048
+#define LNX_ETH_RING_RETIRE_TMO   1     /* RX block retire timeout (ms) */
+
+typedef struct lnx_eth_ring lnx_eth_ring_t;
+struct lnx_eth_ring {
+   int fd,dev_id;
+   u_char *map;
+   size_t map_size;
+
+   /* 
+    * RX ring: current block and next frame to read. A block goes back to
+    * the kernel when the frames lent by reference are all released (the 
+    * reader holds a reference on the current block).
+    */
+   u_char *rx_ring;
+   u_int rx_block,rx_left;
+   void *rx_bd,*rx_hdr;
+   volatile u_int rx_refs[LNX_ETH_RING_RX_BLOCKS];
+   volatile u_int rx_busy[LNX_ETH_RING_RX_BLOCKS];
+
+   /* Owner reference + frames lent by reference */
+   volatile u_int ref_count;
+
+   /* TX ring: next frame to fill */
+   u_char *tx_ring;
+   u_int tx_frame,tx_frame_nr;
+};
 
 /* Get interface index of specified device */
 int lnx_eth_get_dev_index(char *name);
@@ -24,4 +57,23 @@ ssize_t lnx_eth_send(int sck,int dev_id,char *buffer,size_t len);
 /* Receive an ethernet frame */
 ssize_t lnx_eth_recv(int sck,char *buffer,size_t len);
 
+/* Create a raw socket with memory-mapped RX/TX rings */
+lnx_eth_ring_t *lnx_eth_ring_create(char *device);
+
+/* Free a raw socket with memory-mapped rings */
+void lnx_eth_ring_free(lnx_eth_ring_t *r);
+
+/* Send ethernet frames through the TX ring (single kick) */
+int lnx_eth_ring_send(lnx_eth_ring_t *r,struct iovec *vec,u_int count);
+
+/* Get received ethernet frames directly from the RX ring */
+int lnx_eth_ring_recv(lnx_eth_ring_t *r,struct iovec *vec,u_int count);
+
+/* Get received ethernet frames by reference (all from the same block) */
+int lnx_eth_ring_recv_ref(lnx_eth_ring_t *r,struct iovec *vec,u_int count,
+                          u_int *block);
+
+/* Release a frame obtained by reference */
+void lnx_eth_ring_put_block(lnx_eth_ring_t *r,u_int block);
+
 #endif
@@ -32,6 +32,10 @@
 #ifdef __linux__
 #include <net/if.h>
 #include <linux/if_tun.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define NETIO_RXL_EPOLL  1
+#define NETIO_MMSG       1
 #endif
 
 #include "registry.h"
@@ -43,17 +47,17 @@
 /* Free a NetIO descriptor */
 static int netio_free(void *data,void *arg);
 
+/* Packet being handled by the RX listener of the current thread */
+static __thread netio_pkt_t *netio_rx_cur_pkt = NULL;
+
 /* NIO RX listener */
-static pthread_mutex_t netio_rxl_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t netio_rxq_mutex = PTHREAD_MUTEX_INITIALIZER;
-static struct netio_rx_listener *netio_rxl_list = NULL;
-static struct netio_rx_listener *netio_rxl_add_list = NULL;
-static netio_desc_t *netio_rxl_remove_list = NULL;
-static pthread_t netio_rxl_thread;
+static struct netio_rxl_worker netio_rxl_workers[NETIO_RXL_MAX_WORKERS];
+static u_int netio_rxl_worker_count = 0;
 static pthread_cond_t netio_rxl_cond;
 
-#define NETIO_RXL_LOCK()   pthread_mutex_lock(&netio_rxl_mutex);
-#define NETIO_RXL_UNLOCK() pthread_mutex_unlock(&netio_rxl_mutex);
+#define NETIO_RXL_LOCK(w)   pthread_mutex_lock(&(w)->lock);
+#define NETIO_RXL_UNLOCK(w) pthread_mutex_unlock(&(w)->lock);
 
 #define NETIO_RXQ_LOCK()   pthread_mutex_lock(&netio_rxq_mutex);
 #define NETIO_RXQ_UNLOCK() pthread_mutex_unlock(&netio_rxq_mutex);
@@ -184,14 +188,11 @@ void netio_save_config_all(FILE *fd)
    fprintf(fd,"\n");
 }
 
-/* Send a packet through a NetIO descriptor */
-ssize_t netio_send(netio_desc_t *nio,void *pkt,size_t len)
+/* Apply debugging, TX filters and statistics to an outgoing packet */
+static int netio_send_prepare(netio_desc_t *nio,void *pkt,size_t len)
 {
    int res;
 
-   if (!nio)
-      return(-1);
-
    if (nio->debug) {
       printf("NIO %s: sending a packet of %lu bytes:\n",nio->name,(u_long)len);
       mem_dump(stdout,pkt,len);
@@ -202,7 +203,7 @@ ssize_t netio_send(netio_desc_t *nio,void *pkt,size_t len)
       res = nio->tx_filter->pkt_handler(nio,pkt,len,nio->tx_filter_data);
 
       if (res <= 0)
-         return(-1);
+         return(FALSE);
    }
 
    /* Apply the bidirectional filter */
@@ -210,7 +211,7 @@ ssize_t netio_send(netio_desc_t *nio,void *pkt,size_t len)
       res = nio->both_filter->pkt_handler(nio,pkt,len,nio->both_filter_data);
 
       if (res == NETIO_FILTER_ACTION_DROP)
-         return(-1);
+         return(FALSE);
    }
 
    /* Update output statistics */
@@ -218,23 +219,14 @@ ssize_t netio_send(netio_desc_t *nio,void *pkt,size_t len)
    nio->stats_bytes_out += len;
 
    netio_update_bw_stat(nio,len);
-
-   return(nio->send(nio->dptr,pkt,len));
+   return(TRUE);
 }
 
-/* Receive a packet through a NetIO descriptor */
-ssize_t netio_recv(netio_desc_t *nio,void *pkt,size_t max_len)
+/* Apply debugging, RX filters and statistics to an incoming packet */
+static int netio_recv_process(netio_desc_t *nio,void *pkt,ssize_t len)
 {
-   ssize_t len;
    int res;
 
-   if (!nio)
-      return(-1);
-
-   /* Receive the packet */
-   if ((len = nio->recv(nio->dptr,pkt,max_len)) <= 0)
-      return(-1);
-
    if (nio->debug) {
       printf("NIO %s: receiving a packet of %ld bytes:\n",nio->name,(long)len);
       mem_dump(stdout,pkt,len);
@@ -245,7 +237,7 @@ ssize_t netio_recv(netio_desc_t *nio,void *pkt,size_t max_len)
       res = nio->rx_filter->pkt_handler(nio,pkt,len,nio->rx_filter_data);
 
       if (res == NETIO_FILTER_ACTION_DROP)
-         return(-1);
+         return(FALSE);
    }
 
    /* Apply the bidirectional filter */
@@ -253,15 +245,209 @@ ssize_t netio_recv(netio_desc_t *nio,void *pkt,size_t max_len)
       res = nio->both_filter->pkt_handler(nio,pkt,len,nio->both_filter_data);
 
       if (res == NETIO_FILTER_ACTION_DROP)
-         return(-1);
+         return(FALSE);
    }
 
    /* Update input statistics */
    nio->stats_pkts_in++;
    nio->stats_bytes_in += len;
+   return(TRUE);
+}
+
+/* Send a packet through a NetIO descriptor */
+ssize_t netio_send(netio_desc_t *nio,void *pkt,size_t len)
+{
+   netio_pkt_t *p;
+
+   if (!nio)
+      return(-1);
+
+   if (!netio_send_prepare(nio,pkt,len))
+      return(-1);
+
+   /* Forward the packet being received by reference if possible */
+   p = netio_rx_cur_pkt;
+
+   if (nio->send_pkt && p && (pkt == netio_pkt_data(p)) && (len == p->len))
+      return(nio->send_pkt(nio->dptr,p));
+
+   return(nio->send(nio->dptr,pkt,len));
+}
+
+/* Receive a packet through a NetIO descriptor */
+ssize_t netio_recv(netio_desc_t *nio,void *pkt,size_t max_len)
+{
+   ssize_t len;
+
+   if (!nio)
+      return(-1);
+
+   /* Receive the packet */
+   if ((len = nio->recv(nio->dptr,pkt,max_len)) <= 0)
+      return(-1);
+
+   if (!netio_recv_process(nio,pkt,len))
+      return(-1);
+
    return(len);
 }
 
+/* 
+ * Send a batch of packets through a NetIO descriptor.
+ *
+ * Returns the number of packets handed to the NIO driver.
+ */
+int netio_send_batch(netio_desc_t *nio,netio_pktvec_t *vec,u_int count)
+{
+   netio_pktvec_t out[NETIO_BATCH_MAX];
+   u_int i,n,k;
+   int res,sent = 0;
+
+   if (!nio)
+      return(-1);
+
+   for(;count>0;count-=n,vec+=n) {
+      n = m_min(count,NETIO_BATCH_MAX);
+
+      for(i=0,k=0;i<n;i++)
+         if (netio_send_prepare(nio,vec[i].pkt,vec[i].len))
+            out[k++] = vec[i];
+
+      if (!k)
+         continue;
+
+      if (nio->send_batch != NULL) {
+         res = nio->send_batch(nio->dptr,out,k);
+      } else {
+         for(res=0;res<k;res++)
+            if (nio->send(nio->dptr,out[res].pkt,out[res].len) < 0)
+               break;
+      }
+
+      if (res > 0)
+         sent += res;
+   }
+
+   return(sent);
+}
+
+/* 
+ * Receive a batch of packets through a NetIO descriptor.
+ *
+ * On input, each vector entry gives a buffer and its size. On output, the
+ * first entries describe the received packets (packets dropped by filters
+ * are removed). A driver may also point the entries to its own buffers
+ * (zero-copy), these stay valid until the next receive on the NIO.
+ * Only the first packet may block: without a batch method, the next
+ * packets are read with the non-blocking receive method of the NIO, if any.
+ *
+ * Returns the number of packets received.
+ */
+int netio_recv_batch(netio_desc_t *nio,netio_pktvec_t *vec,u_int count)
+{
+   ssize_t len;
+   int i,k,n;
+
+   if (!nio)
+      return(-1);
+
+   count = m_min(count,NETIO_BATCH_MAX);
+
+   if (nio->recv_batch != NULL) {
+      if ((n = nio->recv_batch(nio->dptr,vec,count)) <= 0)
+         return(0);
+   } else {
+      for(n=0;n<count;n++) {
+         if (!n)
+            len = nio->recv(nio->dptr,vec[n].pkt,vec[n].len);
+         else if (nio->recv_nowait != NULL)
+            len = nio->recv_nowait(nio->dptr,vec[n].pkt,vec[n].len);
+         else
+            break;
+
+         if (len <= 0)
+            break;
+
+         vec[n].len = len;
+      }
+   }
+
+   for(i=0,k=0;i<n;i++) {
+      if (!netio_recv_process(nio,vec[i].pkt,vec[i].len))
+         continue;
+
+      if (k != i)
+         vec[k] = vec[i];
+      k++;
+   }
+
+   return(k);
+}
+
+/* Receive a batch of packet buffers (NIO with a recv_pkt method) */
+static int netio_recv_pkt_batch(netio_desc_t *nio,netio_pkt_t **pkts,
+                                u_int count)
+{
+   int i,k,n;
+
+   if ((n = nio->recv_pkt(nio->dptr,pkts,count)) <= 0)
+      return(0);
+
+   for(i=0,k=0;i<n;i++) {
+      if (!netio_recv_process(nio,netio_pkt_data(pkts[i]),pkts[i]->len)) {
+         netio_pkt_release(pkts[i]);
+         continue;
+      }
+
+      pkts[k++] = pkts[i];
+   }
+
+   return(k);
+}
+
+/* Initialize a TX batch */
+int netio_tx_batch_init(netio_tx_batch_t *b,u_int max_count,size_t pkt_size)
+{
+   memset(b,0,sizeof(*b));
+   b->max_count = m_min(max_count,NETIO_BATCH_MAX);
+   b->pkt_size  = pkt_size;
+
+   if (!(b->buffer = malloc(b->max_count * pkt_size)))
+      return(-1);
+
+   return(0);
+}
+
+/* Free the resources used by a TX batch */
+void netio_tx_batch_free(netio_tx_batch_t *b)
+{
+   free(b->buffer);
+   b->buffer = NULL;
+   b->count = 0;
+}
+
+/* Get the buffer for the next packet of a TX batch (flush it if full) */
+u_char *netio_tx_batch_get_buffer(netio_desc_t *nio,netio_tx_batch_t *b)
+{
+   if (b->count == b->max_count)
+      netio_tx_batch_flush(nio,b);
+
+   return(b->buffer + (b->count * b->pkt_size));
+}
+
+/* Send all packets of a TX batch */
+int netio_tx_batch_flush(netio_desc_t *nio,netio_tx_batch_t *b)
+{
+   int res = 0;
+
+   if (b->count != 0) {
+      res = netio_send_batch(nio,b->vec,b->count);
+      b->count = 0;
+   }
+
+   return(res);
+}
+
 /* Get a NetIO FD */
 int netio_get_fd(netio_desc_t *nio)
 {
@@ -283,6 +469,9 @@ int netio_get_fd(netio_desc_t *nio)
       case NETIO_TYPE_UDP_AUTO:
          fd = nio->u.nid.fd;
          break;
+      case NETIO_TYPE_FIFO:
+         fd = nio->u.nfd.sig_fd[0];
+         break;
 #ifdef LINUX_ETH
       case NETIO_TYPE_LINUX_ETH:
          fd = nio->u.nled.fd;
@@ -375,6 +564,13 @@ static ssize_t netio_unix_recv(netio_unix_desc_t *nud,void *pkt,size_t max_len)
    return(recvfrom(nud->fd,pkt,max_len,0,NULL,NULL));
 }
 
+/* Receive a packet from an UNIX socket without blocking */
+static ssize_t netio_unix_recv_nowait(netio_unix_desc_t *nud,
+                                      void *pkt,size_t max_len)
+{
+   return(recvfrom(nud->fd,pkt,max_len,MSG_DONTWAIT,NULL,NULL));
+}
+
 /* Save the NIO configuration */
 static void netio_unix_save_cfg(netio_desc_t *nio,FILE *fd)
 {
@@ -399,6 +595,7 @@ netio_desc_t *netio_desc_create_unix(char *nio_name,char *local,char *remote)
    nio->type     = NETIO_TYPE_UNIX;
    nio->send     = (void *)netio_unix_send;
    nio->recv     = (void *)netio_unix_recv;
+   nio->recv_nowait = (void *)netio_unix_recv_nowait;
    nio->free     = (void *)netio_unix_free;
    nio->save_cfg = netio_unix_save_cfg;
    nio->dptr     = &nio->u.nud;
@@ -527,6 +724,13 @@ static ssize_t netio_vde_recv(netio_vde_desc_t *nvd,void *pkt,size_t max_len)
    return(recvfrom(nvd->data_fd,pkt,max_len,0,NULL,NULL));
 }
 
+/* Receive a packet from a VDE socket without blocking */
+static ssize_t netio_vde_recv_nowait(netio_vde_desc_t *nvd,
+                                     void *pkt,size_t max_len)
+{
+   return(recvfrom(nvd->data_fd,pkt,max_len,MSG_DONTWAIT,NULL,NULL));
+}
+
 /* Save the NIO configuration */
 static void netio_vde_save_cfg(netio_desc_t *nio,FILE *fd)
 {
@@ -554,6 +758,7 @@ netio_desc_t *netio_desc_create_vde(char *nio_name,char *control,char *local)
    nio->type     = NETIO_TYPE_VDE;
    nio->send     = (void *)netio_vde_send;
    nio->recv     = (void *)netio_vde_recv;
+   nio->recv_nowait = (void *)netio_vde_recv_nowait;
    nio->free     = (void *)netio_vde_free;
    nio->save_cfg = netio_vde_save_cfg;
    nio->dptr     = &nio->u.nvd;
@@ -919,6 +1124,61 @@ static ssize_t netio_udp_recv(netio_inet_desc_t *nid,void *pkt,size_t max_len)
    return(recvfrom(nid->fd,pkt,max_len,0,NULL,NULL));
 }
 
+/* Receive a packet from an UDP socket without blocking */
+static ssize_t netio_udp_recv_nowait(netio_inet_desc_t *nid,
+                                     void *pkt,size_t max_len)
+{
+   return(recvfrom(nid->fd,pkt,max_len,MSG_DONTWAIT,NULL,NULL));
+}
+
+#ifdef NETIO_MMSG
+/* Send a batch of packets to an UDP socket */
+static int netio_udp_send_batch(netio_inet_desc_t *nid,
+                                netio_pktvec_t *vec,u_int count)
+{
+   struct mmsghdr msg[NETIO_BATCH_MAX];
+   struct iovec iov[NETIO_BATCH_MAX];
+   u_int i;
+
+   memset(msg,0,count * sizeof(msg[0]));
+
+   for(i=0;i<count;i++) {
+      iov[i].iov_base = vec[i].pkt;
+      iov[i].iov_len  = vec[i].len;
+      msg[i].msg_hdr.msg_iov = &iov[i];
+      msg[i].msg_hdr.msg_iovlen = 1;
+   }
+
+   return(sendmmsg(nid->fd,msg,count,0));
+}
+
+/* Receive a batch of packets from an UDP socket */
+static int netio_udp_recv_batch(netio_inet_desc_t *nid,
+                                netio_pktvec_t *vec,u_int count)
+{
+   struct mmsghdr msg[NETIO_BATCH_MAX];
+   struct iovec iov[NETIO_BATCH_MAX];
+   int i,res;
+
+   memset(msg,0,count * sizeof(msg[0]));
+
+   for(i=0;i<count;i++) {
+      iov[i].iov_base = vec[i].pkt;
+      iov[i].iov_len  = vec[i].len;
+      msg[i].msg_hdr.msg_iov = &iov[i];
+      msg[i].msg_hdr.msg_iovlen = 1;
+   }
+
+   if ((res = recvmmsg(nid->fd,msg,count,MSG_WAITFORONE,NULL)) <= 0)
+      return(res);
+
+   for(i=0;i<res;i++)
+      vec[i].len = msg[i].msg_len;
+
+   return(res);
+}
+#endif
+
 /* Save the NIO configuration */
 static void netio_udp_save_cfg(netio_desc_t *nio,FILE *fd)
 {
@@ -955,6 +1215,11 @@ netio_desc_t *netio_desc_create_udp(char *nio_name,int local_port,
    nio->type     = NETIO_TYPE_UDP;
    nio->send     = (void *)netio_udp_send;
    nio->recv     = (void *)netio_udp_recv;
+   nio->recv_nowait = (void *)netio_udp_recv_nowait;
+#ifdef NETIO_MMSG
+   nio->send_batch = (void *)netio_udp_send_batch;
+   nio->recv_batch = (void *)netio_udp_recv_batch;
+#endif
    nio->free     = (void *)netio_udp_free;
    nio->save_cfg = netio_udp_save_cfg;
    nio->dptr     = &nio->u.nid;
@@ -1037,6 +1302,11 @@ netio_desc_t *netio_desc_create_udp_auto(char *nio_name,char *local_addr,
    nio->type     = NETIO_TYPE_UDP_AUTO;
    nio->send     = (void *)netio_udp_send;
    nio->recv     = (void *)netio_udp_recv;
+   nio->recv_nowait = (void *)netio_udp_recv_nowait;
+#ifdef NETIO_MMSG
+   nio->send_batch = (void *)netio_udp_send_batch;
+   nio->recv_batch = (void *)netio_udp_recv_batch;
+#endif
    nio->free     = (void *)netio_udp_free;
    nio->save_cfg = netio_udp_save_cfg;
    nio->dptr     = &nio->u.nid;
@@ -1060,7 +1330,9 @@ error:
 /* Free a NetIO raw ethernet descriptor */
 static void netio_lnxeth_free(netio_lnxeth_desc_t *nled)
 {
-   if (nled->fd != -1) 
+   if (nled->ring != NULL)
+      lnx_eth_ring_free(nled->ring);
+   else if (nled->fd != -1) 
       close(nled->fd);
 }
 
@@ -1078,15 +1350,121 @@ static ssize_t netio_lnxeth_recv(netio_lnxeth_desc_t *nled,
    return(lnx_eth_recv(nled->fd,pkt,max_len));
 }
 
+/* Receive a packet from an raw Ethernet socket without blocking */
+static ssize_t netio_lnxeth_recv_nowait(netio_lnxeth_desc_t *nled,
+                                        void *pkt,size_t max_len)
+{
+   return(recv(nled->fd,pkt,max_len,MSG_DONTWAIT));
+}
+
+/* Send a packet through the TX ring */
+static ssize_t netio_lnxeth_ring_send(netio_lnxeth_desc_t *nled,
+                                      void *pkt,size_t pkt_len)
+{
+   struct iovec iov;
+
+   iov.iov_base = pkt;
+   iov.iov_len  = pkt_len;
+
+   if (lnx_eth_ring_send(nled->ring,&iov,1) != 1)
+      return(-1);
+
+   return(pkt_len);
+}
+
+/* Receive a packet from the RX ring (copy) */
+static ssize_t netio_lnxeth_ring_recv(netio_lnxeth_desc_t *nled,
+                                      void *pkt,size_t max_len)
+{
+   struct iovec iov;
+   size_t len;
+
+   if (lnx_eth_ring_recv(nled->ring,&iov,1) != 1)
+      return(-1);
+
+   len = m_min(iov.iov_len,max_len);
+   memcpy(pkt,iov.iov_base,len);
+   return(len);
+}
+
+/* Send a batch of packets through the TX ring */
+static int netio_lnxeth_ring_send_batch(netio_lnxeth_desc_t *nled,
+                                        netio_pktvec_t *vec,u_int count)
+{
+   struct iovec iov[NETIO_BATCH_MAX];
+   u_int i;
+
+   for(i=0;i<count;i++) {
+      iov[i].iov_base = vec[i].pkt;
+      iov[i].iov_len  = vec[i].len;
+   }
+
+   return(lnx_eth_ring_send(nled->ring,iov,count));
+}
+
+/* Receive a batch of packets from the RX ring (zero-copy) */
+static int netio_lnxeth_ring_recv_batch(netio_lnxeth_desc_t *nled,
+                                        netio_pktvec_t *vec,u_int count)
+{
+   struct iovec iov[NETIO_BATCH_MAX];
+   int i,res;
+
+   res = lnx_eth_ring_recv(nled->ring,iov,count);
+
+   for(i=0;i<res;i++) {
+      vec[i].pkt = iov[i].iov_base;
+      vec[i].len = iov[i].iov_len;
+   }
+
+   return(res);
+}
+
+/* Give back a RX ring frame lent to a packet buffer */
+static void netio_lnxeth_ring_put_frame(void *arg,u_int block)
+{
+   lnx_eth_ring_put_block(arg,block);
+}
+
+/* Receive a batch of packet buffers from the RX ring (by reference) */
+static int netio_lnxeth_ring_recv_pkt(netio_lnxeth_desc_t *nled,
+                                      netio_pkt_t **pkts,u_int count)
+{
+   struct iovec iov[NETIO_BATCH_MAX];
+   u_int block;
+   int i,k,res;
+
+   res = lnx_eth_ring_recv_ref(nled->ring,iov,m_min(count,NETIO_BATCH_MAX),
+                               &block);
+
+   for(i=0,k=0;i<res;i++) {
+      pkts[k] = netio_pkt_alloc_ext(iov[i].iov_base,iov[i].iov_len,
+                                    netio_lnxeth_ring_put_frame,
+                                    nled->ring,block);
+
+      /* Drop the frame if no header is available */
+      if (!pkts[k]) {
+         lnx_eth_ring_put_block(nled->ring,block);
+         continue;
+      }
+
+      k++;
+   }
+
+   return(k);
+}
+
 /* Save the NIO configuration */
 static void netio_lnxeth_save_cfg(netio_desc_t *nio,FILE *fd)
 {
    netio_lnxeth_desc_t *nled = nio->dptr;
-   fprintf(fd,"nio create_linux_eth %s %s\n",nio->name,nled->dev_name);
+
+   fprintf(fd,"nio create_linux_eth%s %s %s\n",
+           (nled->ring != NULL) ? "_ring" : "",nio->name,nled->dev_name);
 }
 
 /* Create a new NetIO descriptor with raw Ethernet method */
-netio_desc_t *netio_desc_create_lnxeth(char *nio_name,char *dev_name)
+static netio_desc_t *netio_lnxeth_create(char *nio_name,char *dev_name,
+                                         int use_ring)
 {
    netio_lnxeth_desc_t *nled;
    netio_desc_t *nio;
@@ -1105,7 +1483,17 @@ netio_desc_t *netio_desc_create_lnxeth(char *nio_name,char *dev_name)
 
    strcpy(nled->dev_name,dev_name);
 
-   nled->fd = lnx_eth_init_socket(dev_name);
+   if (use_ring) {
+      if (!(nled->ring = lnx_eth_ring_create(dev_name))) {
+         netio_free(nio,NULL);
+         return NULL;
+      }
+
+      nled->fd = nled->ring->fd;
+   } else {
+      nled->fd = lnx_eth_init_socket(dev_name);
+   }
+
    nled->dev_id = lnx_eth_get_dev_index(dev_name);
 
    if (nled->fd < 0) {
@@ -1114,12 +1502,22 @@ netio_desc_t *netio_desc_create_lnxeth(char *nio_name,char *dev_name)
    }
 
    nio->type     = NETIO_TYPE_LINUX_ETH;
-   nio->send     = (void *)netio_lnxeth_send;
-   nio->recv     = (void *)netio_lnxeth_recv;
    nio->free     = (void *)netio_lnxeth_free;
    nio->save_cfg = netio_lnxeth_save_cfg;
    nio->dptr     = &nio->u.nled;
 
+   if (use_ring) {
+      nio->send       = (void *)netio_lnxeth_ring_send;
+      nio->recv       = (void *)netio_lnxeth_ring_recv;
+      nio->send_batch = (void *)netio_lnxeth_ring_send_batch;
+      nio->recv_batch = (void *)netio_lnxeth_ring_recv_batch;
+      nio->recv_pkt   = (void *)netio_lnxeth_ring_recv_pkt;
+   } else {
+      nio->send       = (void *)netio_lnxeth_send;
+      nio->recv       = (void *)netio_lnxeth_recv;
+      nio->recv_nowait = (void *)netio_lnxeth_recv_nowait;
+   }
+
    if (netio_record(nio) == -1) {
       netio_free(nio,NULL);
       return NULL;
@@ -1127,6 +1525,18 @@ netio_desc_t *netio_desc_create_lnxeth(char *nio_name,char *dev_name)
 
    return nio;
 }
+
+/* Create a new NetIO descriptor with raw Ethernet method */
+netio_desc_t *netio_desc_create_lnxeth(char *nio_name,char *dev_name)
+{
+   return(netio_lnxeth_create(nio_name,dev_name,FALSE));
+}
+
+/* Create a new NetIO descriptor with raw Ethernet method (mmap'ed rings) */
+netio_desc_t *netio_desc_create_lnxeth_ring(char *nio_name,char *dev_name)
+{
+   return(netio_lnxeth_create(nio_name,dev_name,TRUE));
+}
 #endif /* LINUX_ETH */
 
 /*
@@ -1209,53 +1619,78 @@ netio_desc_t *netio_desc_create_geneth(char *nio_name,char *dev_name)
  * =========================================================================
  */
 
-/* Extract the first packet of the FIFO */
-static netio_fifo_pkt_t *netio_fifo_extract_pkt(netio_fifo_desc_t *nfd)
-{ 
-   netio_fifo_pkt_t *p;
-      
-   if (!(p = nfd->head))
-      return NULL;
+/* 
+ * Each FIFO NIO owns a preallocated SPSC ring of packet buffers, filled by 
+ * its endpoint (under the endpoint lock, which serializes the producers) 
+ * and drained by the RX listener. The consumer is woken up through an 
+ * eventfd (a pipe on other systems) which is only signaled when the ring 
+ * was empty.
+ */
 
-   nfd->pkt_count--;
-   nfd->head = p->next;
+/* Create the FIFO wakeup descriptor */
+static int netio_fifo_create_sig(netio_fifo_desc_t *nfd)
+{
+#ifdef __linux__
+   if ((nfd->sig_fd[0] = eventfd(0,EFD_NONBLOCK)) == -1)
+      return(-1);
 
-   if (!nfd->head)
-      nfd->last = NULL;
+   nfd->sig_fd[1] = nfd->sig_fd[0];
+#else
+   if (pipe(nfd->sig_fd) == -1)
+      return(-1);
 
-   return p;
+   fcntl(nfd->sig_fd[0],F_SETFL,fcntl(nfd->sig_fd[0],F_GETFL) | O_NONBLOCK);
+   fcntl(nfd->sig_fd[1],F_SETFL,fcntl(nfd->sig_fd[1],F_GETFL) | O_NONBLOCK);
+#endif
+   return(0);
 }
 
-/* Insert a packet into the FIFO (in tail) */
-static void netio_fifo_insert_pkt(netio_fifo_desc_t *nfd,netio_fifo_pkt_t *p)
-{   
-   pthread_mutex_lock(&nfd->lock);
+/* Close the FIFO wakeup descriptor */
+static void netio_fifo_close_sig(netio_fifo_desc_t *nfd)
+{
+   if (nfd->sig_fd[1] != nfd->sig_fd[0])
+      close(nfd->sig_fd[1]);
 
-   nfd->pkt_count++;
-   p->next = NULL;
+   close(nfd->sig_fd[0]);
+}
 
-   if (nfd->last) {
-      nfd->last->next = p;
-   } else {
-      nfd->head = p;
-   }
+/* Signal the FIFO consumer */
+static void netio_fifo_signal(netio_fifo_desc_t *nfd)
+{
+#ifdef __linux__
+   eventfd_write(nfd->sig_fd[1],1);
+#else
+   char c = 0;
+   ssize_t res;
 
-   nfd->last = p;
-   pthread_mutex_unlock(&nfd->lock);
+   res = write(nfd->sig_fd[1],&c,1);
+   (void)res;
+#endif
 }
 
-/* Free the packet list */
-static void netio_fifo_free_pkt_list(netio_fifo_desc_t *nfd)
+/* Acknowledge a FIFO wakeup */
+static void netio_fifo_ack(netio_fifo_desc_t *nfd)
 {
-   netio_fifo_pkt_t *p,*next;
-   
-   for(p=nfd->head;p;p=next) {
-      next = p->next;
-      free(p);
-   }
+#ifdef __linux__
+   eventfd_t val;
+   eventfd_read(nfd->sig_fd[0],&val);
+#else
+   char buf[64];
+
+   while(read(nfd->sig_fd[0],buf,sizeof(buf)) > 0)
+      ;
+#endif
+}
+
+/* Free the packets still present in a FIFO ring */
+static void netio_fifo_free_ring(netio_fifo_ring_t *r)
+{
+   u_int i;
+
+   for(i=r->tail;i!=r->head;i++)
+      netio_pkt_release(r->slot[i & (NETIO_FIFO_RING_SIZE-1)]);
 
-   nfd->head = nfd->last = NULL;
-   nfd->pkt_count = 0;
+   free(r);
 }
 
 /* Establish a cross-connect between two FIFO NetIO */
@@ -1271,18 +1706,12 @@ int netio_fifo_crossconnect(netio_desc_t *a,netio_desc_t *b)
 
    /* A => B */
    pthread_mutex_lock(&pa->endpoint_lock);
-   pthread_mutex_lock(&pa->lock);
    pa->endpoint = pb;
-   netio_fifo_free_pkt_list(pa);
-   pthread_mutex_unlock(&pa->lock);
    pthread_mutex_unlock(&pa->endpoint_lock);
 
    /* B => A */
    pthread_mutex_lock(&pb->endpoint_lock);
-   pthread_mutex_lock(&pb->lock);
    pb->endpoint = pa;
-   netio_fifo_free_pkt_list(pb);
-   pthread_mutex_unlock(&pb->lock);
    pthread_mutex_unlock(&pb->endpoint_lock);
    return(0);
 }
@@ -1301,66 +1730,149 @@ static void netio_fifo_free(netio_fifo_desc_t *nfd)
    if (nfd->endpoint)
       netio_fifo_unbind_endpoint(nfd->endpoint);
 
-   netio_fifo_free_pkt_list(nfd);
-   pthread_mutex_destroy(&nfd->lock);
-   pthread_cond_destroy(&nfd->cond);
+   netio_fifo_free_ring(nfd->ring);
+   netio_fifo_close_sig(nfd);
+   pthread_mutex_destroy(&nfd->endpoint_lock);
 }
 
-/* Send a packet (to the endpoint FIFO) */
-static ssize_t netio_fifo_send(netio_fifo_desc_t *nfd,void *pkt,size_t pkt_len)
+/* Queue a packet buffer on the endpoint FIFO (endpoint lock held) */
+static int netio_fifo_push(netio_fifo_desc_t *nfd,netio_pkt_t *p)
 {
-   netio_fifo_pkt_t *p;
-   size_t len;
-
-   pthread_mutex_lock(&nfd->endpoint_lock);
+   netio_fifo_desc_t *ep;
+   netio_fifo_ring_t *r;
+   u_int head;
 
    /* The cross-connect must have been established before */
-   if (!nfd->endpoint)
-      goto error;
+   if (!(ep = nfd->endpoint))
+      return(-1);
 
-   /* Allocate a a new packet and insert it into the endpoint FIFO */
-   len = sizeof(netio_fifo_pkt_t) + pkt_len;
-   if (!(p = malloc(len)))
-      goto error;
+   r = ep->ring;
+   head = r->head;
+
+   /* Ring is full: drop the packet */
+   if ((head - r->tail) >= NETIO_FIFO_RING_SIZE)
+      return(-1);
+
+   r->slot[head & (NETIO_FIFO_RING_SIZE-1)] = p;
+
+   /* Publish the slot, then wake up the consumer if the ring was empty */
+   __sync_synchronize();
+   r->head = head + 1;
+   __sync_synchronize();
+
+   if (r->tail == head)
+      netio_fifo_signal(ep);
+
+   return(0);
+}
 
-   memcpy(p->pkt,pkt,pkt_len);
-   p->pkt_len = pkt_len;
-   netio_fifo_insert_pkt(nfd->endpoint,p);
-   pthread_cond_signal(&nfd->endpoint->cond);
+/* Send a packet (to the endpoint FIFO) */
+static ssize_t netio_fifo_send(netio_fifo_desc_t *nfd,void *pkt,size_t pkt_len)
+{
+   netio_pkt_t *p;
+   int res;
+
+   if (!(p = netio_pkt_dup(pkt,pkt_len)))
+      return(-1);
+
+   pthread_mutex_lock(&nfd->endpoint_lock);
+   res = netio_fifo_push(nfd,p);
    pthread_mutex_unlock(&nfd->endpoint_lock);
+
+   if (res == -1) {
+      netio_pkt_release(p);
+      return(-1);
+   }
+
    return(pkt_len);
+}
 
- error:
+/* Send a packet buffer by reference (to the endpoint FIFO) */
+static int netio_fifo_send_pkt(netio_fifo_desc_t *nfd,netio_pkt_t *p)
+{
+   int res;
+
+   netio_pkt_ref(p);
+
+   pthread_mutex_lock(&nfd->endpoint_lock);
+   res = netio_fifo_push(nfd,p);
    pthread_mutex_unlock(&nfd->endpoint_lock);
-   return(-1);
+
+   if (res == -1) {
+      netio_pkt_release(p);
+      return(-1);
+   }
+
+   return(p->len);
 }
 
-/* Read a packet from the local FIFO queue */
-static ssize_t netio_fifo_recv(netio_fifo_desc_t *nfd,void *pkt,size_t max_len)
+/* Extract a packet buffer from the local FIFO ring */
+static netio_pkt_t *netio_fifo_extract_pkt(netio_fifo_desc_t *nfd)
+{
+   netio_fifo_ring_t *r = nfd->ring;
+   u_int tail = r->tail;
+   netio_pkt_t *p;
+
+   if (tail == r->head)
+      return NULL;
+
+   __sync_synchronize();
+   p = r->slot[tail & (NETIO_FIFO_RING_SIZE-1)];
+
+   /* Release the slot before the head is checked again */
+   __sync_synchronize();
+   r->tail = tail + 1;
+   __sync_synchronize();
+   return p;
+}
+
+/* Read a batch of packet buffers from the local FIFO ring */
+static int netio_fifo_recv_pkt(netio_fifo_desc_t *nfd,
+                               netio_pkt_t **pkts,u_int count)
 {
-   struct timespec ts; 
-   m_tmcnt_t expire;
-   netio_fifo_pkt_t *p;
-   size_t len = -1;
+   netio_pkt_t *p;
+   u_int n;
 
-   /* Wait for the endpoint to signal a new arriving packet */
-   expire = m_gettime_usec() + 50000;
-   ts.tv_sec = expire / 1000000;
-   ts.tv_nsec = (expire % 1000000) * 1000;
+   netio_fifo_ack(nfd);
 
-   pthread_mutex_lock(&nfd->lock);
-   pthread_cond_timedwait(&nfd->cond,&nfd->lock,&ts);
+   for(n=0;n<count;n++) {
+      if (!(p = netio_fifo_extract_pkt(nfd)))
+         break;
 
-   /* Extract a packet from the list */
-   p = netio_fifo_extract_pkt(nfd);
-   pthread_mutex_unlock(&nfd->lock);
+      /* 
+       * The receiver may modify the packet: take a private copy if 
+       * the buffer is still referenced by another NIO.
+       */
+      if (netio_pkt_shared(p)) {
+         pkts[n] = netio_pkt_dup(netio_pkt_data(p),p->len);
+         netio_pkt_release(p);
 
-   if (p) {
-      len = m_min(p->pkt_len,max_len);
-      memcpy(pkt,p->pkt,len);
-      free(p);
+         if (!pkts[n])
+            break;
+      } else {
+         pkts[n] = p;
+      }
    }
-   
+
+   /* Packets are still pending: make sure we'll be woken up again */
+   if (nfd->ring->tail != nfd->ring->head)
+      netio_fifo_signal(nfd);
+
+   return(n);
+}
+
+/* Read a packet from the local FIFO ring */
+static ssize_t netio_fifo_recv(netio_fifo_desc_t *nfd,void *pkt,size_t max_len)
+{
+   netio_pkt_t *p;
+   size_t len;
+
+   if (netio_fifo_recv_pkt(nfd,&p,1) != 1)
+      return(-1);
+
+   len = m_min(p->len,max_len);
+   memcpy(pkt,netio_pkt_data(p),len);
+   netio_pkt_release(p);
    return(len);
 }
 
@@ -1374,13 +1886,29 @@ netio_desc_t *netio_desc_create_fifo(char *nio_name)
       return NULL;
 
    nfd = &nio->u.nfd;
-   pthread_mutex_init(&nfd->lock,NULL);
+
+   if (!(nfd->ring = m_memalign(NETIO_CACHE_LINE,sizeof(netio_fifo_ring_t)))) {
+      fprintf(stderr,"netio_desc_create_fifo: unable to allocate ring.\n");
+      netio_free(nio,NULL);
+      return NULL;
+   }
+
+   memset(nfd->ring,0,sizeof(netio_fifo_ring_t));
+
+   if (netio_fifo_create_sig(nfd) == -1) {
+      perror("netio_desc_create_fifo: wakeup fd");
+      free(nfd->ring);
+      netio_free(nio,NULL);
+      return NULL;
+   }
+
    pthread_mutex_init(&nfd->endpoint_lock,NULL);
-   pthread_cond_init(&nfd->cond,NULL);
 
    nio->type = NETIO_TYPE_FIFO;
    nio->send = (void *)netio_fifo_send;
    nio->recv = (void *)netio_fifo_recv;
+   nio->send_pkt = (void *)netio_fifo_send_pkt;
+   nio->recv_pkt = (void *)netio_fifo_recv_pkt;
    nio->free = (void *)netio_fifo_free;
    nio->dptr = nfd;
 
@@ -1485,11 +2013,16 @@ void netio_update_bw_stat(netio_desc_t *nio,m_uint64_t bytes)
    nio->bw_cnt_total += bytes;
 }
 
-/* Reset NIO bandwidth counter */
+/* 
+ * Reset NIO bandwidth counter. This is called on each TX ring scan, 
+ * which occurs at a variable rate (adaptive polling).
+ */
 void netio_clear_bw_stat(netio_desc_t *nio)
 {
-   if (++nio->bw_ptask_cnt == (NETIO_BW_SAMPLE_ITV / ptask_sleep_time)) {
-      nio->bw_ptask_cnt = 0;
+   m_tmcnt_t now = m_gettime();
+
+   if ((now - nio->bw_sample_time) >= NETIO_BW_SAMPLE_ITV) {
+      nio->bw_sample_time = now;
 
       if (++nio->bw_pos == NETIO_BW_SAMPLES)
          nio->bw_pos = 0;
@@ -1512,24 +2045,80 @@ void netio_set_bandwidth(netio_desc_t *nio,u_int bandwidth)
  */
 
 /* Find a RX listener */
-static inline struct netio_rx_listener *netio_rxl_find(netio_desc_t *nio)
+static inline struct netio_rx_listener *
+netio_rxl_find(struct netio_rxl_worker *w,netio_desc_t *nio)
 {
    struct netio_rx_listener *rxl;
 
-   for(rxl=netio_rxl_list;rxl;rxl=rxl->next)
+   for(rxl=w->list;rxl;rxl=rxl->next)
       if (rxl->nio == nio)
          return rxl;
 
    return NULL;
 }
 
+/* NIO able to receive a burst without blocking after the first packet */
+static int netio_rxl_can_drain(netio_desc_t *nio)
+{
+   return((nio->recv_batch != NULL) || (nio->recv_pkt != NULL) ||
+          (nio->recv_nowait != NULL));
+}
+
+/* Wake up a RX listener worker */
+static void netio_rxl_worker_kick(struct netio_rxl_worker *w)
+{
+   char c = 0;
+
+   if (write(w->ctl_fd[1],&c,sizeof(c)) == -1 && errno != EAGAIN)
+      perror("netio_rxl_worker_kick: write");
+}
+
+/* Flush the wakeup pipe of a RX listener worker */
+static void netio_rxl_worker_ack(struct netio_rxl_worker *w)
+{
+   char buf[64];
+
+   while(read(w->ctl_fd[0],buf,sizeof(buf)) > 0)
+      ;
+}
+
+/* Free a RX listener */
+static void netio_rxl_free(struct netio_rx_listener *rxl)
+{
+   pthread_cond_destroy(&rxl->pause_cond);
+   pthread_mutex_destroy(&rxl->pause_lock);
+   free(rxl);
+}
+
+/* Poll the FD of a RX listener */
+static void netio_rxl_poll_fd(struct netio_rxl_worker *w,
+                              struct netio_rx_listener *rxl,int fd)
+{
+#ifdef NETIO_RXL_EPOLL
+   struct epoll_event ev;
+
+   memset(&ev,0,sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.ptr = rxl;
+
+   if (epoll_ctl(w->epoll_fd,EPOLL_CTL_ADD,fd,&ev) == -1)
+      perror("netio_rxl_poll_fd: epoll_ctl");
+#else
+   if (fd >= FD_SETSIZE) {
+      fprintf(stderr,"netio_rxl_poll_fd: NIO %s: FD %d exceeds "
+              "FD_SETSIZE, it won't be polled.\n",rxl->nio->name,fd);
+   }
+#endif
+}
+
 /* Remove a NIO from the listener list */
-static int netio_rxl_remove_internal(netio_desc_t *nio)
+static int netio_rxl_remove_internal(struct netio_rxl_worker *w,
+                                     netio_desc_t *nio)
 {
    struct netio_rx_listener *rxl;
-   int res = -1;
+   int fd,res = -1;
 
-   if ((rxl = netio_rxl_find(nio))) {
+   if ((rxl = netio_rxl_find(w,nio))) {
       /* we suppress this NIO only when the ref count hits 0 */
       rxl->ref_count--;
 
@@ -1541,15 +2130,25 @@ static int netio_rxl_remove_internal(netio_desc_t *nio)
          if (rxl->prev)
             rxl->prev->next = rxl->next;
          else
-            netio_rxl_list = rxl->next;
+            w->list = rxl->next;
 
          /* if this is non-FD NIO, wait for thread to terminate */
-         if (netio_get_fd(rxl->nio) == -1) {
+         if ((fd = netio_get_fd(rxl->nio)) == -1) {
+            pthread_mutex_lock(&rxl->pause_lock);
             rxl->running = FALSE;
+            pthread_cond_broadcast(&rxl->pause_cond);
+            pthread_mutex_unlock(&rxl->pause_lock);
             pthread_join(rxl->spec_thread,NULL);
          }
-         
-         free(rxl);
+#ifdef NETIO_RXL_EPOLL
+         else if (!rxl->paused) {
+            epoll_ctl(w->epoll_fd,EPOLL_CTL_DEL,fd,NULL);
+         }
+#endif
+
+         w->nio_count--;
+         nio->rxl_worker = NULL;
+         netio_rxl_free(rxl);
       }
 
       res = 0;
@@ -1559,19 +2158,208 @@ static int netio_rxl_remove_internal(netio_desc_t *nio)
 }
 
 /* Add a RXL listener to the listener list */
-static void netio_rxl_add_internal(struct netio_rx_listener *rxl)
+static void netio_rxl_add_internal(struct netio_rxl_worker *w,
+                                   struct netio_rx_listener *rxl)
 {  
    struct netio_rx_listener *tmp;
+   int fd;
    
-   if ((tmp = netio_rxl_find(rxl->nio))) {
+   if ((tmp = netio_rxl_find(w,rxl->nio))) {
       tmp->ref_count++;
-      free(rxl);
+      netio_rxl_free(rxl);
+      return;
+   }
+
+   rxl->prev = NULL;
+   rxl->next = w->list;
+   if (rxl->next) rxl->next->prev = rxl;
+   w->list = rxl;
+
+   if ((fd = netio_get_fd(rxl->nio)) == -1)
+      return;
+
+   /* 
+    * Bursts are drained with non-blocking receives: the FD itself is left
+    * in blocking mode, since it is also used to send packets.
+    */
+   if (netio_rxl_can_drain(rxl->nio)) {
+      rxl->drain_max = NETIO_RXL_DRAIN_MAX;
    } else {
-      rxl->prev = NULL;
-      rxl->next = netio_rxl_list;
-      if (rxl->next) rxl->next->prev = rxl;
-      netio_rxl_list = rxl;
+      rxl->drain_max = 1;
+   }
+
+   /* Listener moved from another worker while paused */
+   if (!rxl->paused)
+      netio_rxl_poll_fd(w,rxl,fd);
+}
+
+/* 
+ * Move the listeners of a group to another worker, which adds them to its
+ * own list (RXL and RXQ locks held).
+ */
+static void netio_rxl_move_group(struct netio_rxl_worker *w,void *group,
+                                 struct netio_rxl_worker *to)
+{
+   struct netio_rx_listener *rxl,*next;
+#ifdef NETIO_RXL_EPOLL
+   int fd;
+#endif
+
+   for(rxl=w->list;rxl;rxl=next) {
+      next = rxl->next;
+
+      if (rxl->nio->rxl_group != group)
+         continue;
+
+      if (rxl->next)
+         rxl->next->prev = rxl->prev;
+
+      if (rxl->prev)
+         rxl->prev->next = rxl->next;
+      else
+         w->list = rxl->next;
+
+#ifdef NETIO_RXL_EPOLL
+      if (((fd = netio_get_fd(rxl->nio)) != -1) && !rxl->paused)
+         epoll_ctl(w->epoll_fd,EPOLL_CTL_DEL,fd,NULL);
+#endif
+
+      w->nio_count--;
+      to->nio_count++;
+      rxl->nio->rxl_worker = to;
+
+      rxl->next = to->add_list;
+      to->add_list = rxl;
+   }
+
+   netio_rxl_worker_kick(to);
+}
+
+/* Process the add/remove requests of a worker (RXL and RXQ locks held) */
+static void netio_rxl_worker_process_queues(struct netio_rxl_worker *w)
+{
+   struct netio_rx_listener *rxl;
+   netio_desc_t *nio;
+
+   /* Add the new waiting NIO to the active list */
+   while(w->add_list != NULL) {
+      rxl = w->add_list;
+      w->add_list = w->add_list->next;
+      netio_rxl_add_internal(w,rxl);
+   }
+
+   /* Delete the NIO present in the remove list */
+   while(w->remove_list != NULL) {
+      nio = w->remove_list;
+      w->remove_list = w->remove_list->rxl_next;
+      netio_rxl_remove_internal(w,nio);
+   }
+
+   /* 
+    * Hand over the listeners of a group to another worker. This is done
+    * here so that no packet event of this worker refers to them anymore.
+    */
+   if (w->move_group != NULL) {
+      netio_rxl_move_group(w,w->move_group,w->move_to);
+      w->move_group = NULL;
+      w->move_to = NULL;
    }
+
+   pthread_cond_broadcast(&netio_rxl_cond);
+}
+
+/* Pass a received packet to the user handler */
+static inline void netio_rxl_handle_pkt(struct netio_rx_listener *rxl,
+                                        netio_pkt_t *p)
+{
+   netio_rx_cur_pkt = p;
+   rxl->rx_handler(rxl->nio,netio_pkt_data(p),p->len,rxl->arg1,rxl->arg2);
+   netio_rx_cur_pkt = NULL;
+}
+
+/* Receive a burst of packets from a NIO and call the user handler */
+static void netio_rxl_drain(struct netio_rxl_worker *w,
+                            struct netio_rx_listener *rxl)
+{
+   netio_pkt_t *pkts[NETIO_RXL_DRAIN_MAX];
+   int used[NETIO_RXL_DRAIN_MAX];
+   netio_desc_t *nio = rxl->nio;
+   netio_pkt_t *p;
+   int i,j,k,n,count;
+
+   /* NIO giving packet buffers by reference */
+   if (nio->recv_pkt != NULL) {
+      n = netio_recv_pkt_batch(nio,pkts,rxl->drain_max);
+
+      for(i=0;i<n;i++) {
+         netio_rxl_handle_pkt(rxl,pkts[i]);
+         netio_pkt_release(pkts[i]);
+      }
+
+      w->pkt_count += n;
+      return;
+   }
+
+   for(i=0;i<rxl->drain_max;i++) {
+      if (!w->rx_pkts[i] && !(w->rx_pkts[i] = netio_pkt_alloc(NETIO_MAX_PKT_SIZE)))
+         break;
+
+      w->rx_vec[i].pkt = netio_pkt_data(w->rx_pkts[i]);
+      w->rx_vec[i].len = NETIO_MAX_PKT_SIZE;
+   }
+
+   count = i;
+   n = netio_recv_batch(nio,w->rx_vec,count);
+
+   /* 
+    * Find the buffer of each packet. Packets dropped by filters shift the
+    * entries, and zero-copy drivers return their own memory: these packets
+    * are copied to a buffer not used by any other entry.
+    */
+   memset(used,0,sizeof(used));
+
+   for(i=0;i<n;i++) {
+      pkts[i] = NULL;
+
+      for(j=i;j<count;j++)
+         if (w->rx_vec[i].pkt == netio_pkt_data(w->rx_pkts[j])) {
+            pkts[i] = w->rx_pkts[j];
+            used[j] = TRUE;
+            break;
+         }
+   }
+
+   for(i=0,k=0;i<n;i++) {
+      if (pkts[i] != NULL)
+         continue;
+
+      while(used[k])
+         k++;
+
+      used[k] = TRUE;
+      pkts[i] = w->rx_pkts[k];
+
+      if (w->rx_vec[i].len > NETIO_MAX_PKT_SIZE)
+         w->rx_vec[i].len = NETIO_MAX_PKT_SIZE;
+
+      memcpy(netio_pkt_data(pkts[i]),w->rx_vec[i].pkt,w->rx_vec[i].len);
+   }
+
+   for(i=0;i<n;i++) {
+      p = pkts[i];
+      p->len = w->rx_vec[i].len;
+      netio_rxl_handle_pkt(rxl,p);
+   }
+
+   /* Buffers kept by the user handler are replaced on next drain */
+   for(i=0;i<rxl->drain_max;i++) {
+      if (w->rx_pkts[i] && netio_pkt_shared(w->rx_pkts[i])) {
+         netio_pkt_release(w->rx_pkts[i]);
+         w->rx_pkts[i] = NULL;
+      }
+   }
+
+   w->pkt_count += n;
 }
 
 /* RX Listener dedicated thread (for non-FD NIO) */
@@ -1579,65 +2367,127 @@ static void *netio_rxl_spec_thread(void *arg)
 {
    struct netio_rx_listener *rxl = arg;
    netio_desc_t *nio = rxl->nio;
+   netio_pkt_t *p = NULL;
    ssize_t pkt_len;
 
    while(rxl->running) {
-      pkt_len = netio_recv(nio,nio->rx_pkt,sizeof(nio->rx_pkt));
+      if (!p && !(p = netio_pkt_alloc(NETIO_MAX_PKT_SIZE))) {
+         usleep(10000);
+         continue;
+      }
+
+      pkt_len = netio_recv(nio,netio_pkt_data(p),NETIO_MAX_PKT_SIZE);
+
+      if (pkt_len > 0) {
+         p->len = pkt_len;
+
+         pthread_mutex_lock(&rxl->pause_lock);
+
+         while(rxl->paused && rxl->running)
+            pthread_cond_wait(&rxl->pause_cond,&rxl->pause_lock);
 
-      if (pkt_len > 0)
-         rxl->rx_handler(nio,nio->rx_pkt,pkt_len,rxl->arg1,rxl->arg2);
+         if (rxl->running)
+            netio_rxl_handle_pkt(rxl,p);
+
+         pthread_mutex_unlock(&rxl->pause_lock);
+
+         if (netio_pkt_shared(p)) {
+            netio_pkt_release(p);
+            p = NULL;
+         }
+      }
    }
 
+   netio_pkt_release(p);
    return NULL;
 }
 
-/* RX Listener General Thread */
-void *netio_rxl_gen_thread(void *arg)
+#ifdef NETIO_RXL_EPOLL
+/* RX Listener worker thread (epoll) */
+static void *netio_rxl_worker_thread(void *arg)
 { 
+   struct epoll_event events[NETIO_RXL_MAX_EVENTS];
+   struct netio_rxl_worker *w = arg;
    struct netio_rx_listener *rxl;
-   ssize_t pkt_len;
-   netio_desc_t *nio;
-   struct timeval tv;
-   int fd,fd_max,res;
-   fd_set rfds;
+   int i,res,ctl;
+
+   /* Local cache of packet buffers, to avoid locking the pool */
+   netio_pkt_cache_create();
 
    for(;;) {
-      NETIO_RXL_LOCK();
-
-      NETIO_RXQ_LOCK();
-      /* Add the new waiting NIO to the active list */
-      while(netio_rxl_add_list != NULL) {
-         rxl = netio_rxl_add_list;
-         netio_rxl_add_list = netio_rxl_add_list->next;
-         netio_rxl_add_internal(rxl);
+      res = epoll_wait(w->epoll_fd,events,NETIO_RXL_MAX_EVENTS,-1);
+
+      if (res == -1) {
+         if (errno != EINTR)
+            perror("netio_rxl_thread: epoll_wait");
+         continue;
       }
 
-      /* Delete the NIO present in the remove list */
-      while(netio_rxl_remove_list != NULL) {
-         nio = netio_rxl_remove_list;
-         netio_rxl_remove_list = netio_rxl_remove_list->rxl_next;
-         netio_rxl_remove_internal(nio);
+      w->wakeup_count++;
+      ctl = FALSE;
+
+      NETIO_RXL_LOCK(w);
+
+      /* 
+       * Deliver packets first, the listener list can only change when
+       * processing the control queues.
+       */
+      for(i=0;i<res;i++) {
+         if (!(rxl = events[i].data.ptr)) {
+            ctl = TRUE;
+            continue;
+         }
+
+         /* Listener paused after epoll_wait() */
+         if (!rxl->paused)
+            netio_rxl_drain(w,rxl);
       }
 
-      pthread_cond_broadcast(&netio_rxl_cond);
-      NETIO_RXQ_UNLOCK();
+      if (ctl) {
+         netio_rxl_worker_ack(w);
+
+         NETIO_RXQ_LOCK();
+         netio_rxl_worker_process_queues(w);
+         NETIO_RXQ_UNLOCK();
+      }
+
+      NETIO_RXL_UNLOCK(w);
+   }
+   
+   return NULL;
+}
+#else
+/* RX Listener worker thread (select) */
+static void *netio_rxl_worker_thread(void *arg)
+{ 
+   struct netio_rxl_worker *w = arg;
+   struct netio_rx_listener *rxl;
+   int fd,fd_max,res;
+   fd_set rfds;
+
+   /* Local cache of packet buffers, to avoid locking the pool */
+   netio_pkt_cache_create();
+
+   for(;;) {
+      NETIO_RXL_LOCK(w);
 
       /* Build the FD set */
       FD_ZERO(&rfds);
-      fd_max = -1;
-      for(rxl=netio_rxl_list;rxl;rxl=rxl->next) {
-         if ((fd = netio_get_fd(rxl->nio)) == -1)
+      FD_SET(w->ctl_fd[0],&rfds);
+      fd_max = w->ctl_fd[0];
+
+      for(rxl=w->list;rxl;rxl=rxl->next) {
+         if ((fd = netio_get_fd(rxl->nio)) == -1 || (fd >= FD_SETSIZE) ||
+             rxl->paused)
             continue;
 
          if (fd > fd_max) fd_max = fd;
          FD_SET(fd,&rfds);
       }
-      NETIO_RXL_UNLOCK();
+      NETIO_RXL_UNLOCK(w);
 
       /* Wait for incoming packets */
-      tv.tv_sec = 0;
-      tv.tv_usec = 20 * 1000;  /* 200 ms */
-      res = select(fd_max+1,&rfds,NULL,NULL,&tv);
+      res = select(fd_max+1,&rfds,NULL,NULL,NULL);
 
       if (res == -1) {
          if (errno != EINTR)
@@ -1645,34 +2495,146 @@ void *netio_rxl_gen_thread(void *arg)
          continue;
       }
 
-      /* Examine active FDs and call user handlers */
-      NETIO_RXL_LOCK();
+      w->wakeup_count++;
 
-      for(rxl=netio_rxl_list;rxl;rxl=rxl->next) {
-         nio = rxl->nio;
+      /* Examine active FDs and call user handlers */
+      NETIO_RXL_LOCK(w);
 
-         if ((fd = netio_get_fd(nio)) == -1)
+      for(rxl=w->list;rxl;rxl=rxl->next) {
+         if ((fd = netio_get_fd(rxl->nio)) == -1 || (fd >= FD_SETSIZE))
             continue;
 
-         if (FD_ISSET(fd,&rfds)) {
-            pkt_len = netio_recv(nio,nio->rx_pkt,sizeof(nio->rx_pkt));
+         if (FD_ISSET(fd,&rfds) && !rxl->paused)
+            netio_rxl_drain(w,rxl);
+      }
+
+      if (FD_ISSET(w->ctl_fd[0],&rfds)) {
+         netio_rxl_worker_ack(w);
 
-            if (pkt_len > 0)
-               rxl->rx_handler(nio,nio->rx_pkt,pkt_len,rxl->arg1,rxl->arg2);
-         }
+         NETIO_RXQ_LOCK();
+         netio_rxl_worker_process_queues(w);
+         NETIO_RXQ_UNLOCK();
       }
 
-      NETIO_RXL_UNLOCK();
+      NETIO_RXL_UNLOCK(w);
    }
    
    return NULL;
 }
+#endif
+
+/* Start a RX listener worker */
+static int netio_rxl_worker_start(struct netio_rxl_worker *w,u_int id)
+{
+   memset(w,0,sizeof(*w));
+   w->id = id;
+   pthread_mutex_init(&w->lock,NULL);
+
+   if (pipe(w->ctl_fd) == -1) {
+      perror("netio_rxl_worker_start: pipe");
+      return(-1);
+   }
+
+   fcntl(w->ctl_fd[0],F_SETFL,O_NONBLOCK);
+   fcntl(w->ctl_fd[1],F_SETFL,O_NONBLOCK);
+
+#ifdef NETIO_RXL_EPOLL
+   {
+      struct epoll_event ev;
+
+      if ((w->epoll_fd = epoll_create(NETIO_RXL_MAX_EVENTS)) == -1) {
+         perror("netio_rxl_worker_start: epoll_create");
+         goto err_epoll;
+      }
+
+      memset(&ev,0,sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = NULL;
+
+      if (epoll_ctl(w->epoll_fd,EPOLL_CTL_ADD,w->ctl_fd[0],&ev) == -1) {
+         perror("netio_rxl_worker_start: epoll_ctl");
+         goto err_thread;
+      }
+   }
+#endif
+
+   if (pthread_create(&w->thread,NULL,netio_rxl_worker_thread,w)) {
+      perror("netio_rxl_worker_start: pthread_create");
+      goto err_thread;
+   }
+
+   return(0);
+
+ err_thread:
+#ifdef NETIO_RXL_EPOLL
+   close(w->epoll_fd);
+ err_epoll:
+#endif
+   close(w->ctl_fd[0]);
+   close(w->ctl_fd[1]);
+   return(-1);
+}
+
+/* Check if a worker handles a NIO of the specified group (RXQ lock held) */
+static int netio_rxl_worker_has_group(struct netio_rxl_worker *w,
+                                      void *group)
+{
+   struct netio_rx_listener *rxl;
+
+   for(rxl=w->list;rxl;rxl=rxl->next)
+      if (rxl->nio->rxl_group == group)
+         return(TRUE);
+
+   return(FALSE);
+}
+
+/* Find a worker handling a NIO of the specified group (RXQ lock held) */
+static struct netio_rxl_worker *netio_rxl_find_group_worker(void *group)
+{
+   u_int i;
+
+   for(i=0;i<netio_rxl_worker_count;i++)
+      if (netio_rxl_worker_has_group(&netio_rxl_workers[i],group))
+         return(&netio_rxl_workers[i]);
+
+   return NULL;
+}
+
+/* Select the worker that will handle a new NIO (RXQ lock held) */
+static struct netio_rxl_worker *netio_rxl_select_worker(netio_desc_t *nio)
+{
+   struct netio_rxl_worker *w = NULL;
+   u_int i;
+
+   if (nio->rxl_worker != NULL)
+      return(nio->rxl_worker);
+
+   /* Keep the NIO of a group on the same worker */
+   if ((nio->rxl_group != NULL) &&
+       (w = netio_rxl_find_group_worker(nio->rxl_group)))
+      goto done;
+
+   /* Pick the least loaded shared worker */
+   for(i=0;i<netio_rxl_worker_count;i++) {
+      if (netio_rxl_workers[i].pinned)
+         continue;
+
+      if (!w || (netio_rxl_workers[i].nio_count < w->nio_count))
+         w = &netio_rxl_workers[i];
+   }
+
+ done:
+   w->nio_count++;
+   nio->rxl_worker = w;
+   return w;
+}
 
 /* Add a RX listener in the listener list */
 int netio_rxl_add(netio_desc_t *nio,netio_rx_handler_t rx_handler,
                   void *arg1,void *arg2)
 {
    struct netio_rx_listener *rxl;
+   struct netio_rxl_worker *w;
 
    NETIO_RXQ_LOCK();
 
@@ -1689,20 +2651,26 @@ int netio_rxl_add(netio_desc_t *nio,netio_rx_handler_t rx_handler,
    rxl->arg1 = arg1;
    rxl->arg2 = arg2;
    rxl->running = TRUE;
+   pthread_mutex_init(&rxl->pause_lock,NULL);
+   pthread_cond_init(&rxl->pause_cond,NULL);
 
    if ((netio_get_fd(rxl->nio) == -1) &&
        pthread_create(&rxl->spec_thread,NULL,netio_rxl_spec_thread,rxl)) 
    {
       NETIO_RXQ_UNLOCK();
       fprintf(stderr,"netio_rxl_add: unable to create specific thread.\n");
-      free(rxl);
+      netio_rxl_free(rxl);
       return(-1);
    }
 
-   rxl->next = netio_rxl_add_list;
-   netio_rxl_add_list = rxl;
+   w = netio_rxl_select_worker(nio);
+   rxl->next = w->add_list;
+   w->add_list = rxl;
+   netio_rxl_worker_kick(w);
+
+   while(w->add_list != NULL)
+      pthread_cond_wait(&netio_rxl_cond,&netio_rxq_mutex);
 
-   pthread_cond_wait(&netio_rxl_cond,&netio_rxq_mutex);
    NETIO_RXQ_UNLOCK();
    return(0);
 }
@@ -1710,23 +2678,282 @@ int netio_rxl_add(netio_desc_t *nio,netio_rx_handler_t rx_handler,
 /* Remove a NIO from the listener list */
 int netio_rxl_remove(netio_desc_t *nio)
 {
+   struct netio_rxl_worker *w;
+
    NETIO_RXQ_LOCK();
-   nio->rxl_next = netio_rxl_remove_list;
-   netio_rxl_remove_list = nio;
-   pthread_cond_wait(&netio_rxl_cond,&netio_rxq_mutex);
+
+   if ((w = nio->rxl_worker) != NULL) {
+      nio->rxl_next = w->remove_list;
+      w->remove_list = nio;
+      netio_rxl_worker_kick(w);
+
+      while(w->remove_list != NULL)
+         pthread_cond_wait(&netio_rxl_cond,&netio_rxq_mutex);
+   }
+
    NETIO_RXQ_UNLOCK();
    return(0);
 }
 
-/* Initialize the RXL thread */
-int netio_rxl_init(void)
+/* Get the number of shared RX listener workers (RXQ lock held) */
+static u_int netio_rxl_get_shared_workers(void)
 {
-   pthread_cond_init(&netio_rxl_cond,NULL);
+   u_int i,count = 0;
 
-   if (pthread_create(&netio_rxl_thread,NULL,netio_rxl_gen_thread,NULL)) {
-      perror("netio_rxl_init: pthread_create");
+   for(i=0;i<netio_rxl_worker_count;i++)
+      if (!netio_rxl_workers[i].pinned)
+         count++;
+
+   return(count);
+}
+
+/* Start a new RX listener worker (RXQ lock held) */
+static struct netio_rxl_worker *netio_rxl_worker_add(void)
+{
+   struct netio_rxl_worker *w;
+
+   if (netio_rxl_worker_count == NETIO_RXL_MAX_WORKERS)
+      return NULL;
+
+   w = &netio_rxl_workers[netio_rxl_worker_count];
+
+   if (netio_rxl_worker_start(w,netio_rxl_worker_count) == -1)
+      return NULL;
+
+   netio_rxl_worker_count++;
+   return w;
+}
+
+/* 
+ * Set the number of shared RX listener workers.
+ *
+ * Workers can only be added: NIO already bound to a worker stay on it,
+ * new NIO are spread on the least loaded shared worker.
+ */
+int netio_rxl_set_workers(u_int count)
+{
+   int res = 0;
+
+   if ((count == 0) || (count > NETIO_RXL_MAX_WORKERS))
       return(-1);
+
+   NETIO_RXQ_LOCK();
+
+   if (count < netio_rxl_get_shared_workers()) {
+      res = -1;
+   } else {
+      while(netio_rxl_get_shared_workers() < count) {
+         if (!netio_rxl_worker_add()) {
+            res = -1;
+            break;
+         }
+      }
+   }
+
+   NETIO_RXQ_UNLOCK();
+   return(res);
+}
+
+/* Set the pause state of a RX listener (RXL lock of its worker held) */
+static void netio_rxl_set_paused(struct netio_rxl_worker *w,
+                                 struct netio_rx_listener *rxl,int paused)
+{
+#ifdef NETIO_RXL_EPOLL
+   int fd;
+#endif
+
+   if (rxl->paused == paused)
+      return;
+
+   /* A dedicated thread may be handling a packet */
+   pthread_mutex_lock(&rxl->pause_lock);
+   rxl->paused = paused;
+   pthread_cond_broadcast(&rxl->pause_cond);
+   pthread_mutex_unlock(&rxl->pause_lock);
+
+#ifdef NETIO_RXL_EPOLL
+   /* Pending packets would wake up the worker endlessly */
+   if ((fd = netio_get_fd(rxl->nio)) != -1) {
+      if (paused)
+         epoll_ctl(w->epoll_fd,EPOLL_CTL_DEL,fd,NULL);
+      else
+         netio_rxl_poll_fd(w,rxl,fd);
+   }
+#endif
+}
+
+/* Set the pause state of the RX listeners of a group */
+static void netio_rxl_group_set_paused(void *group,int paused)
+{
+   struct netio_rx_listener *rxl;
+   struct netio_rxl_worker *w;
+   u_int i;
+
+   /* 
+    * Listener lists only change with the RXL lock held, which is taken
+    * before the RXQ lock: the latter is not used here.
+    */
+   for(i=0;i<netio_rxl_worker_count;i++) {
+      w = &netio_rxl_workers[i];
+
+      NETIO_RXL_LOCK(w);
+
+      for(rxl=w->list;rxl;rxl=rxl->next)
+         if (rxl->nio->rxl_group == group)
+            netio_rxl_set_paused(w,rxl,paused);
+
+      NETIO_RXL_UNLOCK(w);
+
+      /* The select() worker has to rebuild its FD set */
+      if (!paused)
+         netio_rxl_worker_kick(w);
    }
+}
+
+/* 
+ * Pause the RX listeners of the NIO of a group. Once this returns, none of
+ * their handlers is running anymore.
+ */
+void netio_rxl_group_pause(void *group)
+{
+   netio_rxl_group_set_paused(group,TRUE);
+}
+
+/* Resume the RX listeners of the NIO of a group */
+void netio_rxl_group_resume(void *group)
+{
+   netio_rxl_group_set_paused(group,FALSE);
+}
+
+/* Check if a worker only handles NIO of a group (RXQ lock held) */
+static int netio_rxl_worker_has_only_group(struct netio_rxl_worker *w,
+                                           void *group)
+{
+   struct netio_rx_listener *rxl;
+
+   for(rxl=w->list;rxl;rxl=rxl->next)
+      if (rxl->nio->rxl_group != group)
+         return(FALSE);
+
+   return(TRUE);
+}
+
+/* 
+ * Get a pinned worker for a group bound to a CPU set (RXQ lock held):
+ * the worker already used for this CPU set, the current worker of the group
+ * if it handles nothing else, an empty pinned worker or a new one.
+ */
+static struct netio_rxl_worker *
+netio_rxl_get_pinned_worker(struct netio_rxl_worker *cur,void *group,
+                            affinity_set_t *set)
+{
+   struct netio_rxl_worker *w = NULL;
+   u_int i;
 
+   for(i=0;i<netio_rxl_worker_count;i++) {
+      if (netio_rxl_workers[i].pinned &&
+          affinity_is_equal(&netio_rxl_workers[i].cpus,set))
+         return(&netio_rxl_workers[i]);
+   }
+
+   if (cur->pinned && netio_rxl_worker_has_only_group(cur,group)) {
+      w = cur;
+   } else {
+      for(i=0;i<netio_rxl_worker_count;i++)
+         if (netio_rxl_workers[i].pinned && !netio_rxl_workers[i].nio_count) {
+            w = &netio_rxl_workers[i];
+            break;
+         }
+   }
+
+   if (!w) {
+      if (!(w = netio_rxl_worker_add()))
+         return NULL;
+
+      w->pinned = TRUE;
+   }
+
+   if (affinity_set_thread(w->thread,set) == -1)
+      return NULL;
+
+   w->cpus = *set;
+   return w;
+}
+
+/* 
+ * Bind the RX listeners of the NIO of a group to a CPU set. They are moved
+ * to a pinned worker, shared only with the groups bound to the same CPU set.
+ */
+int netio_rxl_set_group_affinity(void *group,affinity_set_t *set)
+{
+   struct netio_rxl_worker *cur,*w;
+   struct netio_rx_listener *rxl;
+   int res = 0;
+   u_int i;
+
+   NETIO_RXQ_LOCK();
+
+   if (!(cur = netio_rxl_find_group_worker(group)))
+      goto done;
+
+   if (!(w = netio_rxl_get_pinned_worker(cur,group,set))) {
+      res = -1;
+      goto done;
+   }
+
+   /* The listeners are handed over by the workers currently running them */
+   for(i=0;i<netio_rxl_worker_count;i++) {
+      cur = &netio_rxl_workers[i];
+
+      if ((cur == w) || !netio_rxl_worker_has_group(cur,group))
+         continue;
+
+      cur->move_group = group;
+      cur->move_to = w;
+      netio_rxl_worker_kick(cur);
+
+      while((cur->move_group != NULL) || (w->add_list != NULL))
+         pthread_cond_wait(&netio_rxl_cond,&netio_rxq_mutex);
+   }
+
+   /* Non-FD NIO have their own receiving thread */
+   for(rxl=w->list;rxl;rxl=rxl->next) {
+      if ((rxl->nio->rxl_group == group) && 
+          (netio_get_fd(rxl->nio) == -1) &&
+          (affinity_set_thread(rxl->spec_thread,set) == -1))
+         res = -1;
+   }
+
+ done:
+   NETIO_RXQ_UNLOCK();
+   return(res);
+}
+
+/* Get the number of RX listener workers */
+u_int netio_rxl_get_workers(void)
+{
+   return(netio_rxl_worker_count);
+}
+
+/* Get statistics of a RX listener worker */
+int netio_rxl_get_worker_stats(u_int id,u_int *nio_count,
+                               m_uint64_t *wakeups,m_uint64_t *pkts)
+{
+   struct netio_rxl_worker *w;
+
+   if (id >= netio_rxl_worker_count)
+      return(-1);
+
+   w = &netio_rxl_workers[id];
+   *nio_count = w->nio_count;
+   *wakeups   = w->wakeup_count;
+   *pkts      = w->pkt_count;
    return(0);
 }
+
+/* Initialize the RXL thread */
+int netio_rxl_init(void)
+{
+   pthread_cond_init(&netio_rxl_cond,NULL);
+   return(netio_rxl_set_workers(1));
+}
@@ -14,6 +14,8 @@
 #include <pthread.h>
 
 #include "utils.h"
+#include "affinity.h"
+#include "net_io_pool.h"
 
 #ifdef LINUX_ETH
 #include "linux_eth.h"
@@ -28,6 +30,18 @@
 /* Maximum device length */
 #define NETIO_DEV_MAXLEN    64
 
+/* Maximum number of RX listener workers */
+#define NETIO_RXL_MAX_WORKERS  32
+
+/* Maximum number of events handled per RX listener wakeup */
+#define NETIO_RXL_MAX_EVENTS   64
+
+/* Maximum number of packets drained from a NIO per RX listener wakeup */
+#define NETIO_RXL_DRAIN_MAX    16
+
+/* Maximum number of packets in a batched send/receive */
+#define NETIO_BATCH_MAX        32
+
 enum {
    NETIO_TYPE_UNIX = 0,
    NETIO_TYPE_VDE,
@@ -55,6 +69,7 @@ enum {
 };
 
 typedef struct netio_desc netio_desc_t;
+struct netio_rxl_worker;
 
 /* VDE switch definitions */
 enum vde_request_type { VDE_REQ_NEW_CONTROL };
@@ -106,6 +121,7 @@ typedef struct netio_lnxeth_desc netio_lnxeth_desc_t;
 struct netio_lnxeth_desc {
    char dev_name[NETIO_DEV_MAXLEN];
    int dev_id,fd;
+   lnx_eth_ring_t *ring;
 };
 #endif
 
@@ -118,22 +134,45 @@ struct netio_geneth_desc {
 };
 #endif
 
-/* FIFO packet */
-typedef struct netio_fifo_pkt netio_fifo_pkt_t;
-struct netio_fifo_pkt {
-   netio_fifo_pkt_t *next;
-   size_t pkt_len;
-   char pkt[0];
+/* FIFO ring: number of slots (power of 2), cache line size */
+#define NETIO_FIFO_RING_SIZE  128
+#define NETIO_CACHE_LINE      64
+
+/* 
+ * Single-producer/single-consumer FIFO ring of packet buffers.
+ * Producer and consumer indexes are kept on distinct cache lines.
+ */
+typedef struct netio_fifo_ring netio_fifo_ring_t;
+struct netio_fifo_ring {
+   volatile u_int head __attribute__((aligned(NETIO_CACHE_LINE)));
+   volatile u_int tail __attribute__((aligned(NETIO_CACHE_LINE)));
+   netio_pkt_t *slot[NETIO_FIFO_RING_SIZE] 
+      __attribute__((aligned(NETIO_CACHE_LINE)));
 };
 
 /* Netio FIFO */
 typedef struct netio_fifo_desc netio_fifo_desc_t;
 struct netio_fifo_desc {
-   pthread_cond_t cond;
-   pthread_mutex_t lock,endpoint_lock;
+   pthread_mutex_t endpoint_lock;
    netio_fifo_desc_t *endpoint;
-   netio_fifo_pkt_t *head,*last;
-   u_int pkt_count;
+   netio_fifo_ring_t *ring;     /* RX ring, filled by the endpoint */
+   int sig_fd[2];               /* RX wakeup (eventfd or pipe) */
+};
+
+/* Packet vector entry (batched send/receive) */
+typedef struct netio_pktvec netio_pktvec_t;
+struct netio_pktvec {
+   void *pkt;
+   size_t len;
+};
+
+/* Batch of packets built by a device TX path and sent in a single call */
+typedef struct netio_tx_batch netio_tx_batch_t;
+struct netio_tx_batch {
+   u_int count,max_count;
+   size_t pkt_size;
+   u_char *buffer;
+   netio_pktvec_t vec[NETIO_BATCH_MAX];
 };
 
 /* Packet filter */
@@ -190,6 +229,17 @@ struct netio_desc {
    ssize_t (*send)(void *desc,void *pkt,size_t len);
    ssize_t (*recv)(void *desc,void *pkt,size_t len);
 
+   /* Receive a packet without blocking (optional, to drain bursts) */
+   ssize_t (*recv_nowait)(void *desc,void *pkt,size_t len);
+
+   /* Batched send and receive (optional) */
+   int (*send_batch)(void *desc,netio_pktvec_t *vec,u_int count);
+   int (*recv_batch)(void *desc,netio_pktvec_t *vec,u_int count);
+
+   /* Send and receive packet buffers by reference (optional) */
+   int (*send_pkt)(void *desc,netio_pkt_t *pkt);
+   int (*recv_pkt)(void *desc,netio_pkt_t **pkts,u_int count);
+
    /* Configuration saving */
    void (*save_cfg)(netio_desc_t *nio,FILE *fd);
 
@@ -201,7 +251,7 @@ struct netio_desc {
    m_uint64_t bw_cnt[NETIO_BW_SAMPLES];
    m_uint64_t bw_cnt_total;
    u_int bw_pos;
-   u_int bw_ptask_cnt;
+   m_tmcnt_t bw_sample_time;
 
    /* Packet filters */
    netio_pktfilter_t *rx_filter,*tx_filter,*both_filter;
@@ -211,11 +261,14 @@ struct netio_desc {
    m_uint64_t stats_pkts_in,stats_pkts_out;
    m_uint64_t stats_bytes_in,stats_bytes_out;
 
+   /* RX listener worker handling this NIO */
+   struct netio_rxl_worker *rxl_worker;
+
+   /* NIO of the same group (typically a VM) use the same RX worker */
+   void *rxl_group;
+
    /* Next pointer (for RX listener) */
    netio_desc_t *rxl_next;
-
-   /* Packet data */
-   u_char rx_pkt[NETIO_MAX_PKT_SIZE];
 };
 
 /* RX listener */
@@ -229,10 +282,47 @@ struct netio_rx_listener {
    volatile int running;
    netio_rx_handler_t rx_handler;
    void *arg1,*arg2;
+   u_int drain_max;
    pthread_t spec_thread;
+
+   /* Paused listeners don't call their handler */
+   volatile int paused;
+   pthread_mutex_t pause_lock;
+   pthread_cond_t pause_cond;
+
    struct netio_rx_listener *prev,*next;
 };
 
+/* RX listener worker (each worker polls its own subset of NIO) */
+struct netio_rxl_worker {
+   u_int id;
+   pthread_t thread;
+   pthread_mutex_t lock;
+   int epoll_fd;
+   int ctl_fd[2];
+
+   /* Active listeners and pending requests */
+   struct netio_rx_listener *list;
+   struct netio_rx_listener *add_list;
+   netio_desc_t *remove_list;
+   u_int nio_count;
+
+   /* Pending move of the listeners of a group to another worker */
+   void *move_group;
+   struct netio_rxl_worker *move_to;
+
+   /* Pinned workers only handle the groups bound to their CPU set */
+   int pinned;
+   affinity_set_t cpus;
+
+   /* Receive buffers (kept while not referenced elsewhere) */
+   netio_pkt_t *rx_pkts[NETIO_RXL_DRAIN_MAX];
+   netio_pktvec_t rx_vec[NETIO_RXL_DRAIN_MAX];
+
+   /* Statistics */
+   m_uint64_t wakeup_count,pkt_count;
+};
+
 /* Get NETIO type given a description */
 int netio_get_type(char *type);
 
@@ -271,6 +361,9 @@ netio_desc_t *netio_desc_create_udp_auto(char *nio_name,char *local_addr,
 #ifdef LINUX_ETH
 /* Create a new NetIO descriptor with raw Ethernet method */
 netio_desc_t *netio_desc_create_lnxeth(char *nio_name,char *dev_name);
+
+/* Create a new NetIO descriptor with raw Ethernet method (mmap'ed rings) */
+netio_desc_t *netio_desc_create_lnxeth_ring(char *nio_name,char *dev_name);
 #endif
 
 #ifdef GEN_ETH
@@ -311,6 +404,32 @@ ssize_t netio_send(netio_desc_t *nio,void *pkt,size_t len);
 /* Receive a packet through a NetIO descriptor */
 ssize_t netio_recv(netio_desc_t *nio,void *pkt,size_t max_len);
 
+/* Send a batch of packets through a NetIO descriptor */
+int netio_send_batch(netio_desc_t *nio,netio_pktvec_t *vec,u_int count);
+
+/* Receive a batch of packets through a NetIO descriptor */
+int netio_recv_batch(netio_desc_t *nio,netio_pktvec_t *vec,u_int count);
+
+/* Initialize a TX batch */
+int netio_tx_batch_init(netio_tx_batch_t *b,u_int max_count,size_t pkt_size);
+
+/* Free the resources used by a TX batch */
+void netio_tx_batch_free(netio_tx_batch_t *b);
+
+/* Get the buffer for the next packet of a TX batch (flush it if full) */
+u_char *netio_tx_batch_get_buffer(netio_desc_t *nio,netio_tx_batch_t *b);
+
+/* Queue the packet built in the current buffer of a TX batch */
+static inline void netio_tx_batch_queue(netio_tx_batch_t *b,size_t len)
+{
+   b->vec[b->count].pkt = b->buffer + (b->count * b->pkt_size);
+   b->vec[b->count].len = len;
+   b->count++;
+}
+
+/* Send all packets of a TX batch */
+int netio_tx_batch_flush(netio_desc_t *nio,netio_tx_batch_t *b);
+
 /* Get a NetIO FD */
 int netio_get_fd(netio_desc_t *nio);
 
@@ -339,6 +458,29 @@ int netio_rxl_add(netio_desc_t *nio,netio_rx_handler_t rx_handler,
 /* Remove a NIO from the listener list */
 int netio_rxl_remove(netio_desc_t *nio);
 
+/* Set the number of shared RX listener workers */
+int netio_rxl_set_workers(u_int count);
+
+/* 
+ * Pause the RX listeners of the NIO of a group (waiting for the end of the
+ * running handlers), or resume them.
+ */
+void netio_rxl_group_pause(void *group);
+void netio_rxl_group_resume(void *group);
+
+/* 
+ * Bind the RX listeners of the NIO of a group to a CPU set: they are moved
+ * to a worker pinned to this set, which does not handle the other groups.
+ */
+int netio_rxl_set_group_affinity(void *group,affinity_set_t *set);
+
+/* Get the number of RX listener workers */
+u_int netio_rxl_get_workers(void);
+
+/* Get statistics of a RX listener worker */
+int netio_rxl_get_worker_stats(u_int id,u_int *nio_count,
+                               m_uint64_t *wakeups,m_uint64_t *pkts);
+
 /* Initialize the RXL thread */
 int netio_rxl_init(void);
 
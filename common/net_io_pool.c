@@ -0,0 +1,300 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * NetIO packet buffer pool.
+ *
+ * Buffers are grouped by size class, each class keeping a list of free 
+ * buffers to avoid going through malloc/free for each packet.
+ *
+ * Threads handling many packets (RX listener workers) have their own local
+ * cache of free buffers, which is refilled from (or flushed to) the shared
+ * free list by batches: the class lock is not taken for each packet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "net_io.h"
+#include "net_io_pool.h"
+
+/* Size class */
+struct netio_pkt_class {
+   pthread_mutex_t lock;
+   size_t size;
+   netio_pkt_t *free_list;
+   u_int cached;
+   volatile u_int in_use;
+   volatile m_uint64_t alloc_count,free_count;
+};
+
+/* Local cache of a size class */
+struct netio_pkt_cache {
+   netio_pkt_t *free_list;
+   u_int count;
+};
+
+static struct netio_pkt_class netio_pkt_classes[NETIO_PKT_CLASSES+1] = {
+   { PTHREAD_MUTEX_INITIALIZER, 256 },
+   { PTHREAD_MUTEX_INITIALIZER, 2048 },
+   { PTHREAD_MUTEX_INITIALIZER, NETIO_MAX_PKT_SIZE },
+   { PTHREAD_MUTEX_INITIALIZER, 0 },   /* External data */
+};
+
+/* Local cache of the current thread (NULL if none) */
+static __thread struct netio_pkt_cache *netio_pkt_local = NULL;
+
+/* Move free buffers from the shared list to a local cache */
+static void netio_pkt_cache_refill(struct netio_pkt_class *c,
+                                   struct netio_pkt_cache *lc)
+{
+   netio_pkt_t *p;
+
+   pthread_mutex_lock(&c->lock);
+
+   while((lc->count < NETIO_PKT_LOCAL_BATCH) && (p = c->free_list)) {
+      c->free_list = p->next;
+      c->cached--;
+
+      p->next = lc->free_list;
+      lc->free_list = p;
+      lc->count++;
+   }
+
+   pthread_mutex_unlock(&c->lock);
+}
+
+/* Move free buffers from a local cache to the shared list */
+static void netio_pkt_cache_flush(struct netio_pkt_class *c,
+                                  struct netio_pkt_cache *lc,u_int count)
+{
+   netio_pkt_t *p,*excess = NULL;
+
+   pthread_mutex_lock(&c->lock);
+
+   while(count-- && (p = lc->free_list)) {
+      lc->free_list = p->next;
+      lc->count--;
+
+      if (c->cached < NETIO_PKT_CACHE_MAX) {
+         p->next = c->free_list;
+         c->free_list = p;
+         c->cached++;
+      } else {
+         p->next = excess;
+         excess = p;
+      }
+   }
+
+   pthread_mutex_unlock(&c->lock);
+
+   for(;excess;excess=p) {
+      p = excess->next;
+      free(excess);
+   }
+}
+
+/* Get a buffer of a size class */
+static netio_pkt_t *netio_pkt_get(u_int pkt_class)
+{
+   struct netio_pkt_class *c = &netio_pkt_classes[pkt_class];
+   struct netio_pkt_cache *lc;
+   netio_pkt_t *p;
+
+   if (netio_pkt_local != NULL) {
+      lc = &netio_pkt_local[pkt_class];
+
+      if (!lc->free_list)
+         netio_pkt_cache_refill(c,lc);
+
+      if ((p = lc->free_list) != NULL) {
+         lc->free_list = p->next;
+         lc->count--;
+      }
+   } else {
+      pthread_mutex_lock(&c->lock);
+
+      if ((p = c->free_list) != NULL) {
+         c->free_list = p->next;
+         c->cached--;
+      }
+
+      pthread_mutex_unlock(&c->lock);
+   }
+
+   if (!p) {
+      if (!(p = malloc(sizeof(*p) + c->size)))
+         return NULL;
+
+      p->pkt_class = pkt_class;
+      p->size = c->size;
+   }
+
+   __sync_fetch_and_add(&c->in_use,1);
+   __sync_fetch_and_add(&c->alloc_count,1);
+
+   p->next = NULL;
+   p->ref_count = 1;
+   p->len = 0;
+   p->ext_data = NULL;
+   p->ext_release = NULL;
+   return p;
+}
+
+/* Allocate a packet buffer able to hold the specified size */
+netio_pkt_t *netio_pkt_alloc(size_t size)
+{
+   u_int i;
+
+   for(i=0;i<NETIO_PKT_CLASSES;i++)
+      if (size <= netio_pkt_classes[i].size)
+         return(netio_pkt_get(i));
+
+   return NULL;
+}
+
+/* Allocate a packet buffer and copy data into it */
+netio_pkt_t *netio_pkt_dup(void *data,size_t len)
+{
+   netio_pkt_t *p;
+
+   if (!(p = netio_pkt_alloc(len)))
+      return NULL;
+
+   memcpy(p->data,data,len);
+   p->len = len;
+   return p;
+}
+
+/* Allocate a packet buffer pointing to external data */
+netio_pkt_t *netio_pkt_alloc_ext(void *data,size_t len,
+                                 netio_pkt_ext_release_t release,
+                                 void *arg,u_int id)
+{
+   netio_pkt_t *p;
+
+   if (!(p = netio_pkt_get(NETIO_PKT_CLASS_EXT)))
+      return NULL;
+
+   p->len = len;
+   p->ext_data = data;
+   p->ext_release = release;
+   p->ext_arg = arg;
+   p->ext_id = id;
+   return p;
+}
+
+/* Release a reference on a packet buffer */
+void netio_pkt_release(netio_pkt_t *p)
+{
+   struct netio_pkt_class *c;
+   struct netio_pkt_cache *lc;
+
+   if (!p || (__sync_sub_and_fetch(&p->ref_count,1) != 0))
+      return;
+
+   /* Give back the external data to its owner */
+   if (p->ext_release != NULL)
+      p->ext_release(p->ext_arg,p->ext_id);
+
+   c = &netio_pkt_classes[p->pkt_class];
+
+   __sync_fetch_and_sub(&c->in_use,1);
+   __sync_fetch_and_add(&c->free_count,1);
+
+   if (netio_pkt_local != NULL) {
+      lc = &netio_pkt_local[p->pkt_class];
+
+      p->next = lc->free_list;
+      lc->free_list = p;
+      lc->count++;
+
+      if (lc->count > NETIO_PKT_LOCAL_MAX)
+         netio_pkt_cache_flush(c,lc,NETIO_PKT_LOCAL_BATCH);
+      return;
+   }
+
+   pthread_mutex_lock(&c->lock);
+
+   if (c->cached < NETIO_PKT_CACHE_MAX) {
+      p->next = c->free_list;
+      c->free_list = p;
+      c->cached++;
+      p = NULL;
+   }
+
+   pthread_mutex_unlock(&c->lock);
+   free(p);
+}
+
+/* Get the statistics of a size class */
+int netio_pkt_get_stats(u_int pkt_class,netio_pkt_stats_t *stats)
+{
+   struct netio_pkt_class *c;
+
+   if (pkt_class > NETIO_PKT_CLASS_EXT)
+      return(-1);
+
+   c = &netio_pkt_classes[pkt_class];
+
+   pthread_mutex_lock(&c->lock);
+   stats->size = c->size;
+   stats->in_use = c->in_use;
+   stats->cached = c->cached;
+   stats->alloc_count = c->alloc_count;
+   stats->free_count = c->free_count;
+   pthread_mutex_unlock(&c->lock);
+   return(0);
+}
+
+/* Free the buffers kept in the pool */
+void netio_pkt_pool_flush(void)
+{
+   struct netio_pkt_class *c;
+   netio_pkt_t *p,*next;
+   u_int i;
+
+   for(i=0;i<=NETIO_PKT_CLASS_EXT;i++) {
+      c = &netio_pkt_classes[i];
+
+      pthread_mutex_lock(&c->lock);
+      p = c->free_list;
+      c->free_list = NULL;
+      c->cached = 0;
+      pthread_mutex_unlock(&c->lock);
+
+      for(;p;p=next) {
+         next = p->next;
+         free(p);
+      }
+   }
+}
+
+/* Create a local cache of free buffers for the calling thread */
+int netio_pkt_cache_create(void)
+{
+   if (netio_pkt_local != NULL)
+      return(0);
+
+   netio_pkt_local = calloc(NETIO_PKT_CLASS_EXT+1,
+                            sizeof(struct netio_pkt_cache));
+   return((netio_pkt_local != NULL) ? 0 : -1);
+}
+
+/* Give back the local cache of the calling thread to the pool */
+void netio_pkt_cache_destroy(void)
+{
+   struct netio_pkt_cache *lc = netio_pkt_local;
+   u_int i;
+
+   if (lc != NULL) {
+      for(i=0;i<=NETIO_PKT_CLASS_EXT;i++)
+         netio_pkt_cache_flush(&netio_pkt_classes[i],&lc[i],lc[i].count);
+
+      netio_pkt_local = NULL;
+      free(lc);
+   }
+}
@@ -0,0 +1,119 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * NetIO packet buffer pool.
+ */
+
+#ifndef __NET_IO_POOL_H__
+#define __NET_IO_POOL_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "utils.h"
+
+/* Number of size classes and max number of free buffers kept per class */
+#define NETIO_PKT_CLASSES    3
+#define NETIO_PKT_CACHE_MAX  1024
+
+/* Class of the headers of packets with external data (last class) */
+#define NETIO_PKT_CLASS_EXT  NETIO_PKT_CLASSES
+
+/* 
+ * Local cache of a thread: max number of free buffers per class, and 
+ * number of buffers moved at once from/to the shared free list.
+ */
+#define NETIO_PKT_LOCAL_MAX    128
+#define NETIO_PKT_LOCAL_BATCH  32
+
+typedef struct netio_pkt netio_pkt_t;
+
+/* Release hook of external packet data */
+typedef void (*netio_pkt_ext_release_t)(void *arg,u_int id);
+
+/*
+ * Packet buffer. Buffers are reference counted: a buffer can be queued
+ * on several NIO (FIFO) without being copied, and goes back to its pool
+ * when the last reference is released. A buffer with several references
+ * must be considered as read-only.
+ *
+ * The data of a packet can also be external (a frame of a NIO ring, for
+ * example): the release hook is called with the last reference.
+ */
+struct netio_pkt {
+   netio_pkt_t *next;
+   volatile u_int ref_count;
+   u_int pkt_class;
+   size_t size;
+   size_t len;
+
+   /* External data */
+   u_char *ext_data;
+   netio_pkt_ext_release_t ext_release;
+   void *ext_arg;
+   u_int ext_id;
+
+   m_uint64_t data[0];
+};
+
+/* Pool statistics (for a size class) */
+typedef struct netio_pkt_stats netio_pkt_stats_t;
+struct netio_pkt_stats {
+   size_t size;
+   u_int in_use,cached;
+   m_uint64_t alloc_count,free_count;
+};
+
+/* Get the data pointer of a packet buffer */
+static inline u_char *netio_pkt_data(netio_pkt_t *p)
+{
+   return(p->ext_data ? p->ext_data : (u_char *)p->data);
+}
+
+/* Get a packet buffer from its data pointer (not for external data) */
+static inline netio_pkt_t *netio_pkt_from_data(void *data)
+{
+   return((netio_pkt_t *)((u_char *)data - offsetof(netio_pkt_t,data)));
+}
+
+/* Acquire a new reference on a packet buffer */
+static inline void netio_pkt_ref(netio_pkt_t *p)
+{
+   __sync_fetch_and_add(&p->ref_count,1);
+}
+
+/* Returns TRUE if a packet buffer is referenced several times */
+static inline int netio_pkt_shared(netio_pkt_t *p)
+{
+   return(p->ref_count > 1);
+}
+
+/* Allocate a packet buffer able to hold the specified size */
+netio_pkt_t *netio_pkt_alloc(size_t size);
+
+/* Allocate a packet buffer and copy data into it */
+netio_pkt_t *netio_pkt_dup(void *data,size_t len);
+
+/* Allocate a packet buffer pointing to external data */
+netio_pkt_t *netio_pkt_alloc_ext(void *data,size_t len,
+                                 netio_pkt_ext_release_t release,
+                                 void *arg,u_int id);
+
+/* Release a reference on a packet buffer */
+void netio_pkt_release(netio_pkt_t *p);
+
+/* Get the statistics of a size class */
+int netio_pkt_get_stats(u_int pkt_class,netio_pkt_stats_t *stats);
+
+/* Free the buffers kept in the pool */
+void netio_pkt_pool_flush(void);
+
+/* Create a local cache of free buffers for the calling thread */
+int netio_pkt_cache_create(void);
+
+/* Give back the local cache of the calling thread to the pool */
+void netio_pkt_cache_destroy(void);
+
+#endif
@@ -123,6 +123,7 @@ struct pci_io_data *pci_io_data_init(vm_instance_t *vm,m_uint64_t paddr)
    d->dev.phys_addr = paddr;
    d->dev.phys_len  = 2 * 1048576;
    d->dev.handler   = pci_io_access;
+   d->dev.flags     = VDEVICE_FLAG_NO_STATE;
    
    /* Map this device to the VM */
    vm_bind_device(vm,&d->dev);
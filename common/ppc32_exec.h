@@ -17,6 +17,19 @@ struct ppc32_insn_exec_tag {
    m_uint64_t count;
 };
 
+/* Number of pages kept in the pre-decoded instruction cache */
+#define PPC32_EXEC_DCACHE_PAGES  64
+
+/* Number of instructions in a pre-decoded page */
+#define PPC32_EXEC_DPAGE_INSNS   (PPC32_MIN_PAGE_SIZE / sizeof(ppc_insn_t))
+
+/* Pre-decoded instruction (non-JIT mode) */
+struct ppc32_exec_dinsn {
+   fastcall int (*exec)(cpu_ppc_t *,ppc_insn_t);
+   ppc_insn_t insn;
+   int index;
+};
+
 /* Get a rotation mask */
 static forced_inline m_uint32_t ppc32_rotate_mask(m_uint32_t mb,m_uint32_t me)
 {
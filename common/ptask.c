@@ -22,9 +22,35 @@
 
 #include "ptask.h"
 
-static pthread_t ptask_thread;
+/* Worker thread */
+struct ptask_worker {
+   u_int id;
+   pthread_t thread;
+   pthread_mutex_t lock;         /* Held while tasks are running */
+   pthread_mutex_t wake_lock;
+   pthread_cond_t wake_cond;
+   int wakeup;
+   ptask_t *list;
+   u_int task_count;
+   m_uint64_t run_count,kick_count;
+
+   /* Pinned workers only run the groups bound to their CPU set */
+   int pinned;
+   affinity_set_t cpus;
+};
+
+#define PTASK_HASH_SIZE  256
+
+/* 
+ * The hash lock only protects the task hash table and is never held while
+ * taking another lock, so that devices can ring a doorbell with their own
+ * lock held.
+ */
 static pthread_mutex_t ptask_mutex = PTHREAD_MUTEX_INITIALIZER;
-static ptask_t *ptask_list = NULL;
+static pthread_mutex_t ptask_hash_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ptask_worker ptask_workers[PTASK_MAX_WORKERS];
+static u_int ptask_worker_count = 0;
+static ptask_t *ptask_hash[PTASK_HASH_SIZE];
 static ptask_id_t ptask_current_id = 0;
 
 u_int ptask_sleep_time = 10;
@@ -32,46 +58,185 @@ u_int ptask_sleep_time = 10;
 #define PTASK_LOCK() pthread_mutex_lock(&ptask_mutex)
 #define PTASK_UNLOCK() pthread_mutex_unlock(&ptask_mutex)
 
-/* Periodic task thread */
-static void *ptask_run(void *arg)
+#define PTASK_HASH_LOCK() pthread_mutex_lock(&ptask_hash_mutex)
+#define PTASK_HASH_UNLOCK() pthread_mutex_unlock(&ptask_hash_mutex)
+
+#define PTASK_WORKER_LOCK(w)   pthread_mutex_lock(&(w)->lock)
+#define PTASK_WORKER_UNLOCK(w) pthread_mutex_unlock(&(w)->lock)
+
+/* Compute the next run time of a task */
+static void ptask_reschedule(ptask_t *task,m_tmcnt_t now,int busy)
 {
-   pthread_mutex_t umutex = PTHREAD_MUTEX_INITIALIZER;
-   pthread_cond_t ucond = PTHREAD_COND_INITIALIZER;
+   u_int max_interval = ptask_sleep_time * 1000;
+
+   if (!(task->flags & PTASK_ADAPTIVE)) {
+      task->next_run = now + max_interval;
+      return;
+   }
+
+   /* Busy: poll again at once. Idle: back off up to the sleep time */
+   if (busy) {
+      task->interval = 0;
+   } else {
+      task->interval = task->interval ? task->interval * 2 : PTASK_MIN_INTERVAL;
+
+      if (task->interval > max_interval)
+         task->interval = max_interval;
+   }
 
+   task->next_run = now + task->interval;
+}
+
+/* Periodic task worker thread */
+static void *ptask_run(void *arg)
+{
+   struct ptask_worker *w = arg;
+   struct timespec t_spc;
+   m_tmcnt_t now,next;
    ptask_t *task;
+   int busy;
 
    for(;;) {
-      PTASK_LOCK();
-      for(task=ptask_list;task;task=task->next)
-         task->cbk(task->object,task->arg);
-      PTASK_UNLOCK();
+      now = m_gettime_usec();
+      next = now + (ptask_sleep_time * 1000);
 
-      /* For testing! */
-      {
-         struct timespec t_spc;
-         m_tmcnt_t expire;
+      PTASK_WORKER_LOCK(w);
+      for(task=w->list;task;task=task->next) {
+         if (task->paused)
+            continue;
 
-         expire = m_gettime_usec() + (ptask_sleep_time * 1000);
+         if (task->kicked || (now >= task->next_run)) {
+            task->kicked = FALSE;
+            busy = task->cbk(task->object,task->arg);
+            ptask_reschedule(task,now,busy);
+            w->run_count++;
+         }
 
-         pthread_mutex_lock(&umutex);
-         t_spc.tv_sec = expire / 1000000;
-         t_spc.tv_nsec = (expire % 1000000) * 1000;
-         pthread_cond_timedwait(&ucond,&umutex,&t_spc);
-         pthread_mutex_unlock(&umutex);
+         if (task->next_run < next)
+            next = task->next_run;
       }
+      PTASK_WORKER_UNLOCK(w);
 
-      /* Old method... */
-      //usleep(ptask_sleep_time*1000);
+      /* Wait for the next task to run, or for a doorbell */
+      pthread_mutex_lock(&w->wake_lock);
+
+      if (!w->wakeup && (next > m_gettime_usec())) {
+         t_spc.tv_sec = next / 1000000;
+         t_spc.tv_nsec = (next % 1000000) * 1000;
+         pthread_cond_timedwait(&w->wake_cond,&w->wake_lock,&t_spc);
+      }
+
+      w->wakeup = FALSE;
+      pthread_mutex_unlock(&w->wake_lock);
    }
 
    return NULL;
 }
 
-/* Add a new task */
-ptask_id_t ptask_add(ptask_callback cbk,void *object,void *arg)
+/* Start a worker thread (ptask lock held) */
+static int ptask_worker_start(struct ptask_worker *w,u_int id)
+{
+   memset(w,0,sizeof(*w));
+   w->id = id;
+   pthread_mutex_init(&w->lock,NULL);
+   pthread_mutex_init(&w->wake_lock,NULL);
+   pthread_cond_init(&w->wake_cond,NULL);
+
+   if (pthread_create(&w->thread,NULL,ptask_run,w) != 0) {
+      fprintf(stderr,"ptask_worker_start: unable to create thread.\n");
+      pthread_cond_destroy(&w->wake_cond);
+      pthread_mutex_destroy(&w->wake_lock);
+      pthread_mutex_destroy(&w->lock);
+      return(-1);
+   }
+
+   return(0);
+}
+
+/* Find the worker running the tasks of a group (ptask lock held) */
+static struct ptask_worker *ptask_find_group_worker(void *group)
 {
+   struct ptask_worker *w = NULL;
+   ptask_t *task;
+   u_int i;
+
+   PTASK_HASH_LOCK();
+
+   for(i=0;(i<PTASK_HASH_SIZE) && !w;i++)
+      for(task=ptask_hash[i];task;task=task->hash_next)
+         if (task->group == group) {
+            w = task->worker;
+            break;
+         }
+
+   PTASK_HASH_UNLOCK();
+   return w;
+}
+
+/* Select the worker for a new task (ptask lock held) */
+static struct ptask_worker *ptask_select_worker(void *group)
+{
+   struct ptask_worker *w = NULL;
+   u_int i;
+
+   /* Keep the tasks of a group on the same worker */
+   if ((group != NULL) && (w = ptask_find_group_worker(group)))
+      return w;
+
+   /* Use the least loaded shared worker */
+   for(i=0;i<ptask_worker_count;i++) {
+      if (ptask_workers[i].pinned)
+         continue;
+
+      if (!w || (ptask_workers[i].task_count < w->task_count))
+         w = &ptask_workers[i];
+   }
+
+   return w;
+}
+
+/* Get the number of shared workers (ptask lock held) */
+static u_int ptask_get_shared_workers(void)
+{
+   u_int i,count = 0;
+
+   for(i=0;i<ptask_worker_count;i++)
+      if (!ptask_workers[i].pinned)
+         count++;
+
+   return(count);
+}
+
+/* Check if a worker only runs tasks of a group (ptask lock held) */
+static int ptask_worker_has_only_group(struct ptask_worker *w,void *group)
+{
+   ptask_t *task;
+
+   for(task=w->list;task;task=task->next)
+      if (task->group != group)
+         return(FALSE);
+
+   return(TRUE);
+}
+
+/* Wake up a worker thread */
+static void ptask_worker_wakeup(struct ptask_worker *w)
+{
+   pthread_mutex_lock(&w->wake_lock);
+   w->wakeup = TRUE;
+   w->kick_count++;
+   pthread_cond_signal(&w->wake_cond);
+   pthread_mutex_unlock(&w->wake_lock);
+}
+
+/* Add a new task with flags */
+ptask_id_t ptask_add_ext(ptask_callback cbk,void *object,void *arg,
+                         void *group,u_int flags)
+{
+   struct ptask_worker *w;
    ptask_t *task;
    ptask_id_t id;
+   u_int h;
 
    if (!(task = malloc(sizeof(*task)))) {
       fprintf(stderr,"ptask_add: unable to add new task.\n");
@@ -82,48 +247,325 @@ ptask_id_t ptask_add(ptask_callback cbk,void *object,void *arg)
    task->cbk = cbk;
    task->object = object;
    task->arg = arg;
+   task->group = group;
+   task->flags = flags;
+   task->next_run = m_gettime_usec();
 
    PTASK_LOCK();
    id = ++ptask_current_id;
    assert(id != 0);
    task->id = id;
-   task->next = ptask_list;
-   ptask_list = task;
+
+   w = ptask_select_worker(group);
+   task->worker = w;
+
+   PTASK_WORKER_LOCK(w);
+   task->next = w->list;
+   w->list = task;
+   w->task_count++;
+   PTASK_WORKER_UNLOCK(w);
+
+   h = id % PTASK_HASH_SIZE;
+
+   PTASK_HASH_LOCK();
+   task->hash_next = ptask_hash[h];
+   ptask_hash[h] = task;
+   PTASK_HASH_UNLOCK();
+
    PTASK_UNLOCK();
    return(id);
 }
 
+/* Add a new task */
+ptask_id_t ptask_add(ptask_callback cbk,void *object,void *arg)
+{
+   return(ptask_add_ext(cbk,object,arg,NULL,0));
+}
+
 /* Remove a task */
 int ptask_remove(ptask_id_t id)
 {   
-   ptask_t **task,*p;
-   int res = -1;
+   struct ptask_worker *w;
+   ptask_t **task,*p = NULL;
 
    PTASK_LOCK();
+   PTASK_HASH_LOCK();
 
-   for(task=&ptask_list;*task;task=&(*task)->next)
+   for(task=&ptask_hash[id % PTASK_HASH_SIZE];*task;task=&(*task)->hash_next)
       if ((*task)->id == id) {
          p = *task;
-         *task = (*task)->next;
-         free(p);
-         res = 0;
+         *task = (*task)->hash_next;
          break;
       }
-   
+
+   PTASK_HASH_UNLOCK();
+
+   if (p != NULL) {
+      w = p->worker;
+
+      /* Wait for the worker to complete its current pass */
+      PTASK_WORKER_LOCK(w);
+
+      for(task=&w->list;*task;task=&(*task)->next)
+         if (*task == p) {
+            *task = p->next;
+            break;
+         }
+
+      w->task_count--;
+      PTASK_WORKER_UNLOCK(w);
+   }
+
+   PTASK_UNLOCK();
+
+   if (!p)
+      return(-1);
+
+   free(p);
+   return(0);
+}
+
+/* Run a task as soon as possible (doorbell) */
+void ptask_kick(ptask_id_t id)
+{
+   struct ptask_worker *w = NULL;
+   ptask_t *task;
+
+   PTASK_HASH_LOCK();
+
+   for(task=ptask_hash[id % PTASK_HASH_SIZE];task;task=task->hash_next)
+      if (task->id == id) {
+         task->kicked = TRUE;
+         w = task->worker;
+         break;
+      }
+
+   PTASK_HASH_UNLOCK();
+
+   if (w != NULL)
+      ptask_worker_wakeup(w);
+}
+
+/* Set the pause state of the tasks of a group (ptask lock held) */
+static void ptask_group_set_paused(void *group,int paused,
+                                   int *workers)
+{
+   ptask_t *task;
+   u_int i;
+
+   PTASK_HASH_LOCK();
+
+   for(i=0;i<PTASK_HASH_SIZE;i++)
+      for(task=ptask_hash[i];task;task=task->hash_next)
+         if (task->group == group) {
+            task->paused = paused;
+            workers[task->worker->id] = TRUE;
+         }
+
+   PTASK_HASH_UNLOCK();
+}
+
+/* 
+ * Pause the tasks of a group. Once this returns, none of them is running
+ * anymore: the workers running them have completed their current pass.
+ */
+void ptask_group_pause(void *group)
+{
+   int workers[PTASK_MAX_WORKERS] = { 0 };
+   u_int i;
+
+   PTASK_LOCK();
+   ptask_group_set_paused(group,TRUE,workers);
+
+   for(i=0;i<ptask_worker_count;i++)
+      if (workers[i]) {
+         PTASK_WORKER_LOCK(&ptask_workers[i]);
+         PTASK_WORKER_UNLOCK(&ptask_workers[i]);
+      }
+
+   PTASK_UNLOCK();
+}
+
+/* Resume the tasks of a group */
+void ptask_group_resume(void *group)
+{
+   int workers[PTASK_MAX_WORKERS] = { 0 };
+   u_int i;
+
+   PTASK_LOCK();
+   ptask_group_set_paused(group,FALSE,workers);
+
+   /* Doorbells rung during the pause are handled now */
+   for(i=0;i<ptask_worker_count;i++)
+      if (workers[i])
+         ptask_worker_wakeup(&ptask_workers[i]);
+
+   PTASK_UNLOCK();
+}
+
+/* Set the number of shared worker threads (can only be increased) */
+int ptask_set_workers(u_int count)
+{
+   int res = 0;
+
+   if ((count == 0) || (count > PTASK_MAX_WORKERS))
+      return(-1);
+
+   PTASK_LOCK();
+
+   while(ptask_get_shared_workers() < count) {
+      if ((ptask_worker_count == PTASK_MAX_WORKERS) ||
+          (ptask_worker_start(&ptask_workers[ptask_worker_count],
+                              ptask_worker_count) == -1))
+      {
+         res = -1;
+         break;
+      }
+
+      ptask_worker_count++;
+   }
+
    PTASK_UNLOCK();
    return(res);
 }
 
-/* Initialize ptask module */
-int ptask_init(u_int sleep_time)
+/* 
+ * Get a pinned worker for a group bound to a CPU set (ptask lock held):
+ * the worker already used for this CPU set, the current worker of the group
+ * if it runs nothing else, an empty pinned worker or a new one.
+ */
+static struct ptask_worker *ptask_get_pinned_worker(struct ptask_worker *cur,
+                                                    void *group,
+                                                    affinity_set_t *set)
 {
-   if (sleep_time)
-      ptask_sleep_time = sleep_time;
+   struct ptask_worker *w = NULL;
+   u_int i;
+
+   for(i=0;i<ptask_worker_count;i++) {
+      if (ptask_workers[i].pinned && 
+          affinity_is_equal(&ptask_workers[i].cpus,set))
+         return(&ptask_workers[i]);
+   }
+
+   if (cur->pinned && ptask_worker_has_only_group(cur,group)) {
+      w = cur;
+   } else {
+      for(i=0;i<ptask_worker_count;i++)
+         if (ptask_workers[i].pinned && !ptask_workers[i].task_count) {
+            w = &ptask_workers[i];
+            break;
+         }
+   }
+
+   if (!w) {
+      if ((ptask_worker_count == PTASK_MAX_WORKERS) ||
+          (ptask_worker_start(&ptask_workers[ptask_worker_count],
+                              ptask_worker_count) == -1))
+         return NULL;
 
-   if (pthread_create(&ptask_thread,NULL,ptask_run,NULL) != 0) {
-      fprintf(stderr,"ptask_init: unable to create thread.\n");
+      w = &ptask_workers[ptask_worker_count++];
+      w->pinned = TRUE;
+   }
+
+   if (affinity_set_thread(w->thread,set) == -1)
+      return NULL;
+
+   w->cpus = *set;
+   return w;
+}
+
+/* Move the tasks of a group to another worker (ptask lock held) */
+static void ptask_move_group(struct ptask_worker *from,struct ptask_worker *to,
+                             void *group)
+{
+   ptask_t **task,*p;
+
+   /* Wait for both workers to complete their current pass */
+   PTASK_WORKER_LOCK(from);
+   PTASK_WORKER_LOCK(to);
+
+   for(task=&from->list;*task;) {
+      p = *task;
+
+      if (p->group != group) {
+         task = &p->next;
+         continue;
+      }
+
+      *task = p->next;
+      p->next = to->list;
+      to->list = p;
+
+      from->task_count--;
+      to->task_count++;
+
+      /* Doorbells look up the worker of a task in the hash table */
+      PTASK_HASH_LOCK();
+      p->worker = to;
+      PTASK_HASH_UNLOCK();
+   }
+
+   PTASK_WORKER_UNLOCK(to);
+   PTASK_WORKER_UNLOCK(from);
+
+   /* Doorbells rung during the move are handled now */
+   ptask_worker_wakeup(to);
+}
+
+/* 
+ * Bind the tasks of a group to a CPU set. They are moved to a pinned
+ * worker, shared only with the groups bound to the same CPU set.
+ */
+int ptask_set_group_affinity(void *group,affinity_set_t *set)
+{
+   struct ptask_worker *cur,*w;
+   int res = 0;
+
+   PTASK_LOCK();
+
+   if ((cur = ptask_find_group_worker(group)) != NULL) {
+      if (!(w = ptask_get_pinned_worker(cur,group,set)))
+         res = -1;
+      else if (w != cur)
+         ptask_move_group(cur,w,group);
+   }
+
+   PTASK_UNLOCK();
+   return(res);
+}
+
+/* Get the number of worker threads */
+u_int ptask_get_workers(void)
+{
+   return(ptask_worker_count);
+}
+
+/* Get statistics about a worker thread */
+int ptask_get_worker_stats(u_int id,u_int *task_count,
+                           m_uint64_t *run_count,m_uint64_t *kick_count)
+{
+   struct ptask_worker *w;
+
+   PTASK_LOCK();
+
+   if (id >= ptask_worker_count) {
+      PTASK_UNLOCK();
       return(-1);
    }
 
+   w = &ptask_workers[id];
+   *task_count = w->task_count;
+   *run_count  = w->run_count;
+   *kick_count = w->kick_count;
+   PTASK_UNLOCK();
    return(0);
 }
+
+/* Initialize ptask module */
+int ptask_init(u_int sleep_time)
+{
+   if (sleep_time)
+      ptask_sleep_time = sleep_time;
+
+   return(ptask_set_workers(1));
+}
@@ -12,20 +12,43 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include "utils.h"
+#include "affinity.h"
+
+/* Maximum number of worker threads */
+#define PTASK_MAX_WORKERS  16
+
+/* Task flags */
+#define PTASK_ADAPTIVE  0x01   /* Polled again at once while busy */
+
+/* Minimum polling interval of an idle adaptive task (in usec) */
+#define PTASK_MIN_INTERVAL  250
 
 /* ptask identifier */
 typedef m_int64_t ptask_id_t;
 
-/* periodic task callback prototype */
+/* 
+ * periodic task callback prototype.
+ * For adaptive tasks, the callback returns TRUE if it had some work to do.
+ */
 typedef int (*ptask_callback)(void *object,void *arg);
 
+struct ptask_worker;
+
 /* periodic task definition */
 typedef struct ptask ptask_t;
 struct ptask {
    ptask_id_t id;
    ptask_t *next;
+   ptask_t *hash_next;
    ptask_callback cbk;
    void *object,*arg;
+   void *group;
+   u_int flags;
+   u_int interval;
+   m_tmcnt_t next_run;
+   volatile int kicked;
+   volatile int paused;
+   struct ptask_worker *worker;
 };
 
 extern u_int ptask_sleep_time;
@@ -33,9 +56,42 @@ extern u_int ptask_sleep_time;
 /* Add a new task */
 ptask_id_t ptask_add(ptask_callback cbk,void *object,void *arg);
 
+/* 
+ * Add a new task with flags. Tasks of the same group (typically a VM) are 
+ * run by the same worker thread.
+ */
+ptask_id_t ptask_add_ext(ptask_callback cbk,void *object,void *arg,
+                         void *group,u_int flags);
+
 /* Remove a task */
 int ptask_remove(ptask_id_t id);
 
+/* Run a task as soon as possible (doorbell) */
+void ptask_kick(ptask_id_t id);
+
+/* Set the number of shared worker threads (can only be increased) */
+int ptask_set_workers(u_int count);
+
+/* 
+ * Pause the tasks of a group (waiting for the end of the running ones), 
+ * or resume them.
+ */
+void ptask_group_pause(void *group);
+void ptask_group_resume(void *group);
+
+/* 
+ * Bind the tasks of a group to a CPU set: they are moved to a worker 
+ * thread pinned to this set, which does not run the other groups.
+ */
+int ptask_set_group_affinity(void *group,affinity_set_t *set);
+
+/* Get the number of worker threads */
+u_int ptask_get_workers(void);
+
+/* Get statistics about a worker thread */
+int ptask_get_worker_stats(u_int id,u_int *task_count,
+                           m_uint64_t *run_count,m_uint64_t *kick_count);
+
 /* Initialize ptask module */
 int ptask_init(u_int sleep_time);
 
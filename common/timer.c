@@ -92,6 +92,142 @@ timer_queue_t *timer_select_queue_from_pool(void)
    return s_queue;
 }
 
+#ifdef TIMER_WHEEL
+/* 
+ * Hierarchical timing wheel: TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SIZE
+ * slots, level N covering TIMER_WHEEL_SIZE^(N+1) ticks. Insertion and 
+ * removal are O(1). The timers of an upper level slot are moved to the 
+ * lower levels when the wheel reaches it (cascade), and all the timers 
+ * of a level 0 slot expire together.
+ */
+
+/* Insert a timer in a slot */
+static inline void timer_slot_insert(timer_entry_t **slot,timer_entry_t *timer)
+{
+   timer->slot = slot;
+   timer->prev = NULL;
+   timer->next = *slot;
+
+   if (timer->next)
+      timer->next->prev = timer;
+
+   *slot = timer;
+}
+
+/* Insert a timer in the wheel, relative to the last processed tick */
+static void timer_wheel_insert(timer_queue_t *queue,timer_entry_t *timer)
+{
+   m_tmcnt_t expire = timer->expire;
+   m_tmcnt_t delta;
+   u_int i,shift;
+
+   if (expire <= queue->wheel_time) {
+      timer_slot_insert(&queue->due,timer);
+      return;
+   }
+
+   delta = expire - queue->wheel_time;
+
+   for(i=0;i<TIMER_WHEEL_LEVELS;i++) {
+      shift = i * TIMER_WHEEL_BITS;
+
+      if (delta < ((m_tmcnt_t)TIMER_WHEEL_SIZE << shift)) {
+         timer_slot_insert(&queue->wheel[i][(expire >> shift) & 
+                                            TIMER_WHEEL_MASK],timer);
+         return;
+      }
+   }
+
+   /* Beyond the wheel range: use the farthest slot of the last level */
+   shift = (TIMER_WHEEL_LEVELS - 1) * TIMER_WHEEL_BITS;
+   i = ((queue->wheel_time >> shift) + TIMER_WHEEL_MASK) & TIMER_WHEEL_MASK;
+   timer_slot_insert(&queue->wheel[TIMER_WHEEL_LEVELS-1][i],timer);
+}
+
+/* Add a timer in a queue */
+static inline void timer_add_to_queue(timer_queue_t *queue,
+                                      timer_entry_t *timer)
+{
+   /* Restart the wheel from the current time if it was empty */
+   if (queue->timer_count == 0)
+      queue->wheel_time = m_gettime();
+
+   timer->queue = queue;
+   timer_wheel_insert(queue,timer);
+
+   /* Increment number of timers in queue */
+   queue->timer_count++;
+
+   /* Increment criticity level */
+   queue->level += timer->level;
+}
+
+/* Remove a timer from queue */
+static inline void timer_remove_from_queue(timer_queue_t *queue,
+                                           timer_entry_t *timer)
+{
+   /* Not queued (running or not rescheduled) */
+   if (!timer->slot)
+      return;
+
+   if (timer->prev)
+      timer->prev->next = timer->next;
+   else
+      *timer->slot = timer->next;
+
+   if (timer->next)
+      timer->next->prev = timer->prev;
+
+   timer->next = timer->prev = NULL;
+   timer->slot = NULL;
+
+   /* Decrement number of timers in queue */
+   queue->timer_count--;
+
+   /* Decrement criticity level */
+   queue->level -= timer->level;
+}
+
+/* Move the timers of an upper level slot to the lower levels */
+static void timer_wheel_cascade(timer_queue_t *queue,u_int level,u_int index)
+{
+   timer_entry_t *timer,*next;
+
+   timer = queue->wheel[level][index];
+   queue->wheel[level][index] = NULL;
+
+   for(;timer;timer=next) {
+      next = timer->next;
+      timer_wheel_insert(queue,timer);
+   }
+}
+
+/* Get the date at which the timer loop must be woken up */
+static int timer_queue_next_expire(timer_queue_t *queue,m_tmcnt_t *expire)
+{
+   m_tmcnt_t t;
+   u_int i;
+
+   if (queue->timer_count == 0)
+      return(FALSE);
+
+   if (queue->due != NULL) {
+      *expire = queue->wheel_time;
+      return(TRUE);
+   }
+
+   /* First non-empty level 0 slot, or next cascade */
+   for(i=1;i<=TIMER_WHEEL_SIZE;i++) {
+      t = queue->wheel_time + i;
+
+      if (!(t & TIMER_WHEEL_MASK) || queue->wheel[0][t & TIMER_WHEEL_MASK])
+         break;
+   }
+
+   *expire = t;
+   return(TRUE);
+}
+#else
 /* Add a timer in a queue */
 static inline void timer_add_to_queue(timer_queue_t *queue,
                                       timer_entry_t *timer)
@@ -124,15 +260,6 @@ static inline void timer_add_to_queue(timer_queue_t *queue,
    queue->level += timer->level;
 }
 
-/* Add a timer in a queue atomically */
-_Unused static inline void timer_add_to_queue_atomic(timer_queue_t *queue,
-                                             timer_entry_t *timer)
-{
-   TIMERQ_LOCK(queue);
-   timer_add_to_queue(queue,timer);
-   TIMERQ_UNLOCK(queue);
-}
-
 /* Remove a timer from queue */
 static inline void timer_remove_from_queue(timer_queue_t *queue,
                                            timer_entry_t *timer)
@@ -154,6 +281,26 @@ static inline void timer_remove_from_queue(timer_queue_t *queue,
    queue->level -= timer->level;
 }
 
+/* Get the date at which the timer loop must be woken up */
+static int timer_queue_next_expire(timer_queue_t *queue,m_tmcnt_t *expire)
+{
+   if (!queue->list)
+      return(FALSE);
+
+   *expire = queue->list->expire;
+   return(TRUE);
+}
+#endif
+
+/* Add a timer in a queue atomically */
+_Unused static inline void timer_add_to_queue_atomic(timer_queue_t *queue,
+                                             timer_entry_t *timer)
+{
+   TIMERQ_LOCK(queue);
+   timer_add_to_queue(queue,timer);
+   TIMERQ_UNLOCK(queue);
+}
+
 /* Remove a timer from a queue atomically */
 static inline void 
 timer_remove_from_queue_atomic(timer_queue_t *queue,timer_entry_t *timer)
@@ -223,12 +370,81 @@ static int timer_schedule(timer_entry_t *timer)
    return(0);
 }
 
+/* Run a timer removed from its queue, and reschedule it if required */
+static inline void timer_run(timer_queue_t *queue,timer_entry_t *timer)
+{
+   timer->flags |= TIMER_RUNNING;
+
+   if (timer_exec(timer))
+      timer_schedule_in_queue(queue,timer);
+}
+
+#ifdef TIMER_WHEEL
+/* Advance the wheel up to the current time and run the expired timers */
+static void timer_queue_run(timer_queue_t *queue,m_tmcnt_t c_time)
+{
+   timer_entry_t *timer,*next;
+   m_tmcnt_t t;
+   int i;
+
+   while(queue->wheel_time < c_time) {
+      t = ++queue->wheel_time;
+
+      /* Cascade the upper levels when the lower ones wrap */
+      for(i=1;i<TIMER_WHEEL_LEVELS;i++)
+         if (t & (((m_tmcnt_t)1 << (i * TIMER_WHEEL_BITS)) - 1))
+            break;
+
+      while(--i > 0)
+         timer_wheel_cascade(queue,i,(t >> (i * TIMER_WHEEL_BITS)) & 
+                             TIMER_WHEEL_MASK);
+
+      /* Run all the timers of the current slot */
+      timer = queue->wheel[0][t & TIMER_WHEEL_MASK];
+
+      for(;timer;timer=next) {
+         next = timer->next;
+         timer_remove_from_queue(queue,timer);
+         timer_run(queue,timer);
+      }
+   }
+
+   /* Timers which were already expired when (re)scheduled */
+   timer = queue->due;
+
+   for(;timer;timer=next) {
+      next = timer->next;
+      timer_remove_from_queue(queue,timer);
+      timer_run(queue,timer);
+   }
+}
+#else
+/* Run the first timer of the queue if it has expired */
+static void timer_queue_run(timer_queue_t *queue,m_tmcnt_t c_time)
+{
+   timer_entry_t *timer;
+
+   /* Get first event */
+   timer = queue->list;
+
+   /* If there is nothing to do for now, wait again */
+   if ((timer == NULL) || (timer->expire > c_time))
+      return;
+
+   /* 
+    * We have a timer to manage. Remove it from queue and mark it as
+    * running.
+    */
+   timer_remove_from_queue(queue,timer);
+   timer_run(queue,timer);
+}
+#endif
+
 /* Timer loop */
 static void *timer_loop(timer_queue_t *queue)
 {
    struct timespec t_spc;
-   timer_entry_t *timer;
-   m_tmcnt_t c_time;
+   m_tmcnt_t c_time,expire;
 
    /* Set signal properties */
    m_signal_block(SIGINT);
@@ -246,16 +462,13 @@ static void *timer_loop(timer_queue_t *queue)
          break;
       }
 
-      /* Get first event */
-      timer = queue->list;
-
       /* 
        * If we have timers in queue, we setup a timer to wait for first one.
        * In all cases, thread is woken up when a reschedule occurs.
        */
-      if (timer) {
-         t_spc.tv_sec = timer->expire / 1000;
-         t_spc.tv_nsec = (timer->expire % 1000) * 1000000;
+      if (timer_queue_next_expire(queue,&expire)) {
+         t_spc.tv_sec = expire / 1000;
+         t_spc.tv_nsec = (expire % 1000) * 1000000;
          pthread_cond_timedwait(&queue->schedule,&queue->lock,&t_spc);
       }
       else {
@@ -276,26 +489,8 @@ static void *timer_loop(timer_queue_t *queue)
        */
       c_time = m_gettime();
 
-      /* Get first event */
-      timer = queue->list;
-
-      /* If there is nothing to do for now, wait again */
-      if ((timer == NULL) || (timer->expire > c_time)) {
-         TIMERQ_UNLOCK(queue);
-         continue;
-      }
-
-      /* 
-       * We have a timer to manage. Remove it from queue and mark it as
-       * running.
-       */
-      timer_remove_from_queue(queue,timer);
-      timer->flags |= TIMER_RUNNING;
-      
-      /* Execute user function and reschedule timer if required */
-      if (timer_exec(timer))
-         timer_schedule_in_queue(queue,timer);
-
+      /* Execute user functions and reschedule timers if required */
+      timer_queue_run(queue,c_time);
       TIMERQ_UNLOCK(queue);
    }
 
@@ -452,9 +647,8 @@ timer_queue_t *timer_create_queue(void)
    if (!(queue = malloc(sizeof(*queue))))
       return NULL;
 
+   memset(queue,0,sizeof(*queue));
    queue->running = TRUE;
-   queue->list = NULL;
-   queue->level = 0;
 
    /* Create mutex */
    if (pthread_mutex_init(&queue->lock,NULL))
@@ -498,11 +692,31 @@ void timer_flush_queues(void)
       queue->running = FALSE;
 
       /* suppress all timers */
+#ifdef TIMER_WHEEL
+      {
+         u_int i,j;
+
+         for(i=0;i<TIMER_WHEEL_LEVELS;i++)
+            for(j=0;j<TIMER_WHEEL_SIZE;j++)
+               for(timer=queue->wheel[i][j];timer;timer=next_timer) {
+                  next_timer = timer->next;
+                  timer_free_id(timer->id);
+                  free(timer);
+               }
+
+         for(timer=queue->due;timer;timer=next_timer) {
+            next_timer = timer->next;
+            timer_free_id(timer->id);
+            free(timer);
+         }
+      }
+#else
       for(timer=queue->list;timer;timer=next_timer) {
          next_timer = timer->next;
          timer_free_id(timer->id);
          free(timer);
       }
+#endif
 
       /* signal changes to the queue thread */
       pthread_cond_signal(&queue->schedule);
@@ -32,6 +32,14 @@ typedef int (*timer_proc)(void *,timer_entry_t *);
 /* Number of entries in hash table */
 #define TIMER_HASH_SIZE  512
 
+#ifdef TIMER_WHEEL
+/* Timing wheel: number of levels and slots per level (1 tick = 1 msec) */
+#define TIMER_WHEEL_LEVELS  4
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SIZE    (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SIZE - 1)
+#endif
+
 /* Timer properties */
 struct timer_entry {
    long interval;                   /* Interval in msecs */
@@ -44,11 +52,20 @@ struct timer_entry {
 
    timer_queue_t *queue;            /* Associated Timer Queue */
    timer_entry_t *prev,*next;       /* Double linked-list */
+#ifdef TIMER_WHEEL
+   timer_entry_t **slot;            /* Wheel slot containing the timer */
+#endif
 };
 
 /* Timer Queue */
 struct timer_queue {
+#ifdef TIMER_WHEEL
+   timer_entry_t *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+   timer_entry_t *due;              /* Expired timers not run yet */
+   m_tmcnt_t wheel_time;            /* Last processed tick */
+#else
    timer_entry_t * volatile list;   /* List of timers */
+#endif
    pthread_mutex_t lock;            /* Mutex for concurrent accesses */
    pthread_cond_t schedule;         /* Scheduling condition */
    pthread_t thread;                /* Thread running timer loop */
@@ -0,0 +1,257 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Timer IRQ service: drives the virtual clock of all CPUs from a single
+ * thread, instead of one thread per CPU.
+ *
+ * Tick dates are aligned on multiples of the tick interval, so CPUs using
+ * the same frequency share the wakeups of the service: with the default
+ * frequency, there are 250 wakeups per second whatever the number of CPUs.
+ * Ticks missed by a late wakeup are posted at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+#include "utils.h"
+#include "timer_irq.h"
+
+/* Virtual clocks handled by the service */
+static timer_irq_entry_t *timer_irq_list = NULL;
+static pthread_mutex_t timer_irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t timer_irq_thread;
+static int timer_irq_running = FALSE;
+
+/* Date of the next wakeup of the service (0: none) */
+static m_tmcnt_t timer_irq_next = 0;
+
+#ifdef __linux__
+static int timer_irq_fd = -1;
+#else
+static pthread_cond_t timer_irq_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* Get the host time used by virtual clocks (usec) */
+static inline m_tmcnt_t timer_irq_gettime(void)
+{
+#ifdef CLOCK_MONOTONIC
+   struct timespec t_spc;
+
+   clock_gettime(CLOCK_MONOTONIC,&t_spc);
+   return(((m_tmcnt_t)t_spc.tv_sec * 1000000) + (t_spc.tv_nsec / 1000));
+#else
+   return(m_gettime_usec());
+#endif
+}
+
+/* Get the ticks elapsed at the specified date, and schedule the next one */
+static inline u_int timer_irq_elapsed(timer_irq_entry_t *entry,m_tmcnt_t now)
+{
+   u_int ticks;
+
+   if (now < entry->expire)
+      return(0);
+
+   ticks = ((now - entry->expire) / entry->interval) + 1;
+   entry->expire += ticks * entry->interval;
+   return(ticks);
+}
+
+/* Schedule the next wakeup of the service (lock held) */
+static void timer_irq_arm(m_tmcnt_t expire)
+{
+#ifdef __linux__
+   struct itimerspec its;
+
+   memset(&its,0,sizeof(its));
+   its.it_value.tv_sec  = expire / 1000000;
+   its.it_value.tv_nsec = (expire % 1000000) * 1000;
+
+   /* A zero date disarms the timer */
+   if (timerfd_settime(timer_irq_fd,TFD_TIMER_ABSTIME,&its,NULL) == -1)
+      perror("timer_irq_arm: timerfd_settime");
+#else
+   pthread_cond_signal(&timer_irq_cond);
+#endif
+   timer_irq_next = expire;
+}
+
+/* Wait for the next wakeup date (lock held) */
+static void timer_irq_wait(void)
+{
+#ifdef __linux__
+   m_uint64_t count;
+
+   pthread_mutex_unlock(&timer_irq_lock);
+
+   if ((read(timer_irq_fd,&count,sizeof(count)) == -1) && (errno != EINTR))
+      perror("timer_irq_wait: read");
+
+   pthread_mutex_lock(&timer_irq_lock);
+#else
+   struct timespec t_spc;
+   m_tmcnt_t now,expire;
+
+   if (!timer_irq_next) {
+      pthread_cond_wait(&timer_irq_cond,&timer_irq_lock);
+      return;
+   }
+
+   /* Condition variables use the real time clock */
+   now = timer_irq_gettime();
+
+   if (timer_irq_next <= now)
+      return;
+
+   expire = m_gettime_usec() + (timer_irq_next - now);
+   t_spc.tv_sec = expire / 1000000;
+   t_spc.tv_nsec = (expire % 1000000) * 1000;
+   pthread_cond_timedwait(&timer_irq_cond,&timer_irq_lock,&t_spc);
+#endif
+}
+
+/* Timer IRQ service thread */
+static void *timer_irq_run(void *arg)
+{
+   timer_irq_entry_t *entry;
+   m_tmcnt_t now,next;
+   u_int ticks;
+
+   pthread_mutex_lock(&timer_irq_lock);
+
+   for(;;) {
+      now = timer_irq_gettime();
+      next = 0;
+
+      for(entry=timer_irq_list;entry;entry=entry->next) {
+         if ((ticks = timer_irq_elapsed(entry,now)) != 0)
+            entry->tick(entry->arg,ticks);
+
+         if (!next || (entry->expire < next))
+            next = entry->expire;
+      }
+
+      timer_irq_arm(next);
+      timer_irq_wait();
+   }
+
+   return NULL;
+}
+
+/* Start the timer IRQ service (lock held) */
+static int timer_irq_start(void)
+{
+#ifdef __linux__
+   if ((timer_irq_fd = timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC)) == -1) {
+      perror("timer_irq_start: timerfd_create");
+      return(-1);
+   }
+#endif
+
+   if (pthread_create(&timer_irq_thread,NULL,timer_irq_run,NULL) != 0) {
+      fprintf(stderr,"timer_irq_start: unable to create thread.\n");
+#ifdef __linux__
+      close(timer_irq_fd);
+      timer_irq_fd = -1;
+#endif
+      return(-1);
+   }
+
+   pthread_detach(timer_irq_thread);
+   timer_irq_running = TRUE;
+   return(0);
+}
+
+/* Initialize a virtual clock ticking at "freq" Hz */
+void timer_irq_entry_init(timer_irq_entry_t *entry,u_int freq,
+                          timer_irq_tick_t tick,void *arg)
+{
+   memset(entry,0,sizeof(*entry));
+   entry->interval = 1000000 / freq;
+   entry->tick = tick;
+   entry->arg = arg;
+
+   /* Align on the tick interval to share wakeups with other clocks */
+   entry->expire = ((timer_irq_gettime() / entry->interval) + 1) *
+      entry->interval;
+}
+
+/* Get ticks pushed to a virtual clock by the timer IRQ service */
+int timer_irq_add(timer_irq_entry_t *entry)
+{
+   pthread_mutex_lock(&timer_irq_lock);
+
+   if (!timer_irq_running && (timer_irq_start() == -1)) {
+      pthread_mutex_unlock(&timer_irq_lock);
+      return(-1);
+   }
+
+   entry->next = timer_irq_list;
+   entry->pprev = &timer_irq_list;
+
+   if (timer_irq_list)
+      timer_irq_list->pprev = &entry->next;
+
+   timer_irq_list = entry;
+   entry->linked = TRUE;
+
+   if (!timer_irq_next || (entry->expire < timer_irq_next))
+      timer_irq_arm(entry->expire);
+
+   pthread_mutex_unlock(&timer_irq_lock);
+   return(0);
+}
+
+/*
+ * Stop pushing ticks to a virtual clock. The tick callback is not running
+ * anymore when this function returns.
+ */
+void timer_irq_remove(timer_irq_entry_t *entry)
+{
+   pthread_mutex_lock(&timer_irq_lock);
+
+   if (entry->linked) {
+      if (entry->next)
+         entry->next->pprev = entry->pprev;
+
+      *(entry->pprev) = entry->next;
+      entry->linked = FALSE;
+   }
+
+   pthread_mutex_unlock(&timer_irq_lock);
+}
+
+/*
+ * Post the ticks elapsed since the last call, computed from host time
+ * (for virtual clocks not added to the service).
+ */
+u_int timer_irq_poll(timer_irq_entry_t *entry)
+{
+   u_int ticks;
+
+   if ((ticks = timer_irq_elapsed(entry,timer_irq_gettime())) != 0)
+      entry->tick(entry->arg,ticks);
+
+   return(ticks);
+}
+
+/* Get the delay until the next tick of a virtual clock (usec, 0 if due) */
+m_tmcnt_t timer_irq_delay(timer_irq_entry_t *entry)
+{
+   m_tmcnt_t now,expire;
+
+   now = timer_irq_gettime();
+   expire = entry->expire;
+
+   return((expire > now) ? (expire - now) : 0);
+}
@@ -0,0 +1,59 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Timer IRQ service: drives the virtual clock of all CPUs from a single
+ * thread, instead of one thread per CPU.
+ */
+
+#ifndef __TIMER_IRQ_H__
+#define __TIMER_IRQ_H__
+
+#include "utils.h"
+
+/* Callback posting timer ticks to a CPU */
+typedef void (*timer_irq_tick_t)(void *arg,u_int ticks);
+
+/* Virtual clock of a CPU */
+typedef struct timer_irq_entry timer_irq_entry_t;
+struct timer_irq_entry {
+   m_tmcnt_t interval;              /* Tick interval (usec) */
+   m_tmcnt_t expire;                /* Date of next tick (usec) */
+   timer_irq_tick_t tick;
+   void *arg;
+   int linked;
+   timer_irq_entry_t *next,**pprev;
+};
+
+/* Initialize a virtual clock ticking at "freq" Hz */
+void timer_irq_entry_init(timer_irq_entry_t *entry,u_int freq,
+                          timer_irq_tick_t tick,void *arg);
+
+/* Get ticks pushed to a virtual clock by the timer IRQ service */
+int timer_irq_add(timer_irq_entry_t *entry);
+
+/* Stop pushing ticks to a virtual clock */
+void timer_irq_remove(timer_irq_entry_t *entry);
+
+/*
+ * Post the ticks elapsed since the last call, computed from host time
+ * (for virtual clocks not added to the service).
+ */
+u_int timer_irq_poll(timer_irq_entry_t *entry);
+
+/* Get the delay until the next tick of a virtual clock (usec, 0 if due) */
+m_tmcnt_t timer_irq_delay(timer_irq_entry_t *entry);
+
+/* Take a pending tick posted to a CPU */
+static forced_inline int timer_irq_take(volatile u_int *pending)
+{
+   u_int val;
+
+   while((val = *pending) != 0)
+      if (__sync_bool_compare_and_swap(pending,val,val-1))
+         return(TRUE);
+
+   return(FALSE);
+}
+
+#endif
@@ -440,6 +440,116 @@ u_char *memzone_map_exec_area(size_t len)
    return(mmap_or_null(NULL,len,PROT_EXEC|PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,(off_t)0));
 }
 
+/*
+ * Map an anonymous memory zone populated on demand: pages are allocated
+ * (zeroed) by the kernel on first access, and no swap space is reserved.
+ */
+u_char *memzone_map_lazy(size_t len)
+{
+   int flags = MAP_PRIVATE|MAP_ANONYMOUS;
+
+#ifdef MAP_NORESERVE
+   flags |= MAP_NORESERVE;
+#endif
+   return(mmap_or_null(NULL,len,PROT_READ|PROT_WRITE,flags,-1,(off_t)0));
+}
+
+/* 
+ * Map an anonymous memory zone backed by huge pages. The length is rounded
+ * to a multiple of the huge page size (see MEMZONE_HUGE_ROUND).
+ *
+ * hugetlbfs pages are used first if requested. Otherwise, or if there are
+ * no free hugetlbfs pages, the zone is aligned on a huge page boundary and
+ * transparent huge pages are requested. If they are not available, normal
+ * pages are used: call memzone_get_huge_size() to check what was obtained.
+ */
+u_char *memzone_map_huge(size_t len,int exec,int huge)
+{
+   int prot = PROT_READ|PROT_WRITE;
+   size_t head,map_len;
+   u_char *ptr;
+
+   if (exec)
+      prot |= PROT_EXEC;
+
+   len = MEMZONE_HUGE_ROUND(len);
+
+#ifdef MAP_HUGETLB
+   if (huge == MEMZONE_HUGE_TLB) {
+      ptr = mmap_or_null(NULL,len,prot,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,
+                         -1,(off_t)0);
+      if (ptr != NULL)
+         return ptr;
+   }
+#endif
+
+   /* Map one more huge page to align the zone, and trim the excess */
+   map_len = len + MEMZONE_HUGE_PAGE_SIZE;
+   ptr = mmap_or_null(NULL,map_len,prot,MAP_PRIVATE|MAP_ANONYMOUS,-1,(off_t)0);
+
+   if (!ptr)
+      return NULL;
+
+   head = MEMZONE_HUGE_ROUND((m_iptr_t)ptr) - (m_iptr_t)ptr;
+
+   if (head != 0)
+      munmap(ptr,head);
+
+   munmap(ptr+head+len,MEMZONE_HUGE_PAGE_SIZE-head);
+   ptr += head;
+
+   memzone_advise_huge(ptr,len);
+   return ptr;
+}
+
+/* Ask the kernel to back a memory zone with transparent huge pages */
+int memzone_advise_huge(void *addr,size_t len)
+{
+#ifdef MADV_HUGEPAGE
+   return(madvise(addr,len,MADV_HUGEPAGE));
+#else
+   return(-1);
+#endif
+}
+
+/* Get the amount of memory backed by huge pages in a memory zone */
+size_t memzone_get_huge_size(void *addr,size_t len)
+{
+   static char *fields[] = { "AnonHugePages:", "ShmemPmdMapped:",
+                             "FilePmdMapped:", "Private_Hugetlb:",
+                             "Shared_Hugetlb:", NULL };
+   u_long start,end,zone_start,zone_end;
+   char buffer[256],name[64];
+   int i,in_zone = FALSE;
+   size_t total = 0;
+   u_long kb;
+   FILE *fd;
+
+   if (!(fd = fopen("/proc/self/smaps","r")))
+      return(0);
+
+   zone_start = (u_long)addr;
+   zone_end = zone_start + len;
+
+   while(fgets(buffer,sizeof(buffer),fd)) {
+      /* Mapping header: "start-end perms offset dev inode path" */
+      if (sscanf(buffer,"%lx-%lx ",&start,&end) == 2) {
+         in_zone = (start < zone_end) && (end > zone_start);
+         continue;
+      }
+
+      if (!in_zone || (sscanf(buffer,"%63s %lu kB",name,&kb) != 2))
+         continue;
+
+      for(i=0;fields[i];i++)
+         if (!strcmp(name,fields[i]))
+            total += (size_t)kb * 1024;
+   }
+
+   fclose(fd);
+   return(total);
+}
+
 /* Map a memory zone from a file */
 u_char *memzone_map_file(int fd,size_t len)
 {
@@ -0,0 +1,915 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * VM snapshots.
+ *
+ * File layout:
+ *   - RAM image at offset 0. Pages which are not allocated or contain only
+ *     zeroes are not written (holes), so the RAM image is directly usable
+ *     as a ghost image: at restore time it is mapped copy-on-write by
+ *     the usual ghost RAM code.
+ *   - State sections (CPU, memory devices, PCI configuration, devices).
+ *   - Snapshot header, at the end of the file.
+ *
+ * Snapshots use host byte order and structure layouts: they are meant to
+ * be restored by the same dynamips binary, with the same hardware setup
+ * (platform, NPE, RAM size, slots). Only MIPS platforms are supported.
+ * A snapshot cannot be taken if a device has private state and no
+ * save/restore handlers (stateless devices are flagged with
+ * VDEVICE_FLAG_NO_STATE).
+ *
+ * The file is written under a temporary name and renamed when complete:
+ * running VMs map their RAM base copy-on-write, it must never be modified
+ * in place.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cpu.h"
+#include "vm.h"
+#include "dynamips.h"
+#include "memory.h"
+#include "device.h"
+#include "pci_dev.h"
+#include "pci_io.h"
+#include "registry.h"
+#include "dev_c7200.h"
+#include "vm_snapshot.h"
+
+/* MIPS64 CPU state */
+struct vm_snapshot_mips64 {
+   m_uint64_t pc,lo,hi;
+   m_uint64_t gpr[MIPS64_GPR_NR];
+   mips_cp0_t cp0;
+   mips_cp1_t fpu;
+   m_uint32_t cp0_virt_cnt_reg,cp0_virt_cmp_reg;
+   m_uint32_t irq_cause,ll_bit;
+};
+
+/* PCI device configuration */
+struct vm_snapshot_pci_dev {
+   m_uint32_t vendor_id,product_id;
+   m_int32_t device,function;
+   m_uint32_t bar[6];
+};
+
+/* PCI bridge configuration */
+struct vm_snapshot_pci_bridge {
+   m_int32_t pri_bus,sec_bus,sub_bus;
+   m_int32_t skip_bus_check;
+   m_uint32_t cfg_reg_bus;
+};
+
+/* Check if a page contains only zeroes */
+static int vm_snapshot_zero_page(u_char *ptr)
+{
+   m_uint64_t *p = (m_uint64_t *)ptr;
+   u_int i;
+
+   for(i=0;i<VM_PAGE_SIZE/sizeof(m_uint64_t);i++)
+      if (p[i] != 0)
+         return(FALSE);
+
+   return(TRUE);
+}
+
+/*
+ * Get the host address of a device page, without allocating it (NULL is
+ * returned for a sparse page never accessed).
+ */
+static u_char *vm_snapshot_page_ptr(struct vdevice *dev,m_uint32_t offset)
+{
+   m_iptr_t ptr;
+
+   if (!dev->sparse_map)
+      return((u_char *)dev->host_addr + offset);
+
+   ptr = dev->sparse_map[offset >> VM_PAGE_SHIFT];
+
+   if (!dev->host_addr && !(ptr & VDEVICE_PTE_DIRTY))
+      return NULL;
+
+   return((u_char *)(ptr & VM_PAGE_MASK));
+}
+
+/* Get a writable host address of a device page */
+static u_char *vm_snapshot_page_wptr(vm_instance_t *vm,struct vdevice *dev,
+                                     m_uint32_t offset)
+{
+   int cow;
+
+   if (!dev->sparse_map)
+      return((u_char *)dev->host_addr + offset);
+
+   return((u_char *)dev_sparse_get_host_addr(vm,dev,dev->phys_addr+offset,
+                                             MTS_WRITE,&cow));
+}
+
+/* Check if the content of a device has to be saved */
+static int vm_snapshot_memdev(struct vdevice *dev,struct vdevice *ram_dev)
+{
+   if ((dev == ram_dev) || (dev->flags & VDEVICE_FLAG_REMAP))
+      return(FALSE);
+
+   return(dev->host_addr || dev->sparse_map);
+}
+
+/* Write a section header */
+static int vm_snapshot_write_sect(FILE *fd,u_int type,u_int id,char *name,
+                                  m_uint64_t addr,m_uint64_t len)
+{
+   struct vm_snapshot_sect sect;
+
+   memset(&sect,0,sizeof(sect));
+   sect.type = type;
+   sect.id   = id;
+   sect.len  = len;
+   sect.addr = addr;
+
+   if (name != NULL)
+      strncpy(sect.name,name,VM_SNAPSHOT_NAME_LEN-1);
+
+   return((fwrite(&sect,sizeof(sect),1,fd) == 1) ? 0 : -1);
+}
+
+/* Save RAM (non-zero pages only) */
+static int vm_snapshot_save_ram(FILE *fd,struct vdevice *dev,
+                                m_uint32_t *pages)
+{
+   m_uint32_t offset;
+   u_char *ptr;
+
+   for(offset=0;offset<dev->phys_len;offset+=VM_PAGE_SIZE) {
+      if (!(ptr = vm_snapshot_page_ptr(dev,offset)) ||
+          vm_snapshot_zero_page(ptr))
+         continue;
+
+      if ((fseeko(fd,offset,SEEK_SET) == -1) ||
+          (fwrite(ptr,VM_PAGE_SIZE,1,fd) != 1))
+         return(-1);
+
+      (*pages)++;
+   }
+
+   return(fseeko(fd,dev->phys_len,SEEK_SET));
+}
+
+/* Save MIPS64 CPU state */
+static int vm_snapshot_save_mips64(FILE *fd,cpu_mips_t *cpu)
+{
+   struct vm_snapshot_mips64 st;
+
+   memset(&st,0,sizeof(st));
+   st.pc  = cpu->pc;
+   st.lo  = cpu->lo;
+   st.hi  = cpu->hi;
+   memcpy(st.gpr,cpu->gpr,sizeof(st.gpr));
+   st.cp0 = cpu->cp0;
+   st.fpu = cpu->fpu;
+   st.cp0_virt_cnt_reg = cpu->cp0_virt_cnt_reg;
+   st.cp0_virt_cmp_reg = cpu->cp0_virt_cmp_reg;
+   st.irq_cause = cpu->irq_cause;
+   st.ll_bit    = cpu->ll_bit;
+
+   if ((vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_CPU_MIPS64,cpu->gen->id,
+                               NULL,0,sizeof(st)) == -1) ||
+       (fwrite(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   return(0);
+}
+
+/* Save the content of a memory device (zero pages are left as holes) */
+static int vm_snapshot_save_memdev(FILE *fd,struct vdevice *dev)
+{
+   m_uint32_t offset,len;
+   off_t start;
+   u_char *ptr;
+
+   if (vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_MEMDEV,dev->id,dev->name,
+                              dev->phys_addr,dev->phys_len) == -1)
+      return(-1);
+
+   start = ftello(fd);
+
+   for(offset=0;offset<dev->phys_len;offset+=VM_PAGE_SIZE) {
+      len = m_min(VM_PAGE_SIZE,dev->phys_len - offset);
+
+      if (!(ptr = vm_snapshot_page_ptr(dev,offset)) ||
+          ((len == VM_PAGE_SIZE) && vm_snapshot_zero_page(ptr)))
+         continue;
+
+      if ((fseeko(fd,start+offset,SEEK_SET) == -1) ||
+          (fwrite(ptr,len,1,fd) != 1))
+         return(-1);
+   }
+
+   return(fseeko(fd,start+dev->phys_len,SEEK_SET));
+}
+
+/* Save the configuration of PCI devices and bridges of a bus (recursive) */
+static int vm_snapshot_save_pci_bus(FILE *fd,cpu_gen_t *cpu,
+                                    struct pci_bus *bus)
+{
+   struct vm_snapshot_pci_bridge br;
+   struct vm_snapshot_pci_dev pd;
+   struct pci_bridge *bridge;
+   struct pci_device *dev;
+   int i;
+
+   for(dev=bus->dev_list;dev;dev=dev->next) {
+      memset(&pd,0,sizeof(pd));
+      pd.vendor_id  = dev->vendor_id;
+      pd.product_id = dev->product_id;
+      pd.device     = dev->device;
+      pd.function   = dev->function;
+
+      if (dev->read_register != NULL) {
+         for(i=0;i<6;i++)
+            pd.bar[i] = dev->read_register(cpu,dev,PCI_REG_BAR0+(i*4));
+      }
+
+      if (fwrite(&pd,sizeof(pd),1,fd) != 1)
+         return(-1);
+   }
+
+   for(bridge=bus->bridge_list;bridge;bridge=bridge->next) {
+      br.pri_bus = bridge->pri_bus;
+      br.sec_bus = bridge->sec_bus;
+      br.sub_bus = bridge->sub_bus;
+      br.skip_bus_check = bridge->skip_bus_check;
+      br.cfg_reg_bus = bridge->cfg_reg_bus;
+
+      if (fwrite(&br,sizeof(br),1,fd) != 1)
+         return(-1);
+
+      if (bridge->pci_bus &&
+          (vm_snapshot_save_pci_bus(fd,cpu,bridge->pci_bus) == -1))
+         return(-1);
+   }
+
+   return(0);
+}
+
+/* 
+ * Save a section whose content is written by a function. Devices are
+ * identified by name and address (PCI devices of a card share a name).
+ */
+static int vm_snapshot_save_devstate(FILE *fd,struct vdevice *dev,
+                                     m_uint64_t addr)
+{
+   off_t start,end;
+
+   start = ftello(fd);
+
+   if ((vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_DEVSTATE,dev->id,
+                               dev->name,addr,0) == -1) ||
+       (dev->save_state(dev,fd) == -1))
+      return(-1);
+
+   /* Now that the length is known, rewrite the section header */
+   end = ftello(fd);
+
+   if ((fseeko(fd,start,SEEK_SET) == -1) ||
+       (vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_DEVSTATE,dev->id,dev->name,
+                               addr,
+                               end - start - sizeof(struct vm_snapshot_sect))
+        == -1))
+      return(-1);
+
+   return(fseeko(fd,end,SEEK_SET));
+}
+
+/* Check that the private state of a device can be saved */
+static int vm_snapshot_check_dev(vm_instance_t *vm,struct vdevice *dev)
+{
+   if (dev->save_state || (dev->flags & VDEVICE_FLAG_NO_STATE))
+      return(0);
+
+   vm_error(vm,"snapshot: device '%s' has no state handler, "
+            "unable to save.\n",dev->name);
+   return(-1);
+}
+
+/* Check that the state of all devices can be saved */
+static int vm_snapshot_check_devices(vm_instance_t *vm)
+{
+   struct pci_io_device *io_dev;
+   struct vdevice *dev;
+
+   for(dev=vm->dev_list;dev;dev=dev->next) {
+      /* Plain memory (saved as such), or alias of another device */
+      if (!dev->handler || (dev->flags & VDEVICE_FLAG_REMAP))
+         continue;
+
+      if (vm_snapshot_check_dev(vm,dev) == -1)
+         return(-1);
+   }
+
+   if (vm->pci_io_space) {
+      for(io_dev=vm->pci_io_space->dev_list;io_dev;io_dev=io_dev->next)
+         if (vm_snapshot_check_dev(vm,io_dev->real_dev) == -1)
+            return(-1);
+   }
+
+   return(0);
+}
+
+/* Get the NPE driver of a c7200 (NULL for other platforms) */
+static struct c7200_npe_driver *vm_snapshot_npe(vm_instance_t *vm)
+{
+   if (strcmp(vm->platform->name,"c7200") || !vm->hw_data)
+      return NULL;
+
+   return(VM_C7200(vm)->npe_driver);
+}
+
+/* Get the model of a VM (NPE type on c7200) */
+static char *vm_snapshot_model(vm_instance_t *vm)
+{
+   struct c7200_npe_driver *npe = vm_snapshot_npe(vm);
+
+   return(npe ? npe->npe_type : "");
+}
+
+/* 
+ * Get the type of the boot CPU of a VM, even if it is not created yet
+ * (the CPU type depends only on the platform, except on c7200).
+ */
+static u_int vm_snapshot_cpu_type(vm_instance_t *vm)
+{
+   struct c7200_npe_driver *npe;
+
+   if (vm->boot_cpu)
+      return(vm->boot_cpu->type);
+
+   if ((npe = vm_snapshot_npe(vm)) && (npe->npe_family == C7200_NPE_FAMILY_PPC))
+      return(CPU_TYPE_PPC32);
+
+   return(CPU_TYPE_MIPS64);
+}
+
+/* Write the snapshot file */
+static int vm_snapshot_write(vm_instance_t *vm,FILE *fd,
+                             struct vdevice *ram_dev)
+{
+   struct pci_io_device *io_dev;
+   struct vm_snapshot_hdr hdr;
+   struct vdevice *dev;
+   cpu_gen_t *cpu;
+   off_t start,end;
+   int i;
+
+   memset(&hdr,0,sizeof(hdr));
+   hdr.magic = VM_SNAPSHOT_MAGIC;
+   hdr.version = VM_SNAPSHOT_VERSION;
+   hdr.ram_size = vm->ram_size;
+   hdr.conf_reg = vm->conf_reg;
+   hdr.ios_entry_point = vm->ios_entry_point;
+   hdr.cpu_type = vm->boot_cpu->type;
+   strncpy(hdr.platform,vm->platform->name,VM_SNAPSHOT_NAME_LEN-1);
+   strncpy(hdr.model,vm_snapshot_model(vm),VM_SNAPSHOT_NAME_LEN-1);
+
+   /* RAM */
+   if (vm_snapshot_save_ram(fd,ram_dev,&hdr.ram_pages) == -1)
+      return(-1);
+
+   hdr.sect_offset = ram_dev->phys_len;
+
+   /* CPUs */
+   for(cpu=vm->cpu_group->cpu_list;cpu;cpu=cpu->next) {
+      if ((cpu->type == CPU_TYPE_MIPS64) &&
+          (vm_snapshot_save_mips64(fd,CPU_MIPS64(cpu)) == -1))
+         return(-1);
+   }
+
+   /* Content of memory devices (NVRAM, flash, SRAM, ...) */
+   for(dev=vm->dev_list;dev;dev=dev->next) {
+      if (vm_snapshot_memdev(dev,ram_dev) &&
+          (vm_snapshot_save_memdev(fd,dev) == -1))
+         return(-1);
+   }
+
+   /* PCI configuration */
+   for(i=0;i<2;i++) {
+      if (!vm->pci_bus[i])
+         continue;
+
+      start = ftello(fd);
+
+      if ((vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_PCI,i,NULL,0,0) == -1) ||
+          (vm_snapshot_save_pci_bus(fd,vm->boot_cpu,vm->pci_bus[i]) == -1))
+         return(-1);
+
+      end = ftello(fd);
+
+      if ((fseeko(fd,start,SEEK_SET) == -1) ||
+          (vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_PCI,i,NULL,0,
+                                  end - start - sizeof(struct vm_snapshot_sect))
+           == -1) ||
+          (fseeko(fd,end,SEEK_SET) == -1))
+         return(-1);
+   }
+
+   /* Private state of devices, including the ones in PCI I/O space */
+   for(dev=vm->dev_list;dev;dev=dev->next) {
+      if (dev->save_state &&
+          (vm_snapshot_save_devstate(fd,dev,dev->phys_addr) == -1))
+         return(-1);
+   }
+
+   if (vm->pci_io_space) {
+      for(io_dev=vm->pci_io_space->dev_list;io_dev;io_dev=io_dev->next) {
+         dev = io_dev->real_dev;
+
+         if (dev->save_state &&
+             (vm_snapshot_save_devstate(fd,dev,io_dev->start) == -1))
+            return(-1);
+      }
+   }
+
+   if ((vm_snapshot_write_sect(fd,VM_SNAPSHOT_SECT_END,0,NULL,0,0) == -1) ||
+       (fwrite(&hdr,sizeof(hdr),1,fd) != 1))
+      return(-1);
+
+   vm_log(vm,"SNAPSHOT","saved %u RAM pages (%u Mb RAM).\n",
+          hdr.ram_pages,hdr.ram_size);
+   return(0);
+}
+
+/* Read the header of an opened snapshot file */
+static int vm_snapshot_read_header_fd(FILE *fd,struct vm_snapshot_hdr *hdr)
+{
+   if ((fseeko(fd,-(off_t)sizeof(*hdr),SEEK_END) == -1) ||
+       (fread(hdr,sizeof(*hdr),1,fd) != 1))
+      return(-1);
+
+   if ((hdr->magic != VM_SNAPSHOT_MAGIC) ||
+       (hdr->version != VM_SNAPSHOT_VERSION))
+      return(-1);
+
+   hdr->platform[VM_SNAPSHOT_NAME_LEN-1] = 0;
+   hdr->model[VM_SNAPSHOT_NAME_LEN-1] = 0;
+   return(0);
+}
+
+/* Read the header of a snapshot file */
+int vm_snapshot_read_header(char *filename,struct vm_snapshot_hdr *hdr)
+{
+   FILE *fd;
+   int res;
+
+   if (!(fd = fopen(filename,"r"))) {
+      perror("vm_snapshot_read_header: fopen");
+      return(-1);
+   }
+
+   res = vm_snapshot_read_header_fd(fd,hdr);
+   fclose(fd);
+   return(res);
+}
+
+/* Lookup of the running VMs using a file as RAM base */
+struct vm_snapshot_base_lookup {
+   struct stat st;
+   vm_instance_t *vm;
+};
+
+/* Check if a file is the file described by a lookup */
+static int vm_snapshot_same_file(struct vm_snapshot_base_lookup *lk,
+                                 char *filename)
+{
+   struct stat st;
+
+   if (!filename || (stat(filename,&st) == -1))
+      return(FALSE);
+
+   return((st.st_dev == lk->st.st_dev) && (st.st_ino == lk->st.st_ino));
+}
+
+/* Check if a VM maps the file as RAM base (snapshot or ghost image) */
+static void vm_snapshot_base_lookup_cb(registry_entry_t *entry,
+                                       void *opt_arg,int *err)
+{
+   struct vm_snapshot_base_lookup *lk = opt_arg;
+   vm_instance_t *vm = entry->data;
+
+   if (lk->vm || (vm->status == VM_STATUS_HALTED))
+      return;
+
+   if (vm_snapshot_same_file(lk,vm->snapshot_file) ||
+       ((vm->ghost_status == VM_GHOST_RAM_USE) &&
+        vm_snapshot_same_file(lk,vm->ghost_ram_filename)))
+      lk->vm = vm;
+}
+
+/* Find a running VM using a file as RAM base */
+static vm_instance_t *vm_snapshot_base_user(char *filename)
+{
+   struct vm_snapshot_base_lookup lk;
+
+   memset(&lk,0,sizeof(lk));
+
+   if (stat(filename,&lk.st) == -1)
+      return NULL;
+
+   registry_foreach_type(OBJ_TYPE_VM,vm_snapshot_base_lookup_cb,&lk,NULL);
+   return(lk.vm);
+}
+
+/* 
+ * Write the snapshot file under a temporary name, and rename it when
+ * it is complete and on disk.
+ */
+static int vm_snapshot_write_file(vm_instance_t *vm,char *filename,
+                                  struct vdevice *ram_dev)
+{
+   char *tmp_file;
+   int res = -1;
+   FILE *fd;
+
+   if (!(tmp_file = malloc(strlen(filename)+5)))
+      return(-1);
+
+   sprintf(tmp_file,"%s.tmp",filename);
+
+   if (!(fd = fopen(tmp_file,"w"))) {
+      vm_error(vm,"snapshot: unable to create file '%s' (%s)\n",
+               tmp_file,strerror(errno));
+      goto done;
+   }
+
+   res = vm_snapshot_write(vm,fd,ram_dev);
+
+   if ((fflush(fd) != 0) || (fsync(fileno(fd)) == -1))
+      res = -1;
+
+   if (fclose(fd) != 0)
+      res = -1;
+
+   if ((res == 0) && (rename(tmp_file,filename) == -1)) {
+      vm_error(vm,"snapshot: unable to rename '%s' (%s)\n",
+               tmp_file,strerror(errno));
+      res = -1;
+   }
+
+   if (res == -1) {
+      vm_error(vm,"snapshot: unable to write file '%s'\n",filename);
+      unlink(tmp_file);
+   }
+
+ done:
+   free(tmp_file);
+   return(res);
+}
+
+/* Save a snapshot of a VM */
+int vm_snapshot_save(vm_instance_t *vm,char *filename)
+{
+   struct vdevice *ram_dev;
+   vm_instance_t *user;
+   int running,res = -1;
+
+   if ((vm->status != VM_STATUS_RUNNING) &&
+       (vm->status != VM_STATUS_SUSPENDED))
+   {
+      vm_error(vm,"snapshot: VM is not running.\n");
+      return(-1);
+   }
+
+   if (!vm->boot_cpu || (vm->boot_cpu->type != CPU_TYPE_MIPS64)) {
+      vm_error(vm,"snapshot: only MIPS platforms are supported.\n");
+      return(-1);
+   }
+
+   if (!(ram_dev = dev_get_by_name(vm,"ram"))) {
+      vm_error(vm,"snapshot: unable to find RAM device.\n");
+      return(-1);
+   }
+
+   if ((user = vm_snapshot_base_user(filename)) != NULL) {
+      vm_error(vm,"snapshot: '%s' is used as RAM base by VM '%s'.\n",
+               filename,user->name);
+      return(-1);
+   }
+
+   /* Stop CPU activity during the save */
+   running = (vm->status == VM_STATUS_RUNNING);
+   vm_suspend(vm);
+
+   if (cpu_group_sync_state(vm->cpu_group) == -1) {
+      vm_error(vm,"snapshot: unable to sync with system CPUs.\n");
+      goto done;
+   }
+
+   /* Device state may change while CPUs run, check it once suspended */
+   if (vm_snapshot_check_devices(vm) == -1)
+      goto done;
+
+   res = vm_snapshot_write_file(vm,filename,ram_dev);
+
+ done:
+   if (running)
+      vm_resume(vm);
+   return(res);
+}
+
+/* Restore MIPS64 CPU state */
+static int vm_snapshot_load_mips64(vm_instance_t *vm,FILE *fd,
+                                   struct vm_snapshot_sect *sect)
+{
+   struct vm_snapshot_mips64 st;
+   cpu_mips_t *cpu;
+   cpu_gen_t *gen;
+
+   if ((sect->len != sizeof(st)) || (fread(&st,sizeof(st),1,fd) != 1))
+      return(-1);
+
+   if (!(gen = cpu_group_find_id(vm->cpu_group,sect->id)) ||
+       (gen->type != CPU_TYPE_MIPS64))
+   {
+      vm_error(vm,"snapshot: no MIPS64 CPU with id %u.\n",sect->id);
+      return(-1);
+   }
+
+   cpu = CPU_MIPS64(gen);
+
+   if (st.cp0.tlb_entries != cpu->cp0.tlb_entries) {
+      vm_error(vm,"snapshot: CPU%u TLB size mismatch.\n",sect->id);
+      return(-1);
+   }
+
+   cpu->pc  = st.pc;
+   cpu->lo  = st.lo;
+   cpu->hi  = st.hi;
+   memcpy(cpu->gpr,st.gpr,sizeof(cpu->gpr));
+   cpu->cp0 = st.cp0;
+   cpu->fpu = st.fpu;
+   cpu->cp0_virt_cnt_reg = st.cp0_virt_cnt_reg;
+   cpu->cp0_virt_cmp_reg = st.cp0_virt_cmp_reg;
+   cpu->irq_cause = st.irq_cause;
+   cpu->ll_bit    = st.ll_bit;
+
+   /* Rebuild the memory mappings from the restored TLB */
+   gen->mts_rebuild(gen);
+   mips64_update_irq_flag(cpu);
+   return(0);
+}
+
+/* Find the device of a section (by name and address) */
+static struct vdevice *vm_snapshot_find_dev(vm_instance_t *vm,
+                                            struct vm_snapshot_sect *sect)
+{
+   struct pci_io_device *io_dev;
+   struct vdevice *dev;
+
+   for(dev=vm->dev_list;dev;dev=dev->next) {
+      if ((dev->phys_addr == sect->addr) &&
+          !strncmp(dev->name,sect->name,VM_SNAPSHOT_NAME_LEN-1))
+         return dev;
+   }
+
+   if (vm->pci_io_space) {
+      for(io_dev=vm->pci_io_space->dev_list;io_dev;io_dev=io_dev->next) {
+         dev = io_dev->real_dev;
+
+         if ((io_dev->start == sect->addr) &&
+             !strncmp(dev->name,sect->name,VM_SNAPSHOT_NAME_LEN-1))
+            return dev;
+      }
+   }
+
+   return NULL;
+}
+
+/* Restore the content of a memory device */
+static int vm_snapshot_load_memdev(vm_instance_t *vm,FILE *fd,
+                                   struct vm_snapshot_sect *sect)
+{
+   u_char buffer[VM_PAGE_SIZE],*ptr;
+   m_uint32_t offset,len;
+   struct vdevice *dev;
+
+   if (!(dev = vm_snapshot_find_dev(vm,sect)) ||
+       (dev->phys_len != sect->len))
+   {
+      vm_error(vm,"snapshot: no matching device for '%s', ignored.\n",
+               sect->name);
+      return(0);
+   }
+
+   for(offset=0;offset<dev->phys_len;offset+=VM_PAGE_SIZE) {
+      len = m_min(VM_PAGE_SIZE,dev->phys_len - offset);
+
+      if (fread(buffer,len,1,fd) != 1)
+         return(-1);
+
+      /* Don't allocate pages for nothing on sparse devices */
+      if (dev->sparse_map && !vm_snapshot_page_ptr(dev,offset) &&
+          (len == VM_PAGE_SIZE) && vm_snapshot_zero_page(buffer))
+         continue;
+
+      if (!(ptr = vm_snapshot_page_wptr(vm,dev,offset)))
+         return(-1);
+
+      memcpy(ptr,buffer,len);
+   }
+
+   return(0);
+}
+
+/* Restore the configuration of PCI devices and bridges of a bus */
+static int vm_snapshot_load_pci_bus(vm_instance_t *vm,FILE *fd,
+                                    struct pci_bus *bus)
+{
+   struct vm_snapshot_pci_bridge br;
+   struct vm_snapshot_pci_dev pd;
+   struct pci_bridge *bridge;
+   struct pci_device *dev;
+   int i;
+
+   for(dev=bus->dev_list;dev;dev=dev->next) {
+      if (fread(&pd,sizeof(pd),1,fd) != 1)
+         return(-1);
+
+      if ((pd.vendor_id != dev->vendor_id) ||
+          (pd.product_id != dev->product_id) ||
+          (pd.device != dev->device) || (pd.function != dev->function))
+      {
+         vm_error(vm,"snapshot: PCI device mismatch on bus %d "
+                  "(%s, device %d).\n",bus->bus,dev->name,dev->device);
+         return(-1);
+      }
+
+      /* Replay BAR setup, to remap the device memory */
+      if (dev->write_register != NULL) {
+         for(i=0;i<6;i++) {
+            if (pd.bar[i] != 0)
+               dev->write_register(vm->boot_cpu,dev,PCI_REG_BAR0+(i*4),
+                                   pd.bar[i]);
+         }
+      }
+   }
+
+   for(bridge=bus->bridge_list;bridge;bridge=bridge->next) {
+      if (fread(&br,sizeof(br),1,fd) != 1)
+         return(-1);
+
+      pci_bridge_set_bus_info(bridge,br.pri_bus,br.sec_bus,br.sub_bus);
+      bridge->skip_bus_check = br.skip_bus_check;
+      bridge->cfg_reg_bus = br.cfg_reg_bus;
+
+      if (bridge->pci_bus &&
+          (vm_snapshot_load_pci_bus(vm,fd,bridge->pci_bus) == -1))
+         return(-1);
+   }
+
+   return(0);
+}
+
+/* Restore the private state of a device */
+static int vm_snapshot_load_devstate(vm_instance_t *vm,FILE *fd,
+                                     struct vm_snapshot_sect *sect)
+{
+   struct vdevice *dev;
+
+   if (!(dev = vm_snapshot_find_dev(vm,sect)) || !dev->load_state) {
+      vm_error(vm,"snapshot: no state handler for device '%s' "
+               "at 0x%llx.\n",sect->name,sect->addr);
+      return(-1);
+   }
+
+   return(dev->load_state(dev,fd,sect->len));
+}
+
+/* Restore the machine state from the VM snapshot file (at boot time) */
+int vm_snapshot_load(vm_instance_t *vm)
+{
+   struct vm_snapshot_sect sect;
+   struct vm_snapshot_hdr hdr;
+   off_t sect_start;
+   int res = -1;
+   FILE *fd;
+
+   if (!(fd = fopen(vm->snapshot_file,"r"))) {
+      vm_error(vm,"snapshot: unable to open file '%s' (%s)\n",
+               vm->snapshot_file,strerror(errno));
+      return(-1);
+   }
+
+   if (vm_snapshot_read_header_fd(fd,&hdr) == -1) {
+      vm_error(vm,"snapshot: '%s' is not a valid snapshot file.\n",
+               vm->snapshot_file);
+      goto done;
+   }
+
+   if (strcmp(hdr.platform,vm->platform->name) ||
+       strcmp(hdr.model,vm_snapshot_model(vm)) ||
+       (hdr.cpu_type != vm_snapshot_cpu_type(vm)) ||
+       (hdr.ram_size != vm->ram_size))
+   {
+      vm_error(vm,"snapshot: platform, CPU or RAM size mismatch.\n");
+      goto done;
+   }
+
+   if (fseeko(fd,hdr.sect_offset,SEEK_SET) == -1)
+      goto done;
+
+   for(;;) {
+      if (fread(&sect,sizeof(sect),1,fd) != 1)
+         goto done;
+
+      if (sect.type == VM_SNAPSHOT_SECT_END)
+         break;
+
+      sect.name[VM_SNAPSHOT_NAME_LEN-1] = 0;
+      sect_start = ftello(fd);
+
+      switch(sect.type) {
+         case VM_SNAPSHOT_SECT_CPU_MIPS64:
+            res = vm_snapshot_load_mips64(vm,fd,&sect);
+            break;
+         case VM_SNAPSHOT_SECT_MEMDEV:
+            res = vm_snapshot_load_memdev(vm,fd,&sect);
+            break;
+         case VM_SNAPSHOT_SECT_PCI:
+            res = -1;
+            if ((sect.id < 2) && vm->pci_bus[sect.id])
+               res = vm_snapshot_load_pci_bus(vm,fd,vm->pci_bus[sect.id]);
+            break;
+         case VM_SNAPSHOT_SECT_DEVSTATE:
+            res = vm_snapshot_load_devstate(vm,fd,&sect);
+            break;
+         default:
+            /* Unknown section, skip it */
+            res = 0;
+      }
+
+      if ((res == -1) || (fseeko(fd,sect_start+sect.len,SEEK_SET) == -1)) {
+         vm_error(vm,"snapshot: unable to restore section %u (id=%u).\n",
+                  sect.type,sect.id);
+         res = -1;
+         goto done;
+      }
+   }
+
+   vm->conf_reg = hdr.conf_reg;
+   vm->ios_entry_point = hdr.ios_entry_point;
+   vm_log(vm,"SNAPSHOT","restored from '%s' (%u RAM pages).\n",
+          vm->snapshot_file,hdr.ram_pages);
+   res = 0;
+
+ done:
+   fclose(fd);
+   return(res);
+}
+
+/* Configure a VM to be resumed from a snapshot at next start */
+int vm_snapshot_set_file(vm_instance_t *vm,char *filename)
+{
+   struct vm_snapshot_hdr hdr;
+   char *name;
+
+   if (vm->status != VM_STATUS_HALTED) {
+      vm_error(vm,"snapshot: VM must be stopped.\n");
+      return(-1);
+   }
+
+   if (vm_snapshot_read_header(filename,&hdr) == -1) {
+      vm_error(vm,"snapshot: '%s' is not a valid snapshot file.\n",filename);
+      return(-1);
+   }
+
+   if (strcmp(hdr.platform,vm->platform->name) != 0) {
+      vm_error(vm,"snapshot: '%s' is a %s snapshot.\n",
+               filename,hdr.platform);
+      return(-1);
+   }
+
+   if (strcmp(hdr.model,vm_snapshot_model(vm)) != 0) {
+      vm_error(vm,"snapshot: '%s' was taken on model '%s'.\n",
+               filename,hdr.model);
+      return(-1);
+   }
+
+   if (hdr.cpu_type != vm_snapshot_cpu_type(vm)) {
+      vm_error(vm,"snapshot: '%s' was taken with another CPU type.\n",
+               filename);
+      return(-1);
+   }
+
+   if (!(name = strdup(filename)))
+      return(-1);
+
+   free(vm->snapshot_file);
+   vm->snapshot_file = name;
+   vm->ram_size = hdr.ram_size;
+   return(0);
+}
@@ -0,0 +1,72 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * VM snapshots: save a running instance (CPU, RAM, devices) to a file
+ * and resume it later without booting IOS again.
+ */
+
+#ifndef __VM_SNAPSHOT_H__
+#define __VM_SNAPSHOT_H__
+
+#include <sys/types.h>
+
+#include "utils.h"
+#include "vm.h"
+
+/* Snapshot file magic number ("DSNP") and format version */
+#define VM_SNAPSHOT_MAGIC    0x44534e50
+#define VM_SNAPSHOT_VERSION  2
+
+/* Max length of names stored in snapshot files */
+#define VM_SNAPSHOT_NAME_LEN  32
+
+/* Section types */
+enum {
+   VM_SNAPSHOT_SECT_END = 0,
+   VM_SNAPSHOT_SECT_CPU_MIPS64,
+   VM_SNAPSHOT_SECT_MEMDEV,
+   VM_SNAPSHOT_SECT_PCI,
+   VM_SNAPSHOT_SECT_DEVSTATE,
+};
+
+/*
+ * Snapshot header, stored at the end of the file. The RAM image starts
+ * at offset 0 (so that it can be mapped copy-on-write like a ghost image),
+ * and is followed by the state sections.
+ */
+struct vm_snapshot_hdr {
+   m_uint32_t magic;
+   m_uint32_t version;
+   m_uint32_t ram_size;           /* RAM size in Mb */
+   m_uint32_t ram_pages;          /* Number of non-zero RAM pages */
+   m_uint32_t conf_reg;
+   m_uint32_t ios_entry_point;
+   m_uint64_t sect_offset;        /* Offset of the first section */
+   m_uint32_t cpu_type;           /* Type of the boot CPU */
+   char platform[VM_SNAPSHOT_NAME_LEN];
+   char model[VM_SNAPSHOT_NAME_LEN];  /* Platform model (c7200 NPE) */
+};
+
+/* Section header */
+struct vm_snapshot_sect {
+   m_uint32_t type;
+   m_uint32_t id;
+   m_uint64_t len;
+   m_uint64_t addr;               /* Device address */
+   char name[VM_SNAPSHOT_NAME_LEN];
+};
+
+/* Read the header of a snapshot file */
+int vm_snapshot_read_header(char *filename,struct vm_snapshot_hdr *hdr);
+
+/* Save a snapshot of a VM */
+int vm_snapshot_save(vm_instance_t *vm,char *filename);
+
+/* Restore the machine state from the VM snapshot file (at boot time) */
+int vm_snapshot_load(vm_instance_t *vm);
+
+/* Configure a VM to be resumed from a snapshot at next start */
+int vm_snapshot_set_file(vm_instance_t *vm,char *filename);
+
+#endif
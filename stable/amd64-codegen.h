@@ -98,6 +98,13 @@ typedef union {
                 *(inst)++ = (unsigned char)0xc8 + (reg); \
         } while (0)
 
+#define amd64_bswap64(inst,reg) \
+        do {    \
+                amd64_emit_rex(inst, 8, 0, 0, (reg)); \
+                *(inst)++ = 0x0f;	\
+                *(inst)++ = (unsigned char)0xc8 + ((reg) & 0x7); \
+        } while (0)
+
 /* In 64 bit mode, all registers have a low byte subregister */
 #undef X86_IS_BYTE_REG
 #define X86_IS_BYTE_REG(reg) 1
@@ -29,6 +29,7 @@
 #include "device.h"
 #include "dev_c7200.h"
 #include "dev_vtty.h"
+#include "vm_snapshot.h"
 #include "utils.h"
 #include "base64.h"
 #include "net.h"
@@ -512,6 +513,99 @@ static int cmd_set_idle_sleep_time(hypervisor_conn_t *conn,
    return(0);
 }
 
+/* Show the idle loop statistics of the CPUs of a VM */
+static int cmd_show_idle_stats(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   m_uint64_t wakeups = 0;
+   vm_instance_t *vm;
+   cpu_gen_t *cpu;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   for(cpu=vm->cpu_group?vm->cpu_group->cpu_list:NULL;cpu;cpu=cpu->next) {
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                            "CPU%u: sleeps=%llu, skipped=%llu, "
+                            "timer wakeups=%llu, event wakeups=%llu",
+                            cpu->id,cpu->idle_sleeps,cpu->idle_skips,
+                            cpu->idle_wakeups_timer,
+                            cpu->idle_wakeups_event);
+
+      wakeups += cpu->idle_wakeups_timer + cpu->idle_wakeups_event;
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"Total wakeups: %llu",wakeups);
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Enable/disable the automatic idle PC */
+static int cmd_set_idle_pc_auto(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+   cpu_gen_t *cpu;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   vm->idle_pc_auto = atoi(argv[1]);
+
+   /* Running CPUs pick up the change at their next timer tick */
+   for(cpu=vm->cpu_group?vm->cpu_group->cpu_list:NULL;cpu;cpu=cpu->next)
+      cpu->idle_auto.enabled = vm->idle_pc_auto;
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Show the automatic idle PC state of a CPU */
+static int cmd_show_idle_pc_auto(hypervisor_conn_t *conn,
+                                 int argc,char *argv[])
+{
+   vm_instance_t *vm;
+   idle_pc_auto_t *ia;
+   cpu_gen_t *cpu;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if (!(cpu = find_cpu(conn,vm,atoi(argv[1]))))
+      return(-1);
+
+   ia = &cpu->idle_auto;
+
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"State: %s",
+                         idle_pc_auto_get_state_str(ia->state));
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"Idle PC: 0x%llx",ia->idle_pc);
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"Host CPU usage: %u%%",
+                         ia->host_usage);
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                         "Applied: %u, reverted: %u, rejected: %u",
+                         ia->applied,ia->reverted,ia->rejected);
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Enable/disable the host-time virtual clock for timer IRQs */
+static int cmd_set_timer_vclock(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   vm->timer_vclock = atoi(argv[1]);
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
 /* Show info about potential timer drift */
 static int cmd_show_timer_drift(hypervisor_conn_t *conn,
                                 int argc,char *argv[])
@@ -548,6 +642,37 @@ static int cmd_show_timer_drift(hypervisor_conn_t *conn,
    return(0);
 }
 
+/* Show JIT block chaining statistics */
+static int cmd_show_jit_stats(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+   cpu_gen_t *cpu;
+   cpu_mips_t *mcpu;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if (!(cpu = find_cpu(conn,vm,atoi(argv[1]))))
+      return(-1);
+
+   if (cpu->type == CPU_TYPE_MIPS64) {
+      mcpu = CPU_MIPS64(cpu);
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                            "Dispatcher exits: %llu, Compiled pages: %u",
+                            mcpu->jit_disp_exits,mcpu->compiled_pages);
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                            "Chained jumps: %llu, Chain hits: %llu",
+                            mcpu->jit_chain_links,mcpu->jit_chain_hits);
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                            "Indirect hits: %llu, Indirect misses: %llu",
+                            mcpu->jit_ibtc_hits,mcpu->jit_ibtc_misses);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
 /* Set the exec area size */
 static int cmd_set_exec_area(hypervisor_conn_t *conn,int argc,char *argv[])
 {
@@ -579,6 +704,117 @@ static int cmd_set_ghost_file(hypervisor_conn_t *conn,int argc,char *argv[])
    return(0);
 }
 
+/* Show RAM pages shared with the ghost image and private pages */
+static int cmd_show_ram_sharing(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   u_int shared,private,unalloc;
+   struct vdevice *ram_dev;
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if (!(ram_dev = dev_get_by_name(vm,"ram")) ||
+       (dev_ghost_page_stats(ram_dev,&shared,&private,&unalloc) == -1))
+   {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_UNSPECIFIED,1,
+                            "unable to get RAM statistics of VM '%s'",
+                            argv[0]);
+      return(-1);
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                         "Shared pages: %u, Private pages: %u, "
+                         "Unallocated pages: %u",shared,private,unalloc);
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Give back to the ghost image the private pages with same content */
+static int cmd_ram_reshare(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+   int count;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if ((count = vm_ram_reshare(vm)) == -1) {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_UNSPECIFIED,1,
+                            "unable to reshare RAM of VM '%s'",argv[0]);
+      return(-1);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"%d pages released",count);
+   return(0);
+}
+
+/* Give back to the host the RAM pages containing only zeroes */
+static int cmd_reclaim(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+   int count;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if ((count = vm_ram_reclaim(vm)) == -1) {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_UNSPECIFIED,1,
+                            "unable to reclaim RAM of VM '%s'",argv[0]);
+      return(-1);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"%d pages released",count);
+   return(0);
+}
+
+/* Save a snapshot of a VM */
+static int cmd_snapshot_save(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if (vm_snapshot_save(vm,argv[1]) == -1) {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_FILE,1,
+                            "unable to save snapshot of VM '%s'",argv[0]);
+      return(-1);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"VM '%s' snapshot saved",argv[0]);
+   return(0);
+}
+
+/* Resume a VM from a snapshot at next start */
+static int cmd_snapshot_restore(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if (vm_snapshot_set_file(vm,argv[1]) == -1) {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_FILE,1,
+                            "unable to use snapshot '%s'",argv[1]);
+      return(-1);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
 /* Set ghost RAM status */
 static int cmd_set_ghost_status(hypervisor_conn_t *conn,int argc,char *argv[])
 {
@@ -623,6 +859,177 @@ static int cmd_set_disk1(hypervisor_conn_t *conn,int argc,char *argv[])
    return(0);
 }
 
+/* Set base image of PCMCIA ATA disk0 */
+static int cmd_set_disk0_base(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   free(vm->pcmcia_disk_base[0]);
+   vm->pcmcia_disk_base[0] = strdup(argv[1]);
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Set base image of PCMCIA ATA disk1 */
+static int cmd_set_disk1_base(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   free(vm->pcmcia_disk_base[1]);
+   vm->pcmcia_disk_base[1] = strdup(argv[1]);
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Set the host CPUs used by the VM threads */
+static int cmd_set_cpu_affinity(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   if (vm_set_cpu_affinity(vm,argv[1]) == -1) {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_INV_PARAM,1,
+                            "invalid CPU list '%s'",argv[1]);
+      return(-1);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Set the NUMA node used for the VM memory (-1: CPU set node) */
+static int cmd_set_numa_node(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   vm->numa_node = atoi(argv[1]);
+
+   if (vm->numa_node < 0)
+      vm->numa_node = -1;
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Show the host CPUs and NUMA node used by the VM */
+static int cmd_show_affinity(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"CPUs: %s, NUMA node: %d",
+                         vm->cpu_affinity ? vm->cpu_affinity : "all",
+                         vm_get_numa_node(vm));
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Set the huge page mode for RAM and JIT exec areas */
+static int cmd_set_huge_pages(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   vm_instance_t *vm;
+   int mode;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   mode = atoi(argv[1]);
+
+   if ((mode < MEMZONE_HUGE_NONE) || (mode > MEMZONE_HUGE_TLB)) {
+      vm_release(vm);
+      hypervisor_send_reply(conn,HSC_ERR_INV_PARAM,1,
+                            "invalid huge page mode %d",mode);
+      return(-1);
+   }
+
+   vm->huge_pages = mode;
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Report the memory backed by huge pages in a memory zone */
+static void hv_vm_show_huge_zone(hypervisor_conn_t *conn,char *name,
+                                 void *ptr,size_t len)
+{
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%s: %lu MB, huge pages: %lu MB",
+                         name,(u_long)(len >> 20),
+                         (u_long)(memzone_get_huge_size(ptr,len) >> 20));
+}
+
+/* Show the memory of the VM backed by huge pages */
+static int cmd_show_huge_pages(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   struct vdevice *ram_dev;
+   vm_instance_t *vm;
+   cpu_gen_t *cpu;
+   char name[64];
+   void *ptr;
+   size_t len;
+
+   if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
+      return(-1);
+
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"Huge page mode: %d",
+                         vm->huge_pages);
+
+   if ((ram_dev = dev_get_by_name(vm,"ram")) && ram_dev->host_addr &&
+       !(ram_dev->flags & VDEVICE_FLAG_SPARSE))
+   {
+      hv_vm_show_huge_zone(conn,"RAM",(void *)ram_dev->host_addr,
+                           ram_dev->phys_len);
+   }
+
+   for(cpu=vm->cpu_group?vm->cpu_group->cpu_list:NULL;cpu;cpu=cpu->next) {
+      ptr = NULL;
+      len = 0;
+
+      switch(cpu->type) {
+         case CPU_TYPE_MIPS64:
+            snprintf(name,sizeof(name),"CPU%u exec area",cpu->id);
+            ptr = CPU_MIPS64(cpu)->exec_page_area;
+            len = CPU_MIPS64(cpu)->exec_page_area_size;
+            break;
+
+         case CPU_TYPE_PPC32:
+            snprintf(name,sizeof(name),"CPU%u exec area",cpu->id);
+            ptr = CPU_PPC32(cpu)->exec_page_area;
+            len = CPU_PPC32(cpu)->exec_page_area_size;
+            break;
+      }
+
+      if (ptr != NULL)
+         hv_vm_show_huge_zone(conn,name,ptr,len);
+   }
+
+   vm_release(vm);
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
 /* Set the config register used at startup */
 static int cmd_set_conf_reg(hypervisor_conn_t *conn,int argc,char *argv[])
 {
@@ -808,19 +1215,30 @@ static int cmd_show_cpu_info(hypervisor_conn_t *conn,int argc,char *argv[])
    return(0);
 }
 
-/* Show CPU usage - experimental */
+/* Show the host CPU time used by the CPUs of a VM (in seconds) */
 static int cmd_show_cpu_usage(hypervisor_conn_t *conn,int argc,char *argv[])
 {
    vm_instance_t *vm;
-   double usage;
+   cpu_gen_t *cpu;
+   double usage,t;
 
    if (!(vm = hypervisor_find_object(conn,argv[0],OBJ_TYPE_VM)))
       return(-1);
 
-   usage = get_cpu_time();
-   if (usage == -1)
-      return(-1);
-   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%u", (unsigned long)usage);
+   usage = 0.0;
+
+   for(cpu=vm->cpu_group?vm->cpu_group->cpu_list:NULL;cpu;cpu=cpu->next) {
+      if ((t = get_thread_cpu_time(cpu->cpu_thread)) < 0) {
+         vm_release(vm);
+         hypervisor_send_reply(conn,HSC_ERR_UNSPECIFIED,1,
+                               "unable to get CPU time");
+         return(-1);
+      }
+
+      usage += t;
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%lu",(unsigned long)usage);
 
    vm_release(vm);
    hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
@@ -1267,6 +1685,13 @@ static hypervisor_cmd_t vm_cmd_array[] = {
    { "set_exec_area", 2, 2, cmd_set_exec_area, NULL },
    { "set_disk0", 2, 2, cmd_set_disk0, NULL },
    { "set_disk1", 2, 2, cmd_set_disk1, NULL },
+   { "set_disk0_base", 2, 2, cmd_set_disk0_base, NULL },
+   { "set_disk1_base", 2, 2, cmd_set_disk1_base, NULL },
+   { "set_cpu_affinity", 2, 2, cmd_set_cpu_affinity, NULL },
+   { "set_numa_node", 2, 2, cmd_set_numa_node, NULL },
+   { "show_affinity", 1, 1, cmd_show_affinity, NULL },
+   { "set_huge_pages", 2, 2, cmd_set_huge_pages, NULL },
+   { "show_huge_pages", 1, 1, cmd_show_huge_pages, NULL },
    { "set_conf_reg", 2, 2, cmd_set_conf_reg, NULL },
    { "set_idle_pc", 2, 2, cmd_set_idle_pc, NULL },
    { "set_idle_pc_online", 3, 3, cmd_set_idle_pc_online, NULL },
@@ -1274,9 +1699,19 @@ static hypervisor_cmd_t vm_cmd_array[] = {
    { "show_idle_pc_prop", 2, 2, cmd_show_idle_pc_prop, NULL },
    { "set_idle_max", 3, 3, cmd_set_idle_max, NULL },
    { "set_idle_sleep_time", 3, 3, cmd_set_idle_sleep_time, NULL },
+   { "show_idle_stats", 1, 1, cmd_show_idle_stats, NULL },
+   { "set_idle_pc_auto", 2, 2, cmd_set_idle_pc_auto, NULL },
+   { "show_idle_pc_auto", 2, 2, cmd_show_idle_pc_auto, NULL },
+   { "set_timer_vclock", 2, 2, cmd_set_timer_vclock, NULL },
    { "show_timer_drift", 2, 2, cmd_show_timer_drift, NULL },
+   { "show_jit_stats", 2, 2, cmd_show_jit_stats, NULL },
    { "set_ghost_file", 2, 2, cmd_set_ghost_file, NULL },
    { "set_ghost_status", 2, 2, cmd_set_ghost_status, NULL },
+   { "show_ram_sharing", 1, 1, cmd_show_ram_sharing, NULL },
+   { "ram_reshare", 1, 1, cmd_ram_reshare, NULL },
+   { "reclaim", 1, 1, cmd_reclaim, NULL },
+   { "snapshot_save", 2, 2, cmd_snapshot_save, NULL },
+   { "snapshot_restore", 2, 2, cmd_snapshot_restore, NULL },
    { "set_con_tcp_port", 2, 2, cmd_set_con_tcp_port, NULL },
    { "set_aux_tcp_port", 2, 2, cmd_set_aux_tcp_port, NULL },
    { "extract_config", 1, 1, cmd_extract_config, NULL },
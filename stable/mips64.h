@@ -10,6 +10,7 @@
 
 #include "utils.h" 
 #include "rbtree.h"
+#include "timer_irq.h"
 
 /* 
  * MIPS General Purpose Registers 
@@ -397,6 +398,8 @@ struct cpu_mips {
    u_int timer_irq_freq;
    u_int timer_irq_check_itv;
    u_int timer_drift;
+   timer_irq_entry_t timer_irq;
+   int timer_vclock;
 
    /* IRQ disable flag */
    volatile u_int irq_disable;
@@ -438,12 +441,28 @@ struct cpu_mips {
    /* Direct block jump */
    u_int exec_blk_direct_jump;
 
+   /* Block chaining: jump waiting to be chained, indirect branch cache */
+   struct mips64_jit_chain *jit_chain_pending;
+   struct mips64_jit_ibtc_entry *jit_ibtc;
+   u_int jit_ibtc_pending;
+
+   /* Idle PC the current chains were made with */
+   m_uint64_t jit_idle_pc;
+
+   /* Block chaining statistics */
+   m_uint64_t jit_disp_exits,jit_chain_links,jit_chain_hits;
+   m_uint64_t jit_ibtc_hits,jit_ibtc_misses;
+
    /* Address mode (32 or 64 bits) */
    u_int addr_mode;
 
    /* Current exec page (non-JIT) info */
    m_uint64_t njm_exec_page;
    mips_insn_t *njm_exec_ptr;
+   struct mips64_exec_dinsn *njm_exec_dpage;
+
+   /* Pre-decoded instruction cache (non-JIT) */
+   struct mips64_exec_dinsn *njm_dcache;
 
    /* Performance counter (number of instructions executed by CPU) */
    m_uint32_t perf_counter;
@@ -481,8 +500,14 @@ void mips64_set_prid(cpu_mips_t *cpu,m_uint32_t prid);
 /* Set idle PC value */
 void mips64_set_idle_pc(cpu_gen_t *cpu,m_uint64_t addr);
 
-/* Timer IRQ */
-void *mips64_timer_irq_run(cpu_mips_t *cpu);
+/* Check that the code at an idle PC candidate has no side effect */
+int mips64_idle_pc_check(cpu_gen_t *cpu,m_uint64_t pc,m_uint32_t *sum);
+
+/* Start the virtual clock of a CPU */
+int mips64_timer_irq_start(cpu_mips_t *cpu,int pollable);
+
+/* Stop the virtual clock of a CPU */
+void mips64_timer_irq_stop(cpu_mips_t *cpu);
 
 /* Determine an "idling" PC */
 int mips64_get_idling_pc(cpu_gen_t *cpu);
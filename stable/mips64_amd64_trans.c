@@ -73,56 +73,119 @@ void mips64_set_ra(mips64_jit_tcb_t *b,m_uint64_t ret_pc)
                          AMD64_RAX,8);
 }
 
+/* 
+ * Check if the main loop must be entered instead of jumping directly to
+ * another block: a pending timer IRQ, or a CPU state change (suspend,
+ * stop) which would not be seen by a loop of chained blocks. Returns the
+ * branch to patch with the exit path.
+ */
+static u_char *mips64_check_main_loop_events(mips64_jit_tcb_t *b)
+{
+   u_char *test;
+
+   /* CPU_STATE_RUNNING is 0 */
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,
+                         AMD64_R15,OFFSET(cpu_mips_t,timer_irq_pending),4);
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RDX,
+                         AMD64_R15,OFFSET(cpu_mips_t,gen),8);
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_OR,AMD64_RAX,
+                              AMD64_RDX,OFFSET(cpu_gen_t,state),4);
+   test = b->jit_ptr;
+   amd64_branch8(b->jit_ptr, X86_CC_NZ, 0, 1);
+   return test;
+}
+
 /* 
  * Try to branch directly to the specified JIT block without returning to 
- * main loop.
+ * main loop: emit a jump which is chained to the target block by the main
+ * loop once it has been compiled, and unchained when it is freed.
  */
 static void mips64_try_direct_far_jump(cpu_mips_t *cpu,mips64_jit_tcb_t *b,
                                        m_uint64_t new_pc)
 {
-   m_uint64_t new_page;
-   m_uint32_t pc_hash,pc_offset;
+   struct mips64_jit_chain *chain;
+   u_char *test1;
+
+   if (!(chain = mips64_jit_tcb_record_chain(b,new_pc))) {
+      mips64_set_pc(b,new_pc);
+      mips64_jit_tcb_push_epilog(b);
+      return;
+   }
+
+   test1 = mips64_check_main_loop_events(b);
+
+   /* Chained jump, falling through to the exit path until chained */
+   amd64_inc_membase_size(b->jit_ptr,
+                          AMD64_R15,OFFSET(cpu_mips_t,jit_chain_hits),8);
+   chain->jit_insn = b->jit_ptr;
+   amd64_jump32(b->jit_ptr,0);
+   chain->jit_exit = b->jit_ptr;
+   amd64_patch(chain->jit_insn,chain->jit_exit);
+
+   /* Returns to caller, which will chain the jump... */
+   amd64_dec_membase_size(b->jit_ptr,
+                          AMD64_R15,OFFSET(cpu_mips_t,jit_chain_hits),8);
+   amd64_patch(test1,b->jit_ptr);
+   amd64_mov_reg_imm_size(b->jit_ptr,AMD64_RAX,chain,8);
+   amd64_mov_membase_reg(b->jit_ptr,
+                         AMD64_R15,OFFSET(cpu_mips_t,jit_chain_pending),
+                         AMD64_RAX,8);
+
+   mips64_set_pc(b,new_pc);
+   mips64_jit_tcb_push_epilog(b);
+}
+
+/* 
+ * Set an indirect jump (new pc in %r14), going through the indirect 
+ * branch target cache.
+ */
+static void mips64_set_indirect_jump(cpu_mips_t *cpu,mips64_jit_tcb_t *b)
+{
    u_char *test1,*test2,*test3;
 
-   new_page = new_pc & MIPS_MIN_PAGE_MASK;
-   pc_offset = (new_pc & MIPS_MIN_PAGE_IMASK) >> 2;
-   pc_hash = mips64_jit_get_pc_hash(new_pc);
-   
-   /* Get JIT block info in %rdx */
-   amd64_mov_reg_membase(b->jit_ptr,AMD64_RBX,
-                         AMD64_R15,OFFSET(cpu_mips_t,exec_blk_map),8);
-   amd64_mov_reg_membase(b->jit_ptr,AMD64_RDX,
-                         AMD64_RBX,pc_hash*sizeof(void *),8);
+   amd64_mov_membase_reg(b->jit_ptr,
+                         AMD64_R15,OFFSET(cpu_mips_t,pc),
+                         AMD64_R14,8);
 
-   /* no JIT block found ? */
-   amd64_test_reg_reg(b->jit_ptr,AMD64_RDX,AMD64_RDX);
+   if (!cpu->exec_blk_direct_jump || cpu->sym_trace) {
+      mips64_jit_tcb_push_epilog(b);
+      return;
+   }
+
+   /* Let the main loop handle the idle PC, timer IRQs and state changes */
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_CMP,AMD64_R14,
+                              AMD64_R15,OFFSET(cpu_mips_t,idle_pc),8);
    test1 = b->jit_ptr;
    amd64_branch8(b->jit_ptr, X86_CC_Z, 0, 1);
 
-   /* Check block IA */
-   mips64_load_imm(b,AMD64_RAX,new_page);
-   amd64_alu_reg_membase_size(b->jit_ptr,X86_CMP,X86_EAX,AMD64_RDX,
-                              OFFSET(mips64_jit_tcb_t,start_pc),4);
-   test2 = b->jit_ptr;
-   amd64_branch8(b->jit_ptr, X86_CC_NE, 0, 1);
+   test2 = mips64_check_main_loop_events(b);
 
-   /* Jump to the code */
-   amd64_mov_reg_membase(b->jit_ptr,AMD64_RSI,
-                         AMD64_RDX,OFFSET(mips64_jit_tcb_t,jit_insn_ptr),8);
-   amd64_mov_reg_membase(b->jit_ptr,AMD64_RBX,
-                         AMD64_RSI,pc_offset * sizeof(void *),8);
-   
-   amd64_test_reg_reg(b->jit_ptr,AMD64_RBX,AMD64_RBX);
+   /* Get the cache entry (16 bytes) in %rax */
+   amd64_mov_reg_reg(b->jit_ptr,AMD64_RAX,AMD64_R14,8);
+   amd64_shift_reg_imm(b->jit_ptr,X86_SHR,AMD64_RAX,2);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_EAX,MIPS64_JIT_IBTC_MASK,4);
+   amd64_shift_reg_imm(b->jit_ptr,X86_SHL,AMD64_RAX,4);
+   amd64_alu_reg_membase(b->jit_ptr,X86_ADD,AMD64_RAX,
+                         AMD64_R15,OFFSET(cpu_mips_t,jit_ibtc));
+
+   /* Check the entry PC and jump to the code */
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_CMP,AMD64_R14,AMD64_RAX,
+                              OFFSET(struct mips64_jit_ibtc_entry,mips_pc),8);
    test3 = b->jit_ptr;
-   amd64_branch8(b->jit_ptr, X86_CC_Z, 0, 1);
-   amd64_jump_reg(b->jit_ptr,AMD64_RBX);
+   amd64_branch8(b->jit_ptr, X86_CC_NE, 0, 1);
 
-   /* Returns to caller... */
-   amd64_patch(test1,b->jit_ptr);
-   amd64_patch(test2,b->jit_ptr);
+   amd64_inc_membase_size(b->jit_ptr,
+                          AMD64_R15,OFFSET(cpu_mips_t,jit_ibtc_hits),8);
+   amd64_jump_membase(b->jit_ptr,AMD64_RAX,
+                      OFFSET(struct mips64_jit_ibtc_entry,jit_ptr));
+
+   /* Cache miss: returns to caller, which will fill the entry */
    amd64_patch(test3,b->jit_ptr);
+   amd64_mov_membase_imm(b->jit_ptr,
+                         AMD64_R15,OFFSET(cpu_mips_t,jit_ibtc_pending),1,4);
 
-   mips64_set_pc(b,new_pc);
+   amd64_patch(test1,b->jit_ptr);
+   amd64_patch(test2,b->jit_ptr);
    mips64_jit_tcb_push_epilog(b);
 }
 
@@ -207,6 +270,167 @@ static void mips64_memop_fast_sw(mips64_jit_tcb_t *b,int target)
    amd64_bswap32(b->jit_ptr,X86_EAX);
    amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,4);
 }
+/* Fast LB */
+static void mips64_memop_fast_lb(mips64_jit_tcb_t *b,int target)
+{
+   amd64_widen_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                        TRUE,FALSE);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LBU */
+static void mips64_memop_fast_lbu(mips64_jit_tcb_t *b,int target)
+{
+   amd64_widen_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                        FALSE,FALSE);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LH */
+static void mips64_memop_fast_lh(mips64_jit_tcb_t *b,int target)
+{
+   amd64_widen_memindex_size(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                             FALSE,TRUE,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SAR,X86_EAX,16,4);
+   amd64_movsxd_reg_reg(b->jit_ptr,AMD64_RDX,X86_EAX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RDX,8);
+}
+
+/* Fast LHU */
+static void mips64_memop_fast_lhu(mips64_jit_tcb_t *b,int target)
+{
+   amd64_widen_memindex_size(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                             FALSE,TRUE,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHR,X86_EAX,16,4);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LWU */
+static void mips64_memop_fast_lwu(mips64_jit_tcb_t *b,int target)
+{
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LD */
+static void mips64_memop_fast_ld(mips64_jit_tcb_t *b,int target)
+{
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,8);
+   amd64_bswap64(b->jit_ptr,AMD64_RAX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LL */
+static void mips64_memop_fast_ll(mips64_jit_tcb_t *b,int target)
+{
+   mips64_memop_fast_lw(b,target);
+   amd64_mov_membase_imm(b->jit_ptr,AMD64_R15,OFFSET(cpu_mips_t,ll_bit),1,4);
+}
+
+/* Fast LWL */
+static void mips64_memop_fast_lwl(mips64_jit_tcb_t *b,int target)
+{
+   /* ECX = (vaddr & 3) * 8, ESI = aligned offset in page */
+   amd64_mov_reg_reg_size(b->jit_ptr,X86_ECX,X86_ESI,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ECX,0x03,4);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHL,X86_ECX,3,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ESI,~0x03,4);
+
+   /* EAX = data << shift */
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHL,X86_EAX,4);
+
+   /* EDX = (reg & ((1 << shift) - 1)) | EAX, then sign-extend */
+   amd64_mov_reg_imm_size(b->jit_ptr,X86_EDX,1,4);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHL,X86_EDX,4);
+   amd64_dec_reg_size(b->jit_ptr,X86_EDX,4);
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_AND,X86_EDX,
+                              AMD64_R15,REG_OFFSET(target),4);
+   amd64_alu_reg_reg_size(b->jit_ptr,X86_OR,X86_EDX,X86_EAX,4);
+   amd64_movsxd_reg_reg(b->jit_ptr,AMD64_RDX,X86_EDX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RDX,8);
+}
+
+/* Fast LWR */
+static void mips64_memop_fast_lwr(mips64_jit_tcb_t *b,int target)
+{
+   u_char *test1;
+
+   /* ECX = (3 - (vaddr & 3)) * 8, ESI = aligned offset in page */
+   amd64_mov_reg_reg_size(b->jit_ptr,X86_ECX,X86_ESI,4);
+   amd64_not_reg_size(b->jit_ptr,X86_ECX,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ECX,0x03,4);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHL,X86_ECX,3,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ESI,~0x03,4);
+
+   /* RAX = data >> shift */
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHR,X86_EAX,4);
+
+   /* RDX = (reg & ~(0xffffffff >> shift)) | RAX */
+   amd64_mov_reg_imm_size(b->jit_ptr,X86_EDX,0xffffffff,4);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHR,X86_EDX,4);
+   amd64_not_reg(b->jit_ptr,AMD64_RDX);
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_AND,AMD64_RDX,
+                              AMD64_R15,REG_OFFSET(target),8);
+   amd64_alu_reg_reg(b->jit_ptr,X86_OR,AMD64_RDX,AMD64_RAX);
+
+   /* Full word loaded: sign-extend it */
+   amd64_test_reg_reg_size(b->jit_ptr,X86_ECX,X86_ECX,4);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_NZ, 0, 1);
+   amd64_movsxd_reg_reg(b->jit_ptr,AMD64_RDX,X86_EAX);
+   amd64_patch(test1,b->jit_ptr);
+
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RDX,8);
+}
+
+/* Fast SB */
+static void mips64_memop_fast_sb(mips64_jit_tcb_t *b,int target)
+{
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,AMD64_R15,REG_OFFSET(target),4);
+   amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,1);
+}
+
+/* Fast SH */
+static void mips64_memop_fast_sh(mips64_jit_tcb_t *b,int target)
+{
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,AMD64_R15,REG_OFFSET(target),4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHR,X86_EAX,16,4);
+   amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,2);
+}
+
+/* Fast SD */
+static void mips64_memop_fast_sd(mips64_jit_tcb_t *b,int target)
+{
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,AMD64_R15,REG_OFFSET(target),8);
+   amd64_bswap64(b->jit_ptr,AMD64_RAX);
+   amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,8);
+}
+
+/* Fast SC */
+static void mips64_memop_fast_sc(mips64_jit_tcb_t *b,int target)
+{
+   u_char *test1;
+
+   /* Store only if the LL bit is set, then GPR[target] = LL bit */
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RCX,
+                         AMD64_R15,OFFSET(cpu_mips_t,ll_bit),4);
+   amd64_test_reg_reg_size(b->jit_ptr,X86_ECX,X86_ECX,4);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_Z, 0, 1);
+   mips64_memop_fast_sw(b,target);
+   amd64_patch(test1,b->jit_ptr);
+
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RCX,8);
+}
+
 
 /* Fast memory operation (64-bit) */
 static void mips64_emit_memop_fast64(mips64_jit_tcb_t *b,int write_op,
@@ -1653,11 +1877,7 @@ DECLARE_INSN(JALR)
    mips64_jit_fetch_and_emit(cpu,b,1);
 
    /* set the new pc */
-   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,OFFSET(cpu_mips_t,pc),
-                         AMD64_R14,8);
-
-   /* returns to the caller which will determine the next path */
-   mips64_jit_tcb_push_epilog(b);
+   mips64_set_indirect_jump(cpu,b);
    return(0);
 }
 
@@ -1686,12 +1906,7 @@ DECLARE_INSN(JR)
    mips64_jit_fetch_and_emit(cpu,b,1);
 
    /* set the new pc */
-   amd64_mov_membase_reg(b->jit_ptr,
-                         AMD64_R15,OFFSET(cpu_mips_t,pc),
-                         AMD64_R14,8);
-
-   /* returns to the caller which will determine the next path */
-   mips64_jit_tcb_push_epilog(b);
+   mips64_set_indirect_jump(cpu,b);
    return(0);
 }
 
@@ -1702,7 +1917,12 @@ DECLARE_INSN(LB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LB,base,offset,rt,TRUE,
+                             mips64_memop_fast_lb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1713,7 +1933,12 @@ DECLARE_INSN(LBU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LBU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lbu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1724,7 +1949,12 @@ DECLARE_INSN(LD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LD,base,offset,rt,TRUE,
+                             mips64_memop_fast_ld);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1768,7 +1998,12 @@ DECLARE_INSN(LH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LH,base,offset,rt,TRUE,
+                             mips64_memop_fast_lh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1779,7 +2014,12 @@ DECLARE_INSN(LHU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LHU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lhu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1802,7 +2042,12 @@ DECLARE_INSN(LL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LL,base,offset,rt,TRUE,
+                             mips64_memop_fast_ll);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1848,7 +2093,12 @@ DECLARE_INSN(LWL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWL,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwl);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1859,7 +2109,12 @@ DECLARE_INSN(LWR)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWR,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwr);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1870,7 +2125,12 @@ DECLARE_INSN(LWU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2119,7 +2379,12 @@ DECLARE_INSN(SB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SB,base,offset,rt,FALSE,
+                             mips64_memop_fast_sb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2130,7 +2395,12 @@ DECLARE_INSN(SC)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SC,base,offset,rt,TRUE,
+                             mips64_memop_fast_sc);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2141,7 +2411,12 @@ DECLARE_INSN(SD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SD,base,offset,rt,FALSE,
+                             mips64_memop_fast_sd);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2185,7 +2460,12 @@ DECLARE_INSN(SH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SH,base,offset,rt,FALSE,
+                             mips64_memop_fast_sh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -112,13 +112,29 @@ int mips64_jit_init(cpu_mips_t *cpu)
    cpu->exec_blk_map = m_memalign(4096,len);
    memset(cpu->exec_blk_map,0,len);
 
+   /* Indirect branch target cache */
+   len = MIPS64_JIT_IBTC_SIZE * sizeof(struct mips64_jit_ibtc_entry);
+   cpu->jit_ibtc = m_memalign(4096,len);
+
+   for(i=0;i<MIPS64_JIT_IBTC_SIZE;i++) {
+      cpu->jit_ibtc[i].mips_pc = MIPS64_JIT_IBTC_INVALID;
+      cpu->jit_ibtc[i].jit_ptr = NULL;
+   }
+
    /* Get area size */
    if (!(area_size = cpu->vm->exec_area_size))
       area_size = MIPS_EXEC_AREA_SIZE;
 
    /* Create executable page area */
    cpu->exec_page_area_size = area_size * 1048576;
-   cpu->exec_page_area = memzone_map_exec_area(cpu->exec_page_area_size);
+
+   if (cpu->vm->huge_pages != MEMZONE_HUGE_NONE) {
+      cpu->exec_page_area_size = MEMZONE_HUGE_ROUND(cpu->exec_page_area_size);
+      cpu->exec_page_area = memzone_map_huge(cpu->exec_page_area_size,TRUE,
+                                             cpu->vm->huge_pages);
+   } else {
+      cpu->exec_page_area = memzone_map_exec_area(cpu->exec_page_area_size);
+   }
 
    if (!cpu->exec_page_area) {
       fprintf(stderr,
@@ -203,6 +219,9 @@ void mips64_jit_shutdown(cpu_mips_t *cpu)
 
    /* Free physical mapping for executable pages */
    free(cpu->exec_blk_map);   
+
+   /* Free the indirect branch target cache */
+   free(cpu->jit_ibtc);
 }
 
 /* Allocate an exec page */
@@ -461,6 +480,175 @@ static void mips64_jit_tcb_free_patches(mips64_jit_tcb_t *block)
    block->patch_table = NULL;
 }
 
+/* Record a cross-page jump that can be chained to its target block */
+struct mips64_jit_chain *
+mips64_jit_tcb_record_chain(mips64_jit_tcb_t *block,m_uint64_t vaddr)
+{
+   struct mips64_jit_chain_table *ct = block->chain_table;
+   struct mips64_jit_chain *chain;
+
+   if (!ct || (ct->cur_chain >= MIPS64_JIT_CHAIN_TABLE_SIZE))
+   {
+      /* full table or no table, create a new one */
+      if (!(ct = malloc(sizeof(*ct))))
+         return NULL;
+
+      memset(ct,0,sizeof(*ct));
+      ct->next = block->chain_table;
+      block->chain_table = ct;
+   }
+
+   chain = &ct->chains[ct->cur_chain++];
+   chain->src = block;
+   chain->mips_pc = vaddr;
+   return chain;
+}
+
+/* Chain the pending cross-page jump to the block about to be executed */
+static void mips64_jit_tcb_link(cpu_mips_t *cpu,mips64_jit_tcb_t *block)
+{
+   struct mips64_jit_chain *chain = cpu->jit_chain_pending;
+   u_char *jit_dst;
+
+   cpu->jit_chain_pending = NULL;
+
+   /* The idle PC must still be seen by the main loop */
+   if (chain->dst || (chain->mips_pc != cpu->pc) || (cpu->pc == cpu->idle_pc))
+      return;
+
+   if (!(jit_dst = mips64_jit_tcb_get_host_ptr(block,cpu->pc)))
+      return;
+
+   mips64_jit_tcb_set_patch(chain->jit_insn,jit_dst);
+
+   chain->dst = block;
+   chain->dst_pprev = &block->chain_in;
+   chain->dst_next = block->chain_in;
+
+   if (block->chain_in)
+      block->chain_in->dst_pprev = &chain->dst_next;
+
+   block->chain_in = chain;
+   cpu->jit_chain_links++;
+}
+
+/* Record the target of an indirect branch which missed the cache */
+static void mips64_jit_ibtc_fill(cpu_mips_t *cpu,mips64_jit_tcb_t *block)
+{
+   struct mips64_jit_ibtc_entry *entry;
+   u_char *jit_dst;
+
+   cpu->jit_ibtc_pending = FALSE;
+   cpu->jit_ibtc_misses++;
+
+   if (cpu->pc == cpu->idle_pc)
+      return;
+
+   if ((jit_dst = mips64_jit_tcb_get_host_ptr(block,cpu->pc)) != NULL) {
+      entry = &cpu->jit_ibtc[mips64_jit_get_ibtc_hash(cpu->pc)];
+      entry->mips_pc = cpu->pc;
+      entry->jit_ptr = jit_dst;
+   }
+}
+
+/* 
+ * Unchain all jumps to and from a block, and remove its entries from the
+ * indirect branch target cache.
+ */
+static void mips64_jit_tcb_unlink(cpu_mips_t *cpu,mips64_jit_tcb_t *block)
+{
+   struct mips64_jit_chain_table *ct,*next;
+   struct mips64_jit_ibtc_entry *entry;
+   struct mips64_jit_chain *chain;
+   int i;
+
+   /* Jumps from other blocks go back to their exit path */
+   for(chain=block->chain_in;chain;chain=chain->dst_next) {
+      mips64_jit_tcb_set_patch(chain->jit_insn,chain->jit_exit);
+      chain->dst = NULL;
+   }
+
+   block->chain_in = NULL;
+
+   /* Jumps from this block are removed from their target list */
+   for(ct=block->chain_table;ct;ct=next) {
+      next = ct->next;
+
+      for(i=0;i<ct->cur_chain;i++) {
+         chain = &ct->chains[i];
+
+         if (chain->dst) {
+            *chain->dst_pprev = chain->dst_next;
+
+            if (chain->dst_next)
+               chain->dst_next->dst_pprev = chain->dst_pprev;
+         }
+
+         if (cpu->jit_chain_pending == chain)
+            cpu->jit_chain_pending = NULL;
+      }
+
+      free(ct);
+   }
+
+   block->chain_table = NULL;
+
+   if (cpu->jit_ibtc) {
+      for(i=0;i<MIPS64_JIT_IBTC_SIZE;i++) {
+         entry = &cpu->jit_ibtc[i];
+
+         if ((entry->mips_pc & MIPS_MIN_PAGE_MASK) == block->start_pc) {
+            entry->mips_pc = MIPS64_JIT_IBTC_INVALID;
+            entry->jit_ptr = NULL;
+         }
+      }
+   }
+}
+
+/* 
+ * The idle PC has changed (set online or automatically): the jumps chained
+ * to it must go back to the main loop.
+ */
+static void mips64_jit_unchain_idle_pc(cpu_mips_t *cpu)
+{
+   struct mips64_jit_chain *chain,*next;
+   struct mips64_jit_ibtc_entry *entry;
+   mips64_jit_tcb_t *block;
+   m_uint64_t idle_pc;
+
+   idle_pc = cpu->jit_idle_pc = cpu->idle_pc;
+
+   if (cpu->jit_ibtc) {
+      entry = &cpu->jit_ibtc[mips64_jit_get_ibtc_hash(idle_pc)];
+
+      if (entry->mips_pc == idle_pc) {
+         entry->mips_pc = MIPS64_JIT_IBTC_INVALID;
+         entry->jit_ptr = NULL;
+      }
+   }
+
+   block = cpu->exec_blk_map[mips64_jit_get_pc_hash(idle_pc)];
+
+   if (!block || (block->start_pc != (idle_pc & MIPS_MIN_PAGE_MASK)))
+      return;
+
+   for(chain=block->chain_in;chain;chain=next) {
+      next = chain->dst_next;
+
+      if (chain->mips_pc != idle_pc)
+         continue;
+
+      mips64_jit_tcb_set_patch(chain->jit_insn,chain->jit_exit);
+
+      *chain->dst_pprev = chain->dst_next;
+
+      if (chain->dst_next)
+         chain->dst_next->dst_pprev = chain->dst_pprev;
+
+      chain->dst = NULL;
+   }
+}
+
 /* Adjust the JIT buffer if its size is not sufficient */
 static int mips64_jit_tcb_adjust_buffer(cpu_mips_t *cpu,
                                         mips64_jit_tcb_t *block)
@@ -532,6 +720,9 @@ void mips64_jit_tcb_free(cpu_mips_t *cpu,mips64_jit_tcb_t *block,
       /* Free the patch tables */
       mips64_jit_tcb_free_patches(block);
 
+      /* Unchain the block */
+      mips64_jit_tcb_unlink(cpu,block);
+
       /* Free code pages */
       for(i=0;i<MIPS_JIT_MAX_CHUNKS;i++)
          exec_page_free(cpu,block->jit_chunks[i]);
@@ -698,18 +889,12 @@ void mips64_jit_tcb_run(cpu_mips_t *cpu,mips64_jit_tcb_t *block)
 void *mips64_jit_run_cpu(cpu_gen_t *gen)
 {    
    cpu_mips_t *cpu = CPU_MIPS64(gen);
-   pthread_t timer_irq_thread;
    mips64_jit_tcb_t *block;
    int timer_irq_check = 0;
    m_uint32_t pc_hash;
 
-   if (pthread_create(&timer_irq_thread,NULL,
-                      (void *)mips64_timer_irq_run,cpu)) 
-   {
-      fprintf(stderr,
-              "VM '%s': unable to create Timer IRQ thread for CPU%u.\n",
-              cpu->vm->name,gen->id);
-      cpu_stop(cpu->gen);
+   if (mips64_timer_irq_start(cpu,!cpu->exec_blk_direct_jump) == -1) {
+      cpu_stop(gen);
       return NULL;
    }
 
@@ -734,15 +919,26 @@ void *mips64_jit_run_cpu(cpu_gen_t *gen)
          }
       }
 
-      /* Handle the virtual CPU clock */
-      if (++timer_irq_check == cpu->timer_irq_check_itv) {
+      /* 
+       * Handle the virtual CPU clock. With direct block jumps, the compiled
+       * code returns here as soon as a timer IRQ is pending.
+       */
+      if (cpu->exec_blk_direct_jump ||
+          (++timer_irq_check == cpu->timer_irq_check_itv))
+      {
          timer_irq_check = 0;
 
-         if (cpu->timer_irq_pending && !cpu->irq_disable) {
+         if (cpu->timer_vclock)
+            timer_irq_poll(&cpu->timer_irq);
+
+         if (!cpu->irq_disable && timer_irq_take(&cpu->timer_irq_pending)) {
+            idle_pc_auto_tick(gen,cpu->pc,cpu->idle_pc);
             mips64_trigger_timer_irq(cpu);
             mips64_trigger_irq(cpu);
-            cpu->timer_irq_pending--;
          }
+
+         if (unlikely(cpu->jit_idle_pc != cpu->idle_pc))
+            mips64_jit_unchain_idle_pc(cpu);
       }
 
       pc_hash = mips64_jit_get_pc_hash(cpu->pc);
@@ -771,6 +967,14 @@ void *mips64_jit_run_cpu(cpu_gen_t *gen)
 #if DEBUG_BLOCK_TIMESTAMP
       block->tm_last_use = jit_jiffies++;
 #endif
+      /* Chain the jump which brought us here, if any */
+      if (cpu->jit_chain_pending)
+         mips64_jit_tcb_link(cpu,block);
+
+      if (cpu->jit_ibtc_pending)
+         mips64_jit_ibtc_fill(cpu,block);
+
+      cpu->jit_disp_exits++;
       block->acc_count++;
       mips64_jit_tcb_run(cpu,block);
    }
@@ -791,12 +995,12 @@ void *mips64_jit_run_cpu(cpu_gen_t *gen)
 
          case CPU_STATE_HALTED:
             gen->cpu_thread_running = FALSE;
-            pthread_join(timer_irq_thread,NULL);
+            mips64_timer_irq_stop(cpu);
             return NULL;
       }
       
       /* CPU is paused */
-      usleep(200000);
+      cpu_pause_wait(gen);
    }
 
    return NULL;
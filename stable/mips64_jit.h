@@ -44,6 +44,37 @@ struct mips64_jit_patch_table {
    struct mips64_jit_patch_table *next;
 };
 
+/* Cross-page jump chained to another block */
+struct mips64_jit_chain {
+   u_char *jit_insn;       /* Patchable jump in the source block */
+   u_char *jit_exit;       /* Exit path taken while unchained */
+   m_uint64_t mips_pc;
+   mips64_jit_tcb_t *src,*dst;
+   struct mips64_jit_chain *dst_next,**dst_pprev;
+};
+
+/* Chain table */
+#define MIPS64_JIT_CHAIN_TABLE_SIZE  16
+
+struct mips64_jit_chain_table {
+   struct mips64_jit_chain chains[MIPS64_JIT_CHAIN_TABLE_SIZE];
+   u_int cur_chain;
+   struct mips64_jit_chain_table *next;
+};
+
+/* Indirect branch (JR/JALR) target cache */
+#define MIPS64_JIT_IBTC_BITS  8
+#define MIPS64_JIT_IBTC_SIZE  (1 << MIPS64_JIT_IBTC_BITS)
+#define MIPS64_JIT_IBTC_MASK  (MIPS64_JIT_IBTC_SIZE - 1)
+
+/* Unaligned PC, never matched by a branch target */
+#define MIPS64_JIT_IBTC_INVALID  0x01
+
+struct mips64_jit_ibtc_entry {
+   m_uint64_t mips_pc;
+   u_char *jit_ptr;
+};
+
 /* MIPS64 translated code block */
 struct mips64_jit_tcb {
    m_uint64_t start_pc;
@@ -56,6 +87,8 @@ struct mips64_jit_tcb {
    insn_exec_page_t *jit_buffer;
    insn_exec_page_t *jit_chunks[MIPS_JIT_MAX_CHUNKS];
    struct mips64_jit_patch_table *patch_table;
+   struct mips64_jit_chain_table *chain_table;
+   struct mips64_jit_chain *chain_in;
    mips64_jit_tcb_t *prev,*next;
 #if DEBUG_BLOCK_TIMESTAMP
    m_uint64_t tm_first_use,tm_last_use;
@@ -119,6 +152,12 @@ static forced_inline m_uint32_t mips64_jit_get_pc_hash(m_uint64_t pc)
    return((page_hash ^ (page_hash >> 12)) & MIPS_JIT_PC_HASH_MASK);
 }
 
+/* Compute the indirect branch target cache index for the specified PC */
+static forced_inline m_uint32_t mips64_jit_get_ibtc_hash(m_uint64_t pc)
+{
+   return((pc >> 2) & MIPS64_JIT_IBTC_MASK);
+}
+
 /* Check if there are pending IRQ */
 extern void mips64_check_pending_irq(mips64_jit_tcb_t *b);
 
@@ -146,6 +185,10 @@ struct mips64_insn_tag *mips64_jit_fetch_and_emit(cpu_mips_t *cpu,
 int mips64_jit_tcb_record_patch(mips64_jit_tcb_t *block,u_char *x86_ptr,
                                 m_uint64_t vaddr);
 
+/* Record a cross-page jump that can be chained to its target block */
+struct mips64_jit_chain *
+mips64_jit_tcb_record_chain(mips64_jit_tcb_t *block,m_uint64_t vaddr);
+
 /* Free an instruction block */
 void mips64_jit_tcb_free(cpu_mips_t *cpu,mips64_jit_tcb_t *block,
                          int list_removal);
@@ -218,6 +218,176 @@ static void mips64_memop_fast_sw(mips64_jit_tcb_t *b,int target)
    x86_bswap(b->jit_ptr,X86_EDX);
    x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,4);
 }
+/* Fast LB */
+static void mips64_memop_fast_lb(mips64_jit_tcb_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,TRUE,FALSE);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LBU */
+static void mips64_memop_fast_lbu(mips64_jit_tcb_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,FALSE,FALSE);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
+/* Fast LH */
+static void mips64_memop_fast_lh(mips64_jit_tcb_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,FALSE,TRUE);
+   x86_bswap(b->jit_ptr,X86_EAX);
+   x86_shift_reg_imm(b->jit_ptr,X86_SAR,X86_EAX,16);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LHU */
+static void mips64_memop_fast_lhu(mips64_jit_tcb_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,FALSE,TRUE);
+   x86_bswap(b->jit_ptr,X86_EAX);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHR,X86_EAX,16);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
+/* Fast LWU */
+static void mips64_memop_fast_lwu(mips64_jit_tcb_t *b,int target)
+{
+   x86_mov_reg_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EAX);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
+/* Fast LD */
+static void mips64_memop_fast_ld(mips64_jit_tcb_t *b,int target)
+{
+   /* EDX = high part, ECX = low part */
+   x86_mov_reg_memindex(b->jit_ptr,X86_EDX,X86_EAX,0,X86_EBX,0,4);
+   x86_mov_reg_memindex(b->jit_ptr,X86_ECX,X86_EAX,4,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_bswap(b->jit_ptr,X86_ECX);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_ECX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LL */
+static void mips64_memop_fast_ll(mips64_jit_tcb_t *b,int target)
+{
+   mips64_memop_fast_lw(b,target);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,OFFSET(cpu_mips_t,ll_bit),1,4);
+}
+
+/* Fast LWL */
+static void mips64_memop_fast_lwl(mips64_jit_tcb_t *b,int target)
+{
+   /* ECX = (vaddr & 3) * 8, EBX = aligned offset in page */
+   x86_mov_reg_reg(b->jit_ptr,X86_ECX,X86_EBX,4);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_ECX,0x03);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_ECX,3);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_EBX,~0x03);
+
+   /* EDX = data << shift */
+   x86_mov_reg_memindex(b->jit_ptr,X86_EDX,X86_EAX,0,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_shift_reg(b->jit_ptr,X86_SHL,X86_EDX);
+
+   /* EAX = (reg & ((1 << shift) - 1)) | EDX, then sign-extend */
+   x86_mov_reg_imm(b->jit_ptr,X86_EAX,1);
+   x86_shift_reg(b->jit_ptr,X86_SHL,X86_EAX);
+   x86_dec_reg(b->jit_ptr,X86_EAX);
+   x86_alu_reg_membase(b->jit_ptr,X86_AND,X86_EAX,X86_EDI,REG_OFFSET(target));
+   x86_alu_reg_reg(b->jit_ptr,X86_OR,X86_EAX,X86_EDX);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LWR */
+static void mips64_memop_fast_lwr(mips64_jit_tcb_t *b,int target)
+{
+   u_char *test1;
+
+   /* ECX = (3 - (vaddr & 3)) * 8, EBX = aligned offset in page */
+   x86_mov_reg_reg(b->jit_ptr,X86_ECX,X86_EBX,4);
+   x86_not_reg(b->jit_ptr,X86_ECX);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_ECX,0x03);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_ECX,3);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_EBX,~0x03);
+
+   /* EDX = data >> shift */
+   x86_mov_reg_memindex(b->jit_ptr,X86_EDX,X86_EAX,0,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_shift_reg(b->jit_ptr,X86_SHR,X86_EDX);
+
+   /* EAX = (reg & ~(0xffffffff >> shift)) | EDX */
+   x86_mov_reg_imm(b->jit_ptr,X86_EAX,0xffffffff);
+   x86_shift_reg(b->jit_ptr,X86_SHR,X86_EAX);
+   x86_not_reg(b->jit_ptr,X86_EAX);
+   x86_alu_reg_membase(b->jit_ptr,X86_AND,X86_EAX,X86_EDI,REG_OFFSET(target));
+   x86_alu_reg_reg(b->jit_ptr,X86_OR,X86_EAX,X86_EDX);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+
+   /* Full word loaded: sign-extend it, otherwise keep the high part */
+   x86_test_reg_reg(b->jit_ptr,X86_ECX,X86_ECX);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_NZ, 0, 1);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+   x86_patch(test1,b->jit_ptr);
+}
+
+/* Fast SB */
+static void mips64_memop_fast_sb(mips64_jit_tcb_t *b,int target)
+{
+   x86_mov_reg_membase(b->jit_ptr,X86_EDX,X86_EDI,REG_OFFSET(target),4);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,1);
+}
+
+/* Fast SH */
+static void mips64_memop_fast_sh(mips64_jit_tcb_t *b,int target)
+{
+   x86_mov_reg_membase(b->jit_ptr,X86_EDX,X86_EDI,REG_OFFSET(target),4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHR,X86_EDX,16);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,2);
+}
+
+/* Fast SD */
+static void mips64_memop_fast_sd(mips64_jit_tcb_t *b,int target)
+{
+   /* EDX = high part, ECX = low part */
+   x86_mov_reg_membase(b->jit_ptr,X86_EDX,X86_EDI,REG_OFFSET(target)+4,4);
+   x86_mov_reg_membase(b->jit_ptr,X86_ECX,X86_EDI,REG_OFFSET(target),4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_bswap(b->jit_ptr,X86_ECX);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,4);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,4,X86_EBX,0,X86_ECX,4);
+}
+
+/* Fast SC */
+static void mips64_memop_fast_sc(mips64_jit_tcb_t *b,int target)
+{
+   u_char *test1;
+
+   /* Store only if the LL bit is set, then GPR[target] = LL bit */
+   x86_mov_reg_membase(b->jit_ptr,X86_ECX,X86_EDI,OFFSET(cpu_mips_t,ll_bit),4);
+   x86_test_reg_reg(b->jit_ptr,X86_ECX,X86_ECX);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_Z, 0, 1);
+   mips64_memop_fast_sw(b,target);
+   x86_patch(test1,b->jit_ptr);
+
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_ECX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
 
 /* Fast memory operation (64-bit) */
 static void mips64_emit_memop_fast64(mips64_jit_tcb_t *b,int write_op,
@@ -1882,7 +2052,12 @@ DECLARE_INSN(LB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LB,base,offset,rt,TRUE,
+                             mips64_memop_fast_lb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1893,7 +2068,12 @@ DECLARE_INSN(LBU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LBU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lbu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1904,7 +2084,12 @@ DECLARE_INSN(LD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LD,base,offset,rt,TRUE,
+                             mips64_memop_fast_ld);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1948,7 +2133,12 @@ DECLARE_INSN(LH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LH,base,offset,rt,TRUE,
+                             mips64_memop_fast_lh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1959,7 +2149,12 @@ DECLARE_INSN(LHU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LHU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lhu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1982,7 +2177,12 @@ DECLARE_INSN(LL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LL,base,offset,rt,TRUE,
+                             mips64_memop_fast_ll);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2023,7 +2223,12 @@ DECLARE_INSN(LWL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWL,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwl);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2034,7 +2239,12 @@ DECLARE_INSN(LWR)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWR,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwr);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2045,7 +2255,12 @@ DECLARE_INSN(LWU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2324,7 +2539,12 @@ DECLARE_INSN(SB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SB,base,offset,rt,FALSE,
+                             mips64_memop_fast_sb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2335,7 +2555,12 @@ DECLARE_INSN(SC)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SC,base,offset,rt,TRUE,
+                             mips64_memop_fast_sc);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2346,7 +2571,12 @@ DECLARE_INSN(SD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SD,base,offset,rt,FALSE,
+                             mips64_memop_fast_sd);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2390,7 +2620,12 @@ DECLARE_INSN(SH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SH,base,offset,rt,FALSE,
+                             mips64_memop_fast_sh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
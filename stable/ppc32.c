@@ -68,6 +68,7 @@ int ppc32_init(cpu_ppc_t *cpu)
    cpu->gen->remove_breakpoint = (void *)ppc32_remove_breakpoint;
    cpu->gen->set_idle_pc = (void *)ppc32_set_idle_pc;
    cpu->gen->get_idling_pc = (void *)ppc32_get_idling_pc;
+   cpu->gen->idle_pc_check = ppc32_idle_pc_check;
 
    /* zzz */
    memset(cpu->vtlb,0xFF,sizeof(cpu->vtlb));
@@ -99,54 +100,210 @@ void ppc32_set_idle_pc(cpu_gen_t *cpu,m_uint64_t addr)
    CPU_PPC32(cpu)->idle_pc = (m_uint32_t)addr;
 }
 
-/* Timer IRQ */
-void *ppc32_timer_irq_run(cpu_ppc_t *cpu)
+/* 
+ * Check that the code at an idle PC candidate is a spin loop without side
+ * effect: a short backward branch to the candidate, polling a fixed address
+ * (load with base registers not modified by the loop) or a system register,
+ * with no store out of the stack frame, no call and no system instruction.
+ * Returns a checksum of the code in "sum".
+ */
+int ppc32_idle_pc_check(cpu_gen_t *cpu,m_uint64_t pc,m_uint32_t *sum)
 {
-   pthread_mutex_t umutex = PTHREAD_MUTEX_INITIALIZER;
-   pthread_cond_t ucond = PTHREAD_COND_INITIALIZER;
-   struct timespec t_spc;
-   m_tmcnt_t expire;
-   u_int interval;
-   u_int threshold;
+   cpu_ppc_t *pcpu = CPU_PPC32(cpu);
+   m_uint32_t loads[IDLE_PC_AUTO_MAX_INSNS];
+   m_uint32_t phys_page,ia = pc,target = 0,written = 0;
+   int i,nloads = 0,end = FALSE,poll_sys = FALSE;
+   ppc_insn_t insn;
+   u_int spr,rd,ra;
 
-#if 0
-   while(!cpu->timer_irq_armed)
-      sleep(1);
-#endif
+   *sum = 0;
+
+   for(i=0;i<IDLE_PC_AUTO_MAX_INSNS;i++,ia+=sizeof(ppc_insn_t)) {
+      if (pcpu->translate(pcpu,ia,PPC32_MTS_ICACHE,&phys_page) == -1)
+         return(-1);
 
-   interval = 1000000 / cpu->timer_irq_freq;
-   threshold = cpu->timer_irq_freq * 10;
-   expire = m_gettime_usec() + interval;
+      insn = physmem_copy_u32_from_vm(pcpu->vm,
+                                      ((m_uint64_t)phys_page << 
+                                       PPC32_MIN_PAGE_SHIFT) +
+                                      (ia & PPC32_MIN_PAGE_IMASK));
 
-   while(cpu->gen->state != CPU_STATE_HALTED) {
-      pthread_mutex_lock(&umutex);
-      t_spc.tv_sec = expire / 1000000;
-      t_spc.tv_nsec = (expire % 1000000) * 1000;
-      pthread_cond_timedwait(&ucond,&umutex,&t_spc);
-      pthread_mutex_unlock(&umutex);
+      *sum = ((*sum << 5) | (*sum >> 27)) ^ insn;
 
-      if (likely(!cpu->irq_disable) &&
-          likely(cpu->gen->state == CPU_STATE_RUNNING) &&
-          likely(cpu->msr & PPC32_MSR_EE))
-      {
-         cpu->timer_irq_pending++;
+      rd = bits(insn,21,25);
+      ra = bits(insn,16,20);
 
-         if (unlikely(cpu->timer_irq_pending > threshold)) {
-            cpu->timer_irq_pending = 0;
-            cpu->timer_drift++;
-#if 0
-            printf("Timer IRQ not accurate (%u pending IRQ): "
-                   "reduce the \"--timer-irq-check-itv\" parameter "
-                   "(current value: %u)\n",
-                   cpu->timer_irq_pending,cpu->timer_irq_check_itv);
-#endif
-         }
+      switch(bits(insn,26,31)) {
+         case 3:    /* TWI */
+         case 17:   /* SC */
+            return(-1);
+
+         case 16:   /* BC, B: no link, must loop to the candidate */
+         case 18:
+            if (insn & 1)
+               return(-1);
+
+            if (bits(insn,26,31) == 16)
+               target = sign_extend_32(bits(insn,2,15) << 2,16);
+            else
+               target = sign_extend_32(bits(insn,2,25) << 2,26);
+
+            if (!(insn & 2))
+               target += ia;
+
+            end = TRUE;
+            break;
+
+         case 19:
+            switch(bits(insn,1,10)) {
+               case 16:    /* BCLR, BCCTR, RFI: no static loop */
+               case 528:
+               case 50:
+                  return(-1);
+            }
+            break;
+
+         case 10:   /* CMPLI, CMPI: only CR is written */
+         case 11:
+            break;
+
+         case 31:
+            switch(bits(insn,1,10)) {
+               case 0:     /* CMP, CMPL */
+               case 32:
+                  break;
+
+               case 83:    /* MFMSR, MFSPR, MFTB: system register polling */
+               case 339:
+               case 371:
+                  written |= 1U << rd;
+                  poll_sys = TRUE;
+                  break;
+
+               case 467:   /* MTSPR: only XER, LR and CTR */
+                  spr = (bits(insn,11,15) << 5) | bits(insn,16,20);
+                  if ((spr != 1) && (spr != 8) && (spr != 9))
+                     return(-1);
+                  break;
+
+               /* Indexed loads (with update forms) */
+               case 23: case 87: case 279: case 343: case 535:
+               case 599: case 790: case 534: case 20:
+                  loads[nloads++] = ((ra ? 1U << ra : 0) | 
+                                     (1U << bits(insn,11,15)));
+                  written |= 1U << rd;
+                  break;
+
+               case 55: case 119: case 311: case 375:
+                  written |= (1U << rd) | (1U << ra);
+                  break;
+
+               /* Indexed stores */
+               case 150: case 151: case 183: case 215: case 247:
+               case 407: case 439: case 661: case 662: case 663:
+               case 695: case 725: case 727: case 759: case 918:
+               case 983:
+               /* Cache, MMU and system instructions */
+               case 4: case 54: case 86: case 146: case 210:
+               case 242: case 306: case 370: case 451: case 470:
+               case 566: case 978: case 982: case 1014:
+                  return(-1);
+
+               default:
+                  written |= (1U << rd) | (1U << ra);
+            }
+            break;
+
+         /* Loads, update forms also modify the base register */
+         case 32: case 34: case 40: case 42:
+            loads[nloads++] = ra ? 1U << ra : 0;
+            written |= 1U << rd;
+            break;
+
+         case 46:    /* LMW */
+            loads[nloads++] = ra ? 1U << ra : 0;
+            written |= ~0U << rd;
+            break;
+
+         case 48: case 50:
+            loads[nloads++] = ra ? 1U << ra : 0;
+            break;
+
+         case 33: case 35: case 41: case 43:
+            written |= (1U << rd) | (1U << ra);
+            break;
+
+         case 49: case 51:
+            written |= 1U << ra;
+            break;
+
+         /* Stores are allowed in the stack frame */
+         case 36 ... 39:
+         case 44: case 45: case 47:
+         case 52 ... 55:
+            if (ra != 1)
+               return(-1);
+            break;
+
+         default:
+            written |= (1U << rd) | (1U << ra);
       }
 
-      expire += interval;
+      if (end)
+         break;
    }
 
-   return NULL;
+   if (!end || (target != (m_uint32_t)pc))
+      return(-1);
+
+   for(i=0;i<nloads;i++)
+      if (!(loads[i] & written))
+         poll_sys = TRUE;
+
+   return(poll_sys ? 0 : -1);
+}
+
+/* Post timer ticks to a CPU */
+static void ppc32_timer_irq_tick(cpu_ppc_t *cpu,u_int ticks)
+{
+   if (unlikely(cpu->irq_disable) ||
+       unlikely(cpu->gen->state != CPU_STATE_RUNNING) ||
+       unlikely(!(cpu->msr & PPC32_MSR_EE)))
+      return;
+
+   if (unlikely(__sync_add_and_fetch(&cpu->timer_irq_pending,ticks) >
+                (cpu->timer_irq_freq * 10)))
+   {
+      __sync_fetch_and_and(&cpu->timer_irq_pending,0);
+      cpu->timer_drift++;
+   }
+}
+
+/* 
+ * Start the virtual clock of a CPU. Ticks are pushed by the timer IRQ
+ * service, or with a host-time virtual clock, computed by the CPU loop
+ * (timer_irq_poll). The latter is only possible if the CPU loop is
+ * entered regularly ("pollable").
+ */
+int ppc32_timer_irq_start(cpu_ppc_t *cpu,int pollable)
+{
+   timer_irq_entry_init(&cpu->timer_irq,cpu->timer_irq_freq,
+                        (timer_irq_tick_t)ppc32_timer_irq_tick,cpu);
+
+   cpu->timer_vclock = cpu->vm->timer_vclock && pollable;
+
+   if (!cpu->timer_vclock && (timer_irq_add(&cpu->timer_irq) == -1)) {
+      fprintf(stderr,"VM '%s': unable to start Timer IRQ for CPU%u.\n",
+              cpu->vm->name,cpu->gen->id);
+      return(-1);
+   }
+
+   return(0);
+}
+
+/* Stop the virtual clock of a CPU */
+void ppc32_timer_irq_stop(cpu_ppc_t *cpu)
+{
+   timer_irq_remove(&cpu->timer_irq);
 }
 
 #define IDLE_HASH_SIZE  8192
@@ -332,6 +489,7 @@ fastcall void ppc32_trigger_irq(cpu_ppc_t *cpu)
    if (cpu->irq_pending && (cpu->msr & PPC32_MSR_EE)) {
       cpu->irq_count++;
       cpu->irq_pending = FALSE;
+      cpu->gen->idle_auto.irqs++;
       ppc32_trigger_exception(cpu,PPC32_EXC_EXT);
    }
 }
@@ -341,8 +499,10 @@ void ppc32_trigger_timer_irq(cpu_ppc_t *cpu)
 {
    cpu->timer_irq_count++;
 
-   if (cpu->msr & PPC32_MSR_EE)
+   if (cpu->msr & PPC32_MSR_EE) {
+      cpu->gen->idle_auto.irqs++;
       ppc32_trigger_exception(cpu,PPC32_EXC_DEC);
+   }
 }
 
 /* Virtual breakpoint */
@@ -531,6 +691,35 @@ int ppc32_load_raw_image(cpu_ppc_t *cpu,char *filename,m_uint32_t vaddr)
    return(0);
 }
 
+/* Populate in background the RAM used by an ELF image */
+static void ppc32_prefault_elf_image(cpu_ppc_t *cpu,Elf *img_elf,Elf32_Ehdr *ehdr)
+{
+   m_uint32_t start = 0xFFFFFFFF,end = 0;
+   Elf32_Shdr *shdr;
+   void *haddr;
+   int i;
+
+   /* Host pages of sparse memory are allocated on first access */
+   if (cpu->vm->sparse_mem)
+      return;
+
+   for(i=0;i<ehdr->e_shnum;i++) {
+      shdr = elf32_getshdr(elf_getscn(img_elf,i));
+
+      if (!(shdr->sh_flags & SHF_ALLOC) || !shdr->sh_size)
+         continue;
+
+      if (shdr->sh_addr < start)
+         start = shdr->sh_addr;
+
+      if ((shdr->sh_addr + shdr->sh_size) > end)
+         end = shdr->sh_addr + shdr->sh_size;
+   }
+
+   if ((end > start) && (haddr = cpu->mem_op_lookup(cpu,start,PPC32_MTS_DCACHE)))
+      dev_ram_prefault_image(cpu->vm,haddr,end - start);
+}
+
 /* Load an ELF image into the simulated memory */
 int ppc32_load_elf_image(cpu_ppc_t *cpu,char *filename,int skip_load,
                          m_uint32_t *entry_point)
@@ -634,6 +823,8 @@ int ppc32_load_elf_image(cpu_ppc_t *cpu,char *filename,int skip_load,
       printf("ELF loading skipped, using a ghost RAM file.\n");
    }
 
+   ppc32_prefault_elf_image(cpu,img_elf,ehdr);
+
    printf("ELF entry point: 0x%x\n",ehdr->e_entry);
 
    if (entry_point)
@@ -10,6 +10,7 @@
 
 #include "utils.h" 
 #include "rbtree.h"
+#include "timer_irq.h"
 
 /* CPU identifiers */
 #define PPC32_PVR_405     0x40110000
@@ -352,6 +353,8 @@ struct cpu_ppc {
    u_int timer_irq_freq;
    u_int timer_irq_check_itv;
    u_int timer_drift;
+   timer_irq_entry_t timer_irq;
+   int timer_vclock;
 
    /* IRQ disable flag */
    volatile u_int irq_disable;
@@ -424,6 +427,10 @@ struct cpu_ppc {
    /* Current exec page (non-JIT) info */
    m_uint64_t njm_exec_page;
    mips_insn_t *njm_exec_ptr;
+   struct ppc32_exec_dinsn *njm_exec_dpage;
+
+   /* Pre-decoded instruction cache (non-JIT) */
+   struct ppc32_exec_dinsn *njm_dcache;
 
    /* Performance counter (non-JIT) */
    m_uint32_t perf_counter;
@@ -502,8 +509,14 @@ void ppc32_set_pvr(cpu_ppc_t *cpu,m_uint32_t pvr);
 /* Set idle PC value */
 void ppc32_set_idle_pc(cpu_gen_t *cpu,m_uint64_t addr);
 
-/* Timer IRQ */
-void *ppc32_timer_irq_run(cpu_ppc_t *cpu);
+/* Check that the code at an idle PC candidate has no side effect */
+int ppc32_idle_pc_check(cpu_gen_t *cpu,m_uint64_t pc,m_uint32_t *sum);
+
+/* Start the virtual clock of a CPU */
+int ppc32_timer_irq_start(cpu_ppc_t *cpu,int pollable);
+
+/* Stop the virtual clock of a CPU */
+void ppc32_timer_irq_stop(cpu_ppc_t *cpu);
 
 /* Determine an "idling" PC */
 int ppc32_get_idling_pc(cpu_gen_t *cpu);
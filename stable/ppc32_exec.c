@@ -94,24 +94,6 @@ static forced_inline void ppc32_exec_memop(cpu_ppc_t *cpu,int memop,
    fn(cpu,vaddr,dst_reg);
 }
 
-/* Fetch an instruction */
-static forced_inline int ppc32_exec_fetch(cpu_ppc_t *cpu,m_uint32_t ia,
-                                          ppc_insn_t *insn)
-{
-   m_uint32_t exec_page,offset;
-
-   exec_page = ia & ~PPC32_MIN_PAGE_IMASK;
-
-   if (unlikely(exec_page != cpu->njm_exec_page)) {
-      cpu->njm_exec_page = exec_page;
-      cpu->njm_exec_ptr  = cpu->mem_op_lookup(cpu,exec_page,PPC32_MTS_ICACHE);
-   }
-
-   offset = (ia & PPC32_MIN_PAGE_IMASK) >> 2;
-   *insn = vmtoh32(cpu->njm_exec_ptr[offset]);
-   return(0);
-}
-
 /* Unknown opcode */
 static fastcall int ppc32_exec_unknown(cpu_ppc_t *cpu,ppc_insn_t insn)
 {   
@@ -144,6 +126,102 @@ ppc32_exec_single_instruction(cpu_ppc_t *cpu,ppc_insn_t instruction)
    return(exec(cpu,instruction));
 }
 
+/* Decode an instruction into a pre-decoded slot */
+static forced_inline void ppc32_exec_decode(struct ppc32_exec_dinsn *d,
+                                            ppc_insn_t insn)
+{
+   d->index = ilt_lookup(ilt,insn);
+   d->exec  = ppc32_exec_tags[d->index].exec;
+   d->insn  = insn;
+}
+
+/* Create the pre-decoded instruction cache */
+static int ppc32_exec_dcache_create(cpu_ppc_t *cpu)
+{
+   size_t i,count;
+
+   count = PPC32_EXEC_DCACHE_PAGES * PPC32_EXEC_DPAGE_INSNS;
+
+   if (!(cpu->njm_dcache = malloc(count * sizeof(*cpu->njm_dcache))))
+      return(-1);
+
+   /* Empty slots hold the decoding of a null instruction word */
+   ppc32_exec_decode(&cpu->njm_dcache[0],0);
+
+   for(i=1;i<count;i++)
+      cpu->njm_dcache[i] = cpu->njm_dcache[0];
+
+   /* Force a lookup of the current exec page */
+   cpu->njm_exec_page = (m_uint64_t)-1;
+   return(0);
+}
+
+/* Free the pre-decoded instruction cache */
+static void ppc32_exec_dcache_free(cpu_ppc_t *cpu)
+{
+   free(cpu->njm_dcache);
+   cpu->njm_dcache = NULL;
+   cpu->njm_exec_dpage = NULL;
+   cpu->njm_exec_page = (m_uint64_t)-1;
+}
+
+/* 
+ * Get the pre-decoded page associated to a host page.
+ *
+ * Slots are not tagged with their page: an entry is used only if it holds
+ * the instruction word read from memory, so pages sharing a cache entry
+ * and self-modifying code just cause the instruction to be decoded again.
+ */
+static forced_inline struct ppc32_exec_dinsn *
+ppc32_exec_get_dpage(cpu_ppc_t *cpu,ppc_insn_t *exec_ptr)
+{
+   u_int index;
+
+   index = ((m_iptr_t)exec_ptr >> PPC32_MIN_PAGE_SHIFT);
+   index &= PPC32_EXEC_DCACHE_PAGES - 1;
+   return(&cpu->njm_dcache[index * PPC32_EXEC_DPAGE_INSNS]);
+}
+
+/* Fetch a pre-decoded instruction */
+static forced_inline struct ppc32_exec_dinsn *
+ppc32_exec_fetch_decoded(cpu_ppc_t *cpu,m_uint32_t ia)
+{
+   struct ppc32_exec_dinsn *d;
+   m_uint32_t exec_page,offset;
+   ppc_insn_t insn;
+
+   exec_page = ia & ~PPC32_MIN_PAGE_IMASK;
+
+   if (unlikely(exec_page != cpu->njm_exec_page)) {
+      cpu->njm_exec_page  = exec_page;
+      cpu->njm_exec_ptr   = cpu->mem_op_lookup(cpu,exec_page,PPC32_MTS_ICACHE);
+      cpu->njm_exec_dpage = ppc32_exec_get_dpage(cpu,cpu->njm_exec_ptr);
+   }
+
+   offset = (ia & PPC32_MIN_PAGE_IMASK) >> 2;
+   insn = vmtoh32(cpu->njm_exec_ptr[offset]);
+   d = &cpu->njm_exec_dpage[offset];
+
+   if (unlikely(d->insn != insn))
+      ppc32_exec_decode(d,insn);
+
+   return(d);
+}
+
+/* Execute a pre-decoded instruction */
+static forced_inline int 
+ppc32_exec_decoded_instruction(cpu_ppc_t *cpu,struct ppc32_exec_dinsn *d)
+{
+#if DEBUG_INSN_PERF_CNT
+   cpu->perf_counter++;
+#endif
+#if NJM_STATS_ENABLE
+   cpu->insn_exec_count++;
+   ppc32_exec_tags[d->index].count++;
+#endif
+   return(d->exec(cpu,d->insn));
+}
+
 /* Execute a single instruction (external) */
 fastcall int ppc32_exec_single_insn_ext(cpu_ppc_t *cpu,ppc_insn_t insn)
 {
@@ -180,16 +258,18 @@ fastcall int ppc32_exec_page(cpu_ppc_t *cpu)
 void *ppc32_exec_run_cpu(cpu_gen_t *gen)
 {   
    cpu_ppc_t *cpu = CPU_PPC32(gen);
-   pthread_t timer_irq_thread;
+   struct ppc32_exec_dinsn *dinsn;
    int timer_irq_check = 0;
-   ppc_insn_t insn;
    int res;
 
-   if (pthread_create(&timer_irq_thread,NULL,
-                      (void *)ppc32_timer_irq_run,cpu))
-   {
-      fprintf(stderr,"VM '%s': unable to create Timer IRQ thread for CPU%u.\n",
-              cpu->vm->name,gen->id);
+   if (ppc32_exec_dcache_create(cpu) == -1) {
+      cpu_log(gen,"SLOW_EXEC","unable to create instruction cache.\n");
+      cpu_stop(gen);
+      return NULL;
+   }
+
+   if (ppc32_timer_irq_start(cpu,TRUE) == -1) {
+      ppc32_exec_dcache_free(cpu);
       cpu_stop(gen);
       return NULL;
    }
@@ -218,11 +298,14 @@ void *ppc32_exec_run_cpu(cpu_gen_t *gen)
       if (++timer_irq_check == cpu->timer_irq_check_itv) {
          timer_irq_check = 0;
 
-         if (cpu->timer_irq_pending && !cpu->irq_disable && 
-             (cpu->msr & PPC32_MSR_EE)) 
-         {        
+         if (cpu->timer_vclock)
+            timer_irq_poll(&cpu->timer_irq);
+
+         if (!cpu->irq_disable && (cpu->msr & PPC32_MSR_EE) &&
+             timer_irq_take(&cpu->timer_irq_pending))
+         {
+            idle_pc_auto_tick(gen,cpu->ia,cpu->idle_pc);
             cpu->timer_irq_armed = 0;
-            cpu->timer_irq_pending--;
 
             vm_set_irq(cpu->vm,0);
             //ppc32_trigger_timer_irq(cpu);
@@ -233,8 +316,8 @@ void *ppc32_exec_run_cpu(cpu_gen_t *gen)
       cpu->tb += 100;
 
       /* Fetch and execute the instruction */
-      ppc32_exec_fetch(cpu,cpu->ia,&insn);
-      res = ppc32_exec_single_instruction(cpu,insn);
+      dinsn = ppc32_exec_fetch_decoded(cpu,cpu->ia);
+      res = ppc32_exec_decoded_instruction(cpu,dinsn);
 
       /* Normal flow ? */
       if (likely(!res)) cpu->ia += sizeof(ppc_insn_t);
@@ -251,12 +334,13 @@ void *ppc32_exec_run_cpu(cpu_gen_t *gen)
 
          case CPU_STATE_HALTED:     
             gen->cpu_thread_running = FALSE;
-            pthread_join(timer_irq_thread,NULL);
+            ppc32_timer_irq_stop(cpu);
+            ppc32_exec_dcache_free(cpu);
             break;
       }
       
       /* CPU is paused */
-      usleep(200000);
+      cpu_pause_wait(gen);
    }
 
    return NULL;
@@ -347,6 +347,27 @@ int memzone_unmap(void *addr, size_t len);
 /* Map a memory zone as an executable area */
 u_char *memzone_map_exec_area(size_t len);
 
+/* Map an anonymous memory zone populated on demand, without reservation */
+u_char *memzone_map_lazy(size_t len);
+
+/* Huge page modes */
+#define MEMZONE_HUGE_NONE  0   /* Normal pages */
+#define MEMZONE_HUGE_THP   1   /* Transparent huge pages */
+#define MEMZONE_HUGE_TLB   2   /* hugetlbfs pages, or THP if unavailable */
+
+#define MEMZONE_HUGE_PAGE_SIZE  (2 * 1048576)
+#define MEMZONE_HUGE_ROUND(len) \
+   (((len) + MEMZONE_HUGE_PAGE_SIZE - 1) & ~(MEMZONE_HUGE_PAGE_SIZE - 1))
+
+/* Map an anonymous memory zone backed by huge pages */
+u_char *memzone_map_huge(size_t len,int exec,int huge);
+
+/* Ask the kernel to back a memory zone with transparent huge pages */
+int memzone_advise_huge(void *addr,size_t len);
+
+/* Get the amount of memory backed by huge pages in a memory zone */
+size_t memzone_get_huge_size(void *addr,size_t len);
+
 /* Map a memory zone from a file */
 u_char *memzone_map_file(int fd,size_t len);
 
@@ -17,6 +17,7 @@
 #include "cisco_eeprom.h"
 #include "cisco_card.h"
 #include "rommon_var.h"
+#include "affinity.h"
 
 #define VM_PAGE_SHIFT  12
 #define VM_PAGE_SIZE   (1 << VM_PAGE_SHIFT)
@@ -100,6 +101,7 @@ struct vm_instance {
    u_int iomem_size;              /* IOMEM size in Mb */
    u_int nvram_size;              /* NVRAM size in Kb */
    u_int pcmcia_disk_size[2];     /* PCMCIA disk0 and disk1 sizes (in Mb) */
+   char *pcmcia_disk_base[2];     /* Base images shared by disk0 and disk1 */
    u_int conf_reg,conf_reg_setup; /* Config register */
    u_int clock_divisor;           /* Clock Divisor (see cp0.c) */
    u_int ram_mmap;                /* Memory-mapped RAM ? */
@@ -116,13 +118,23 @@ struct vm_instance {
    int debug_level;               /* Debugging Level */
    int jit_use;                   /* CPUs use JIT */
    int sparse_mem;                /* Use sparse virtual memory */
+   char *cpu_affinity;            /* Host CPUs used by the VM threads */
+   affinity_set_t cpu_set;        /* Parsed host CPU set */
+   int numa_node;                 /* NUMA node for memory (-1: auto) */
+   int huge_pages;                /* Huge page mode (MEMZONE_HUGE_*) */
    u_int nm_iomem_size;           /* IO mem size to be passed to Smart Init */
 
    /* ROMMON variables */
    struct rommon_var_list rommon_vars;
 
-   /* Memory chunks */
+   /* 
+    * Memory chunks, and host pages released with vm_free_host_page().
+    * Pages are allocated by CPUs and device threads (DMA).
+    */
+   pthread_mutex_t host_pages_lock;
    vm_chunk_t *chunks;
+   void **free_pages;
+   u_int free_pages_count,free_pages_max;
 
    /* Basic hardware: system CPU, PCI busses and PCI I/O space */
    cpu_group_t *cpu_group;
@@ -152,12 +164,21 @@ struct vm_instance {
    /* Ghost RAM image handling */
    int ghost_status;
 
+   /* Snapshot to resume from at VM start (RAM is mapped from it) */
+   char *snapshot_file;
+
    /* Timer IRQ interval check */
    u_int timer_irq_check_itv;
 
+   /* Timer ticks computed from host time by the CPUs (virtual clock) */
+   int timer_vclock;
+
    /* "idling" pointer counter */
    m_uint64_t idle_pc;
 
+   /* Automatic idle PC detection */
+   int idle_pc_auto;
+
    /* JIT block direct jumps */
    int exec_blk_direct_jump;
 
@@ -296,6 +317,12 @@ int vm_release(vm_instance_t *vm);
 /* Initialize RAM */
 int vm_ram_init(vm_instance_t *vm,m_uint64_t paddr);
 
+/* Give back to the ghost image the private RAM pages with same content */
+int vm_ram_reshare(vm_instance_t *vm);
+
+/* Give back to the host the RAM pages containing only zeroes */
+int vm_ram_reclaim(vm_instance_t *vm);
+
 /* Initialize VTTY */
 int vm_init_vtty(vm_instance_t *vm);
 
@@ -390,6 +417,15 @@ int vm_delete_instance(char *name);
 /* Rename a VM instance */
 int vm_rename_instance(vm_instance_t *vm, char *name);
 
+/* Set the host CPUs used by a VM */
+int vm_set_cpu_affinity(vm_instance_t *vm,char *cpu_list);
+
+/* Get the NUMA node used for the memory of a VM (-1 if none) */
+int vm_get_numa_node(vm_instance_t *vm);
+
+/* Bind the CPU, ptask and RX listener threads of a VM to its CPU set */
+void vm_apply_affinity(vm_instance_t *vm);
+
 /* Initialize a VM instance */
 int vm_init_instance(vm_instance_t *vm);
 
@@ -15,6 +15,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <errno.h>
 
 #include "cpu.h"
 #include "vm.h"
@@ -145,6 +146,7 @@ cpu_gen_t *cpu_create(vm_instance_t *vm,u_int type,u_int id)
    cpu->id    = id;
    cpu->type  = type;
    cpu->state = CPU_STATE_SUSPENDED;
+   cpu->idle_auto.enabled = vm->idle_pc_auto;
    cpu->tsg   = vm->tsg;
 
    switch(cpu->type) {
@@ -216,12 +218,43 @@ void cpu_delete(cpu_gen_t *cpu)
    }
 }
 
+/* Wait for a state change while the CPU is paused */
+void cpu_pause_wait(cpu_gen_t *cpu)
+{
+   struct timespec t_spc;
+   m_tmcnt_t expire;
+
+   expire = m_gettime_usec() + CPU_PAUSE_SLEEP_TIME;
+
+   pthread_mutex_lock(&cpu->idle_mutex);
+
+   /* Don't sleep if a sync is pending or if the state has changed */
+   if (cpu->seq_state && (cpu->state != CPU_STATE_RUNNING) &&
+       (cpu->state != CPU_STATE_HALTED))
+   {
+      t_spc.tv_sec = expire / 1000000;
+      t_spc.tv_nsec = (expire % 1000000) * 1000;
+      pthread_cond_timedwait(&cpu->idle_cond,&cpu->idle_mutex,&t_spc);
+   }
+
+   pthread_mutex_unlock(&cpu->idle_mutex);
+}
+
+/* Wake up a paused CPU to make it see a state change */
+void cpu_pause_wakeup(cpu_gen_t *cpu)
+{
+   pthread_mutex_lock(&cpu->idle_mutex);
+   pthread_cond_signal(&cpu->idle_cond);
+   pthread_mutex_unlock(&cpu->idle_mutex);
+}
+
 /* Start a CPU */
 void cpu_start(cpu_gen_t *cpu)
 {
    if (cpu) {
       cpu_log(cpu,"CPU_STATE","Starting CPU (old state=%u)...\n",cpu->state);
       cpu->state = CPU_STATE_RUNNING;
+      cpu_pause_wakeup(cpu);
    }
 }
 
@@ -231,6 +264,7 @@ void cpu_stop(cpu_gen_t *cpu)
    if (cpu) {
       cpu_log(cpu,"CPU_STATE","Halting CPU (old state=%u)...\n",cpu->state);
       cpu->state = CPU_STATE_HALTED;
+      cpu_pause_wakeup(cpu);
    }
 }
 
@@ -286,8 +320,10 @@ int cpu_group_sync_state(cpu_group_t *group)
    /* Check that CPU activity is really suspended */
    t1 = m_gettime();
 
-   for(cpu=group->cpu_list;cpu;cpu=cpu->next)
+   for(cpu=group->cpu_list;cpu;cpu=cpu->next) {
       cpu->seq_state = 0;
+      cpu_pause_wakeup(cpu);
+   }
 
    while(!cpu_group_check_activity(group)) {
       t2 = m_gettime();
@@ -295,7 +331,7 @@ int cpu_group_sync_state(cpu_group_t *group)
       if (t2 > (t1 + 10000))
          return(-1);
 
-      usleep(50000);
+      usleep(1000);
    }
 
    return(0);
@@ -323,24 +359,87 @@ int cpu_group_restore_state(cpu_group_t *group)
    return(TRUE);
 }
 
-/* Virtual idle loop */
+/* 
+ * Get the delay until the next timer tick of a CPU (usec). It is 0 if a
+ * tick is already pending and can be taken.
+ */
+static m_tmcnt_t cpu_idle_get_deadline(cpu_gen_t *cpu)
+{
+   cpu_mips_t *mcpu;
+   cpu_ppc_t *pcpu;
+
+   switch(cpu->type) {
+      case CPU_TYPE_MIPS64:
+         mcpu = CPU_MIPS64(cpu);
+
+         if (mcpu->timer_irq_pending && !mcpu->irq_disable)
+            return(0);
+
+         return(timer_irq_delay(&mcpu->timer_irq));
+
+      case CPU_TYPE_PPC32:
+         pcpu = CPU_PPC32(cpu);
+
+         if (pcpu->timer_irq_pending && !pcpu->irq_disable &&
+             (pcpu->msr & PPC32_MSR_EE))
+            return(0);
+
+         return(timer_irq_delay(&pcpu->timer_irq));
+   }
+
+   return(cpu->idle_sleep_time);
+}
+
+/* 
+ * Virtual idle loop: sleep until the next timer tick of the CPU (at most
+ * "idle_sleep_time"), unless an IRQ, network or console input breaks the 
+ * wait before.
+ */
 void cpu_idle_loop(cpu_gen_t *cpu)
 {
    struct timespec t_spc;
-   m_tmcnt_t expire;
+   m_tmcnt_t delay,expire;
+   int res = 0;
 
-   expire = m_gettime_usec() + cpu->idle_sleep_time;
+   delay = m_min(cpu_idle_get_deadline(cpu),cpu->idle_sleep_time);
 
    pthread_mutex_lock(&cpu->idle_mutex);
+
+   if (!delay || cpu->idle_break) {
+      cpu->idle_break = FALSE;
+      cpu->idle_skips++;
+      pthread_mutex_unlock(&cpu->idle_mutex);
+      return;
+   }
+
+   /* Condition variables use the real time clock */
+   expire = m_gettime_usec() + delay;
    t_spc.tv_sec = expire / 1000000;
    t_spc.tv_nsec = (expire % 1000000) * 1000;
-   pthread_cond_timedwait(&cpu->idle_cond,&cpu->idle_mutex,&t_spc);
+
+   cpu->idle_sleeps++;
+
+   /* State changes (cpu_pause_wakeup) also end the wait */
+   while(!cpu->idle_break && (cpu->state == CPU_STATE_RUNNING) &&
+         (res != ETIMEDOUT))
+      res = pthread_cond_timedwait(&cpu->idle_cond,&cpu->idle_mutex,&t_spc);
+
+   if (res == ETIMEDOUT)
+      cpu->idle_wakeups_timer++;
+   else
+      cpu->idle_wakeups_event++;
+
+   cpu->idle_break = FALSE;
    pthread_mutex_unlock(&cpu->idle_mutex);
 }
 
 /* Break idle wait state */
 void cpu_idle_break_wait(cpu_gen_t *cpu)
 {
+   pthread_mutex_lock(&cpu->idle_mutex);
+   cpu->idle_break = TRUE;
    pthread_cond_signal(&cpu->idle_cond);
+   pthread_mutex_unlock(&cpu->idle_mutex);
+
    cpu->idle_count = 0;
 }
@@ -10,6 +10,7 @@
 #include <setjmp.h>
 #include "utils.h"
 #include "jit_op.h"
+#include "idle_pc_auto.h"
 
 #include "mips64.h"
 #include "mips64_cp0.h"
@@ -28,6 +29,9 @@ enum {
    CPU_STATE_SUSPENDED,
 };
 
+/* Maximum sleep time of a paused CPU (in usec) */
+#define CPU_PAUSE_SLEEP_TIME  200000
+
 /* Maximum results for idle pc */
 #define CPU_IDLE_PC_MAX_RES  10
 
@@ -75,6 +79,11 @@ struct cpu_gen {
    u_int idle_count,idle_max,idle_sleep_time;
    pthread_mutex_t idle_mutex;
    pthread_cond_t idle_cond;
+   int idle_break;
+
+   /* Idle loop statistics: sleeps, wakeups on deadline or by an event */
+   m_uint64_t idle_sleeps,idle_skips;
+   m_uint64_t idle_wakeups_timer,idle_wakeups_event;
 
    /* VM instance */
    vm_instance_t *vm;
@@ -86,6 +95,9 @@ struct cpu_gen {
    struct cpu_idle_pc idle_pc_prop[CPU_IDLE_PC_MAX_RES];
    u_int idle_pc_prop_count;
 
+   /* Automatic idle PC */
+   idle_pc_auto_t idle_auto;
+
    /* Specific CPU part */
    union {
       cpu_mips_t mips64_cpu;
@@ -101,6 +113,7 @@ struct cpu_gen {
    void (*remove_breakpoint)(cpu_gen_t *cpu,m_uint64_t addr);
    void (*set_idle_pc)(cpu_gen_t *cpu,m_uint64_t addr);
    void (*get_idling_pc)(cpu_gen_t *cpu);   
+   int (*idle_pc_check)(cpu_gen_t *cpu,m_uint64_t pc,m_uint32_t *sum);
    void (*mts_rebuild)(cpu_gen_t *cpu);
    void (*mts_show_stats)(cpu_gen_t *cpu);
 
@@ -223,6 +236,12 @@ int cpu_group_save_state(cpu_group_t *group);
 /* Restore state of all CPUs */
 int cpu_group_restore_state(cpu_group_t *group);
 
+/* Wait for a state change while the CPU is paused */
+void cpu_pause_wait(cpu_gen_t *cpu);
+
+/* Wake up a paused CPU to make it see a state change */
+void cpu_pause_wakeup(cpu_gen_t *cpu);
+
 /* Virtual idle loop */
 void cpu_idle_loop(cpu_gen_t *cpu);
 
@@ -24,6 +24,11 @@
 #include <arpa/inet.h>
 #include <pthread.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define HYPERVISOR_EPOLL  1
+#endif
+
 #include "utils.h"
 #include "parser.h"
 #include "net.h"
@@ -31,7 +36,9 @@
 #include "cpu.h"
 #include "vm.h"
 #include "dynamips.h"
+#include "ptask.h"
 #include "tcb.h"
+#include "tc_cache.h"
 #include "dev_c7200.h"
 #include "dev_c3600.h"
 #include "dev_c2691.h"
@@ -44,16 +51,29 @@
 #include "net_io_bridge.h"
 #include "frame_relay.h"
 #include "atm.h"
+#include "atm_bridge.h"
+#include "eth_switch.h"
 
 #define DEBUG_TOKEN  0
 
 /* Hypervisor modules */
 static hypervisor_module_t *module_list = NULL;
+static hash_table_t *module_hash = NULL;
 static volatile int hypervisor_running = 0;
 
 /* Hypervisor connection list */
 static hypervisor_conn_t *hypervisor_conn_list = NULL;
 
+/* Locate the module and execute command */
+static int hypervisor_exec_cmd(hypervisor_conn_t *conn,
+                               char *mod_name,char *cmd_name,
+                               int argc,char *argv[]);
+
+#ifdef HYPERVISOR_EPOLL
+/* Event loop descriptor, serving all control connections */
+static int hypervisor_epoll_fd = -1;
+#endif
+
 /* Show hypervisor version */
 static int cmd_version(hypervisor_conn_t *conn,int argc,char *argv[])
 {
@@ -172,10 +192,353 @@ static int cmd_stop(hypervisor_conn_t *conn,int argc,char *argv[])
 static int cmd_tsg_stats(hypervisor_conn_t *conn,int argc,char *argv[])
 {
    tsg_show_stats();   
+   tc_cache_show_stats();
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Set the number of periodic task worker threads */
+static int cmd_set_ptask_workers(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   if (ptask_set_workers(atoi(argv[0])) == -1) {
+      hypervisor_send_reply(conn,HSC_ERR_INV_PARAM,1,
+                            "unable to set ptask worker count to %s",argv[0]);
+      return(-1);
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Show the periodic task worker threads */
+static int cmd_show_ptask_workers(hypervisor_conn_t *conn,
+                                  int argc,char *argv[])
+{
+   m_uint64_t runs,kicks;
+   u_int i,task_count;
+
+   for(i=0;ptask_get_worker_stats(i,&task_count,&runs,&kicks)!=-1;i++) {
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%u %u %llu %llu",
+                            i,task_count,runs,kicks);
+   }
+
+   hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
+   return(0);
+}
+
+/* Free the commands queued in a batch */
+static void hypervisor_batch_free(hypervisor_conn_t *conn)
+{
+   hypervisor_batch_cmd_t *cmd,*next;
+   int i;
+
+   for(cmd=conn->batch_head;cmd;cmd=next) {
+      next = cmd->next;
+
+      for(i=0;i<cmd->argc;i++)
+         free(cmd->argv[i]);
+
+      free(cmd->argv);
+      free(cmd);
+   }
+
+   conn->batch_head  = NULL;
+   conn->batch_tail  = &conn->batch_head;
+   conn->batch_count = 0;
+}
+
+/* Queue a command in the current batch */
+static int hypervisor_batch_add(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   hypervisor_batch_cmd_t *cmd;
+   int i;
+
+   if (conn->batch_count >= HYPERVISOR_BATCH_MAX) {
+      conn->batch_error = HSC_ERR_INV_PARAM;
+      return(-1);
+   }
+
+   if (!(cmd = malloc(sizeof(*cmd))))
+      goto err_malloc;
+
+   if (!(cmd->argv = calloc(argc,sizeof(char *))))
+      goto err_argv;
+
+   for(i=0;i<argc;i++) {
+      if (!(cmd->argv[i] = strdup(argv[i]))) {
+         while(--i >= 0)
+            free(cmd->argv[i]);
+         goto err_strdup;
+      }
+   }
+
+   cmd->argc = argc;
+   cmd->next = NULL;
+   *(conn->batch_tail) = cmd;
+   conn->batch_tail = &cmd->next;
+   conn->batch_count++;
+   return(0);
+
+ err_strdup:
+   free(cmd->argv);
+ err_argv:
+   free(cmd);
+ err_malloc:
+   conn->batch_error = HSC_ERR_UNSPECIFIED;
+   return(-1);
+}
+
+/* 
+ * Objects which can be created by the commands of a batch, with their
+ * destructor. Users of NIOs come first, so that NIOs created by the
+ * batch are no longer referenced when they are deleted.
+ */
+static struct hypervisor_batch_obj {
+   int type;
+   int (*delete)(char *name);
+} hypervisor_batch_objs[] = {
+   { OBJ_TYPE_VM, vm_delete_instance },
+   { OBJ_TYPE_NIO_BRIDGE, netio_bridge_delete },
+   { OBJ_TYPE_FRSW, frsw_delete },
+   { OBJ_TYPE_ATMSW, atmsw_delete },
+   { OBJ_TYPE_ATM_BRIDGE, atm_bridge_delete },
+   { OBJ_TYPE_ETHSW, ethsw_delete },
+   { OBJ_TYPE_NIO, netio_delete },
+};
+
+#define HYPERVISOR_BATCH_OBJ_TYPES \
+   (sizeof(hypervisor_batch_objs) / sizeof(hypervisor_batch_objs[0]))
+
+/* Record the name of an existing object */
+static void hypervisor_batch_save_obj(registry_entry_t *entry,void *opt,
+                                      int *err)
+{
+   hash_table_t *names = opt;
+   char *name;
+
+   if (!(name = strdup(entry->name)) || 
+       (hash_table_insert(names,name,name) == -1)) 
+   {
+      free(name);
+      *err = TRUE;
+   }
+}
+
+/* Free the names of recorded objects */
+static void hypervisor_batch_free_name(void *key,void *value,void *opt)
+{
+   free(key);
+}
+
+/* Free the objects recorded before a batch */
+static void hypervisor_batch_free_objs(hash_table_t **objs)
+{
+   int i;
+
+   for(i=0;i<HYPERVISOR_BATCH_OBJ_TYPES;i++) {
+      if (objs[i] != NULL) {
+         hash_table_foreach(objs[i],hypervisor_batch_free_name,NULL);
+         hash_table_delete(objs[i]);
+         objs[i] = NULL;
+      }
+   }
+}
+
+/* Record the objects existing before a batch */
+static int hypervisor_batch_save_objs(hash_table_t **objs)
+{
+   int i,err = FALSE;
+
+   memset(objs,0,HYPERVISOR_BATCH_OBJ_TYPES * sizeof(hash_table_t *));
+
+   for(i=0;i<HYPERVISOR_BATCH_OBJ_TYPES;i++) {
+      if (!(objs[i] = hash_string_create(HYPERVISOR_BATCH_OBJ_HASH_SIZE))) {
+         err = TRUE;
+         break;
+      }
+
+      registry_foreach_type(hypervisor_batch_objs[i].type,
+                            hypervisor_batch_save_obj,objs[i],&err);
+      if (err)
+         break;
+   }
+
+   if (err) {
+      hypervisor_batch_free_objs(objs);
+      return(-1);
+   }
+
+   return(0);
+}
+
+/* Lookup of the objects created by a batch */
+struct hypervisor_batch_lookup {
+   hash_table_t *names;
+   m_list_t *created;
+};
+
+/* Find an object which didn't exist before the batch */
+static void hypervisor_batch_find_obj(registry_entry_t *entry,void *opt,
+                                      int *err)
+{
+   struct hypervisor_batch_lookup *lk = opt;
+   char *name;
+
+   if (hash_table_lookup(lk->names,entry->name) != NULL)
+      return;
+
+   if (!(name = strdup(entry->name)) || !m_list_add(&lk->created,name)) {
+      free(name);
+      *err = TRUE;
+   }
+}
+
+/* 
+ * Delete the objects created by a failed batch. Returns the number of
+ * objects which could not be deleted.
+ */
+static int hypervisor_batch_rollback(hash_table_t **objs)
+{
+   struct hypervisor_batch_lookup lk;
+   m_list_t *item,*next;
+   int i,err,failed = 0;
+
+   for(i=0;i<HYPERVISOR_BATCH_OBJ_TYPES;i++) {
+      lk.names = objs[i];
+      lk.created = NULL;
+      err = FALSE;
+
+      registry_foreach_type(hypervisor_batch_objs[i].type,
+                            hypervisor_batch_find_obj,&lk,&err);
+      if (err)
+         failed++;
+
+      for(item=lk.created;item;item=next) {
+         next = item->next;
+
+         m_log("HYPERVISOR","batch rollback: deleting object '%s' "
+               "(type %d)\n",(char *)item->data,hypervisor_batch_objs[i].type);
+
+         if (hypervisor_batch_objs[i].delete(item->data) != 1) {
+            m_log("HYPERVISOR","batch rollback: unable to delete '%s'\n",
+                  (char *)item->data);
+            failed++;
+         }
+
+         free(item->data);
+         free(item);
+      }
+   }
+
+   return(failed);
+}
+
+/* Start a batch: next commands are queued until batch_end */
+static int cmd_batch_start(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   if (conn->batch_active || conn->batch_exec) {
+      hypervisor_send_reply(conn,HSC_ERR_INV_PARAM,1,
+                            "a batch is already in progress");
+      return(-1);
+   }
+
+   hypervisor_batch_free(conn);
+   conn->batch_active = TRUE;
+   conn->batch_error  = 0;
+
    hypervisor_send_reply(conn,HSC_INFO_OK,1,"OK");
    return(0);
 }
 
+/* 
+ * Execute the queued commands, stopping at the first error, and reply
+ * with the status of each command ("-" if not executed). If a command
+ * fails, the objects created by the batch are deleted.
+ */
+static int cmd_batch_end(hypervisor_conn_t *conn,int argc,char *argv[])
+{
+   hash_table_t *objs[HYPERVISOR_BATCH_OBJ_TYPES];
+   hypervisor_batch_cmd_t *cmd;
+   int code,err_index,failed,i;
+   char *status,*p;
+
+   if (!conn->batch_active) {
+      hypervisor_send_reply(conn,HSC_ERR_INV_PARAM,1,"no batch in progress");
+      return(-1);
+   }
+
+   conn->batch_active = FALSE;
+
+   if (conn->batch_error) {
+      hypervisor_send_reply(conn,conn->batch_error,1,
+                            "batch cancelled (%u commands queued)",
+                            conn->batch_count);
+      hypervisor_batch_free(conn);
+      return(-1);
+   }
+
+   /* 4 chars per status code */
+   if (!(status = malloc((conn->batch_count * 4) + 1))) {
+      hypervisor_send_reply(conn,HSC_ERR_UNSPECIFIED,1,"No memory");
+      hypervisor_batch_free(conn);
+      return(-1);
+   }
+
+   /* Objects existing before the batch are kept on rollback */
+   if (hypervisor_batch_save_objs(objs) == -1) {
+      hypervisor_send_reply(conn,HSC_ERR_UNSPECIFIED,1,"No memory");
+      hypervisor_batch_free(conn);
+      free(status);
+      return(-1);
+   }
+
+   code = HSC_INFO_OK;
+   err_index = -1;
+   *status = 0;
+   p = status;
+
+   for(cmd=conn->batch_head,i=0;cmd;cmd=cmd->next,i++) {
+      if (code != HSC_INFO_OK) {
+         p += sprintf(p,"%s-",(i > 0) ? " " : "");
+         continue;
+      }
+
+      m_log("HYPERVISOR","batch_cmd: ");
+      m_flog_str_array(log_file,cmd->argc,cmd->argv);
+
+      /* Replies are not sent, only the final status is kept */
+      conn->batch_exec = TRUE;
+      conn->batch_code = HSC_INFO_OK;
+
+      hypervisor_exec_cmd(conn,cmd->argv[0],cmd->argv[1],cmd->argc-2,
+                          &cmd->argv[2]);
+
+      conn->batch_exec = FALSE;
+      p += sprintf(p,"%s%d",(i > 0) ? " " : "",conn->batch_code);
+
+      if (conn->batch_code >= HSC_ERR_PARSING) {
+         code = conn->batch_code;
+         err_index = i;
+      }
+   }
+
+   if (err_index != -1) {
+      hypervisor_send_reply(conn,HSC_INFO_MSG,0,"%d: %s",
+                            err_index,conn->batch_msg);
+
+      if ((failed = hypervisor_batch_rollback(objs)) != 0)
+         hypervisor_send_reply(conn,HSC_INFO_MSG,0,
+                               "rollback: %d objects not deleted",failed);
+   }
+
+   hypervisor_send_reply(conn,code,1,"%s",status);
+
+   hypervisor_batch_free_objs(objs);
+   free(status);
+   hypervisor_batch_free(conn);
+   return((code == HSC_INFO_OK) ? 0 : -1);
+}
+
 /* Hypervisor commands */
 static hypervisor_cmd_t hypervisor_cmd_array[] = {
    { "version", 0, 0, cmd_version, NULL },
@@ -187,51 +550,109 @@ static hypervisor_cmd_t hypervisor_cmd_array[] = {
    { "reset", 0, 0, cmd_reset, NULL },
    { "close", 0, 0, cmd_close, NULL },
    { "stop", 0, 0, cmd_stop, NULL },
+   { "set_ptask_workers", 1, 1, cmd_set_ptask_workers, NULL },
+   { "show_ptask_workers", 0, 0, cmd_show_ptask_workers, NULL },
+   { "batch_start", 0, 0, cmd_batch_start, NULL },
+   { "batch_end", 0, 0, cmd_batch_end, NULL },
    { "tsg_stats", 0, 0, cmd_tsg_stats, NULL },
    { NULL, -1, -1, NULL, NULL },
 };
 
-/* Send a reply */
+/* Append formatted data to the pending replies of a connection */
+static int hypervisor_out_vprintf(hypervisor_conn_t *conn,
+                                  char *format,va_list ap)
+{
+   size_t new_size;
+   char *new_buf;
+   va_list aq;
+   int len;
+
+   for(;;) {
+      va_copy(aq,ap);
+      len = vsnprintf(conn->out_buf + conn->out_len,
+                      conn->out_size - conn->out_len,format,aq);
+      va_end(aq);
+
+      if (len < 0)
+         return(-1);
+
+      if (conn->out_len + len < conn->out_size) {
+         conn->out_len += len;
+         return(len);
+      }
+
+      /* Grow the output buffer */
+      new_size = (conn->out_size * 2) + len;
+
+      if (!(new_buf = realloc(conn->out_buf,new_size)))
+         return(-1);
+
+      conn->out_buf  = new_buf;
+      conn->out_size = new_size;
+   }
+}
+
+/* Append formatted data to the pending replies of a connection */
+static int hypervisor_out_printf(hypervisor_conn_t *conn,char *format,...)
+{
+   va_list ap;
+   int len;
+
+   va_start(ap,format);
+   len = hypervisor_out_vprintf(conn,format,ap);
+   va_end(ap);
+   return(len);
+}
+
+/* 
+ * Send a reply. Replies are queued and sent once all the commands
+ * received in the same read have been executed.
+ */
 int hypervisor_send_reply(hypervisor_conn_t *conn,int code,int done,
                           char *format,...)
 {
    va_list ap;
    size_t n = 0;
 
-   if (conn != NULL) {
-      va_start(ap,format);
-      n += fprintf(conn->out,"%3d%s",code,(done)?"-":" ");
-      n += vfprintf(conn->out,format,ap);
-      n += fprintf(conn->out,"\r\n");
-      fflush(conn->out);
-      va_end(ap);
+   if (conn == NULL)
+      return(0);
+
+   /* Command executed in a batch: only keep its status */
+   if (conn->batch_exec) {
+      if (done) {
+         conn->batch_code = code;
+
+         if (code >= HSC_ERR_PARSING) {
+            va_start(ap,format);
+            vsnprintf(conn->batch_msg,sizeof(conn->batch_msg),format,ap);
+            va_end(ap);
+         }
+      }
+
+      return(0);
    }
 
+   va_start(ap,format);
+   n += hypervisor_out_printf(conn,"%3d%s",code,(done)?"-":" ");
+   n += hypervisor_out_vprintf(conn,format,ap);
+   n += hypervisor_out_printf(conn,"\r\n");
+   va_end(ap);
    return(n);
 }
 
 /* Find a module */
 hypervisor_module_t *hypervisor_find_module(char *name)
 {
-   hypervisor_module_t *m;
-
-   for(m=module_list;m;m=m->next)
-      if (!strcmp(m->name,name))
-         return m;
+   if (!module_hash)
+      return NULL;
 
-   return NULL;
+   return(hash_table_lookup(module_hash,name));
 }
 
 /* Find a command in a module */
 hypervisor_cmd_t *hypervisor_find_cmd(hypervisor_module_t *module,char *name)
 {                                      
-   hypervisor_cmd_t *cmd;
-   
-   for(cmd=module->cmd_list;cmd;cmd=cmd->next)
-      if (!strcmp(cmd->name,name))
-         return cmd;
-
-   return NULL;
+   return(hash_table_lookup(module->cmd_hash,name));
 }
 
 /* Find an object in the registry */
@@ -278,9 +699,13 @@ static void destroy_module_list(void)
 
    for (m = module_list; m; m = next) {
       next = m->next;
+      hash_table_delete(m->cmd_hash);
       free(m);
    }
    module_list = NULL;
+
+   hash_table_delete(module_hash);
+   module_hash = NULL;
 }
 
 /* Register a module */
@@ -298,13 +723,25 @@ hypervisor_module_t *hypervisor_register_module(char *name,void *opt)
       return NULL;
    }
 
-   if (!module_list)
+   if (!module_list) {
       atexit(destroy_module_list);
+      module_hash = hash_string_create(HYPERVISOR_MOD_HASH_SIZE);
+   }
 
    m->name = name;
    m->opt  = opt;
    m->cmd_list = NULL;
 
+   if (!module_hash ||
+       !(m->cmd_hash = hash_string_create(HYPERVISOR_CMD_HASH_SIZE)) ||
+       (hash_table_insert(module_hash,m->name,m) == -1))
+   {
+      fprintf(stderr,"Hypervisor: unable to register new module.\n");
+      hash_table_delete(m->cmd_hash);
+      free(m);
+      return NULL;
+   }
+
    m->next = module_list;
    module_list = m;
    return m;
@@ -314,14 +751,27 @@ hypervisor_module_t *hypervisor_register_module(char *name,void *opt)
 int hypervisor_register_cmd_list(hypervisor_module_t *module,
                                  hypervisor_cmd_t *cmd_list)
 {
-   hypervisor_cmd_t *cmd = cmd_list;
+   hypervisor_cmd_t *cmd,*last = NULL;
+   int res = 0;
+
+   /* Commands which can't be dispatched are not listed */
+   for(cmd=cmd_list;cmd;cmd=cmd->next) {
+      if (hash_table_insert(module->cmd_hash,cmd->name,cmd) == -1) {
+         fprintf(stderr,"Hypervisor: unable to register command '%s'.\n",
+                 cmd->name);
+         res = -1;
+         break;
+      }
 
-   while(cmd->next != NULL)
-      cmd = cmd->next;
+      last = cmd;
+   }
 
-   cmd->next = module->cmd_list;
-   module->cmd_list = cmd_list;
-   return(0);
+   if (last != NULL) {
+      last->next = module->cmd_list;
+      module->cmd_list = cmd_list;
+   }
+
+   return(res);
 }
 
 /* Register an array of commands */
@@ -331,6 +781,12 @@ int hypervisor_register_cmd_array(hypervisor_module_t *module,
    hypervisor_cmd_t *cmd;
 
    for(cmd=cmd_array;cmd->name!=NULL;cmd++) {
+      if (hash_table_insert(module->cmd_hash,cmd->name,cmd) == -1) {
+         fprintf(stderr,"Hypervisor: unable to register command '%s'.\n",
+                 cmd->name);
+         return(-1);
+      }
+
       cmd->next = module->cmd_list;
       module->cmd_list = cmd;
    }
@@ -370,68 +826,178 @@ static int hypervisor_exec_cmd(hypervisor_conn_t *conn,
    return(cmd->handler(conn,argc,argv));
 }
 
-/* Thread for servicing connections */
-static void *hypervisor_thread(void *arg)
-{   
-   hypervisor_conn_t *conn = arg;
-   char buffer[512],**tokens;
-   parser_context_t ctx;
+/* Tokenize and execute a command line (or a chunk of it) */
+static void hypervisor_exec_line(hypervisor_conn_t *conn,char *buffer,
+                                 size_t len)
+{
+   parser_context_t *ctx = &conn->ctx;
+   char **tokens = NULL;
    int res;
-   
-   tokens = NULL;
-   parser_context_init(&ctx);
 
-   while(conn->active) {
-      if (!fgets(buffer,sizeof(buffer),conn->in))
-         break;
-   
-      if (!*buffer)
-         continue;
+   if (!(len = strnlen(buffer,len)))
+      return;
 
-      /* Tokenize command line */
-      res = parser_scan_buffer(&ctx,buffer,strlen(buffer));
+   /* Tokenize command line */
+   res = parser_scan_buffer(ctx,buffer,len);
 
-      if (res != 0) {   
-         tokens = NULL;
+   if (res != 0) {
+      /* A batch is cancelled by invalid command lines */
+      if (conn->batch_active && ((ctx->error != 0) || (ctx->tok_count < 2)))
+         conn->batch_error = HSC_ERR_PARSING;
 
-         if (ctx.error != 0) {
-            hypervisor_send_reply(conn,HSC_ERR_PARSING,1,"Parse error: %s",
-                                  parser_strerror(&ctx));
-            goto free_tokens;
-         }
+      if (ctx->error != 0) {
+         hypervisor_send_reply(conn,HSC_ERR_PARSING,1,"Parse error: %s",
+                               parser_strerror(ctx));
+         goto free_tokens;
+      }
 
-         if (ctx.tok_count < 2) {
-            hypervisor_send_reply(conn,HSC_ERR_PARSING,1,
-                                  "At least a module and a command "
-                                  "must be specified");
-            goto free_tokens;
-         }
+      if (ctx->tok_count < 2) {
+         hypervisor_send_reply(conn,HSC_ERR_PARSING,1,
+                               "At least a module and a command "
+                               "must be specified");
+         goto free_tokens;
+      }
 
-         /* Map token list to an array */
-         tokens = parser_map_array(&ctx);
+      /* Map token list to an array */
+      tokens = parser_map_array(ctx);
       
-         if (!tokens) {
-            hypervisor_send_reply(conn,HSC_ERR_PARSING,1,"No memory");
-            goto free_tokens;
-         }
+      if (!tokens) {
+         hypervisor_send_reply(conn,HSC_ERR_PARSING,1,"No memory");
+         goto free_tokens;
+      }
 
-         /* Execute command */
-         m_log("HYPERVISOR","exec_cmd: ");
-         m_flog_str_array(log_file,ctx.tok_count,tokens);
+      /* Commands of a batch are queued until its end */
+      if (conn->batch_active &&
+          (strcmp(tokens[0],"hypervisor") || strcmp(tokens[1],"batch_end")))
+      {
+         hypervisor_batch_add(conn,ctx->tok_count,tokens);
+         goto free_tokens;
+      }
 
-         hypervisor_exec_cmd(conn,tokens[0],tokens[1],ctx.
-                             tok_count-2,&tokens[2]);
+      /* Execute command */
+      m_log("HYPERVISOR","exec_cmd: ");
+      m_flog_str_array(log_file,ctx->tok_count,tokens);
+
+      hypervisor_exec_cmd(conn,tokens[0],tokens[1],ctx->tok_count-2,
+                          &tokens[2]);
       
-      free_tokens:
-         free(tokens);
-         tokens = NULL;
-         parser_context_free(&ctx);
+   free_tokens:
+      free(tokens);
+      parser_context_free(ctx);
+   }
+}
+
+/* 
+ * Execute all the command lines received on a connection. Lines are cut
+ * as fgets() would do with a buffer of HYPERVISOR_LINE_SIZE bytes.
+ */
+static void hypervisor_exec_input(hypervisor_conn_t *conn,int eof)
+{
+   size_t pos,len;
+   char *eol;
+
+   for(pos=0;conn->active && (pos < conn->in_len);pos+=len) {
+      len = conn->in_len - pos;
+
+      if ((eol = memchr(&conn->in_buf[pos],'\n',len)) != NULL)
+         len = (eol - &conn->in_buf[pos]) + 1;
+      else if (!eof && (len < HYPERVISOR_LINE_SIZE - 1))
+         break;
+
+      len = m_min(len,HYPERVISOR_LINE_SIZE - 1);
+      hypervisor_exec_line(conn,&conn->in_buf[pos],len);
+   }
+
+   conn->in_len -= pos;
+   memmove(conn->in_buf,&conn->in_buf[pos],conn->in_len);
+}
+
+/* Read data from a connection and execute the received commands */
+static int hypervisor_read_conn(hypervisor_conn_t *conn)
+{
+   ssize_t len;
+
+   len = read(conn->client_fd,&conn->in_buf[conn->in_len],
+              sizeof(conn->in_buf) - conn->in_len);
+
+   if (len == -1) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+         return(0);
+
+      return(-1);
+   }
+
+   /* End of stream: execute the last incomplete line */
+   if (len == 0) {
+      hypervisor_exec_input(conn,TRUE);
+      return(-1);
+   }
+
+   conn->in_len += len;
+   hypervisor_exec_input(conn,FALSE);
+   return(0);
+}
+
+/* 
+ * Update the events monitored for a connection: wait for the socket to be
+ * writable while replies are pending, and stop reading commands while too
+ * many replies are pending (client not reading them).
+ */
+static void hypervisor_update_conn_events(hypervisor_conn_t *conn)
+{
+#ifdef HYPERVISOR_EPOLL
+   struct epoll_event ev;
+#endif
+   int out_wait,in_wait;
+
+   out_wait = (conn->out_len != 0);
+   in_wait  = (conn->out_len < HYPERVISOR_OUT_MAX);
+
+   if ((conn->out_wait == out_wait) && (conn->in_wait == in_wait))
+      return;
+
+#ifdef HYPERVISOR_EPOLL
+   memset(&ev,0,sizeof(ev));
+   ev.events = ((in_wait) ? EPOLLIN : 0) | ((out_wait) ? EPOLLOUT : 0);
+   ev.data.ptr = conn;
+
+   if (epoll_ctl(hypervisor_epoll_fd,EPOLL_CTL_MOD,conn->client_fd,&ev) == -1)
+      perror("hypervisor_update_conn_events: epoll_ctl");
+#endif
+
+   conn->out_wait = out_wait;
+   conn->in_wait  = in_wait;
+}
+
+/* Send the pending replies of a connection, with as few writes as possible */
+static int hypervisor_flush_conn(hypervisor_conn_t *conn)
+{
+   size_t pos = 0;
+   ssize_t len;
+
+   while(pos < conn->out_len) {
+      len = write(conn->client_fd,&conn->out_buf[pos],conn->out_len - pos);
+
+      if (len == -1) {
+         if (errno == EINTR)
+            continue;
+
+         if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            break;
+
+         conn->out_len = 0;
+         return(-1);
       }
+
+      pos += len;
    }
 
-   free(tokens);
-   parser_context_free(&ctx);
-   return NULL;
+   conn->out_len -= pos;
+   memmove(conn->out_buf,&conn->out_buf[pos],conn->out_len);
+
+   /* Wait for the socket to be writable if some replies are still pending */
+   hypervisor_update_conn_events(conn);
+   return(0);
 }
 
 static void sigpipe_handler(int sig)
@@ -466,32 +1032,31 @@ static void hypervisor_remove_conn(hypervisor_conn_t *conn)
 static void hypervisor_close_conn(hypervisor_conn_t *conn)
 {
    if (conn != NULL) {
-      conn->active = FALSE;      
-      shutdown(conn->client_fd,2);
-      pthread_join(conn->tid,NULL);
-
-      fclose(conn->in);
-      fclose(conn->out);
+      conn->active = FALSE;
+#ifdef HYPERVISOR_EPOLL
+      epoll_ctl(hypervisor_epoll_fd,EPOLL_CTL_DEL,conn->client_fd,NULL);
+#endif
 
       shutdown(conn->client_fd,2);
       close(conn->client_fd);
 
+      parser_context_free(&conn->ctx);
+      hypervisor_batch_free(conn);
+      free(conn->out_buf);
+
       hypervisor_remove_conn(conn);
       free(conn);
    }
 }
 
-/* Close connections (dead or all) */
-static void hypervisor_close_conn_list(int dead_status)
+/* Close all connections */
+static void hypervisor_close_conn_list(void)
 {
    hypervisor_conn_t *conn,*next;
    
    for(conn=hypervisor_conn_list;conn;conn=next) {
       next = conn->next;
-
-      if (dead_status && conn->active)
-         continue;
-
+      hypervisor_flush_conn(conn);
       hypervisor_close_conn(conn);
    }
 }
@@ -512,6 +1077,9 @@ static void hypervisor_add_conn(hypervisor_conn_t *conn)
 static hypervisor_conn_t *hypervisor_create_conn(int client_fd)
 {
    hypervisor_conn_t *conn;
+#ifdef HYPERVISOR_EPOLL
+   struct epoll_event ev;
+#endif
 
    if (!(conn = malloc(sizeof(*conn))))
       goto err_malloc;
@@ -519,41 +1087,87 @@ static hypervisor_conn_t *hypervisor_create_conn(int client_fd)
    memset(conn,0,sizeof(*conn));
    conn->active    = TRUE;
    conn->client_fd = client_fd;
+   conn->in_wait   = TRUE;
+   conn->batch_tail = &conn->batch_head;
+   parser_context_init(&conn->ctx);
 
-   /* Open input buffered stream */
-   if (!(conn->in = fdopen(client_fd,"r"))) {
-      perror("hypervisor_create_conn: fdopen/in");
-      goto err_fd_in;
-   }
+   /* Allocate output buffer */
+   conn->out_size = HYPERVISOR_LINE_SIZE;
 
-   /* Open output buffered stream */
-   if (!(conn->out = fdopen(client_fd,"w"))) {
-      perror("hypervisor_create_conn: fdopen/out");
-      goto err_fd_out;
+   if (!(conn->out_buf = malloc(conn->out_size)))
+      goto err_out_buf;
+
+   if (m_fd_set_non_block(client_fd) == -1) {
+      perror("hypervisor_create_conn: m_fd_set_non_block");
+      goto err_non_block;
    }
 
-   /* Set line buffering */
-   setlinebuf(conn->in);
-   setlinebuf(conn->out);
-  
-   /* Create the managing thread */
-   if (pthread_create(&conn->tid,NULL,hypervisor_thread,conn) != 0)
-      goto err_thread;
+   /* Monitor incoming commands */
+#ifdef HYPERVISOR_EPOLL
+   memset(&ev,0,sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.ptr = conn;
+
+   if (epoll_ctl(hypervisor_epoll_fd,EPOLL_CTL_ADD,client_fd,&ev) == -1) {
+      perror("hypervisor_create_conn: epoll_ctl");
+      goto err_non_block;
+   }
+#else
+   if (client_fd >= FD_SETSIZE) {
+      fprintf(stderr,"hypervisor_create_conn: FD %d exceeds FD_SETSIZE\n",
+              client_fd);
+      goto err_non_block;
+   }
+#endif
 
    /* Add it to the connection list */
    hypervisor_add_conn(conn);
    return conn;
 
- err_thread:
-   fclose(conn->out);
- err_fd_out:
-   fclose(conn->in);
- err_fd_in:
+ err_non_block:
+   free(conn->out_buf);
+ err_out_buf:
    free(conn);
  err_malloc:
    return NULL;
 }
 
+/* Handle events on a connection */
+static void hypervisor_handle_conn(hypervisor_conn_t *conn,int readable)
+{
+   if (readable) {
+      if (hypervisor_read_conn(conn) == -1)
+         conn->active = FALSE;
+   }
+
+   /* Send the replies (coalesced for all commands of the read) */
+   if ((hypervisor_flush_conn(conn) == -1) || !conn->active)
+      hypervisor_close_conn(conn);
+}
+
+/* Accept a new connection on a listening socket */
+static void hypervisor_accept_conn(int fd)
+{
+   struct sockaddr_storage remote_addr;
+   socklen_t remote_len;
+   int clnt;
+
+   remote_len = sizeof(remote_addr);
+   clnt = accept(fd,(struct sockaddr *)&remote_addr,&remote_len);
+
+   if (clnt < 0) {
+      perror("hypervisor_tcp_server: accept");
+      return;
+   }
+            
+   /* create a new connection, served by the event loop */
+   if (!hypervisor_create_conn(clnt)) {
+      fprintf(stderr,"hypervisor_tcp_server: unable to create new "
+              "connection for FD %d\n",clnt);
+      close(clnt);
+   }
+}
+
 /* Stop hypervisor from sighandler */
 int hypervisor_stopsig(void)
 {
@@ -564,12 +1178,18 @@ int hypervisor_stopsig(void)
 /* Hypervisor TCP server */
 int hypervisor_tcp_server(char *ip_addr,int tcp_port)
 {
-   int fd_array[HYPERVISOR_MAX_FD];
-   struct sockaddr_storage remote_addr;
-   socklen_t remote_len;
-   int i,res,clnt,fd_count,fd_max;
+#ifdef HYPERVISOR_EPOLL
+   struct epoll_event events[HYPERVISOR_MAX_EVENTS];
+   struct epoll_event ev;
+   int *fd_ptr;
+#else
+   hypervisor_conn_t *conn,*next;
    struct timeval tv;
-   fd_set fds;
+   fd_set rfds,wfds;
+   int fd_max;
+#endif
+   int fd_array[HYPERVISOR_MAX_FD];
+   int i,res,fd_count;
 
    /* Initialize all hypervisor modules */
    hypervisor_init();
@@ -596,6 +1216,26 @@ int hypervisor_tcp_server(char *ip_addr,int tcp_port)
       return(-1);
    }
 
+   /* All sockets are served by a single event loop */
+#ifdef HYPERVISOR_EPOLL
+   if ((hypervisor_epoll_fd = epoll_create(HYPERVISOR_MAX_EVENTS)) == -1) {
+      perror("hypervisor_tcp_server: epoll_create");
+      return(-1);
+   }
+
+   for(i=0;i<fd_count;i++) {
+      if (fd_array[i] == -1)
+         continue;
+
+      memset(&ev,0,sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = &fd_array[i];
+
+      if (epoll_ctl(hypervisor_epoll_fd,EPOLL_CTL_ADD,fd_array[i],&ev) == -1)
+         perror("hypervisor_tcp_server: epoll_ctl");
+   }
+#endif
+
    /* Start accepting connections */
    m_log("HYPERVISOR","Release %s/%s (tag %s)\n",
          sw_version,os_name,sw_version_tag);
@@ -613,55 +1253,78 @@ int hypervisor_tcp_server(char *ip_addr,int tcp_port)
    hypervisor_running = TRUE;
 
    while(hypervisor_running) {
-      FD_ZERO(&fds);
+#ifdef HYPERVISOR_EPOLL
+      /* Wait for incoming connections and commands */
+      res = epoll_wait(hypervisor_epoll_fd,events,HYPERVISOR_MAX_EVENTS,500);
+
+      if (res == -1) {
+         if (errno == EINTR)
+            continue;
+
+         perror("hypervisor_tcp_server: epoll_wait");
+         break;
+      }
+
+      for(i=0;i<res;i++) {
+         fd_ptr = events[i].data.ptr;
+
+         /* Listening socket: accept a new connection */
+         if ((fd_ptr >= fd_array) && (fd_ptr < &fd_array[fd_count])) {
+            hypervisor_accept_conn(*fd_ptr);
+            continue;
+         }
+
+         hypervisor_handle_conn(events[i].data.ptr,events[i].events &
+                                (EPOLLIN|EPOLLHUP|EPOLLERR));
+      }
+#else
+      FD_ZERO(&rfds);
+      FD_ZERO(&wfds);
       fd_max = -1;
 
       for(i=0;i<fd_count;i++)
          if (fd_array[i] != -1) {
-            FD_SET(fd_array[i],&fds);
-            if (fd_array[i] > fd_max)
-               fd_max = fd_array[i];
+            FD_SET(fd_array[i],&rfds);
+            fd_max = m_max(fd_array[i],fd_max);
          }
 
-      /* Wait for incoming connections */
+      for(conn=hypervisor_conn_list;conn;conn=conn->next) {
+         if (conn->in_wait)
+            FD_SET(conn->client_fd,&rfds);
+
+         if (conn->out_wait)
+            FD_SET(conn->client_fd,&wfds);
+
+         fd_max = m_max(conn->client_fd,fd_max);
+      }
+
+      /* Wait for incoming connections and commands */
       tv.tv_sec  = 0;
       tv.tv_usec = 500 * 1000;  /* 500 ms */
-      res = select(fd_max+1,&fds,NULL,NULL,&tv);
+      res = select(fd_max+1,&rfds,&wfds,NULL,&tv);
 
       if (res == -1) {
          if (errno == EINTR)
             continue;
-         else
-            perror("hypervisor_tcp_server: select");
-      }
 
-      /* Accept connections on signaled sockets */
-      for(i=0;i<fd_count;i++) {
-         if (fd_array[i] == -1)
-            continue;
-         
-         if (!FD_ISSET(fd_array[i],&fds))
-            continue;
+         perror("hypervisor_tcp_server: select");
+         break;
+      }
 
-         remote_len = sizeof(remote_addr);
-         clnt = accept(fd_array[i],(struct sockaddr *)&remote_addr,
-                       &remote_len);
+      /* Serve the connections (new ones are not in the FD sets) */
+      for(conn=hypervisor_conn_list;conn;conn=next) {
+         next = conn->next;
 
-         if (clnt < 0) {
-            perror("hypervisor_tcp_server: accept");
-            continue;
-         }
-            
-         /* create a new connection and start a thread to handle it */
-         if (!hypervisor_create_conn(clnt)) {
-            fprintf(stderr,"hypervisor_tcp_server: unable to create new "
-                    "connection for FD %d\n",clnt);
-            close(clnt);
-         }
+         if (FD_ISSET(conn->client_fd,&rfds) || 
+             FD_ISSET(conn->client_fd,&wfds))
+            hypervisor_handle_conn(conn,FD_ISSET(conn->client_fd,&rfds));
       }
 
-      /* Walk through the connection list to eliminate dead connections */
-      hypervisor_close_conn_list(TRUE);
+      /* Accept connections on signaled sockets */
+      for(i=0;i<fd_count;i++)
+         if ((fd_array[i] != -1) && FD_ISSET(fd_array[i],&rfds))
+            hypervisor_accept_conn(fd_array[i]);
+#endif
    }   
 
    /* Close all control sockets */
@@ -675,7 +1338,12 @@ int hypervisor_tcp_server(char *ip_addr,int tcp_port)
 
    /* Close all remote client connections */
    printf("Hypervisor: closing remote client connections.\n");
-   hypervisor_close_conn_list(FALSE);
+   hypervisor_close_conn_list();
+
+#ifdef HYPERVISOR_EPOLL
+   close(hypervisor_epoll_fd);
+   hypervisor_epoll_fd = -1;
+#endif
 
    m_log("HYPERVISOR","Stopped.\n");
    return(0);
@@ -39,28 +39,64 @@
 /* Macro for easy hash computing */
 #define MTS_SHR(v,sr) ((v) >> (sr))
 
-/* Hash table size for MTS64 (default: [shift:16,bits:12]) */
+/*
+ * MTS cache geometry: 2^MTS_CACHE_BITS sets of MTS_CACHE_WAYS entries
+ * (1, 2 or 4). Both can be overridden at build time.
+ */
+#ifndef MTS_CACHE_BITS
+#define MTS_CACHE_BITS  12
+#endif
+
+#ifndef MTS_CACHE_WAYS
+#define MTS_CACHE_WAYS  2
+#endif
+
+#if MTS_CACHE_WAYS == 1
+#define MTS_CACHE_WAYS_SHIFT  0
+#elif MTS_CACHE_WAYS == 2
+#define MTS_CACHE_WAYS_SHIFT  1
+#elif MTS_CACHE_WAYS == 4
+#define MTS_CACHE_WAYS_SHIFT  2
+#else
+#error "MTS_CACHE_WAYS must be 1, 2 or 4"
+#endif
+
+/* Hash table size for MTS64 (number of sets) */
 #define MTS64_HASH_SHIFT1  12
 #define MTS64_HASH_SHIFT2  20
-#define MTS64_HASH_BITS    8
+#define MTS64_HASH_BITS    MTS_CACHE_BITS
 #define MTS64_HASH_SIZE    (1 << MTS64_HASH_BITS)
 #define MTS64_HASH_MASK    (MTS64_HASH_SIZE - 1)
 
+/* MTS64 set associativity (entries per set) */
+#define MTS64_WAYS_SHIFT   MTS_CACHE_WAYS_SHIFT
+#define MTS64_WAYS         (1 << MTS64_WAYS_SHIFT)
+
 /* MTS64 hash on virtual addresses */
 #define MTS64_SHR(v,i)    (MTS_SHR((v),MTS64_HASH_SHIFT##i))
 #define MTS64_HASH(vaddr) ((MTS64_SHR(vaddr,1) ^ MTS64_SHR(vaddr,2)) & MTS64_HASH_MASK)
 
-/* Hash table size for MTS32 (default: [shift:15,bits:15]) */
+/* MTS64 set (first way) for a virtual address */
+#define MTS64_SET(cache,vaddr) (&(cache)[MTS64_HASH(vaddr) << MTS64_WAYS_SHIFT])
+
+/* Hash table size for MTS32 (number of sets) */
 #define MTS32_HASH_SHIFT1  12
 #define MTS32_HASH_SHIFT2  20
-#define MTS32_HASH_BITS    8
+#define MTS32_HASH_BITS    MTS_CACHE_BITS
 #define MTS32_HASH_SIZE    (1 << MTS32_HASH_BITS)
 #define MTS32_HASH_MASK    (MTS32_HASH_SIZE - 1)
 
+/* MTS32 set associativity (entries per set, MIPS only) */
+#define MTS32_WAYS_SHIFT   MTS_CACHE_WAYS_SHIFT
+#define MTS32_WAYS         (1 << MTS32_WAYS_SHIFT)
+
 /* MTS32 hash on virtual addresses */
 #define MTS32_SHR(v,i)    (MTS_SHR((v),MTS32_HASH_SHIFT##i))
 #define MTS32_HASH(vaddr) ((MTS32_SHR(vaddr,1) ^ MTS32_SHR(vaddr,2)) & MTS32_HASH_MASK)
 
+/* MTS32 set (first way) for a virtual address */
+#define MTS32_SET(cache,vaddr) (&(cache)[MTS32_HASH(vaddr) << MTS32_WAYS_SHIFT])
+
 /* Number of entries per chunk */
 #define MTS64_CHUNK_SIZE   256
 #define MTS32_CHUNK_SIZE   256
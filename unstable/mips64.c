@@ -114,6 +114,7 @@ int mips64_init(cpu_mips_t *cpu)
    cpu->gen->remove_breakpoint = (void *)mips64_remove_breakpoint;
    cpu->gen->set_idle_pc = (void *)mips64_set_idle_pc;
    cpu->gen->get_idling_pc = (void *)mips64_get_idling_pc;
+   cpu->gen->idle_pc_check = mips64_idle_pc_check;
 
    /* Set the startup parameters */
    mips64_reset(cpu);
@@ -144,48 +145,201 @@ void mips64_set_idle_pc(cpu_gen_t *cpu,m_uint64_t addr)
    CPU_MIPS64(cpu)->idle_pc = addr;
 }
 
-/* Timer IRQ */
-void *mips64_timer_irq_run(cpu_mips_t *cpu)
+/* 
+ * Scan a basic block for the idle PC check: no store out of the stack 
+ * frame, no call and no system instruction, up to a static branch 
+ * (returned in "target" and "branch"). "poll" is set if the block reads a
+ * fixed address (load with a base register not modified by the block) or 
+ * a CP0 register. Returns a checksum of the code in "sum".
+ */
+static int mips64_idle_pc_scan(cpu_mips_t *mcpu,m_uint64_t pc,
+                               m_uint32_t *sum,m_uint64_t *target,
+                               m_uint64_t *branch,int *poll)
 {
-   pthread_mutex_t umutex = PTHREAD_MUTEX_INITIALIZER;
-   pthread_cond_t ucond = PTHREAD_COND_INITIALIZER;
-   struct timespec t_spc;
-   m_tmcnt_t expire;
-   u_int interval;
-   u_int threshold;
-
-   interval = 1000000 / cpu->timer_irq_freq;
-   threshold = cpu->timer_irq_freq * 10;
-   expire = m_gettime_usec() + interval;
-
-   while(cpu->gen->state != CPU_STATE_HALTED) {
-      pthread_mutex_lock(&umutex);
-      t_spc.tv_sec = expire / 1000000;
-      t_spc.tv_nsec = (expire % 1000000) * 1000;
-      pthread_cond_timedwait(&ucond,&umutex,&t_spc);
-      pthread_mutex_unlock(&umutex);
-
-      if (likely(!cpu->irq_disable) && 
-          likely(cpu->gen->state == CPU_STATE_RUNNING)) 
-      {
-         cpu->timer_irq_pending++;
-
-         if (unlikely(cpu->timer_irq_pending > threshold)) {
-            cpu->timer_irq_pending = 0;
-            cpu->timer_drift++;
-#if 0
-            printf("Timer IRQ not accurate (%u pending IRQ): "
-                   "reduce the \"--timer-irq-check-itv\" parameter "
-                   "(current value: %u)\n",
-                   cpu->timer_irq_pending,cpu->timer_irq_check_itv);
-#endif
-         }
+   m_uint32_t phys_page,written = 0,bases = 0;
+   int i,end = -1,poll_cp0 = FALSE;
+   mips_insn_t insn;
+
+   *sum = 0;
+   *target = 0;
+
+   for(i=0;i<IDLE_PC_AUTO_MAX_INSNS;i++,pc+=sizeof(mips_insn_t)) {
+      if (mcpu->translate(mcpu,pc,&phys_page) == -1)
+         return(-1);
+
+      insn = physmem_copy_u32_from_vm(mcpu->vm,
+                                      ((m_uint64_t)phys_page << 
+                                       MIPS_MIN_PAGE_SHIFT) +
+                                      (pc & MIPS_MIN_PAGE_IMASK));
+
+      *sum = ((*sum << 5) | (*sum >> 27)) ^ insn;
+
+      switch(bits(insn,26,31)) {
+         case 0x00:   /* SPECIAL: no JR/JALR/SYSCALL/traps */
+            switch(bits(insn,0,5)) {
+               case 0x08:
+               case 0x09:
+               case 0x0c:
+               case 0x0d:
+               case 0x30 ... 0x36:
+                  return(-1);
+               default:
+                  written |= 1U << bits(insn,11,15);
+            }
+            break;
+
+         case 0x01:   /* REGIMM: branches, no links/traps */
+            if (bits(insn,16,20) >= 0x04)
+               return(-1);
+            *target = (pc + 4) + sign_extend(bits(insn,0,15) << 2,18);
+            *branch = pc;
+            end = i + 1;
+            break;
+
+         case 0x02:   /* J */
+            *target = ((pc + 4) & ~0x0fffffffULL) | (bits(insn,0,25) << 2);
+            *branch = pc;
+            end = i + 1;
+            break;
+
+         case 0x04 ... 0x07:   /* Branches */
+         case 0x14 ... 0x17:
+            *target = (pc + 4) + sign_extend(bits(insn,0,15) << 2,18);
+            *branch = pc;
+            end = i + 1;
+            break;
+
+         case 0x03:   /* JAL */
+         case 0x2f:   /* CACHE */
+            return(-1);
+
+         case 0x10:   /* COP0: only moves from cp0 and WAIT */
+            if (bits(insn,25,25) ? (bits(insn,0,5) != 0x20) :
+                (bits(insn,21,25) >= 0x04))
+               return(-1);
+
+            if (!bits(insn,25,25) && (bits(insn,21,25) <= 0x01)) {
+               written |= 1U << bits(insn,16,20);
+               poll_cp0 = TRUE;
+            }
+            break;
+
+         case 0x11:   /* COP1: branches */
+            if (bits(insn,21,25) == 0x08) {
+               *target = (pc + 4) + sign_extend(bits(insn,0,15) << 2,18);
+               *branch = pc;
+               end = i + 1;
+            }
+            break;
+
+         case 0x08 ... 0x0f:   /* Immediate ops */
+         case 0x18 ... 0x19:
+            written |= 1U << bits(insn,16,20);
+            break;
+
+         case 0x1a ... 0x1b:   /* Loads (LWC1/LDC1 don't write a GPR) */
+         case 0x20 ... 0x27:
+         case 0x30 ... 0x31:
+         case 0x34 ... 0x35:
+         case 0x37:
+            if ((bits(insn,26,31) != 0x31) && (bits(insn,26,31) != 0x35))
+               written |= 1U << bits(insn,16,20);
+
+            bases |= 1U << bits(insn,21,25);
+            break;
+
+         case 0x28 ... 0x2e:   /* Stores are allowed in the stack frame */
+         case 0x38 ... 0x3f:
+            if (bits(insn,21,25) != 29)
+               return(-1);
+            break;
       }
 
-      expire += interval;
+      if (i == end)
+         break;
+   }
+
+   if (i != end)
+      return(-1);
+
+   written &= ~1;
+   *poll = poll_cp0 || (bases & ~written);
+   return(0);
+}
+
+/* 
+ * Check that the code at an idle PC candidate is a spin loop without side
+ * effect: a short backward branch to the candidate (or to the start of the
+ * loop, for a PC sampled in the middle of it), polling something. 
+ */
+int mips64_idle_pc_check(cpu_gen_t *cpu,m_uint64_t pc,m_uint32_t *sum)
+{
+   cpu_mips_t *mcpu = CPU_MIPS64(cpu);
+   m_uint64_t start,target,branch,loop_branch;
+   int poll;
+
+   if (mips64_idle_pc_scan(mcpu,pc,sum,&target,&branch,&poll) == -1)
+      return(-1);
+
+   if (target == pc)
+      return(poll ? 0 : -1);
+
+   if ((target > pc) ||
+       ((pc - target) >= (IDLE_PC_AUTO_MAX_INSNS * sizeof(mips_insn_t))))
+      return(-1);
+
+   /* The whole loop must be checked, and must contain the candidate */
+   start = target;
+
+   if ((mips64_idle_pc_scan(mcpu,start,sum,&target,&loop_branch,
+                            &poll) == -1) ||
+       (target != start) || (loop_branch != branch) || !poll)
+      return(-1);
+
+   return(0);
+}
+
+/* Post timer ticks to a CPU */
+static void mips64_timer_irq_tick(cpu_mips_t *cpu,u_int ticks)
+{
+   if (unlikely(cpu->irq_disable) ||
+       unlikely(cpu->gen->state != CPU_STATE_RUNNING))
+      return;
+
+   if (unlikely(__sync_add_and_fetch(&cpu->timer_irq_pending,ticks) >
+                (cpu->timer_irq_freq * 10)))
+   {
+      __sync_fetch_and_and(&cpu->timer_irq_pending,0);
+      cpu->timer_drift++;
    }
+}
 
-   return NULL;
+/* 
+ * Start the virtual clock of a CPU. Ticks are pushed by the timer IRQ
+ * service, or with a host-time virtual clock, computed by the CPU loop
+ * (timer_irq_poll). The latter is only possible if the CPU loop is
+ * entered regularly ("pollable").
+ */
+int mips64_timer_irq_start(cpu_mips_t *cpu,int pollable)
+{
+   timer_irq_entry_init(&cpu->timer_irq,cpu->timer_irq_freq,
+                        (timer_irq_tick_t)mips64_timer_irq_tick,cpu);
+
+   cpu->timer_vclock = cpu->vm->timer_vclock && pollable;
+
+   if (!cpu->timer_vclock && (timer_irq_add(&cpu->timer_irq) == -1)) {
+      fprintf(stderr,"VM '%s': unable to start Timer IRQ for CPU%u.\n",
+              cpu->vm->name,cpu->gen->id);
+      return(-1);
+   }
+
+   return(0);
+}
+
+/* Stop the virtual clock of a CPU */
+void mips64_timer_irq_stop(cpu_mips_t *cpu)
+{
+   timer_irq_remove(&cpu->timer_irq);
 }
 
 #define IDLE_HASH_SIZE  8192
@@ -578,9 +732,10 @@ fastcall void mips64_trigger_irq(cpu_mips_t *cpu)
    }
 
    cpu->irq_count++;
-   if (mips64_update_irq_flag_fast(cpu))
+   if (mips64_update_irq_flag_fast(cpu)) {
+      cpu->gen->idle_auto.irqs++;
       mips64_general_exception(cpu,MIPS_CP0_CAUSE_INTERRUPT);
-   else
+   } else
       cpu->irq_fp_count++;
 }
 
@@ -987,6 +1142,35 @@ int mips64_load_raw_image(cpu_mips_t *cpu,char *filename,m_uint64_t vaddr)
    return(0);
 }
 
+/* Populate in background the RAM used by an ELF image */
+static void mips64_prefault_elf_image(cpu_mips_t *cpu,Elf *img_elf,Elf32_Ehdr *ehdr)
+{
+   m_uint32_t start = 0xFFFFFFFF,end = 0;
+   Elf32_Shdr *shdr;
+   void *haddr;
+   int i;
+
+   /* Host pages of sparse memory are allocated on first access */
+   if (cpu->vm->sparse_mem)
+      return;
+
+   for(i=0;i<ehdr->e_shnum;i++) {
+      shdr = elf32_getshdr(elf_getscn(img_elf,i));
+
+      if (!(shdr->sh_flags & SHF_ALLOC) || !shdr->sh_size)
+         continue;
+
+      if (shdr->sh_addr < start)
+         start = shdr->sh_addr;
+
+      if ((shdr->sh_addr + shdr->sh_size) > end)
+         end = shdr->sh_addr + shdr->sh_size;
+   }
+
+   if ((end > start) && (haddr = cpu->mem_op_lookup(cpu,sign_extend(start,32))))
+      dev_ram_prefault_image(cpu->vm,haddr,end - start);
+}
+
 /* Load an ELF image into the simulated memory */
 int mips64_load_elf_image(cpu_mips_t *cpu,char *filename,int skip_load,
                           m_uint32_t *entry_point)
@@ -1091,6 +1275,8 @@ int mips64_load_elf_image(cpu_mips_t *cpu,char *filename,int skip_load,
       printf("ELF loading skipped, using a ghost RAM file.\n");
    }
 
+   mips64_prefault_elf_image(cpu,img_elf,ehdr);
+
    printf("ELF entry point: 0x%x\n",ehdr->e_entry);
 
    if (entry_point)
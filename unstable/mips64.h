@@ -10,6 +10,7 @@
 
 #include "utils.h" 
 #include "rbtree.h"
+#include "timer_irq.h"
 
 /* 
  * MIPS General Purpose Registers 
@@ -427,6 +428,8 @@ struct cpu_mips {
    u_int timer_irq_freq;
    u_int timer_irq_check_itv;
    u_int timer_drift;
+   timer_irq_entry_t timer_irq;
+   int timer_vclock;
 
    /* IRQ disable flag */
    volatile u_int irq_disable;
@@ -445,10 +448,13 @@ struct cpu_mips {
 
    /* MTS invalidate/shutdown operations */
    void (*mts_invalidate)(cpu_mips_t *cpu);
+   void (*mts_invalidate_range)(cpu_mips_t *cpu,m_uint64_t vaddr,
+                                m_uint64_t len);
    void (*mts_shutdown)(cpu_mips_t *cpu);
 
    /* MTS cache statistics */
    m_uint64_t mts_misses,mts_lookups;
+   m_uint64_t mts_set_hits,mts_evictions;
 
    /* JIT flush method */
    u_int jit_flush_method;
@@ -468,6 +474,10 @@ struct cpu_mips {
    /* Current exec page (non-JIT) info */
    m_uint64_t njm_exec_page;
    mips_insn_t *njm_exec_ptr;
+   struct mips64_exec_dinsn *njm_exec_dpage;
+
+   /* Pre-decoded instruction cache (non-JIT) */
+   struct mips64_exec_dinsn *njm_dcache;
 
    /* Performance counter (number of instructions executed by CPU) */
    m_uint32_t perf_counter;
@@ -508,8 +518,14 @@ void mips64_set_prid(cpu_mips_t *cpu,m_uint32_t prid);
 /* Set idle PC value */
 void mips64_set_idle_pc(cpu_gen_t *cpu,m_uint64_t addr);
 
-/* Timer IRQ */
-void *mips64_timer_irq_run(cpu_mips_t *cpu);
+/* Check that the code at an idle PC candidate has no side effect */
+int mips64_idle_pc_check(cpu_gen_t *cpu,m_uint64_t pc,m_uint32_t *sum);
+
+/* Start the virtual clock of a CPU */
+int mips64_timer_irq_start(cpu_mips_t *cpu,int pollable);
+
+/* Stop the virtual clock of a CPU */
+void mips64_timer_irq_stop(cpu_mips_t *cpu);
 
 /* Determine an "idling" PC */
 int mips64_get_idling_pc(cpu_gen_t *cpu);
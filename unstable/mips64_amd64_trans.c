@@ -151,8 +151,15 @@ static void mips64_set_jump(cpu_mips_t *cpu,cpu_tc_t *b,
       return_to_caller = TRUE;
 
    if (!return_to_caller && mips64_jit_tcb_local_addr(b,new_pc,&jump_ptr)) {
-      if (jump_ptr) {
+      if (jump_ptr && tc_in_jit_buffer(b,jump_ptr)) {
          amd64_jump_code(b->jit_ptr,jump_ptr);
+      } else if (jump_ptr) {
+         /* 
+          * Jump to another JIT chunk: it is patched at the end so that 
+          * the chunks can be moved when loaded from the translation cache.
+          */
+         mips64_jit_tcb_record_patch(cpu,b,b->jit_ptr,new_pc);
+         amd64_jump32(b->jit_ptr,0);
       } else {
          /* Never jump directly to code in a delay slot */
          if (mips64_jit_is_delay_slot(b,new_pc)) {
@@ -175,10 +182,14 @@ static void mips64_set_jump(cpu_mips_t *cpu,cpu_tc_t *b,
    }
 }
 
-/* Basic C call */
+/* 
+ * Basic C call. The function address is always a 64-bit immediate, 
+ * recorded as a host relocation for the translation cache.
+ */
 static forced_inline void mips64_emit_basic_c_call(cpu_tc_t *b,void *f)
 {
-   amd64_mov_reg_imm(b->jit_ptr,AMD64_RCX,f);
+   tc_record_reloc(b,b->jit_ptr,TC_RELOC_HOST_ADDR,f);
+   amd64_mov_reg_imm_size(b->jit_ptr,AMD64_RCX,f,8);
    amd64_call_reg(b->jit_ptr,AMD64_RCX);
 }
 
@@ -186,8 +197,7 @@ static forced_inline void mips64_emit_basic_c_call(cpu_tc_t *b,void *f)
 static void mips64_emit_c_call(cpu_tc_t *b,void *f)
 {   
    mips64_set_pc(b,b->vaddr+((b->trans_pos-1)<<2));
-   amd64_mov_reg_imm(b->jit_ptr,AMD64_RCX,f);
-   amd64_call_reg(b->jit_ptr,AMD64_RCX);
+   mips64_emit_basic_c_call(b,f);
 }
 
 /* Single-step operation */
@@ -220,6 +230,167 @@ static void mips64_memop_fast_sw(cpu_tc_t *b,int target)
    amd64_bswap32(b->jit_ptr,X86_EAX);
    amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,4);
 }
+/* Fast LB */
+static void mips64_memop_fast_lb(cpu_tc_t *b,int target)
+{
+   amd64_widen_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                        TRUE,FALSE);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LBU */
+static void mips64_memop_fast_lbu(cpu_tc_t *b,int target)
+{
+   amd64_widen_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                        FALSE,FALSE);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LH */
+static void mips64_memop_fast_lh(cpu_tc_t *b,int target)
+{
+   amd64_widen_memindex_size(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                             FALSE,TRUE,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SAR,X86_EAX,16,4);
+   amd64_movsxd_reg_reg(b->jit_ptr,AMD64_RDX,X86_EAX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RDX,8);
+}
+
+/* Fast LHU */
+static void mips64_memop_fast_lhu(cpu_tc_t *b,int target)
+{
+   amd64_widen_memindex_size(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,
+                             FALSE,TRUE,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHR,X86_EAX,16,4);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LWU */
+static void mips64_memop_fast_lwu(cpu_tc_t *b,int target)
+{
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LD */
+static void mips64_memop_fast_ld(cpu_tc_t *b,int target)
+{
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,8);
+   amd64_bswap64(b->jit_ptr,AMD64_RAX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RAX,8);
+}
+
+/* Fast LL */
+static void mips64_memop_fast_ll(cpu_tc_t *b,int target)
+{
+   mips64_memop_fast_lw(b,target);
+   amd64_mov_membase_imm(b->jit_ptr,AMD64_R15,OFFSET(cpu_mips_t,ll_bit),1,4);
+}
+
+/* Fast LWL */
+static void mips64_memop_fast_lwl(cpu_tc_t *b,int target)
+{
+   /* ECX = (vaddr & 3) * 8, ESI = aligned offset in page */
+   amd64_mov_reg_reg_size(b->jit_ptr,X86_ECX,X86_ESI,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ECX,0x03,4);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHL,X86_ECX,3,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ESI,~0x03,4);
+
+   /* EAX = data << shift */
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHL,X86_EAX,4);
+
+   /* EDX = (reg & ((1 << shift) - 1)) | EAX, then sign-extend */
+   amd64_mov_reg_imm_size(b->jit_ptr,X86_EDX,1,4);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHL,X86_EDX,4);
+   amd64_dec_reg_size(b->jit_ptr,X86_EDX,4);
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_AND,X86_EDX,
+                              AMD64_R15,REG_OFFSET(target),4);
+   amd64_alu_reg_reg_size(b->jit_ptr,X86_OR,X86_EDX,X86_EAX,4);
+   amd64_movsxd_reg_reg(b->jit_ptr,AMD64_RDX,X86_EDX);
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RDX,8);
+}
+
+/* Fast LWR */
+static void mips64_memop_fast_lwr(cpu_tc_t *b,int target)
+{
+   u_char *test1;
+
+   /* ECX = (3 - (vaddr & 3)) * 8, ESI = aligned offset in page */
+   amd64_mov_reg_reg_size(b->jit_ptr,X86_ECX,X86_ESI,4);
+   amd64_not_reg_size(b->jit_ptr,X86_ECX,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ECX,0x03,4);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHL,X86_ECX,3,4);
+   amd64_alu_reg_imm_size(b->jit_ptr,X86_AND,X86_ESI,~0x03,4);
+
+   /* RAX = data >> shift */
+   amd64_mov_reg_memindex(b->jit_ptr,AMD64_RAX,AMD64_RBX,0,AMD64_RSI,0,4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHR,X86_EAX,4);
+
+   /* RDX = (reg & ~(0xffffffff >> shift)) | RAX */
+   amd64_mov_reg_imm_size(b->jit_ptr,X86_EDX,0xffffffff,4);
+   amd64_shift_reg_size(b->jit_ptr,X86_SHR,X86_EDX,4);
+   amd64_not_reg(b->jit_ptr,AMD64_RDX);
+   amd64_alu_reg_membase_size(b->jit_ptr,X86_AND,AMD64_RDX,
+                              AMD64_R15,REG_OFFSET(target),8);
+   amd64_alu_reg_reg(b->jit_ptr,X86_OR,AMD64_RDX,AMD64_RAX);
+
+   /* Full word loaded: sign-extend it */
+   amd64_test_reg_reg_size(b->jit_ptr,X86_ECX,X86_ECX,4);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_NZ, 0, 1);
+   amd64_movsxd_reg_reg(b->jit_ptr,AMD64_RDX,X86_EAX);
+   amd64_patch(test1,b->jit_ptr);
+
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RDX,8);
+}
+
+/* Fast SB */
+static void mips64_memop_fast_sb(cpu_tc_t *b,int target)
+{
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,AMD64_R15,REG_OFFSET(target),4);
+   amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,1);
+}
+
+/* Fast SH */
+static void mips64_memop_fast_sh(cpu_tc_t *b,int target)
+{
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,AMD64_R15,REG_OFFSET(target),4);
+   amd64_bswap32(b->jit_ptr,X86_EAX);
+   amd64_shift_reg_imm_size(b->jit_ptr,X86_SHR,X86_EAX,16,4);
+   amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,2);
+}
+
+/* Fast SD */
+static void mips64_memop_fast_sd(cpu_tc_t *b,int target)
+{
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RAX,AMD64_R15,REG_OFFSET(target),8);
+   amd64_bswap64(b->jit_ptr,AMD64_RAX);
+   amd64_mov_memindex_reg(b->jit_ptr,AMD64_RBX,0,AMD64_RSI,0,AMD64_RAX,8);
+}
+
+/* Fast SC */
+static void mips64_memop_fast_sc(cpu_tc_t *b,int target)
+{
+   u_char *test1;
+
+   /* Store only if the LL bit is set, then GPR[target] = LL bit */
+   amd64_mov_reg_membase(b->jit_ptr,AMD64_RCX,
+                         AMD64_R15,OFFSET(cpu_mips_t,ll_bit),4);
+   amd64_test_reg_reg_size(b->jit_ptr,X86_ECX,X86_ECX,4);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_Z, 0, 1);
+   mips64_memop_fast_sw(b,target);
+   amd64_patch(test1,b->jit_ptr);
+
+   amd64_mov_membase_reg(b->jit_ptr,AMD64_R15,REG_OFFSET(target),AMD64_RCX,8);
+}
+
 
 /* Fast memory operation (64-bit) */
 static void mips64_emit_memop_fast64(cpu_tc_t *b,int write_op,
@@ -254,7 +425,7 @@ static void mips64_emit_memop_fast64(cpu_tc_t *b,int write_op,
    amd64_mov_reg_membase(b->jit_ptr,AMD64_RCX,
                          AMD64_R15,
                          OFFSET(cpu_mips_t,mts_u.mts64_cache),8);
-   amd64_shift_reg_imm(b->jit_ptr,X86_SHL,AMD64_RBX,5);  /* TO FIX */
+   amd64_shift_reg_imm(b->jit_ptr,X86_SHL,AMD64_RBX,5+MTS64_WAYS_SHIFT);
    amd64_alu_reg_reg(b->jit_ptr,X86_ADD,AMD64_RCX,AMD64_RBX);
 
    /* Compare virtual page address (EAX = vpage) */
@@ -344,7 +515,7 @@ static void mips64_emit_memop_fast32(cpu_tc_t *b,int write_op,
    amd64_mov_reg_membase(b->jit_ptr,AMD64_RCX,
                          AMD64_R15,
                          OFFSET(cpu_mips_t,mts_u.mts32_cache),8);
-   amd64_shift_reg_imm(b->jit_ptr,X86_SHL,AMD64_RBX,5);  /* TO FIX */
+   amd64_shift_reg_imm(b->jit_ptr,X86_SHL,AMD64_RBX,5+MTS32_WAYS_SHIFT);
    amd64_alu_reg_reg(b->jit_ptr,X86_ADD,AMD64_RCX,AMD64_RBX);
 
    /* Compare virtual page address (EAX = vpage) */
@@ -1764,7 +1935,12 @@ DECLARE_INSN(LB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LB,base,offset,rt,TRUE,
+                             mips64_memop_fast_lb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1775,7 +1951,12 @@ DECLARE_INSN(LBU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LBU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lbu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1786,7 +1967,12 @@ DECLARE_INSN(LD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LD,base,offset,rt,TRUE,
+                             mips64_memop_fast_ld);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1830,7 +2016,12 @@ DECLARE_INSN(LH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LH,base,offset,rt,TRUE,
+                             mips64_memop_fast_lh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1841,7 +2032,12 @@ DECLARE_INSN(LHU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LHU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lhu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1864,7 +2060,12 @@ DECLARE_INSN(LL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LL,base,offset,rt,TRUE,
+                             mips64_memop_fast_ll);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1910,7 +2111,12 @@ DECLARE_INSN(LWL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWL,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwl);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1921,7 +2127,12 @@ DECLARE_INSN(LWR)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWR,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwr);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1932,7 +2143,12 @@ DECLARE_INSN(LWU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2201,7 +2417,12 @@ DECLARE_INSN(SB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SB,base,offset,rt,FALSE,
+                             mips64_memop_fast_sb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2212,7 +2433,12 @@ DECLARE_INSN(SC)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SC,base,offset,rt,TRUE,
+                             mips64_memop_fast_sc);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2223,7 +2449,12 @@ DECLARE_INSN(SD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SD,base,offset,rt,FALSE,
+                             mips64_memop_fast_sd);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2267,7 +2498,12 @@ DECLARE_INSN(SH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SH,base,offset,rt,FALSE,
+                             mips64_memop_fast_sh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
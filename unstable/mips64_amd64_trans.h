@@ -13,6 +13,7 @@
 #include "mips64_exec.h"
 
 #define JIT_SUPPORT 1
+#define JIT_TC_CACHE 1  /* Code can be saved to a translation cache */
 
 /* Manipulate bitmasks atomically */
 static forced_inline void atomic_or(m_uint32_t *v,m_uint32_t m)
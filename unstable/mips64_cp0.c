@@ -171,6 +171,10 @@ static inline void mips64_cp0_set_reg(cpu_mips_t *cpu,u_int cp0_reg,
          break;
 
      case MIPS_CP0_TLB_HI:
+         /* MTS entries don't hold the ASID, flush them on ASID change */
+         if ((val ^ cp0->reg[cp0_reg]) & MIPS_TLB_ASID_MASK)
+            cpu->mts_invalidate(cpu);
+
          cp0->reg[cp0_reg] = val & MIPS_CP0_HI_SAFE_MASK;
          break;
 
@@ -503,6 +507,17 @@ fastcall void mips64_cp0_exec_tlbr(cpu_mips_t *cpu)
    }
 }
 
+/* Invalidate the MTS cache sets covering a TLB entry (both pages) */
+static inline void mips64_cp0_tlb_invalidate_mts(cpu_mips_t *cpu,
+                                                 tlb_entry_t *entry)
+{
+   m_uint64_t vaddr,len;
+
+   len = (m_uint64_t)get_page_size(entry->mask) << 1;
+   vaddr = entry->hi & mips64_cp0_get_vpn2_mask(cpu) & ~(len - 1);
+   cpu->mts_invalidate_range(cpu,vaddr,len);
+}
+
 /* TLBW: Write a TLB entry */
 static inline void mips64_cp0_exec_tlbw(cpu_mips_t *cpu,u_int index)
 {
@@ -522,6 +537,10 @@ static inline void mips64_cp0_exec_tlbw(cpu_mips_t *cpu,u_int index)
 
       mips64_cp0_tlb_callback(cpu,entry,TLB_ZONE_ADD);
 
+      /* Pages mapped by the previous entry */
+      if ((entry->lo0 | entry->lo1) & MIPS_TLB_V_MASK)
+         mips64_cp0_tlb_invalidate_mts(cpu,entry);
+
       entry->mask = cp0->reg[MIPS_CP0_PAGEMASK] & MIPS_TLB_PAGE_MASK;
       entry->hi   = cp0->reg[MIPS_CP0_TLB_HI];
       entry->lo0  = cp0->reg[MIPS_CP0_TLB_LO_0];
@@ -537,8 +556,8 @@ static inline void mips64_cp0_exec_tlbw(cpu_mips_t *cpu,u_int index)
       entry->lo0 &= ~MIPS_CP0_LO_G_MASK;
       entry->lo1 &= ~MIPS_CP0_LO_G_MASK;
 
-      /* Inform the MTS subsystem */
-      cpu->mts_invalidate(cpu);
+      /* Inform the MTS subsystem (pages mapped by the new entry) */
+      mips64_cp0_tlb_invalidate_mts(cpu,entry);
 
       mips64_cp0_tlb_callback(cpu,entry,TLB_ZONE_DELETE);
 
@@ -386,6 +386,107 @@ fastcall void mips64_exec_single_step(cpu_mips_t *cpu,mips_insn_t instruction)
    if (likely(!res)) cpu->pc += 4;
 }
 
+/* Decode an instruction into a pre-decoded slot */
+static forced_inline void mips64_exec_decode(struct mips64_exec_dinsn *d,
+                                             mips_insn_t insn)
+{
+   d->index = ilt_lookup(ilt,insn);
+   d->exec  = mips64_exec_tags[d->index].exec;
+   d->insn  = insn;
+}
+
+/* Create the pre-decoded instruction cache */
+static int mips64_exec_dcache_create(cpu_mips_t *cpu)
+{
+   size_t i,count;
+
+   count = MIPS64_EXEC_DCACHE_PAGES * MIPS64_EXEC_DPAGE_INSNS;
+
+   if (!(cpu->njm_dcache = malloc(count * sizeof(*cpu->njm_dcache))))
+      return(-1);
+
+   /* Empty slots hold the decoding of a null instruction word */
+   mips64_exec_decode(&cpu->njm_dcache[0],0);
+
+   for(i=1;i<count;i++)
+      cpu->njm_dcache[i] = cpu->njm_dcache[0];
+
+   /* Force a lookup of the current exec page */
+   cpu->njm_exec_page = (m_uint64_t)-1;
+   return(0);
+}
+
+/* Free the pre-decoded instruction cache */
+static void mips64_exec_dcache_free(cpu_mips_t *cpu)
+{
+   free(cpu->njm_dcache);
+   cpu->njm_dcache = NULL;
+   cpu->njm_exec_dpage = NULL;
+   cpu->njm_exec_page = (m_uint64_t)-1;
+}
+
+/* 
+ * Get the pre-decoded page associated to a host page.
+ *
+ * Slots are not tagged with their page: an entry is used only if it holds
+ * the instruction word read from memory, so pages sharing a cache entry
+ * and self-modifying code just cause the instruction to be decoded again.
+ */
+static forced_inline struct mips64_exec_dinsn *
+mips64_exec_get_dpage(cpu_mips_t *cpu,mips_insn_t *exec_ptr)
+{
+   u_int index;
+
+   index = ((m_iptr_t)exec_ptr >> MIPS_MIN_PAGE_SHIFT);
+   index &= MIPS64_EXEC_DCACHE_PAGES - 1;
+   return(&cpu->njm_dcache[index * MIPS64_EXEC_DPAGE_INSNS]);
+}
+
+/* Fetch a pre-decoded instruction */
+static forced_inline struct mips64_exec_dinsn *
+mips64_exec_fetch_decoded(cpu_mips_t *cpu,m_uint64_t pc)
+{
+   struct mips64_exec_dinsn *d;
+   m_uint64_t exec_page;
+   m_uint32_t offset;
+   mips_insn_t insn;
+
+   exec_page = pc & MIPS_MIN_PAGE_MASK;
+
+   if (unlikely(exec_page != cpu->njm_exec_page)) {
+      cpu->njm_exec_ptr   = cpu->mem_op_ifetch(cpu,exec_page);
+      cpu->njm_exec_page  = exec_page;
+      cpu->njm_exec_dpage = mips64_exec_get_dpage(cpu,cpu->njm_exec_ptr);
+   }
+
+   offset = (pc & MIPS_MIN_PAGE_IMASK) >> 2;
+   insn = vmtoh32(cpu->njm_exec_ptr[offset]);
+   d = &cpu->njm_exec_dpage[offset];
+
+   if (unlikely(d->insn != insn))
+      mips64_exec_decode(d,insn);
+
+   return(d);
+}
+
+/* Execute a pre-decoded instruction */
+static forced_inline int 
+mips64_exec_decoded_instruction(cpu_mips_t *cpu,struct mips64_exec_dinsn *d)
+{
+#if DEBUG_INSN_PERF_CNT
+   cpu->perf_counter++;
+#endif
+
+   /* Increment CP0 count register */
+   mips64_exec_inc_cp0_cnt(cpu);
+
+#if NJM_STATS_ENABLE
+   cpu->insn_exec_count++;
+   mips64_exec_tags[d->index].count++;
+#endif
+   return(d->exec(cpu,d->insn));
+}
+
 /* Execute a page */
 fastcall int mips64_exec_page(cpu_mips_t *cpu)
 {
@@ -418,16 +519,18 @@ fastcall int mips64_exec_page(cpu_mips_t *cpu)
 void *mips64_exec_run_cpu(cpu_gen_t *gen)
 {   
    cpu_mips_t *cpu = CPU_MIPS64(gen);
-   pthread_t timer_irq_thread;
+   struct mips64_exec_dinsn *dinsn;
    int timer_irq_check = 0;
-   mips_insn_t insn;
    int res;
 
-   if (pthread_create(&timer_irq_thread,NULL,
-                      (void *)mips64_timer_irq_run,cpu))
-   {
-      fprintf(stderr,"VM '%s': unable to create Timer IRQ thread for CPU%u.\n",
-              cpu->vm->name,gen->id);
+   if (mips64_exec_dcache_create(cpu) == -1) {
+      cpu_log(gen,"SLOW_EXEC","unable to create instruction cache.\n");
+      cpu_stop(gen);
+      return NULL;
+   }
+
+   if (mips64_timer_irq_start(cpu,TRUE) == -1) {
+      mips64_exec_dcache_free(cpu);
       cpu_stop(gen);
       return NULL;
    }
@@ -454,10 +557,13 @@ void *mips64_exec_run_cpu(cpu_gen_t *gen)
       if (++timer_irq_check == cpu->timer_irq_check_itv) {
          timer_irq_check = 0;
 
-         if (cpu->timer_irq_pending && !cpu->irq_disable) {
+         if (cpu->timer_vclock)
+            timer_irq_poll(&cpu->timer_irq);
+
+         if (!cpu->irq_disable && timer_irq_take(&cpu->timer_irq_pending)) {
+            idle_pc_auto_tick(gen,cpu->pc,cpu->idle_pc);
             mips64_trigger_timer_irq(cpu);
             mips64_trigger_irq(cpu);
-            cpu->timer_irq_pending--;
          }
       }
 
@@ -470,9 +576,9 @@ void *mips64_exec_run_cpu(cpu_gen_t *gen)
          continue;
       }
 
-      /* Fetch and execute the instruction */      
-      mips64_exec_fetch(cpu,cpu->pc,&insn);
-      res = mips64_exec_single_instruction(cpu,insn);
+      /* Fetch and execute the instruction */
+      dinsn = mips64_exec_fetch_decoded(cpu,cpu->pc);
+      res = mips64_exec_decoded_instruction(cpu,dinsn);
 
       /* Normal flow ? */
       if (likely(!res)) cpu->pc += sizeof(mips_insn_t);
@@ -494,12 +600,13 @@ void *mips64_exec_run_cpu(cpu_gen_t *gen)
 
          case CPU_STATE_HALTED:     
             gen->cpu_thread_running = FALSE;
-            pthread_join(timer_irq_thread,NULL);
+            mips64_timer_irq_stop(cpu);
+            mips64_exec_dcache_free(cpu);
             break;
       }
       
       /* CPU is paused */
-      usleep(200000);
+      cpu_pause_wait(gen);
    }
 
    return NULL;
@@ -508,16 +615,23 @@ void *mips64_exec_run_cpu(cpu_gen_t *gen)
 /* Execute the instruction in delay slot */
 static forced_inline void mips64_exec_bdslot(cpu_mips_t *cpu)
 {
+   struct mips64_exec_dinsn *dinsn;
    mips_insn_t insn;
 
    /* Set BD slot flag */
    cpu->bd_slot = 1;
 
-   /* Fetch the instruction in delay slot */
-   mips64_exec_fetch(cpu,cpu->pc+4,&insn);
+   /* Use the pre-decoded instruction cache in non-JIT mode */
+   if (likely(cpu->njm_dcache != NULL)) {
+      dinsn = mips64_exec_fetch_decoded(cpu,cpu->pc+4);
+      mips64_exec_decoded_instruction(cpu,dinsn);
+   } else {
+      /* Fetch the instruction in delay slot */
+      mips64_exec_fetch(cpu,cpu->pc+4,&insn);
 
-   /* Execute the instruction */
-   mips64_exec_single_instruction(cpu,insn);
+      /* Execute the instruction */
+      mips64_exec_single_instruction(cpu,insn);
+   }
    
    /* Clear BD slot flag */
    cpu->bd_slot = 0;
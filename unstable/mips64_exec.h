@@ -18,6 +18,19 @@ struct mips64_insn_exec_tag {
    m_uint64_t count;
 };
 
+/* Number of pages kept in the pre-decoded instruction cache */
+#define MIPS64_EXEC_DCACHE_PAGES  64
+
+/* Number of instructions in a pre-decoded page */
+#define MIPS64_EXEC_DPAGE_INSNS   (MIPS_MIN_PAGE_SIZE / sizeof(mips_insn_t))
+
+/* Pre-decoded instruction (non-JIT mode) */
+struct mips64_exec_dinsn {
+   fastcall int (*exec)(cpu_mips_t *,mips_insn_t);
+   mips_insn_t insn;
+   int index;
+};
+
 /* Initialize instruction lookup table */
 void mips64_exec_create_ilt(void);
 
@@ -19,6 +19,7 @@
 #include "cpu.h"
 #include "device.h"
 #include "tcb.h"
+#include "tc_cache.h"
 #include "mips64.h"
 #include "mips64_cp0.h"
 #include "mips64_exec.h"
@@ -104,8 +105,20 @@ void mips64_jit_create_ilt(void)
 /* Initialize the JIT structure */
 int mips64_jit_init(cpu_mips_t *cpu)
 {
+   vm_instance_t *vm = cpu->vm;
+
    if (tsg_bind_cpu(cpu->gen) == -1)
       return(-1);
+
+   /* Open the translation cache, shared by all CPUs of the VM */
+   if (vm->tc_cache_filename && !vm->tc_cache) {
+      if (!JIT_TC_CACHE) {
+         vm_error(vm,"translation cache is not supported by this JIT.\n");
+      } else if (!(vm->tc_cache = tc_cache_open(vm->tc_cache_filename))) {
+         vm_error(vm,"unable to open translation cache '%s'.\n",
+                  vm->tc_cache_filename);
+      }
+   }
    
    return(cpu_jit_init(cpu->gen,
                        MIPS_JIT_VIRT_HASH_SIZE,
@@ -277,6 +290,21 @@ static int mips64_jit_tcb_adjust_buffer(cpu_mips_t *cpu,cpu_tc_t *tc)
    return(tc_adjust_jit_buffer(cpu->gen,tc,mips64_jit_tcb_set_jump));
 }
 
+/* CPU settings which change the translated code */
+static inline m_uint32_t mips64_jit_trans_flags(cpu_mips_t *cpu)
+{
+   return(((cpu->addr_mode == 64) ? 0x01 : 0) | (cpu->fast_memop ? 0x02 : 0));
+}
+
+/* 
+ * Returns TRUE if the translation cache can be used. Code emitted for 
+ * symbol tracing and breakpoints is never saved.
+ */
+static inline int mips64_jit_use_tc_cache(cpu_mips_t *cpu)
+{
+   return(cpu->vm->tc_cache && !cpu->sym_trace && !cpu->breakpoints_enabled);
+}
+
 /* Produce translated code for a page. If this fails, use non-compiled mode */
 static cpu_tc_t *mips64_jit_tcb_translate(cpu_mips_t *cpu,cpu_tb_t *tb)
 {
@@ -299,6 +327,7 @@ static cpu_tc_t *mips64_jit_tcb_translate(cpu_mips_t *cpu,cpu_tb_t *tb)
          cpu_log(cpu->gen,"JIT",
                  "unable to fetch instruction (VA=0x%8.8llx,exec_state=%u).\n",
                  tb->vaddr,tb->exec_state);
+         tc_discard(cpu->gen,tc);
          return NULL;
       }
 
@@ -313,20 +342,40 @@ static cpu_tc_t *mips64_jit_tcb_translate(cpu_mips_t *cpu,cpu_tb_t *tb)
 
    mips64_jit_tcb_add_end(tc);
    mips64_jit_tcb_apply_patches(cpu,tc);
+
+   if (mips64_jit_use_tc_cache(cpu))
+      tc_cache_store(cpu->vm->tc_cache,cpu->gen,tb,tc,
+                     mips64_jit_trans_flags(cpu));
+
    tc_free_patches(tc);
+   tc_free_relocs(tc);
    tc->target_code = NULL;
    return tc;
 }
 
+/* Load translated code from the translation cache */
+static cpu_tc_t *mips64_jit_tcb_load(cpu_mips_t *cpu,cpu_tb_t *tb)
+{
+#if JIT_TC_CACHE
+   return(tc_cache_load(cpu->gen,cpu->vm->tc_cache,tb,
+                        mips64_jit_trans_flags(cpu),
+                        mips64_jit_tcb_set_patch,
+                        mips64_jit_tcb_set_jump));
+#else
+   return NULL;
+#endif
+}
+
 /* Compile a MIPS instruction page */
 static cpu_tb_t *
 mips64_jit_tcb_compile(cpu_mips_t *cpu,m_uint64_t vaddr,m_uint32_t exec_state)
 {
    cpu_tb_t *tb;
-   cpu_tc_t *tc;
+   cpu_tc_t *tc = NULL;
    m_uint64_t page_addr;
    mips_insn_t *mips_code;
    m_uint32_t phys_page;
+   m_tmcnt_t start;
 
    page_addr = vaddr & MIPS_MIN_PAGE_MASK;
 
@@ -360,8 +409,17 @@ mips64_jit_tcb_compile(cpu_mips_t *cpu,m_uint64_t vaddr,m_uint32_t exec_state)
       return tb;
    }
 
-   /* The page is not shared, we have to compile it */
-   tc = mips64_jit_tcb_translate(cpu,tb);
+   /* The page is not shared, try to load it from the translation cache */
+   if (mips64_jit_use_tc_cache(cpu)) {
+      if (!(tc = mips64_jit_tcb_load(cpu,tb))) {
+         start = m_gettime_usec();
+         tc = mips64_jit_tcb_translate(cpu,tb);
+         tc_cache_add_trans_time(cpu->vm->tc_cache,m_gettime_usec() - start);
+      }
+   } else {
+      /* We have to compile it */
+      tc = mips64_jit_tcb_translate(cpu,tb);
+   }
    
    if (tc != NULL) {
       tc->target_code = tb->target_code;
@@ -424,19 +482,13 @@ void mips64_jit_tcb_run(cpu_mips_t *cpu,cpu_tb_t *tb)
 void *mips64_jit_run_cpu(cpu_gen_t *gen)
 {    
    cpu_mips_t *cpu = CPU_MIPS64(gen);
-   pthread_t timer_irq_thread;
    cpu_tb_t *tb;
    m_uint32_t hv,hp;
    m_uint32_t phys_page;
    int timer_irq_check = 0;
 
-   if (pthread_create(&timer_irq_thread,NULL,
-                      (void *)mips64_timer_irq_run,cpu)) 
-   {
-      fprintf(stderr,
-              "VM '%s': unable to create Timer IRQ thread for CPU%u.\n",
-              cpu->vm->name,gen->id);
-      cpu_stop(cpu->gen);
+   if (mips64_timer_irq_start(cpu,TRUE) == -1) {
+      cpu_stop(gen);
       return NULL;
    }
 
@@ -471,10 +523,13 @@ void *mips64_jit_run_cpu(cpu_gen_t *gen)
       if (++timer_irq_check == cpu->timer_irq_check_itv) {
          timer_irq_check = 0;
 
-         if (cpu->timer_irq_pending && !cpu->irq_disable) {
+         if (cpu->timer_vclock)
+            timer_irq_poll(&cpu->timer_irq);
+
+         if (!cpu->irq_disable && timer_irq_take(&cpu->timer_irq_pending)) {
+            idle_pc_auto_tick(gen,cpu->pc,cpu->idle_pc);
             mips64_trigger_timer_irq(cpu);
             mips64_trigger_irq(cpu);
-            cpu->timer_irq_pending--;
          }
       }
 
@@ -532,12 +587,12 @@ void *mips64_jit_run_cpu(cpu_gen_t *gen)
 
          case CPU_STATE_HALTED:
             gen->cpu_thread_running = FALSE;
-            pthread_join(timer_irq_thread,NULL);
+            mips64_timer_irq_stop(cpu);
             return NULL;
       }
       
       /* CPU is paused */
-      usleep(200000);
+      cpu_pause_wait(gen);
    }
 
    return NULL;
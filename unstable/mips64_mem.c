@@ -158,15 +158,20 @@ mips64_mts64_slow_lookup(cpu_mips_t *cpu,m_uint64_t vaddr,
                          u_int op_type,m_uint64_t *data,
                          mts64_entry_t *alt_entry)
 {
-   m_uint32_t hash_bucket,zone,sub_zone,cca;
+   m_uint32_t zone,sub_zone,cca;
    mts64_entry_t *entry;
    mts_map_t map;
    int tlb_res;
 
-   hash_bucket = MTS64_HASH(vaddr);
-   entry = &cpu->mts_u.mts64_cache[hash_bucket];
+   entry = MTS64_SET(cpu->mts_u.mts64_cache,vaddr);
    zone = vaddr >> 40;
 
+   /* Look in the other ways of the set before doing a full translation */
+   if (((vaddr & MIPS_MIN_PAGE_MASK) != entry->gvpa) &&
+       mips64_mts64_set_lookup(cpu,entry,vaddr & MIPS_MIN_PAGE_MASK) &&
+       !((op_type == MTS_WRITE) && (entry->flags & MTS_FLAG_WRCATCH)))
+      return(entry);
+
 #if DEBUG_MTS_STATS
    cpu->mts_misses++;
 #endif
@@ -281,7 +286,6 @@ void *mips64_mts64_access(cpu_mips_t *cpu,m_uint64_t vaddr,
                           u_int op_type,m_uint64_t *data)
 {   
    mts64_entry_t *entry,alt_entry;
-   m_uint32_t hash_bucket;
    m_iptr_t haddr;
    u_int dev_id;
    int wr_catch;
@@ -291,8 +295,7 @@ void *mips64_mts64_access(cpu_mips_t *cpu,m_uint64_t vaddr,
    memlog_rec_access(cpu->gen,vaddr,*data,op_size,op_type);
 #endif
    
-   hash_bucket = MTS64_HASH(vaddr);
-   entry = &cpu->mts_u.mts64_cache[hash_bucket];
+   entry = MTS64_SET(cpu->mts_u.mts64_cache,vaddr);
 
 #if DEBUG_MTS_STATS
    cpu->mts_lookups++;
@@ -332,11 +335,9 @@ static fastcall int mips64_mts64_translate(cpu_mips_t *cpu,m_uint64_t vaddr,
                                            m_uint32_t *phys_page)
 {   
    mts64_entry_t *entry,alt_entry;
-   m_uint32_t hash_bucket;
    m_uint64_t data = 0;
    
-   hash_bucket = MTS64_HASH(vaddr);
-   entry = &cpu->mts_u.mts64_cache[hash_bucket];
+   entry = MTS64_SET(cpu->mts_u.mts64_cache,vaddr);
 
    /* Slow lookup if nothing found in cache */
    if (unlikely((vaddr & MIPS_MIN_PAGE_MASK) != entry->gvpa)) {
@@ -359,15 +360,20 @@ mips64_mts32_slow_lookup(cpu_mips_t *cpu,m_uint64_t vaddr,
                          u_int op_type,m_uint64_t *data,
                          mts32_entry_t *alt_entry)
 {
-   m_uint32_t hash_bucket,zone;
+   m_uint32_t zone;
    mts32_entry_t *entry;
    mts_map_t map;
    int tlb_res;
 
-   hash_bucket = MTS32_HASH(vaddr);
-   entry = &cpu->mts_u.mts32_cache[hash_bucket];
+   entry = MTS32_SET(cpu->mts_u.mts32_cache,vaddr);
    zone = (vaddr >> 29) & 0x7;
 
+   /* Look in the other ways of the set before doing a full translation */
+   if ((((m_uint32_t)vaddr & MIPS_MIN_PAGE_MASK) != entry->gvpa) &&
+       mips64_mts32_set_lookup(cpu,entry,vaddr & MIPS_MIN_PAGE_MASK) &&
+       !((op_type == MTS_WRITE) && (entry->flags & MTS_FLAG_WRCATCH)))
+      return(entry);
+
 #if DEBUG_MTS_STATS
    cpu->mts_misses++;
 #endif
@@ -443,7 +449,6 @@ void *mips64_mts32_access(cpu_mips_t *cpu,m_uint64_t vaddr,
                           u_int op_type,m_uint64_t *data)
 {
    mts32_entry_t *entry,alt_entry;
-   m_uint32_t hash_bucket;
    m_iptr_t haddr;
    u_int dev_id;
    int wr_catch;
@@ -453,8 +458,7 @@ void *mips64_mts32_access(cpu_mips_t *cpu,m_uint64_t vaddr,
    memlog_rec_access(cpu->gen,vaddr,*data,op_size,op_type);
 #endif
 
-   hash_bucket = MTS32_HASH(vaddr);
-   entry = &cpu->mts_u.mts32_cache[hash_bucket];
+   entry = MTS32_SET(cpu->mts_u.mts32_cache,vaddr);
 
 #if DEBUG_MTS_STATS
    cpu->mts_lookups++;
@@ -496,11 +500,9 @@ static fastcall int mips64_mts32_translate(cpu_mips_t *cpu,m_uint64_t vaddr,
                                            m_uint32_t *phys_page)
 {     
    mts32_entry_t *entry,alt_entry;
-   m_uint32_t hash_bucket;
    m_uint64_t data = 0;
    
-   hash_bucket = MTS32_HASH(vaddr);
-   entry = &cpu->mts_u.mts32_cache[hash_bucket];
+   entry = MTS32_SET(cpu->mts_u.mts32_cache,vaddr);
 
    /* Slow lookup if nothing found in cache */
    if (unlikely(((m_uint32_t)vaddr & MIPS_MIN_PAGE_MASK) != entry->gvpa)) {
@@ -322,9 +322,9 @@ static void mips64_emit_memop_fast64(mips64_jit_tcb_t *b,int write_op,
    ppc_srwi(b->jit_ptr,ppc_r6,ppc_r5,MTS64_HASH_SHIFT2);
    ppc_xor(b->jit_ptr,ppc_r8,ppc_r7,ppc_r6);
    ppc_rlwinm(b->jit_ptr,ppc_r7,ppc_r8,
-              MTS64_HASH_BITS+5,
-              32-(MTS64_HASH_BITS+5),
-              31-MTS64_HASH_BITS);
+              5+MTS64_WAYS_SHIFT,
+              32-(MTS64_HASH_BITS+5+MTS64_WAYS_SHIFT),
+              31-(5+MTS64_WAYS_SHIFT));
                  
    /* r8 = mts64_cache */
    ppc_lwz(b->jit_ptr,ppc_r8,OFFSET(cpu_mips_t,mts_u.mts64_cache),ppc_r3);
@@ -408,9 +408,9 @@ static void mips64_emit_memop_fast32(mips64_jit_tcb_t *b,int write_op,
    ppc_srwi(b->jit_ptr,ppc_r6,ppc_r5,MTS32_HASH_SHIFT2);
    ppc_xor(b->jit_ptr,ppc_r8,ppc_r7,ppc_r6);
    ppc_rlwinm(b->jit_ptr,ppc_r7,ppc_r8,
-              MTS32_HASH_BITS+4,
-              32-(MTS32_HASH_BITS+4),
-              31-MTS32_HASH_BITS);         
+              4+MTS32_WAYS_SHIFT,
+              32-(MTS32_HASH_BITS+4+MTS32_WAYS_SHIFT),
+              31-(4+MTS32_WAYS_SHIFT));         
               
    /* r8 = mts32_cache */
    ppc_lwz(b->jit_ptr,ppc_r8,OFFSET(cpu_mips_t,mts_u.mts32_cache),ppc_r3);
@@ -16,6 +16,7 @@
 #include "ppc-codegen.h"
 
 #define JIT_SUPPORT 1
+#define JIT_TC_CACHE 0
 
 /* Manipulate bitmasks synchronically */
 static forced_inline void atomic_or(m_uint32_t *v,m_uint32_t m)
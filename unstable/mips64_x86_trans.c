@@ -235,6 +235,176 @@ static void mips64_memop_fast_sw(cpu_tc_t *b,int target)
    x86_bswap(b->jit_ptr,X86_EDX);
    x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,4);
 }
+/* Fast LB */
+static void mips64_memop_fast_lb(cpu_tc_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,TRUE,FALSE);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LBU */
+static void mips64_memop_fast_lbu(cpu_tc_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,FALSE,FALSE);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
+/* Fast LH */
+static void mips64_memop_fast_lh(cpu_tc_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,FALSE,TRUE);
+   x86_bswap(b->jit_ptr,X86_EAX);
+   x86_shift_reg_imm(b->jit_ptr,X86_SAR,X86_EAX,16);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LHU */
+static void mips64_memop_fast_lhu(cpu_tc_t *b,int target)
+{
+   x86_widen_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,FALSE,TRUE);
+   x86_bswap(b->jit_ptr,X86_EAX);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHR,X86_EAX,16);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
+/* Fast LWU */
+static void mips64_memop_fast_lwu(cpu_tc_t *b,int target)
+{
+   x86_mov_reg_memindex(b->jit_ptr,X86_EAX,X86_EAX,0,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EAX);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
+/* Fast LD */
+static void mips64_memop_fast_ld(cpu_tc_t *b,int target)
+{
+   /* EDX = high part, ECX = low part */
+   x86_mov_reg_memindex(b->jit_ptr,X86_EDX,X86_EAX,0,X86_EBX,0,4);
+   x86_mov_reg_memindex(b->jit_ptr,X86_ECX,X86_EAX,4,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_bswap(b->jit_ptr,X86_ECX);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_ECX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LL */
+static void mips64_memop_fast_ll(cpu_tc_t *b,int target)
+{
+   mips64_memop_fast_lw(b,target);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,OFFSET(cpu_mips_t,ll_bit),1,4);
+}
+
+/* Fast LWL */
+static void mips64_memop_fast_lwl(cpu_tc_t *b,int target)
+{
+   /* ECX = (vaddr & 3) * 8, EBX = aligned offset in page */
+   x86_mov_reg_reg(b->jit_ptr,X86_ECX,X86_EBX,4);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_ECX,0x03);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_ECX,3);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_EBX,~0x03);
+
+   /* EDX = data << shift */
+   x86_mov_reg_memindex(b->jit_ptr,X86_EDX,X86_EAX,0,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_shift_reg(b->jit_ptr,X86_SHL,X86_EDX);
+
+   /* EAX = (reg & ((1 << shift) - 1)) | EDX, then sign-extend */
+   x86_mov_reg_imm(b->jit_ptr,X86_EAX,1);
+   x86_shift_reg(b->jit_ptr,X86_SHL,X86_EAX);
+   x86_dec_reg(b->jit_ptr,X86_EAX);
+   x86_alu_reg_membase(b->jit_ptr,X86_AND,X86_EAX,X86_EDI,REG_OFFSET(target));
+   x86_alu_reg_reg(b->jit_ptr,X86_OR,X86_EAX,X86_EDX);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+}
+
+/* Fast LWR */
+static void mips64_memop_fast_lwr(cpu_tc_t *b,int target)
+{
+   u_char *test1;
+
+   /* ECX = (3 - (vaddr & 3)) * 8, EBX = aligned offset in page */
+   x86_mov_reg_reg(b->jit_ptr,X86_ECX,X86_EBX,4);
+   x86_not_reg(b->jit_ptr,X86_ECX);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_ECX,0x03);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_ECX,3);
+   x86_alu_reg_imm(b->jit_ptr,X86_AND,X86_EBX,~0x03);
+
+   /* EDX = data >> shift */
+   x86_mov_reg_memindex(b->jit_ptr,X86_EDX,X86_EAX,0,X86_EBX,0,4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_shift_reg(b->jit_ptr,X86_SHR,X86_EDX);
+
+   /* EAX = (reg & ~(0xffffffff >> shift)) | EDX */
+   x86_mov_reg_imm(b->jit_ptr,X86_EAX,0xffffffff);
+   x86_shift_reg(b->jit_ptr,X86_SHR,X86_EAX);
+   x86_not_reg(b->jit_ptr,X86_EAX);
+   x86_alu_reg_membase(b->jit_ptr,X86_AND,X86_EAX,X86_EDI,REG_OFFSET(target));
+   x86_alu_reg_reg(b->jit_ptr,X86_OR,X86_EAX,X86_EDX);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_EAX,4);
+
+   /* Full word loaded: sign-extend it, otherwise keep the high part */
+   x86_test_reg_reg(b->jit_ptr,X86_ECX,X86_ECX);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_NZ, 0, 1);
+   x86_cdq(b->jit_ptr);
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,X86_EDX,4);
+   x86_patch(test1,b->jit_ptr);
+}
+
+/* Fast SB */
+static void mips64_memop_fast_sb(cpu_tc_t *b,int target)
+{
+   x86_mov_reg_membase(b->jit_ptr,X86_EDX,X86_EDI,REG_OFFSET(target),4);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,1);
+}
+
+/* Fast SH */
+static void mips64_memop_fast_sh(cpu_tc_t *b,int target)
+{
+   x86_mov_reg_membase(b->jit_ptr,X86_EDX,X86_EDI,REG_OFFSET(target),4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHR,X86_EDX,16);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,2);
+}
+
+/* Fast SD */
+static void mips64_memop_fast_sd(cpu_tc_t *b,int target)
+{
+   /* EDX = high part, ECX = low part */
+   x86_mov_reg_membase(b->jit_ptr,X86_EDX,X86_EDI,REG_OFFSET(target)+4,4);
+   x86_mov_reg_membase(b->jit_ptr,X86_ECX,X86_EDI,REG_OFFSET(target),4);
+   x86_bswap(b->jit_ptr,X86_EDX);
+   x86_bswap(b->jit_ptr,X86_ECX);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,0,X86_EBX,0,X86_EDX,4);
+   x86_mov_memindex_reg(b->jit_ptr,X86_EAX,4,X86_EBX,0,X86_ECX,4);
+}
+
+/* Fast SC */
+static void mips64_memop_fast_sc(cpu_tc_t *b,int target)
+{
+   u_char *test1;
+
+   /* Store only if the LL bit is set, then GPR[target] = LL bit */
+   x86_mov_reg_membase(b->jit_ptr,X86_ECX,X86_EDI,OFFSET(cpu_mips_t,ll_bit),4);
+   x86_test_reg_reg(b->jit_ptr,X86_ECX,X86_ECX);
+   test1 = b->jit_ptr;
+   x86_branch8(b->jit_ptr, X86_CC_Z, 0, 1);
+   mips64_memop_fast_sw(b,target);
+   x86_patch(test1,b->jit_ptr);
+
+   x86_mov_membase_reg(b->jit_ptr,X86_EDI,REG_OFFSET(target),X86_ECX,4);
+   x86_mov_membase_imm(b->jit_ptr,X86_EDI,REG_OFFSET(target)+4,0,4);
+}
+
 
 /* Fast memory operation (64-bit) */
 static void mips64_emit_memop_fast64(cpu_tc_t *b,int write_op,
@@ -268,7 +438,7 @@ static void mips64_emit_memop_fast64(cpu_tc_t *b,int write_op,
    x86_mov_reg_membase(b->jit_ptr,X86_EDX,
                        X86_EDI,OFFSET(cpu_mips_t,mts_u.mts64_cache),
                        4);
-   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_EAX,5);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_EAX,5+MTS64_WAYS_SHIFT);
    x86_alu_reg_reg(b->jit_ptr,X86_ADD,X86_EDX,X86_EAX);
 
    /* Compare virtual page address (ESI = vpage) */
@@ -365,7 +535,7 @@ static void mips64_emit_memop_fast32(cpu_tc_t *b,int write_op,
    x86_mov_reg_membase(b->jit_ptr,X86_EDX,
                        X86_EDI,OFFSET(cpu_mips_t,mts_u.mts32_cache),
                        4);
-   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_EAX,4);
+   x86_shift_reg_imm(b->jit_ptr,X86_SHL,X86_EAX,4+MTS32_WAYS_SHIFT);
    x86_alu_reg_reg(b->jit_ptr,X86_ADD,X86_EDX,X86_EAX);
 
    /* Compare virtual page address (ESI = vpage) */
@@ -1910,7 +2080,12 @@ DECLARE_INSN(LB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LB,base,offset,rt,TRUE,
+                             mips64_memop_fast_lb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LB,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1921,7 +2096,12 @@ DECLARE_INSN(LBU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LBU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lbu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LBU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1932,7 +2112,12 @@ DECLARE_INSN(LD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LD,base,offset,rt,TRUE,
+                             mips64_memop_fast_ld);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LD,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1976,7 +2161,12 @@ DECLARE_INSN(LH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LH,base,offset,rt,TRUE,
+                             mips64_memop_fast_lh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LH,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -1987,7 +2177,12 @@ DECLARE_INSN(LHU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LHU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lhu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LHU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2010,7 +2205,12 @@ DECLARE_INSN(LL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LL,base,offset,rt,TRUE,
+                             mips64_memop_fast_ll);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2051,7 +2251,12 @@ DECLARE_INSN(LWL)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWL,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwl);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWL,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2062,7 +2267,12 @@ DECLARE_INSN(LWR)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWR,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwr);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWR,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2073,7 +2283,12 @@ DECLARE_INSN(LWU)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,0,MIPS_MEMOP_LWU,base,offset,rt,TRUE,
+                             mips64_memop_fast_lwu);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_LWU,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2384,7 +2599,12 @@ DECLARE_INSN(SB)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SB,base,offset,rt,FALSE,
+                             mips64_memop_fast_sb);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SB,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2395,7 +2615,12 @@ DECLARE_INSN(SC)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SC,base,offset,rt,TRUE,
+                             mips64_memop_fast_sc);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SC,base,offset,rt,TRUE);
+   }
    return(0);
 }
 
@@ -2406,7 +2631,12 @@ DECLARE_INSN(SD)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SD,base,offset,rt,FALSE,
+                             mips64_memop_fast_sd);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SD,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -2450,7 +2680,12 @@ DECLARE_INSN(SH)
    int rt     = bits(insn,16,20);
    int offset = bits(insn,0,15);
 
-   mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   if (cpu->fast_memop) {
+      mips64_emit_memop_fast(cpu,b,1,MIPS_MEMOP_SH,base,offset,rt,FALSE,
+                             mips64_memop_fast_sh);
+   } else {
+      mips64_emit_memop(b,MIPS_MEMOP_SH,base,offset,rt,FALSE);
+   }
    return(0);
 }
 
@@ -7,6 +7,15 @@
 
 #define MTS_ENTRY  MTS_NAME(entry_t)
 #define MTS_CACHE(cpu)  ( cpu->mts_u. MTS_NAME(cache) )
+#define MTS_WAYS        MTS_NAME_UP(WAYS)
+#define MTS_CACHE_LEN   \
+   ((MTS_NAME_UP(HASH_SIZE) << MTS_NAME_UP(WAYS_SHIFT)) * sizeof(MTS_ENTRY))
+
+#if MTS_ADDR_SIZE == 64
+#define MTS_VPAGE  m_uint64_t
+#else
+#define MTS_VPAGE  m_uint32_t
+#endif
 
 /* Forward declarations */
 static forced_inline void *MTS_PROTO(access)(cpu_mips_t *cpu,m_uint64_t vaddr,
@@ -22,13 +31,15 @@ int MTS_PROTO(init)(cpu_mips_t *cpu)
    size_t len;
 
    /* Initialize the cache entries to 0 (empty) */
-   len = MTS_NAME_UP(HASH_SIZE) * sizeof(MTS_ENTRY);
+   len = MTS_CACHE_LEN;
    if (!(MTS_CACHE(cpu) = malloc(len)))
       return(-1);
 
    memset(MTS_CACHE(cpu),0xFF,len);
-   cpu->mts_lookups = 0;
-   cpu->mts_misses  = 0;
+   cpu->mts_lookups   = 0;
+   cpu->mts_misses    = 0;
+   cpu->mts_set_hits  = 0;
+   cpu->mts_evictions = 0;
    return(0);
 }
 
@@ -53,7 +64,7 @@ void MTS_PROTO(show_stats)(cpu_gen_t *gen_cpu)
 
 #if DEBUG_MTS_MAP_VIRT
    /* Valid hash entries */
-   for(count=0,i=0;i<MTS_NAME_UP(HASH_SIZE);i++) {
+   for(count=0,i=0;i<(MTS_NAME_UP(HASH_SIZE) * MTS_WAYS);i++) {
       entry = &(MTS_CACHE(cpu)[i]);
 
       if (!(entry->gvpa & MTS_INV_ENTRY_MASK)) {
@@ -64,22 +75,86 @@ void MTS_PROTO(show_stats)(cpu_gen_t *gen_cpu)
       }
    }
 
-   printf("   %u/%u valid hash entries.\n",count,MTS_NAME_UP(HASH_SIZE));
+   printf("   %u/%u valid hash entries.\n",
+          count,MTS_NAME_UP(HASH_SIZE) * MTS_WAYS);
 #endif
 
+   printf("   Geometry: %u sets, %u ways\n",MTS_NAME_UP(HASH_SIZE),MTS_WAYS);
    printf("   Total lookups: %llu, misses: %llu, efficiency: %g%%\n",
           cpu->mts_lookups, cpu->mts_misses,
           100 - ((double)(cpu->mts_misses*100)/
                  (double)cpu->mts_lookups));
+   printf("   Set hits: %llu, evictions: %llu\n",
+          cpu->mts_set_hits, cpu->mts_evictions);
 }
 
 /* Invalidate the complete MTS cache */
 void MTS_PROTO(invalidate_cache)(cpu_mips_t *cpu)
 {
-   size_t len;
+   memset(MTS_CACHE(cpu),0xFF,MTS_CACHE_LEN);
+}
 
-   len = MTS_NAME_UP(HASH_SIZE) * sizeof(MTS_ENTRY);
-   memset(MTS_CACHE(cpu),0xFF,len);
+/* 
+ * Invalidate the cache sets which may hold pages of a virtual address
+ * range (TLB entry update). Large ranges invalidate the complete cache.
+ */
+void MTS_PROTO(invalidate_range)(cpu_mips_t *cpu,m_uint64_t vaddr,
+                                 m_uint64_t len)
+{
+   m_uint64_t count;
+   MTS_ENTRY *set;
+
+   count = len >> MIPS_MIN_PAGE_SHIFT;
+
+   if (count >= MTS_NAME_UP(HASH_SIZE)) {
+      MTS_PROTO(invalidate_cache)(cpu);
+      return;
+   }
+
+   for(;count>0;count--,vaddr+=MIPS_MIN_PAGE_SIZE) {
+      set = MTS_NAME_UP(SET)(MTS_CACHE(cpu),vaddr);
+      memset(set,0xFF,MTS_WAYS*sizeof(MTS_ENTRY));
+   }
+}
+
+/* 
+ * Look for a virtual page in the other ways of a cache set. On hit, the
+ * entry is moved to the first way which is the only one probed by the
+ * fast path, so ways are kept in most-recently-used order.
+ */
+static forced_inline int MTS_PROTO(set_lookup)(cpu_mips_t *cpu,MTS_ENTRY *set,
+                                               MTS_VPAGE vpage)
+{
+   MTS_ENTRY tmp;
+   u_int i;
+
+   for(i=1;i<MTS_WAYS;i++) {
+      if (set[i].gvpa == vpage) {
+         tmp = set[i];
+         memmove(&set[1],&set[0],i*sizeof(MTS_ENTRY));
+         set[0] = tmp;
+         cpu->mts_set_hits++;
+         return(TRUE);
+      }
+   }
+
+   return(FALSE);
+}
+
+/* Get the first way of a cache set to store a new entry (LRU is evicted) */
+static forced_inline MTS_ENTRY *MTS_PROTO(set_alloc)(cpu_mips_t *cpu,
+                                                     MTS_ENTRY *set,
+                                                     MTS_VPAGE vpage)
+{
+   /* Entry refresh (copy-on-write, write-on-exec...) */
+   if ((MTS_WAYS == 1) || (set[0].gvpa == vpage))
+      return set;
+
+   if (!(set[MTS_WAYS-1].gvpa & MTS_INV_ENTRY_MASK))
+      cpu->mts_evictions++;
+
+   memmove(&set[1],&set[0],(MTS_WAYS-1)*sizeof(MTS_ENTRY));
+   return set;
 }
 
 /* 
@@ -111,6 +186,7 @@ MTS_PROTO(map)(cpu_mips_t *cpu,u_int op_type,mts_map_t *map,
    if (dev->flags & VDEVICE_FLAG_SPARSE) {
       host_ptr = dev_sparse_get_host_addr(cpu->vm,dev,map->paddr,op_type,&cow);
 
+      entry = MTS_PROTO(set_alloc)(cpu,entry,map->vaddr);
       entry->gvpa  = map->vaddr;
       entry->gppa  = map->paddr;
       entry->hpa   = host_ptr;
@@ -128,6 +204,7 @@ MTS_PROTO(map)(cpu_mips_t *cpu,u_int op_type,mts_map_t *map,
       return alt_entry;
    }
 
+   entry = MTS_PROTO(set_alloc)(cpu,entry,map->vaddr);
    entry->gvpa  = map->vaddr;
    entry->gppa  = map->paddr;
    entry->hpa   = dev->host_addr + (map->paddr - dev->phys_addr);
@@ -563,6 +640,7 @@ void MTS_PROTO(init_memop_vectors)(cpu_mips_t *cpu)
 
    /* Invalidate and Shutdown operations */
    cpu->mts_invalidate = MTS_PROTO(invalidate_cache);
+   cpu->mts_invalidate_range = MTS_PROTO(invalidate_range);
    cpu->mts_shutdown = MTS_PROTO(shutdown);
 
    /* Rebuild MTS data structures */
@@ -619,3 +697,6 @@ void MTS_PROTO(init_memop_vectors)(cpu_mips_t *cpu)
 #undef MTS_PROTO_UP
 #undef MTS_ENTRY
 #undef MTS_CHUNK
+#undef MTS_WAYS
+#undef MTS_CACHE_LEN
+#undef MTS_VPAGE
@@ -93,7 +93,14 @@ int ppc32_jit_init(cpu_ppc_t *cpu)
 
    /* Create executable page area */
    cpu->exec_page_area_size = area_size * 1048576;
-   cpu->exec_page_area = memzone_map_exec_area(cpu->exec_page_area_size);
+
+   if (cpu->vm->huge_pages != MEMZONE_HUGE_NONE) {
+      cpu->exec_page_area_size = MEMZONE_HUGE_ROUND(cpu->exec_page_area_size);
+      cpu->exec_page_area = memzone_map_huge(cpu->exec_page_area_size,TRUE,
+                                             cpu->vm->huge_pages);
+   } else {
+      cpu->exec_page_area = memzone_map_exec_area(cpu->exec_page_area_size);
+   }
 
    if (!cpu->exec_page_area) {
       fprintf(stderr,
@@ -1249,7 +1256,6 @@ void ppc32_jit_tcb_run(cpu_ppc_t *cpu,ppc32_jit_tcb_t *tcb)
 void *ppc32_jit_run_cpu(cpu_gen_t *gen)
 {    
    cpu_ppc_t *cpu = CPU_PPC32(gen);
-   pthread_t timer_irq_thread;
    ppc32_jit_tcb_t *tcb;
    m_uint32_t hv,hp;
    m_uint32_t phys_page;
@@ -1257,12 +1263,8 @@ void *ppc32_jit_run_cpu(cpu_gen_t *gen)
 
    ppc32_jit_init_hreg_mapping(cpu);
 
-   if (pthread_create(&timer_irq_thread,NULL,(void *)ppc32_timer_irq_run,cpu)) 
-   {
-      fprintf(stderr,
-              "VM '%s': unable to create Timer IRQ thread for CPU%u.\n",
-              cpu->vm->name,gen->id);
-      cpu_stop(cpu->gen);
+   if (ppc32_timer_irq_start(cpu,TRUE) == -1) {
+      cpu_stop(gen);
       return NULL;
    }
 
@@ -1291,11 +1293,14 @@ void *ppc32_jit_run_cpu(cpu_gen_t *gen)
       if (++timer_irq_check == cpu->timer_irq_check_itv) {
          timer_irq_check = 0;
 
-         if (cpu->timer_irq_pending && !cpu->irq_disable &&
-             (cpu->msr & PPC32_MSR_EE))
+         if (cpu->timer_vclock)
+            timer_irq_poll(&cpu->timer_irq);
+
+         if (!cpu->irq_disable && (cpu->msr & PPC32_MSR_EE) &&
+             timer_irq_take(&cpu->timer_irq_pending))
          {
+            idle_pc_auto_tick(gen,cpu->ia,cpu->idle_pc);
             cpu->timer_irq_armed = 0;
-            cpu->timer_irq_pending--;
             vm_set_irq(cpu->vm,0);
          }
       }
@@ -1361,12 +1366,12 @@ void *ppc32_jit_run_cpu(cpu_gen_t *gen)
 
          case CPU_STATE_HALTED:
             gen->cpu_thread_running = FALSE;
-            pthread_join(timer_irq_thread,NULL);
+            ppc32_timer_irq_stop(cpu);
             break;
       }
       
       /* CPU is paused */
-      usleep(200000);
+      cpu_pause_wait(gen);
    }
 
    return NULL;
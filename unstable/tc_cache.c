@@ -0,0 +1,962 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Persistent translation cache.
+ *
+ * Translated pages are appended to a file with their JIT instruction
+ * offsets, their patches and their host relocations. When the file is
+ * opened, it is mapped in memory and indexed by page checksum, so that a
+ * VM started again with the same image loads translated code instead of
+ * compiling it again.
+ *
+ * The file is shared by dynamips processes, which map it: it is never
+ * truncated. When it has to be emptied or repaired, a new file is built
+ * and renamed over it; the other processes switch to the new file the
+ * next time they lock it.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "cpu.h"
+#include "vm.h"
+#include "tcb.h"
+#include "tc_cache.h"
+
+#define DEBUG_TC_CACHE  0
+
+/* Hash table used to index the entries */
+#define TC_CACHE_HASH_BITS  14
+#define TC_CACHE_HASH_SIZE  (1 << TC_CACHE_HASH_BITS)
+#define TC_CACHE_HASH_MASK  (TC_CACHE_HASH_SIZE - 1)
+
+/* Number of instructions in a target page */
+#define TC_CACHE_INSN_COUNT  (VM_PAGE_SIZE / sizeof(m_uint32_t))
+
+/* Alignment of entry parts */
+#define TC_CACHE_ALIGN(x)  (((x) + 7) & ~((size_t)7))
+
+/*
+ * Host addresses are saved relative to this function, so they can be
+ * relocated when the binary is loaded at another address.
+ */
+#define TC_CACHE_TEXT_REF  ((u_char *)tc_cache_open)
+
+/* Index entry */
+struct tc_cache_index {
+   tsg_checksum_t checksum;
+   m_uint64_t vaddr;
+   m_uint32_t exec_state;
+   m_uint32_t cpu_type;
+   m_uint32_t trans_flags;
+   off_t offset;
+   struct tc_cache_index *next;
+};
+
+/* Position of the parts of an entry */
+struct tc_cache_layout {
+   size_t page;
+   size_t chunk_len;
+   size_t insn;
+   size_t patches;
+   size_t relocs;
+   size_t code;
+};
+
+struct tc_cache {
+   char *filename;
+   int fd;
+   int ref_count;
+   pthread_mutex_t lock;
+
+   /* Read-only mapping of the file */
+   u_char *map;
+   size_t map_size;
+   off_t file_size;
+
+   struct tc_cache_index **index;
+   struct tc_cache_stats stats;
+
+   tc_cache_t *next;
+};
+
+#define TC_CACHE_LOCK(c)   pthread_mutex_lock(&(c)->lock)
+#define TC_CACHE_UNLOCK(c) pthread_mutex_unlock(&(c)->lock)
+
+/* List of open caches */
+static tc_cache_t *tc_cache_list = NULL;
+static pthread_mutex_t tc_cache_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Identifier of the emulator binary */
+static m_uint64_t tc_cache_build_id = 0;
+
+/*
+ * Compute an identifier of the emulator binary. Translated code depends
+ * on the exact binary (function addresses, structure offsets), so a cache
+ * created by another build is discarded.
+ */
+static m_uint64_t tc_cache_get_build_id(void)
+{
+   u_char *buffer;
+   m_uint64_t id;
+   ssize_t len;
+   int fd;
+
+   if (tc_cache_build_id != 0)
+      return(tc_cache_build_id);
+
+   if (!(buffer = malloc(TC_JIT_PAGE_SIZE)))
+      return(0);
+
+   id = 0;
+
+   if ((fd = open("/proc/self/exe",O_RDONLY)) != -1) {
+      while((len = read(fd,buffer,TC_JIT_PAGE_SIZE)) > 0) {
+         memset(buffer+len,0,TC_JIT_PAGE_SIZE-len);
+         id = (id * 0x9E3779B185EBCA87ULL) ^
+            tsg_checksum_page(buffer,TC_JIT_PAGE_SIZE);
+      }
+
+      close(fd);
+   } else {
+      /* No way to read the binary: use the build date */
+      memset(buffer,0,TC_JIT_PAGE_SIZE);
+      snprintf((char *)buffer,TC_JIT_PAGE_SIZE,"%s %s %s",
+               sw_version,__DATE__,__TIME__);
+      id = tsg_checksum_page(buffer,TC_JIT_PAGE_SIZE);
+   }
+
+   free(buffer);
+   tc_cache_build_id = id;
+   return(id);
+}
+
+/* Compute the position of the parts of an entry */
+static void tc_cache_get_layout(struct tc_cache_entry *e,
+                                struct tc_cache_layout *l)
+{
+   l->page      = TC_CACHE_ALIGN(sizeof(*e));
+   l->chunk_len = l->page + VM_PAGE_SIZE;
+   l->insn      = l->chunk_len +
+      TC_CACHE_ALIGN(e->chunk_count * sizeof(m_uint32_t));
+   l->patches   = l->insn +
+      TC_CACHE_ALIGN(TC_CACHE_INSN_COUNT * sizeof(m_uint32_t));
+   l->relocs    = l->patches +
+      (e->patch_count * sizeof(struct tc_cache_patch));
+   l->code      = l->relocs +
+      (e->reloc_count * sizeof(struct tc_cache_reloc));
+}
+
+/* Compute a hash on the key of an entry */
+static inline u_int tc_cache_hash(tsg_checksum_t cksum,m_uint64_t vaddr)
+{
+   m_uint64_t tmp;
+
+   tmp = cksum ^ (vaddr >> 12);
+   tmp ^= (tmp >> 23) ^ (tmp >> 41);
+   return((u_int)(tmp & TC_CACHE_HASH_MASK));
+}
+
+/* Find an index entry */
+static struct tc_cache_index *
+tc_cache_find(tc_cache_t *cache,tsg_checksum_t checksum,m_uint64_t vaddr,
+              m_uint32_t exec_state,m_uint32_t cpu_type,
+              m_uint32_t trans_flags)
+{
+   struct tc_cache_index *p;
+
+   p = cache->index[tc_cache_hash(checksum,vaddr)];
+
+   for(;p;p=p->next)
+      if ((p->checksum == checksum) && (p->vaddr == vaddr) &&
+          (p->exec_state == exec_state) && (p->cpu_type == cpu_type) &&
+          (p->trans_flags == trans_flags))
+         return p;
+
+   return NULL;
+}
+
+/* Add an entry to the index (only the first one is kept for a key) */
+static int tc_cache_add_index(tc_cache_t *cache,struct tc_cache_entry *e,
+                              off_t offset)
+{
+   struct tc_cache_index *p;
+   u_int hash;
+
+   if (tc_cache_find(cache,e->checksum,e->vaddr,e->exec_state,
+                     e->cpu_type,e->trans_flags))
+      return(0);
+
+   if (!(p = malloc(sizeof(*p))))
+      return(-1);
+
+   p->checksum    = e->checksum;
+   p->vaddr       = e->vaddr;
+   p->exec_state  = e->exec_state;
+   p->cpu_type    = e->cpu_type;
+   p->trans_flags = e->trans_flags;
+   p->offset      = offset;
+
+   hash = tc_cache_hash(e->checksum,e->vaddr);
+   p->next = cache->index[hash];
+   cache->index[hash] = p;
+   cache->stats.entries++;
+   return(0);
+}
+
+/* Remove all entries from the index */
+static void tc_cache_clear_index(tc_cache_t *cache)
+{
+   struct tc_cache_index *p,*next;
+   int i;
+
+   for(i=0;i<TC_CACHE_HASH_SIZE;i++) {
+      for(p=cache->index[i];p;p=next) {
+         next = p->next;
+         free(p);
+      }
+
+      cache->index[i] = NULL;
+   }
+
+   cache->stats.entries = 0;
+}
+
+/* Free the index */
+static void tc_cache_free_index(tc_cache_t *cache)
+{
+   tc_cache_clear_index(cache);
+   free(cache->index);
+}
+
+/* Unmap the file */
+static void tc_cache_unmap(tc_cache_t *cache)
+{
+   if (cache->map != NULL) {
+      munmap(cache->map,cache->map_size);
+      cache->map = NULL;
+      cache->map_size = 0;
+   }
+}
+
+/* Map the file, up to its current size */
+static int tc_cache_map(tc_cache_t *cache)
+{
+   void *ptr;
+
+   if (cache->map_size >= cache->file_size)
+      return(0);
+
+   tc_cache_unmap(cache);
+
+   ptr = mmap(NULL,cache->file_size,PROT_READ,MAP_SHARED,cache->fd,0);
+
+   if (ptr == MAP_FAILED)
+      return(-1);
+
+   cache->map = ptr;
+   cache->map_size = cache->file_size;
+   return(0);
+}
+
+/* Check an entry of the file, and return its length */
+static ssize_t tc_cache_check_entry(tc_cache_t *cache,off_t offset)
+{
+   struct tc_cache_layout l;
+   struct tc_cache_entry *e;
+   m_uint32_t *chunk_len;
+   size_t code_len;
+   int i;
+
+   if ((offset + sizeof(*e)) > cache->file_size)
+      return(-1);
+
+   e = (struct tc_cache_entry *)(cache->map + offset);
+
+   if ((e->magic != TC_CACHE_ENTRY_MAGIC) ||
+       ((offset + e->len) > cache->file_size) ||
+       (e->chunk_count == 0) || (e->chunk_count > TC_MAX_CHUNKS))
+      return(-1);
+
+   tc_cache_get_layout(e,&l);
+
+   if (l.code > e->len)
+      return(-1);
+
+   chunk_len = (m_uint32_t *)((u_char *)e + l.chunk_len);
+
+   for(i=0,code_len=0;i<e->chunk_count;i++) {
+      if (chunk_len[i] > TC_JIT_PAGE_SIZE)
+         return(-1);
+
+      code_len += chunk_len[i];
+   }
+
+   if ((l.code + TC_CACHE_ALIGN(code_len)) != e->len)
+      return(-1);
+
+   return(e->len);
+}
+
+/* Copy the first bytes of the cache file to another file */
+static int tc_cache_copy(tc_cache_t *cache,int fd,off_t len)
+{
+   u_char *buffer;
+   ssize_t count;
+   off_t pos;
+   int res = -1;
+
+   if (!(buffer = malloc(TC_JIT_PAGE_SIZE)))
+      return(-1);
+
+   for(pos=0;pos<len;pos+=count) {
+      count = m_min(TC_JIT_PAGE_SIZE,len - pos);
+
+      if ((pread(cache->fd,buffer,count,pos) != count) ||
+          (pwrite(fd,buffer,count,pos) != count))
+         goto done;
+   }
+
+   res = 0;
+ done:
+   free(buffer);
+   return(res);
+}
+
+/*
+ * Replace the cache file by a file holding its first "len" bytes, or only
+ * a new header if len is 0. The file lock is kept on the new file.
+ */
+static int tc_cache_rebuild(tc_cache_t *cache,off_t len)
+{
+   struct tc_cache_hdr hdr;
+   char *tmp_file;
+   int fd,res = -1;
+
+   if (!(tmp_file = malloc(strlen(cache->filename)+5)))
+      return(-1);
+
+   sprintf(tmp_file,"%s.tmp",cache->filename);
+
+   if ((fd = open(tmp_file,O_RDWR|O_CREAT|O_TRUNC,0644)) == -1)
+      goto err_open;
+
+   if (len == 0) {
+      memset(&hdr,0,sizeof(hdr));
+      hdr.magic    = TC_CACHE_MAGIC;
+      hdr.version  = TC_CACHE_VERSION;
+      hdr.build_id = tc_cache_get_build_id();
+
+      if (pwrite(fd,&hdr,sizeof(hdr),0) != sizeof(hdr))
+         goto err_write;
+
+      len = sizeof(hdr);
+   } else {
+      if (tc_cache_copy(cache,fd,len) == -1)
+         goto err_write;
+   }
+
+   /* Lock the new file before other processes can see it */
+   if ((fsync(fd) == -1) || (flock(fd,LOCK_EX) == -1) ||
+       (rename(tmp_file,cache->filename) == -1))
+      goto err_write;
+
+   /* Closing the old file releases its lock */
+   tc_cache_unmap(cache);
+   close(cache->fd);
+   cache->fd = fd;
+   cache->file_size = len;
+   res = 0;
+   goto done;
+
+ err_write:
+   close(fd);
+   unlink(tmp_file);
+ err_open:
+   fprintf(stderr,"TC cache %s: unable to rebuild file (%s).\n",
+           cache->filename,strerror(errno));
+ done:
+   free(tmp_file);
+   return(res);
+}
+
+/*
+ * Lock the cache file. If another process has replaced it in the meantime,
+ * switch to the new file and return 1: the index has to be built again.
+ */
+static int tc_cache_lock_file(tc_cache_t *cache)
+{
+   struct stat cur,st;
+   int fd,changed = 0;
+
+   for(;;) {
+      flock(cache->fd,LOCK_EX);
+
+      if ((fstat(cache->fd,&cur) == -1) ||
+          (stat(cache->filename,&st) == -1) ||
+          ((cur.st_dev == st.st_dev) && (cur.st_ino == st.st_ino)))
+         return(changed);
+
+      /* Keep the current file if the new one cannot be opened */
+      if ((fd = open(cache->filename,O_RDWR)) == -1)
+         return(changed);
+
+      tc_cache_unmap(cache);
+      close(cache->fd);
+      cache->fd = fd;
+      changed = 1;
+   }
+}
+
+/*
+ * Build the index from the file content. A file created by another build
+ * is emptied, and an incomplete entry at the end (crash during a write)
+ * is removed.
+ */
+static int tc_cache_scan(tc_cache_t *cache)
+{
+   struct tc_cache_hdr hdr;
+   struct stat st;
+   ssize_t len;
+   off_t pos;
+
+   if (fstat(cache->fd,&st) == -1)
+      return(-1);
+
+   if ((st.st_size < sizeof(hdr)) ||
+       (pread(cache->fd,&hdr,sizeof(hdr),0) != sizeof(hdr)) ||
+       (hdr.magic != TC_CACHE_MAGIC) || (hdr.version != TC_CACHE_VERSION) ||
+       (hdr.build_id != tc_cache_get_build_id()))
+   {
+      return(tc_cache_rebuild(cache,0));
+   }
+
+   cache->file_size = st.st_size;
+
+   if (tc_cache_map(cache) == -1)
+      return(-1);
+
+   for(pos=sizeof(hdr);pos<cache->file_size;pos+=len) {
+      if ((len = tc_cache_check_entry(cache,pos)) == -1)
+         break;
+
+      if (tc_cache_add_index(cache,(struct tc_cache_entry *)(cache->map+pos),
+                             pos) == -1)
+         return(-1);
+   }
+
+   if (pos < cache->file_size) {
+      fprintf(stderr,"TC cache %s: dropping invalid data at offset %lld.\n",
+              cache->filename,(long long)pos);
+
+      if (tc_cache_rebuild(cache,pos) == -1)
+         return(-1);
+
+      return(tc_cache_map(cache));
+   }
+
+   return(0);
+}
+
+/* Build the index again, from a file replaced by another process */
+static int tc_cache_reload(tc_cache_t *cache)
+{
+   tc_cache_unmap(cache);
+   tc_cache_clear_index(cache);
+   cache->file_size = 0;
+   return(tc_cache_scan(cache));
+}
+
+/* Free a translation cache */
+static void tc_cache_free(tc_cache_t *cache)
+{
+   tc_cache_unmap(cache);
+
+   if (cache->fd != -1)
+      close(cache->fd);
+
+   if (cache->index != NULL)
+      tc_cache_free_index(cache);
+
+   pthread_mutex_destroy(&cache->lock);
+   free(cache->filename);
+   free(cache);
+}
+
+/* Open a translation cache file (shared by all VMs using it) */
+tc_cache_t *tc_cache_open(char *filename)
+{
+   tc_cache_t *cache;
+   int res;
+
+   pthread_mutex_lock(&tc_cache_list_lock);
+
+   for(cache=tc_cache_list;cache;cache=cache->next) {
+      if (!strcmp(cache->filename,filename)) {
+         cache->ref_count++;
+         pthread_mutex_unlock(&tc_cache_list_lock);
+         return cache;
+      }
+   }
+
+   if (!(cache = malloc(sizeof(*cache))))
+      goto err_alloc;
+
+   memset(cache,0,sizeof(*cache));
+   cache->fd = -1;
+   cache->ref_count = 1;
+   pthread_mutex_init(&cache->lock,NULL);
+
+   if (!(cache->filename = strdup(filename)) ||
+       !(cache->index = calloc(TC_CACHE_HASH_SIZE,sizeof(void *))))
+      goto err_init;
+
+   if ((cache->fd = open(filename,O_RDWR|O_CREAT,0644)) == -1) {
+      fprintf(stderr,"TC cache: unable to open file '%s' (%s)\n",
+              filename,strerror(errno));
+      goto err_init;
+   }
+
+   /* Other dynamips processes may use the same file */
+   tc_cache_lock_file(cache);
+   res = tc_cache_scan(cache);
+   flock(cache->fd,LOCK_UN);
+
+   if (res == -1) {
+      fprintf(stderr,"TC cache: unable to read file '%s' (%s)\n",
+              filename,strerror(errno));
+      goto err_init;
+   }
+
+   cache->next = tc_cache_list;
+   tc_cache_list = cache;
+   pthread_mutex_unlock(&tc_cache_list_lock);
+   return cache;
+
+ err_init:
+   tc_cache_free(cache);
+ err_alloc:
+   pthread_mutex_unlock(&tc_cache_list_lock);
+   return NULL;
+}
+
+/* Release a translation cache */
+void tc_cache_close(tc_cache_t *cache)
+{
+   tc_cache_t **p;
+
+   if (!cache)
+      return;
+
+   pthread_mutex_lock(&tc_cache_list_lock);
+
+   if (--cache->ref_count > 0) {
+      pthread_mutex_unlock(&tc_cache_list_lock);
+      return;
+   }
+
+   for(p=&tc_cache_list;*p;p=&(*p)->next) {
+      if (*p == cache) {
+         *p = cache->next;
+         break;
+      }
+   }
+
+   pthread_mutex_unlock(&tc_cache_list_lock);
+   tc_cache_free(cache);
+}
+
+/* Get the host pointer corresponding to a position in the JIT chunks */
+static inline u_char *tc_cache_host_ptr(cpu_tc_t *tc,m_uint32_t offset)
+{
+   u_int chunk = offset / TC_JIT_PAGE_SIZE;
+
+   if (chunk >= tc->jit_chunk_pos)
+      return NULL;
+
+   return(tc->jit_chunks[chunk]->ptr + (offset % TC_JIT_PAGE_SIZE));
+}
+
+/* Copy the code of an entry into a new TC descriptor, and relocate it */
+static cpu_tc_t *tc_cache_build_tc(cpu_gen_t *cpu,struct tc_cache_entry *e,
+                                   void (*set_patch)(u_char *insn,
+                                                     u_char *dst),
+                                   void (*set_jump)(u_char **insn,
+                                                    u_char *dst))
+{
+   struct tc_cache_layout l;
+   struct tc_cache_patch *patch;
+   struct tc_cache_reloc *reloc;
+   m_uint32_t *chunk_len,*insn;
+   u_char *code,*ptr,*dst;
+   u_int chunk;
+   cpu_tc_t *tc;
+   int i;
+
+   tc_cache_get_layout(e,&l);
+   chunk_len = (m_uint32_t *)((u_char *)e + l.chunk_len);
+   insn      = (m_uint32_t *)((u_char *)e + l.insn);
+   patch     = (struct tc_cache_patch *)((u_char *)e + l.patches);
+   reloc     = (struct tc_cache_reloc *)((u_char *)e + l.relocs);
+   code      = (u_char *)e + l.code;
+
+   if (!(tc = tc_alloc(cpu,e->vaddr,e->exec_state)))
+      return NULL;
+
+   /* tc_alloc() gives the first chunk */
+   for(i=1;i<e->chunk_count;i++) {
+      if (tc_alloc_jit_chunk(cpu,tc) == -1)
+         goto err_build;
+   }
+
+   for(i=0;i<e->chunk_count;i++) {
+      memcpy(tc->jit_chunks[i]->ptr,code,chunk_len[i]);
+      code += chunk_len[i];
+   }
+
+   tc->jit_ptr = tc->jit_buffer->ptr + chunk_len[e->chunk_count-1];
+
+   /* JIT instruction pointers */
+   for(i=0;i<TC_CACHE_INSN_COUNT;i++) {
+      if (insn[i] == TC_CACHE_NO_INSN)
+         continue;
+
+      if (!(tc->jit_insn_ptr[i] = tc_cache_host_ptr(tc,insn[i])))
+         goto err_build;
+   }
+
+   /* Host relocations */
+   for(i=0;i<e->reloc_count;i++) {
+      if (!(ptr = tc_cache_host_ptr(tc,reloc[i].offset)))
+         goto err_build;
+
+      switch(reloc[i].type) {
+         case TC_RELOC_HOST_ADDR:
+            set_patch(ptr,TC_CACHE_TEXT_REF + reloc[i].addr);
+            break;
+
+         case TC_RELOC_CHUNK_LINK:
+            chunk = reloc[i].offset / TC_JIT_PAGE_SIZE;
+
+            if ((chunk + 1) >= tc->jit_chunk_pos)
+               goto err_build;
+
+            set_jump(&ptr,tc->jit_chunks[chunk+1]->ptr);
+            break;
+
+         default:
+            goto err_build;
+      }
+   }
+
+   /* Jumps inside the page */
+   for(i=0;i<e->patch_count;i++) {
+      if (!(ptr = tc_cache_host_ptr(tc,patch[i].offset)))
+         goto err_build;
+
+      if ((dst = tc_get_host_ptr(tc,patch[i].vaddr)))
+         set_patch(ptr,dst);
+   }
+
+   return tc;
+
+ err_build:
+   tc_discard(cpu,tc);
+   return NULL;
+}
+
+/* Load translated code for a TB from the cache */
+cpu_tc_t *tc_cache_load(cpu_gen_t *cpu,tc_cache_t *cache,cpu_tb_t *tb,
+                        m_uint32_t trans_flags,
+                        void (*set_patch)(u_char *insn,u_char *dst),
+                        void (*set_jump)(u_char **insn,u_char *dst))
+{
+   struct tc_cache_index *idx;
+   struct tc_cache_entry *e;
+   m_tmcnt_t start;
+   cpu_tc_t *tc = NULL;
+
+   start = m_gettime_usec();
+   TC_CACHE_LOCK(cache);
+
+   idx = tc_cache_find(cache,tb->checksum,tb->vaddr,tb->exec_state,
+                       cpu->type,trans_flags);
+
+   if (!idx)
+      goto done;
+
+   /* The entry may have been written after the file was mapped */
+   if (tc_cache_map(cache) == -1) {
+      cache->stats.errors++;
+      goto done;
+   }
+
+   e = (struct tc_cache_entry *)(cache->map + idx->offset);
+
+   /* Check the page content, in case of checksum collision */
+   if (memcmp((u_char *)e + TC_CACHE_ALIGN(sizeof(*e)),
+              tb->target_code,VM_PAGE_SIZE) != 0)
+      goto done;
+
+   if (!(tc = tc_cache_build_tc(cpu,e,set_patch,set_jump))) {
+      cache->stats.errors++;
+      goto done;
+   }
+
+#if DEBUG_TC_CACHE
+   cpu_log(cpu,"TC_CACHE","page 0x%8.8llx loaded (%u chunks)\n",
+           tb->vaddr,tc->jit_chunk_pos);
+#endif
+
+   cache->stats.loads++;
+   cache->stats.load_time += m_gettime_usec() - start;
+
+ done:
+   TC_CACHE_UNLOCK(cache);
+   return tc;
+}
+
+/* Count the patches of a TC descriptor */
+static u_int tc_cache_count_patches(cpu_tc_t *tc)
+{
+   struct insn_patch_table *ipt;
+   u_int count = 0;
+
+   for(ipt=tc->patch_table;ipt;ipt=ipt->next)
+      count += ipt->cur_patch;
+
+   return(count);
+}
+
+/* Count the host relocations of a TC descriptor */
+static u_int tc_cache_count_relocs(cpu_tc_t *tc)
+{
+   struct tc_reloc_table *rt;
+   u_int count = 0;
+
+   for(rt=tc->reloc_table;rt;rt=rt->next)
+      count += rt->cur_reloc;
+
+   return(count);
+}
+
+/*
+ * Build a cache entry from a TC descriptor. Code of a chunk stops at the
+ * jump to the next chunk, which is emitted again when the entry is loaded.
+ */
+static struct tc_cache_entry *
+tc_cache_build_entry(cpu_gen_t *cpu,cpu_tb_t *tb,cpu_tc_t *tc,
+                     m_uint32_t trans_flags)
+{
+   struct tc_cache_layout l;
+   struct tc_cache_entry hdr,*e;
+   struct insn_patch_table *ipt;
+   struct tc_cache_patch *patch;
+   struct tc_cache_reloc *reloc;
+   struct tc_reloc_table *rt;
+   m_uint32_t *chunk_len,*insn,offset;
+   size_t code_len;
+   u_char *code;
+   int i,j;
+
+   memset(&hdr,0,sizeof(hdr));
+   hdr.magic       = TC_CACHE_ENTRY_MAGIC;
+   hdr.checksum    = tb->checksum;
+   hdr.vaddr       = tb->vaddr;
+   hdr.exec_state  = tb->exec_state;
+   hdr.cpu_type    = cpu->type;
+   hdr.trans_flags = trans_flags;
+   hdr.chunk_count = tc->jit_chunk_pos;
+   hdr.patch_count = tc_cache_count_patches(tc);
+   hdr.reloc_count = tc_cache_count_relocs(tc);
+
+   tc_cache_get_layout(&hdr,&l);
+
+   /* Entry size is bounded by the chunk count, allocate the maximum */
+   if (!(e = malloc(l.code + (tc->jit_chunk_pos * TC_JIT_PAGE_SIZE))))
+      return NULL;
+
+   memset(e,0,l.code);
+   *e = hdr;
+
+   chunk_len = (m_uint32_t *)((u_char *)e + l.chunk_len);
+   insn      = (m_uint32_t *)((u_char *)e + l.insn);
+   patch     = (struct tc_cache_patch *)((u_char *)e + l.patches);
+   reloc     = (struct tc_cache_reloc *)((u_char *)e + l.relocs);
+
+   memcpy((u_char *)e + l.page,tb->target_code,VM_PAGE_SIZE);
+
+   /* Last chunk ends at the current JIT pointer */
+   for(i=0;i<tc->jit_chunk_pos;i++)
+      chunk_len[i] = TC_CACHE_NO_INSN;
+
+   chunk_len[tc->jit_chunk_pos-1] = tc->jit_ptr - tc->jit_buffer->ptr;
+
+   for(i=0;i<TC_CACHE_INSN_COUNT;i++) {
+      insn[i] = TC_CACHE_NO_INSN;
+
+      if (tc->jit_insn_ptr[i] &&
+          (tc_get_chunk_offset(tc,tc->jit_insn_ptr[i],&insn[i]) == -1))
+         goto err_build;
+   }
+
+   for(ipt=tc->patch_table;ipt;ipt=ipt->next)
+      for(j=0;j<ipt->cur_patch;j++,patch++) {
+         if (tc_get_chunk_offset(tc,ipt->patches[j].jit_insn,
+                                 &patch->offset) == -1)
+            goto err_build;
+
+         patch->vaddr = ipt->patches[j].vaddr;
+      }
+
+   for(rt=tc->reloc_table;rt;rt=rt->next)
+      for(j=0;j<rt->cur_reloc;j++,reloc++) {
+         if (tc_get_chunk_offset(tc,rt->relocs[j].jit_insn,&offset) == -1)
+            goto err_build;
+
+         reloc->offset = offset;
+         reloc->type   = rt->relocs[j].type;
+         reloc->addr   = (u_char *)rt->relocs[j].addr - TC_CACHE_TEXT_REF;
+
+         if (reloc->type == TC_RELOC_CHUNK_LINK)
+            chunk_len[offset / TC_JIT_PAGE_SIZE] = offset % TC_JIT_PAGE_SIZE;
+      }
+
+   /* Copy the code */
+   code = (u_char *)e + l.code;
+
+   for(i=0,code_len=0;i<tc->jit_chunk_pos;i++) {
+      /* Each chunk except the last one must be linked to the next one */
+      if (chunk_len[i] == TC_CACHE_NO_INSN)
+         goto err_build;
+
+      memcpy(code+code_len,tc->jit_chunks[i]->ptr,chunk_len[i]);
+      code_len += chunk_len[i];
+   }
+
+   memset(code+code_len,0,TC_CACHE_ALIGN(code_len) - code_len);
+   e->len = l.code + TC_CACHE_ALIGN(code_len);
+   return e;
+
+ err_build:
+   free(e);
+   return NULL;
+}
+
+/* Save translated code to the cache (patches and relocs must be present) */
+int tc_cache_store(tc_cache_t *cache,cpu_gen_t *cpu,cpu_tb_t *tb,
+                   cpu_tc_t *tc,m_uint32_t trans_flags)
+{
+   struct tc_cache_entry *e;
+   off_t offset;
+   int res = -1;
+
+   if (tc->flags & TC_FLAG_NOCACHE)
+      return(-1);
+
+   TC_CACHE_LOCK(cache);
+
+   /* Another CPU may have translated the same page */
+   if (tc_cache_find(cache,tb->checksum,tb->vaddr,tb->exec_state,
+                     cpu->type,trans_flags))
+   {
+      TC_CACHE_UNLOCK(cache);
+      return(0);
+   }
+
+   if (!(e = tc_cache_build_entry(cpu,tb,tc,trans_flags))) {
+      cache->stats.errors++;
+      TC_CACHE_UNLOCK(cache);
+      return(-1);
+   }
+
+   if ((tc_cache_lock_file(cache) == 1) && (tc_cache_reload(cache) == -1)) {
+      cache->stats.errors++;
+      goto done;
+   }
+
+   if (((offset = lseek(cache->fd,0,SEEK_END)) != -1) &&
+       (pwrite(cache->fd,e,e->len,offset) == e->len))
+   {
+      cache->file_size = offset + e->len;
+      tc_cache_add_index(cache,e,offset);
+      cache->stats.stores++;
+      res = 0;
+   } else {
+      /* Don't leave an incomplete entry (the file may be mapped) */
+      if (offset != -1)
+         tc_cache_rebuild(cache,offset);
+
+      cache->stats.errors++;
+   }
+
+ done:
+   flock(cache->fd,LOCK_UN);
+   TC_CACHE_UNLOCK(cache);
+   free(e);
+   return(res);
+}
+
+/* Account time spent to translate a page */
+void tc_cache_add_trans_time(tc_cache_t *cache,m_tmcnt_t usec)
+{
+   TC_CACHE_LOCK(cache);
+   cache->stats.translations++;
+   cache->stats.trans_time += usec;
+   TC_CACHE_UNLOCK(cache);
+}
+
+/* Get statistics about a translation cache */
+void tc_cache_get_stats(tc_cache_t *cache,struct tc_cache_stats *s)
+{
+   TC_CACHE_LOCK(cache);
+   *s = cache->stats;
+   s->file_size = cache->file_size;
+   TC_CACHE_UNLOCK(cache);
+}
+
+/* Compute an average time per page (usec) */
+static inline double tc_cache_avg(m_uint64_t time,m_uint64_t count)
+{
+   return(count ? (double)time / count : 0.0);
+}
+
+/* Show statistics about translation caches */
+void tc_cache_show_stats(void)
+{
+   struct tc_cache_stats s;
+   tc_cache_t *cache;
+
+   pthread_mutex_lock(&tc_cache_list_lock);
+
+   if (tc_cache_list != NULL) {
+      printf("\nTranslation cache statistics:\n\n");
+
+      printf("    Entries   Size (KB)     Loads   us/page  Translations   "
+             "us/page    Stores  Errors  File\n");
+   }
+
+   for(cache=tc_cache_list;cache;cache=cache->next) {
+      tc_cache_get_stats(cache,&s);
+
+      printf(" %10llu  %10llu  %8llu  %8.1f      %8llu  %8.1f  %8llu  %6llu  "
+             "%s\n",
+             s.entries,s.file_size >> 10,
+             s.loads,tc_cache_avg(s.load_time,s.loads),
+             s.translations,tc_cache_avg(s.trans_time,s.translations),
+             s.stores,s.errors,cache->filename);
+   }
+
+   pthread_mutex_unlock(&tc_cache_list_lock);
+}
@@ -0,0 +1,105 @@
+/*
+ * Cisco router simulation platform.
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Persistent translation cache: translated code is saved to a file, keyed
+ * by the TSG page checksum, so that next starts don't translate again the
+ * same pages.
+ */
+
+#ifndef __TC_CACHE_H__
+#define __TC_CACHE_H__
+
+#include "utils.h"
+#include "tcb.h"
+
+/* Translation cache file magic number ("DTCC") and format version */
+#define TC_CACHE_MAGIC        0x44544343
+#define TC_CACHE_ENTRY_MAGIC  0x54434345
+#define TC_CACHE_VERSION      1
+
+/* File header */
+struct tc_cache_hdr {
+   m_uint32_t magic;
+   m_uint32_t version;
+   m_uint64_t build_id;        /* Checksum of the emulator binary */
+};
+
+/*
+ * Entry header, followed by the target page, the chunk lengths, the JIT
+ * instruction offsets, the patches, the host relocations and finally the
+ * host code. All parts are 8-byte aligned.
+ */
+struct tc_cache_entry {
+   m_uint32_t magic;
+   m_uint32_t len;             /* Total length of the entry */
+   tsg_checksum_t checksum;
+   m_uint64_t vaddr;
+   m_uint32_t exec_state;
+   m_uint32_t cpu_type;
+   m_uint32_t trans_flags;     /* CPU settings used for the translation */
+   m_uint32_t chunk_count;
+   m_uint32_t patch_count;
+   m_uint32_t reloc_count;
+};
+
+/* No JIT code for an instruction */
+#define TC_CACHE_NO_INSN  0xFFFFFFFF
+
+/* Patch record in a cache entry */
+struct tc_cache_patch {
+   m_uint32_t offset;
+   m_uint32_t pad;
+   m_uint64_t vaddr;
+};
+
+/* Relocation record in a cache entry (address relative to tc_cache_open) */
+struct tc_cache_reloc {
+   m_uint32_t offset;
+   m_uint32_t type;
+   m_int64_t addr;
+};
+
+/* Translation cache statistics */
+struct tc_cache_stats {
+   m_uint64_t entries;
+   m_uint64_t file_size;
+
+   /* Pages loaded from the cache, and time spent to load them (usec) */
+   m_uint64_t loads;
+   m_uint64_t load_time;
+
+   /* Pages translated, and time spent to translate them (usec) */
+   m_uint64_t translations;
+   m_uint64_t trans_time;
+
+   m_uint64_t stores;
+   m_uint64_t errors;
+};
+
+/* Open a translation cache file (shared by all VMs using it) */
+tc_cache_t *tc_cache_open(char *filename);
+
+/* Release a translation cache */
+void tc_cache_close(tc_cache_t *cache);
+
+/* Load translated code for a TB from the cache */
+cpu_tc_t *tc_cache_load(cpu_gen_t *cpu,tc_cache_t *cache,cpu_tb_t *tb,
+                        m_uint32_t trans_flags,
+                        void (*set_patch)(u_char *insn,u_char *dst),
+                        void (*set_jump)(u_char **insn,u_char *dst));
+
+/* Save translated code to the cache (patches and relocs must be present) */
+int tc_cache_store(tc_cache_t *cache,cpu_gen_t *cpu,cpu_tb_t *tb,
+                   cpu_tc_t *tc,m_uint32_t trans_flags);
+
+/* Account time spent to translate a page */
+void tc_cache_add_trans_time(tc_cache_t *cache,m_tmcnt_t usec);
+
+/* Get statistics about a translation cache */
+void tc_cache_get_stats(tc_cache_t *cache,struct tc_cache_stats *s);
+
+/* Show statistics about translation caches */
+void tc_cache_show_stats(void);
+
+#endif
@@ -26,9 +26,6 @@
 #define DEBUG_JIT_BUFFER_ADJUST  0
 #define DEBUG_JIT_PATCH          0
 
-/* Size of a JIT page */
-#define TC_JIT_PAGE_SIZE  32768
-
 /* CPU provisionning */
 #ifndef __CYGWIN__
 #define TSG_EXEC_AREA_SINGLE_CPU  64
@@ -48,14 +45,44 @@
 #define TC_HASH_SIZE   (1 << TC_HASH_BITS)
 #define TC_HASH_MASK   (TC_HASH_SIZE - 1)
 
+/* 
+ * The TC hash table is split in shards, each one with its own lock, so
+ * that CPUs looking up different pages don't wait for each other.
+ * Lock order: shard lock, then group lock.
+ */
+#define TC_HASH_SHARDS      64
+#define TC_HASH_SHARD_MASK  (TC_HASH_SHARDS - 1)
+
+/* Lock statistics */
+struct tsg_lock_stats {
+   m_uint64_t acquired;
+   m_uint64_t contended;
+};
+
+/* TC hash table shard */
+struct tc_hash_shard {
+   pthread_mutex_t lock;
+   struct tsg_lock_stats lock_stats;
+
+   /* Lookup statistics */
+   m_uint64_t lookups;
+   m_uint64_t hits;
+   m_uint64_t collisions;
+};
+
 typedef struct tsg tsg_t;
 struct tsg {
-   /* Lock to synchronize multiple CPU accesses */
+   /* 
+    * Lock to synchronize multiple CPU accesses (TC descriptors, CPU local 
+    * lists and exec pages).
+    */
    pthread_mutex_t lock;
    pthread_mutexattr_t lock_attr;   
+   struct tsg_lock_stats lock_stats;
 
    /* Hash table to retrieve Translated Code */
    cpu_tc_t **tc_hash;
+   struct tc_hash_shard tc_shards[TC_HASH_SHARDS];
    
    /* Free list of TC descriptors */
    cpu_tc_t *tc_free_list;
@@ -69,20 +96,43 @@ struct tsg {
    insn_exec_page_t *exec_page_array;
    insn_exec_page_t *exec_page_free_list;
 
-   size_t exec_area_alloc_size;
+   size_t exec_area_alloc_size,exec_area_size;
+   int exec_area_huge;
    u_int exec_page_alloc,exec_page_total;
    u_int exec_area_full;
 };
 
-#define TSG_LOCK(g)   pthread_mutex_lock(&(g)->lock)
+#define TSG_LOCK(g)   tsg_mutex_lock(&(g)->lock,&(g)->lock_stats)
 #define TSG_UNLOCK(g) pthread_mutex_unlock(&(g)->lock)
 
+#define TC_SHARD_LOCK(s)   tsg_mutex_lock(&(s)->lock,&(s)->lock_stats)
+#define TC_SHARD_UNLOCK(s) pthread_mutex_unlock(&(s)->lock)
+
 /* TCB groups */
 static tsg_t *tsg_array[TSG_MAX_GROUPS];
 
 /* forward prototype declarations */
 int tsg_remove_single_desc(cpu_gen_t *cpu);
 static int tc_free(tsg_t *tsg,cpu_tc_t *tc);
+static inline u_int tsg_cksum_hash(tsg_checksum_t cksum);
+
+/* Take a lock, recording if we had to wait for it */
+static inline void tsg_mutex_lock(pthread_mutex_t *lock,
+                                  struct tsg_lock_stats *stats)
+{
+   if (pthread_mutex_trylock(lock) != 0) {
+      pthread_mutex_lock(lock);
+      stats->contended++;
+   }
+
+   stats->acquired++;
+}
+
+/* Get the TC hash shard protecting the specified hash bucket */
+static inline struct tc_hash_shard *tc_get_shard(tsg_t *tsg,u_int bucket)
+{
+   return(&tsg->tc_shards[bucket & TC_HASH_SHARD_MASK]);
+}
 
 /* Create a new exec area */
 static int exec_page_create_area(tsg_t *tsg)
@@ -98,7 +148,13 @@ static int exec_page_create_area(tsg_t *tsg)
       
    /* Allocate an executable area through MMAP */
    area_size = tsg->exec_area_alloc_size * 1048756;
-   tsg->exec_area = memzone_map_exec_area(area_size);
+
+   if (tsg->exec_area_huge != MEMZONE_HUGE_NONE) {
+      area_size = MEMZONE_HUGE_ROUND(area_size);
+      tsg->exec_area = memzone_map_huge(area_size,TRUE,tsg->exec_area_huge);
+   } else {
+      tsg->exec_area = memzone_map_exec_area(area_size);
+   }
   
    if (!tsg->exec_area) {
       perror("exec_page_create_area: mmap");
@@ -111,6 +167,8 @@ static int exec_page_create_area(tsg_t *tsg)
       
    if (!tsg->exec_page_array)
       goto err_array;
+
+   tsg->exec_area_size = area_size;
    
    for(i=0,cp_addr=tsg->exec_area;i<page_count;i++) {
       cp = &tsg->exec_page_array[i];
@@ -145,21 +203,26 @@ static insn_exec_page_t *exec_page_alloc(cpu_gen_t *cpu)
 
    /* 
     * If the free list is empty, try to increase exec area capacity, then
-    * flush JIT for the requesting CPU.
+    * flush JIT for the requesting CPU. Descriptors are freed without
+    * holding the group lock, since TC hash locks must be taken first.
     */
-   if (unlikely(!(p = tsg->exec_page_free_list))) {
+   if (unlikely(!tsg->exec_page_free_list) && !tsg->exec_area_full) {
+      TSG_UNLOCK(tsg);
       count = tsg_remove_single_desc(cpu);
 #if DEBUG_JIT_FLUSH
       cpu_log(cpu,"JIT","flushed %d TCB\n",count);
 #endif
+      TSG_LOCK(tsg);
 
-      if (unlikely(!(p = tsg->exec_page_free_list)))
+      if (unlikely(!tsg->exec_page_free_list))
          tsg->exec_area_full = TRUE;
    }
 
    /* If the area is full, stop allocating pages and free TCB */
    if (tsg->exec_area_full) {
+      TSG_UNLOCK(tsg);
       cpu_jit_tcb_flush_all(cpu);
+      TSG_LOCK(tsg);
       
       /* if we get >= 25% of free pages, we can reallocate */
       if (tsg->exec_page_total >= (tsg->exec_page_alloc * 4)) {
@@ -170,6 +233,7 @@ static insn_exec_page_t *exec_page_alloc(cpu_gen_t *cpu)
       return NULL;
    }
 
+   p = tsg->exec_page_free_list;
    tsg->exec_page_free_list = p->next;
    tsg->exec_page_alloc++;
    TSG_UNLOCK(tsg);
@@ -201,10 +265,14 @@ int tsg_alloc(void)
    return(-1);
 }
 
-/* Create a translation sharing group */
-int tsg_create(int id,size_t alloc_size)
+/* 
+ * Create a translation sharing group. The exec area is shared by all CPUs
+ * of the group, so the huge page mode of the first CPU is used.
+ */
+int tsg_create(int id,size_t alloc_size,int huge)
 {
    tsg_t *tsg;
+   int i;
    
    /* If the group is already initialized, skip it */
    if (tsg_array[id] != NULL)
@@ -217,6 +285,7 @@ int tsg_create(int id,size_t alloc_size)
    memset(tsg,0,sizeof(*tsg));
    tsg->exec_area_full = FALSE;
    tsg->exec_area_alloc_size = alloc_size;
+   tsg->exec_area_huge = huge;
    
    /* Create the TC hash table */
    if (!(tsg->tc_hash = calloc(sizeof(cpu_tc_t *),TC_HASH_SIZE)))
@@ -231,6 +300,9 @@ int tsg_create(int id,size_t alloc_size)
    pthread_mutexattr_init(&tsg->lock_attr);
    pthread_mutexattr_settype(&tsg->lock_attr,PTHREAD_MUTEX_RECURSIVE);
    pthread_mutex_init(&tsg->lock,&tsg->lock_attr);
+
+   for(i=0;i<TC_HASH_SHARDS;i++)
+      pthread_mutex_init(&tsg->tc_shards[i].lock,NULL);
    return(0);
    
  err_area:
@@ -257,7 +329,7 @@ int tsg_bind_cpu(cpu_gen_t *cpu)
       alloc_size = TSG_EXEC_AREA_SHARED;
    }
       
-   if (tsg_create(cpu->tsg,alloc_size) == -1)
+   if (tsg_create(cpu->tsg,alloc_size,cpu->vm->huge_pages) == -1)
       return(-1);
       
    tsg = tsg_array[cpu->tsg];
@@ -265,6 +337,19 @@ int tsg_bind_cpu(cpu_gen_t *cpu)
    return(0);
 }
 
+/* Get the exec area of the TSG of a CPU */
+int tsg_get_exec_area(cpu_gen_t *cpu,void **ptr,size_t *len)
+{
+   tsg_t *tsg;
+
+   if ((cpu->tsg == -1) || !(tsg = tsg_array[cpu->tsg]))
+      return(-1);
+
+   *ptr = tsg->exec_area;
+   *len = tsg->exec_area_size;
+   return(0);
+}
+
 /* Unbind a CPU from a TSG - release all resources used */
 int tsg_unbind_cpu(cpu_gen_t *cpu)
 {
@@ -350,11 +435,12 @@ static inline void tc_remove_cpu_local(cpu_tc_t *tc)
    M_LIST_REMOVE(tc,sc);
 }
 
-/* Free a TC descriptor */
-static int tc_free(tsg_t *tsg,cpu_tc_t *tc)
+/* 
+ * Free a TC descriptor.
+ * Note: the TC hash shard lock and the group lock must be held.
+ */
+static int tc_free_locked(tsg_t *tsg,cpu_tc_t *tc)
 {
-   TSG_LOCK(tsg);
-      
    tc->ref_count--;   
    assert(tc->ref_count >= 0);
       
@@ -362,6 +448,7 @@ static int tc_free(tsg_t *tsg,cpu_tc_t *tc)
       tc->flags &= ~TC_FLAG_VALID;
       
       tc_free_patches(tc);
+      tc_free_relocs(tc);
       
       tc_remove_from_hash(tc);
       tc_remove_cpu_local(tc);
@@ -370,15 +457,49 @@ static int tc_free(tsg_t *tsg,cpu_tc_t *tc)
       
       tc->sc_next = tsg->tc_free_list;
       tsg->tc_free_list = tc;
-      TSG_UNLOCK(tsg);
       return(TRUE);
    }
    
    /* not yet deleted */
-   TSG_UNLOCK(tsg);
    return(FALSE);
 }
 
+/* Free a TC descriptor */
+static int tc_free(tsg_t *tsg,cpu_tc_t *tc)
+{
+   struct tc_hash_shard *shard;
+   int res;
+
+   shard = tc_get_shard(tsg,tsg_cksum_hash(tc->checksum));
+
+   TC_SHARD_LOCK(shard);
+   TSG_LOCK(tsg);
+   res = tc_free_locked(tsg,tc);
+   TSG_UNLOCK(tsg);
+   TC_SHARD_UNLOCK(shard);
+   return(res);
+}
+
+/* Unbind a TB from its TC descriptor, and release the descriptor */
+static void tb_release_tc(tsg_t *tsg,cpu_tb_t *tb)
+{
+   struct tc_hash_shard *shard;
+   cpu_tc_t *tc = tb->tc;
+
+   if (tc == NULL)
+      return;
+
+   shard = tc_get_shard(tsg,tsg_cksum_hash(tc->checksum));
+
+   TC_SHARD_LOCK(shard);
+   TSG_LOCK(tsg);
+   M_LIST_REMOVE(tb,tb_dl);
+   tc_free_locked(tsg,tc);
+   tb->tc = NULL;
+   TSG_UNLOCK(tsg);
+   TC_SHARD_UNLOCK(shard);
+}
+
 /* Allocate a new TC descriptor */
 cpu_tc_t *tc_alloc(cpu_gen_t *cpu,m_uint64_t vaddr,m_uint32_t exec_state)
 {
@@ -391,8 +512,10 @@ cpu_tc_t *tc_alloc(cpu_gen_t *cpu,m_uint64_t vaddr,m_uint32_t exec_state)
       tc = tsg->tc_free_list;
       tsg->tc_free_list = tc->sc_next;
    } else {
-      if (!(tc = malloc(sizeof(*tc))))
+      if (!(tc = malloc(sizeof(*tc)))) {
+         TSG_UNLOCK(tsg);
          return NULL;
+      }
    }
    TSG_UNLOCK(tsg);
    
@@ -418,18 +541,72 @@ cpu_tc_t *tc_alloc(cpu_gen_t *cpu,m_uint64_t vaddr,m_uint32_t exec_state)
    return tc;
 }
 
-/* Compute a checksum on a page */
+/* Primes used by the page checksum (from xxHash64) */
+#define TSG_CKSUM_PRIME1  0x9E3779B185EBCA87ULL
+#define TSG_CKSUM_PRIME2  0xC2B2AE3D27D4EB4FULL
+#define TSG_CKSUM_PRIME3  0x165667B19E3779F9ULL
+#define TSG_CKSUM_PRIME4  0x85EBCA77C2B2AE63ULL
+
+#define TSG_CKSUM_ROTL(x,n)  (((x) << (n)) | ((x) >> (64 - (n))))
+
+/* Mix a 64-bit word into an accumulator */
+static forced_inline m_uint64_t tsg_cksum_round(m_uint64_t acc,m_uint64_t val)
+{
+   acc += val * TSG_CKSUM_PRIME2;
+   acc  = TSG_CKSUM_ROTL(acc,31);
+   return(acc * TSG_CKSUM_PRIME1);
+}
+
+/* Merge an accumulator into the final checksum */
+static forced_inline m_uint64_t tsg_cksum_merge(m_uint64_t h,m_uint64_t acc)
+{
+   h ^= tsg_cksum_round(0,acc);
+   return(h * TSG_CKSUM_PRIME1 + TSG_CKSUM_PRIME4);
+}
+
+/* 
+ * Compute a checksum on a page (xxHash64 algorithm, on host words).
+ * Unlike a plain XOR, moving words around changes the result, so pages
+ * with the same checksum almost always have the same content.
+ * The size must be a multiple of 32 bytes.
+ */
 tsg_checksum_t tsg_checksum_page(void *page,ssize_t size)
 {
-   tsg_checksum_t cksum = 0;
+   m_uint64_t v1,v2,v3,v4,h;
    m_uint64_t *ptr = page;
-   
-   while(size > 0) {
-      cksum ^= *ptr;
-      ptr++;
-      size -= sizeof(m_uint64_t);
+   ssize_t len = size;
+
+   v1 = TSG_CKSUM_PRIME1 + TSG_CKSUM_PRIME2;
+   v2 = TSG_CKSUM_PRIME2;
+   v3 = 0;
+   v4 = -TSG_CKSUM_PRIME1;
+
+   /* 4 independent lanes, to keep the pipeline busy */
+   while(len > 0) {
+      v1 = tsg_cksum_round(v1,ptr[0]);
+      v2 = tsg_cksum_round(v2,ptr[1]);
+      v3 = tsg_cksum_round(v3,ptr[2]);
+      v4 = tsg_cksum_round(v4,ptr[3]);
+      ptr += 4;
+      len -= 4 * sizeof(m_uint64_t);
    }
-   return(cksum);
+
+   h = TSG_CKSUM_ROTL(v1,1) + TSG_CKSUM_ROTL(v2,7) + 
+       TSG_CKSUM_ROTL(v3,12) + TSG_CKSUM_ROTL(v4,18);
+
+   h = tsg_cksum_merge(h,v1);
+   h = tsg_cksum_merge(h,v2);
+   h = tsg_cksum_merge(h,v3);
+   h = tsg_cksum_merge(h,v4);
+   h += size;
+
+   /* Final avalanche */
+   h ^= h >> 33;
+   h *= TSG_CKSUM_PRIME2;
+   h ^= h >> 29;
+   h *= TSG_CKSUM_PRIME3;
+   h ^= h >> 32;
+   return(h);
 }
 
 /* Compute a hash on the specified checksum */
@@ -461,15 +638,19 @@ static forced_inline int tb_compare(cpu_tb_t *tb1,cpu_tb_t *tb2)
 int tc_find_shared(cpu_gen_t *cpu,cpu_tb_t *tb)
 {
    tsg_t *tsg = tsg_array[cpu->tsg];
+   struct tc_hash_shard *shard;
    cpu_tb_t *p;
    cpu_tc_t *tc;
    u_int hash_bucket;
-      
-   TSG_LOCK(tsg);   
 
    assert(tb->target_code != NULL);
 
    hash_bucket = tsg_cksum_hash(tb->checksum);
+   shard = tc_get_shard(tsg,hash_bucket);
+      
+   TC_SHARD_LOCK(shard);
+   shard->lookups++;
+
    for(tc=tsg->tc_hash[hash_bucket];tc;tc=tc->hash_next) 
    {
       assert(tc->flags & TC_FLAG_VALID);
@@ -483,24 +664,37 @@ int tc_find_shared(cpu_gen_t *cpu,cpu_tb_t *tb)
                abort();
             }
             
-            if (tb_compare(tb,p) && !tb_compare_page(tb,p))
-            {
-               /* matching page, we can share the code */
-               tc->ref_count++;
-               tb->tc = tc;
-               tc_remove_cpu_local(tc);
-               M_LIST_ADD(tb,tc->tb_list,tb_dl);               
-               tb_enable(cpu,tb);
-               
-               TSG_UNLOCK(tsg);
-               return(TSG_LOOKUP_SHARED);
+            if (!tb_compare(tb,p))
+               continue;
+
+            /* 
+             * All TBs bound to a TC have the same content, a mismatch
+             * means a checksum collision.
+             */
+            if (tb_compare_page(tb,p) != 0) {
+               shard->collisions++;
+               break;
             }
+
+            /* matching page, we can share the code */
+            TSG_LOCK(tsg);
+            tc->ref_count++;
+            tb->tc = tc;
+            tc_remove_cpu_local(tc);
+            M_LIST_ADD(tb,tc->tb_list,tb_dl);               
+            TSG_UNLOCK(tsg);
+
+            tb_enable(cpu,tb);
+            shard->hits++;
+            
+            TC_SHARD_UNLOCK(shard);
+            return(TSG_LOOKUP_SHARED);
          }
       }
    }
    
    /* A new TCB descriptor must be created */
-   TSG_UNLOCK(tsg);   
+   TC_SHARD_UNLOCK(shard);
    return(TSG_LOOKUP_NEW);
 }
 
@@ -509,35 +703,57 @@ void tc_register(cpu_gen_t *cpu,cpu_tb_t *tb,cpu_tc_t *tc)
 {
    tsg_t *tsg = tsg_array[cpu->tsg];
    u_int hash_bucket = tsg_cksum_hash(tb->checksum);
+   struct tc_hash_shard *shard = tc_get_shard(tsg,hash_bucket);
    
    tb->tc = tc;
    tc->checksum = tb->checksum;
 
+   TC_SHARD_LOCK(shard);
    TSG_LOCK(tsg);   
    tc_add_cpu_local(cpu,tc);
    M_LIST_ADD(tb,tc->tb_list,tb_dl);
    M_LIST_ADD(tc,tsg->tc_hash[hash_bucket],hash);
    tc->flags |= TC_FLAG_VALID;
    TSG_UNLOCK(tsg);
+   TC_SHARD_UNLOCK(shard);
 }
 
 /* Remove all TC descriptors belonging to a single CPU (ie not shared) */
 int tsg_remove_single_desc(cpu_gen_t *cpu)
 {
-   cpu_tc_t *tc,*next;
+   cpu_tb_t *tb;
+   cpu_tc_t *tc;
+   tsg_t *tsg;
    int count = 0;
+
+   /* Nothing to do if the CPU is not bound to a group yet (reset) */
+   if (!cpu->tc_local_list)
+      return(0);
+
+   tsg = tsg_array[cpu->tsg];
    
-   for(tc=cpu->tc_local_list;tc;tc=next) {      
-      next = tc->sc_next;
+   /* 
+    * The group lock is released while freeing a TB, another CPU may then 
+    * share the descriptor, which removes it from the local list.
+    */
+   for(;;) {
+      TSG_LOCK(tsg);
+
+      if (!(tc = cpu->tc_local_list)) {
+         TSG_UNLOCK(tsg);
+         break;
+      }
 
       assert(tc->ref_count == 1);
       assert(tc->tb_list->tb_dl_next == NULL);
 
-      tb_free(cpu,tc->tb_list);      
+      tb = tc->tb_list;
+      TSG_UNLOCK(tsg);
+
+      tb_free(cpu,tb);      
       count++;
    }
    
-   cpu->tc_local_list = NULL;
    return(count);
 }
 
@@ -569,6 +785,31 @@ void tc_dump(cpu_tc_t *tc)
    printf("  - sc_LIST    : (%p,%p)\n",tc->sc_pprev,tc->sc_next);    
 }
 
+/* 
+ * Take all TC hash shard locks and the group lock (not accounted in lock
+ * statistics).
+ */
+static void tsg_lock_all(tsg_t *tsg)
+{
+   int i;
+
+   for(i=0;i<TC_HASH_SHARDS;i++)
+      pthread_mutex_lock(&tsg->tc_shards[i].lock);
+
+   pthread_mutex_lock(&tsg->lock);
+}
+
+/* Release all locks taken by tsg_lock_all() */
+static void tsg_unlock_all(tsg_t *tsg)
+{
+   int i;
+
+   TSG_UNLOCK(tsg);
+
+   for(i=TC_HASH_SHARDS-1;i>=0;i--)
+      TC_SHARD_UNLOCK(&tsg->tc_shards[i]);
+}
+
 /* Consistency check */
 int tc_check_consistency(cpu_gen_t *cpu)
 {
@@ -577,7 +818,7 @@ int tc_check_consistency(cpu_gen_t *cpu)
    cpu_tc_t *tc;
    int i,err=0;
    
-   TSG_LOCK(tsg);
+   tsg_lock_all(tsg);
 
    for(i=0;i<TC_HASH_SIZE;i++) {
       for(tc=tsg->tc_hash[i];tc;tc=tc->hash_next) {
@@ -602,7 +843,7 @@ int tc_check_consistency(cpu_gen_t *cpu)
       }
    }
 
-   TSG_UNLOCK(tsg);
+   tsg_unlock_all(tsg);
    
    if (err > 0) {
       printf("TSG %d: internal consistency error (%d pb detected)\n",
@@ -616,15 +857,29 @@ int tc_check_consistency(cpu_gen_t *cpu)
 /* Statistics: compute number of shared pages in a translation group */
 static int tsg_get_stats(tsg_t *tsg,struct tsg_stats *s)
 {
+   struct tc_hash_shard *shard;
    cpu_tc_t *tc;
    int i;
    
-   s->shared_tc = s->total_tc = 0;
-   s->shared_pages = 0; 
+   memset(s,0,sizeof(*s));
    
    if (!tsg)
       return(-1);
 
+   tsg_lock_all(tsg);
+
+   for(i=0;i<TC_HASH_SHARDS;i++) {
+      shard = &tsg->tc_shards[i];
+      s->lookups    += shard->lookups;
+      s->hits       += shard->hits;
+      s->collisions += shard->collisions;
+      s->hash_lock_acquired  += shard->lock_stats.acquired;
+      s->hash_lock_contended += shard->lock_stats.contended;
+   }
+
+   s->tsg_lock_acquired  = tsg->lock_stats.acquired;
+   s->tsg_lock_contended = tsg->lock_stats.contended;
+
    for(i=0;i<TC_HASH_SIZE;i++) {
       for(tc=tsg->tc_hash[i];tc;tc=tc->hash_next) {
          if (tc->ref_count > 1) {
@@ -635,10 +890,17 @@ static int tsg_get_stats(tsg_t *tsg,struct tsg_stats *s)
          s->total_tc++;
       }
    }
-   
+
+   tsg_unlock_all(tsg);
    return(0);
 }
 
+/* Compute a percentage for statistics */
+static inline double tsg_stats_pct(m_uint64_t val,m_uint64_t total)
+{
+   return(total ? (100.0 * val) / total : 0.0);
+}
+
 /* Show statistics about all translation groups */
 void tsg_show_stats(void)
 {
@@ -659,6 +921,21 @@ void tsg_show_stats(void)
       }
    }
 
+   printf("\n  ID      Lookups         Hits   Collisions Coll.%%  "
+          "Hash Locks Cont.%%  Group Locks Cont.%%\n");
+
+   for(i=0;i<TSG_MAX_GROUPS;i++) {
+      if (!tsg_get_stats(tsg_array[i],&s)) {
+         printf(" %3d %12llu %12llu %12llu %6.2f %11llu %6.2f %12llu %6.2f\n",
+                i,s.lookups,s.hits,s.collisions,
+                tsg_stats_pct(s.collisions,s.lookups),
+                s.hash_lock_acquired,
+                tsg_stats_pct(s.hash_lock_contended,s.hash_lock_acquired),
+                s.tsg_lock_acquired,
+                tsg_stats_pct(s.tsg_lock_contended,s.tsg_lock_acquired));
+      }
+   }
+
    printf("\n");
 }
 
@@ -688,6 +965,7 @@ int tc_adjust_jit_buffer(cpu_gen_t *cpu,cpu_tc_t *tc,
    }
 
    /* jump to the new exec page (link) */
+   tc_record_reloc(tc,tc->jit_ptr,TC_RELOC_CHUNK_LINK,NULL);
    set_jump(&tc->jit_ptr,tc->jit_buffer->ptr);
    tc->jit_ptr = tc->jit_buffer->ptr;
    return(0);
@@ -776,6 +1054,75 @@ void tc_free_patches(cpu_tc_t *tc)
    tc->patch_table = NULL;
 }
 
+/* 
+ * Record a host relocation in a compiled block. If it cannot be recorded,
+ * the code is still valid but cannot be saved to the translation cache.
+ */
+int tc_record_reloc(cpu_tc_t *tc,u_char *jit_ptr,u_int type,void *addr)
+{
+   struct tc_reloc_table *rt = tc->reloc_table;
+   struct tc_reloc *reloc;
+
+   if (!rt || (rt->cur_reloc >= TC_RELOC_TABLE_SIZE))
+   {
+      /* full table or no table, create a new one */
+      if (!(rt = malloc(sizeof(*rt)))) {
+         tc->flags |= TC_FLAG_NOCACHE;
+         return(-1);
+      }
+
+      memset(rt,0,sizeof(*rt));
+      rt->next = tc->reloc_table;
+      tc->reloc_table = rt;
+   }
+
+   reloc = &rt->relocs[rt->cur_reloc++];
+   reloc->jit_insn = jit_ptr;
+   reloc->type     = type;
+   reloc->addr     = addr;
+   return(0);
+}
+
+/* Free the host relocation table */
+void tc_free_relocs(cpu_tc_t *tc)
+{
+   struct tc_reloc_table *p,*next;
+
+   for(p=tc->reloc_table;p;p=next) {
+      next = p->next;
+      free(p);
+   }
+
+   tc->reloc_table = NULL;
+}
+
+/* Free a TC descriptor which has not been registered */
+void tc_discard(cpu_gen_t *cpu,cpu_tc_t *tc)
+{
+   tc_free(tsg_array[cpu->tsg],tc);
+}
+
+/* 
+ * Get the position of a host code pointer in a TC, as an offset from the 
+ * start of its JIT chunks (chunk index * chunk size + offset in chunk).
+ */
+int tc_get_chunk_offset(cpu_tc_t *tc,u_char *ptr,m_uint32_t *offset)
+{
+   u_char *start;
+   int i;
+
+   for(i=0;i<tc->jit_chunk_pos;i++) {
+      start = tc->jit_chunks[i]->ptr;
+
+      if ((ptr >= start) && (ptr < (start + TC_JIT_PAGE_SIZE))) {
+         *offset = (i * TC_JIT_PAGE_SIZE) + (ptr - start);
+         return(0);
+      }
+   }
+
+   return(-1);
+}
+
 /* Initialize the JIT structures of a CPU */
 int cpu_jit_init(cpu_gen_t *cpu,size_t virt_hash_size,size_t phys_hash_size)
 {
@@ -831,14 +1178,11 @@ void tb_free(cpu_gen_t *cpu,cpu_tb_t *tb)
 {   
    tsg_t *tsg = tsg_array[cpu->tsg];
 
-   /* Remove this TB from the TB list bound to a TC descriptor */   
-   TSG_LOCK(tsg);
-   M_LIST_REMOVE(tb,tb_dl);
-   TSG_UNLOCK(tsg);
-
-   /* Release the TC descriptor first */
-   if (tb->tc != NULL)
-      tc_free(tsg,tb->tc);
+   /* 
+    * Remove this TB from the TB list bound to a TC descriptor, and release
+    * the TC descriptor first.
+    */
+   tb_release_tc(tsg,tb);
 
    /* Remove the block from the CPU TCB list */
    M_LIST_REMOVE(tb,tb);
@@ -885,10 +1229,7 @@ void tb_mark_smc(cpu_gen_t *cpu,cpu_tb_t *tb)
 
    tb->flags |= TB_FLAG_SMC;
 
-   if (tb->tc != NULL) {
-      tc_free(tsg_array[cpu->tsg],tb->tc);
-      tb->tc = NULL;
-   }
+   tb_release_tc(tsg_array[cpu->tsg],tb);
 }
 
 /* Handle write access on an executable page */
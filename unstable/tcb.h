@@ -30,6 +30,28 @@ struct insn_patch_table {
    u_int cur_patch;
 };
 
+/* 
+ * Host relocations, recorded so that translated code can be saved to the
+ * persistent translation cache and loaded at another address.
+ */
+#define TC_RELOC_HOST_ADDR   0   /* 64-bit address of a host function */
+#define TC_RELOC_CHUNK_LINK  1   /* Jump to the next JIT chunk */
+
+struct tc_reloc {
+   u_char *jit_insn;
+   u_int type;
+   void *addr;
+};
+
+/* Host relocation table */
+#define TC_RELOC_TABLE_SIZE  32
+
+struct tc_reloc_table {
+   struct tc_reloc_table *next;
+   struct tc_reloc relocs[TC_RELOC_TABLE_SIZE];
+   u_int cur_reloc;
+};
+
 /* Flags for CPU Tranlation Blocks (TB) */
 #define TB_FLAG_SMC      0x01  /* Self-modifying code */
 #define TB_FLAG_RECOMP   0x02  /* Page being recompiled */
@@ -68,12 +90,16 @@ struct cpu_tb {
 #endif
 };
 
+/* Size of a JIT page */
+#define TC_JIT_PAGE_SIZE  32768
+
 /* Maximum exec pages per TC descriptor */ 
 #define TC_MAX_CHUNKS  32
 
 /* TC descriptor flags */
 #define TC_FLAG_REMOVAL  0x01  /* Descriptor marked for removal */
 #define TC_FLAG_VALID    0x02
+#define TC_FLAG_NOCACHE  0x04  /* Incomplete relocations, don't save it */
 
 /* CPU Translated Code */
 struct cpu_tc {
@@ -96,6 +122,9 @@ struct cpu_tc {
    /* Patch table */
    struct insn_patch_table *patch_table;
 
+   /* Host relocation table */
+   struct tc_reloc_table *reloc_table;
+
    /* Translation position in target code */
    u_int trans_pos;
    
@@ -150,6 +179,13 @@ static forced_inline u_char *tc_get_host_ptr(cpu_tc_t *tc,m_uint64_t vaddr)
    return(tc->jit_insn_ptr[offset]);
 }
 
+/* Returns TRUE if a host code pointer is in the current JIT buffer */
+static inline int tc_in_jit_buffer(cpu_tc_t *tc,u_char *ptr)
+{
+   return((ptr >= tc->jit_buffer->ptr) && 
+          (ptr < (tc->jit_buffer->ptr + TC_JIT_PAGE_SIZE)));
+}
+
 /* Get the JIT instruction pointer in a translated block */
 static forced_inline u_char *tb_get_host_ptr(cpu_tb_t *tb,m_uint64_t vaddr)
 {
@@ -165,6 +201,17 @@ struct tsg_stats {
    u_int total_tc;
    u_int shared_tc;
    u_int shared_pages;
+
+   /* TC lookups, shared TC found and checksum collisions */
+   m_uint64_t lookups;
+   m_uint64_t hits;
+   m_uint64_t collisions;
+
+   /* Lock acquisitions, and how many had to wait */
+   m_uint64_t hash_lock_acquired;
+   m_uint64_t hash_lock_contended;
+   m_uint64_t tsg_lock_acquired;
+   m_uint64_t tsg_lock_contended;
 };
 
 enum {
@@ -181,6 +228,9 @@ int tsg_bind_cpu(cpu_gen_t *cpu);
 /* Unbind a CPU from a TSG - release all resources used */
 int tsg_unbind_cpu(cpu_gen_t *cpu);
 
+/* Get the exec area of the TSG of a CPU */
+int tsg_get_exec_area(cpu_gen_t *cpu,void **ptr,size_t *len);
+
 /* Create a JIT chunk */
 int tc_alloc_jit_chunk(cpu_gen_t *cpu,cpu_tc_t *tc);
 
@@ -222,6 +272,18 @@ int tc_apply_patches(cpu_tc_t *tc,void (*set_patch)(u_char *insn,u_char *dst));
 /* Free the patch table */
 void tc_free_patches(cpu_tc_t *tc);
 
+/* Record a host relocation in a compiled block */
+int tc_record_reloc(cpu_tc_t *tc,u_char *jit_ptr,u_int type,void *addr);
+
+/* Free the host relocation table */
+void tc_free_relocs(cpu_tc_t *tc);
+
+/* Free a TC descriptor which has not been registered */
+void tc_discard(cpu_gen_t *cpu,cpu_tc_t *tc);
+
+/* Get the position of a host code pointer in the JIT chunks of a TC */
+int tc_get_chunk_offset(cpu_tc_t *tc,u_char *ptr,m_uint32_t *offset);
+
 /* Initialize the JIT structures of a CPU */
 int cpu_jit_init(cpu_gen_t *cpu,size_t virt_hash_size,size_t phys_hash_size);
 
@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <assert.h>
 #include <glob.h>
 
@@ -22,8 +23,11 @@
 #include "cpu.h"
 #include "vm.h"
 #include "tcb.h"
+#include "tc_cache.h"
 #include "mips64_jit.h"
 #include "dev_vtty.h"
+#include "ptask.h"
+#include "net_io.h"
 
 #include MIPS64_ARCH_INC_FILE
 
@@ -353,6 +357,7 @@ static vm_instance_t *vm_create(char *name,int instance_id,
    }
    
    memset(vm,0,sizeof(*vm));
+   pthread_mutex_init(&vm->host_pages_lock,NULL);
 
    if (!(vm->name = strdup(name))) {
       fprintf(stderr,"VM %s: unable to store instance name!\n",name);
@@ -368,6 +373,7 @@ static vm_instance_t *vm_create(char *name,int instance_id,
    vm->vtty_aux_type        = VTTY_TYPE_NONE;
    vm->timer_irq_check_itv  = VM_TIMER_IRQ_CHECK_ITV;
    vm->log_file_enabled     = TRUE;
+   vm->numa_node            = -1;
    vm->rommon_vars.filename = vm_build_filename(vm,"rommon_vars");
 
    if (!vm->rommon_vars.filename)
@@ -412,6 +418,7 @@ static vm_instance_t *vm_create(char *name,int instance_id,
  */
 int vm_hardware_shutdown(vm_instance_t *vm)
 {  
+   struct tc_cache_stats tcc_stats;
    int i;
 
    if ((vm->status == VM_STATUS_HALTED) || !vm->cpu_group) {
@@ -456,6 +463,23 @@ int vm_hardware_shutdown(vm_instance_t *vm)
    vm->cpu_group = NULL;
    vm->boot_cpu = NULL;
 
+   /* Release the translation cache */
+   if (vm->tc_cache != NULL) {
+      tc_cache_get_stats(vm->tc_cache,&tcc_stats);
+      vm_log(vm,"TC_CACHE","%llu pages loaded (%.1f us/page), "
+             "%llu pages translated (%.1f us/page), %llu pages saved.\n",
+             tcc_stats.loads,
+             tcc_stats.loads ? 
+             (double)tcc_stats.load_time / tcc_stats.loads : 0.0,
+             tcc_stats.translations,
+             tcc_stats.translations ? 
+             (double)tcc_stats.trans_time / tcc_stats.translations : 0.0,
+             tcc_stats.stores);
+
+      tc_cache_close(vm->tc_cache);
+      vm->tc_cache = NULL;
+   }
+
    vm_log(vm,"VM","shutdown procedure completed.\n");
    m_log("VM","VM %s shutdown.\n",vm->name);
    return(0);
@@ -478,10 +502,16 @@ void vm_free(vm_instance_t *vm)
 
       /* Free all chunks */
       vm_chunk_free_all(vm);
+      pthread_mutex_destroy(&vm->host_pages_lock);
 
       /* Free various elements */
       free(vm->rommon_vars.filename);
       free(vm->ghost_ram_filename);
+      free(vm->pcmcia_disk_base[0]);
+      free(vm->pcmcia_disk_base[1]);
+      free(vm->snapshot_file);
+      free(vm->cpu_affinity);
+      free(vm->tc_cache_filename);
       free(vm->sym_filename);
       free(vm->ios_image);
       free(vm->ios_startup_config);
@@ -511,6 +541,11 @@ int vm_ram_init(vm_instance_t *vm,m_uint64_t paddr)
 
    len = vm->ram_size * 1048576;
 
+   if (vm->snapshot_file != NULL) {
+      return(dev_ram_ghost_init(vm,"ram",vm->sparse_mem,vm->snapshot_file,
+                                paddr,len));
+   }
+
    if (vm->ghost_status == VM_GHOST_RAM_USE) {
       return(dev_ram_ghost_init(vm,"ram",vm->sparse_mem,vm->ghost_ram_filename,
                                 paddr,len));
@@ -521,6 +556,114 @@ int vm_ram_init(vm_instance_t *vm,m_uint64_t paddr)
                        vm->ghost_ram_filename,vm->sparse_mem,paddr,len));
 }
 
+/* 
+ * Stop the device threads of a VM (periodic tasks and RX listeners, which
+ * access the RAM by DMA), or restart them.
+ */
+static void vm_devices_pause(vm_instance_t *vm)
+{
+   ptask_group_pause(vm);
+   netio_rxl_group_pause(vm);
+}
+
+static void vm_devices_resume(vm_instance_t *vm)
+{
+   netio_rxl_group_resume(vm);
+   ptask_group_resume(vm);
+}
+
+/* 
+ * Give back to the ghost image (or snapshot) the private RAM pages which
+ * have the same content. Returns the number of pages released.
+ */
+int vm_ram_reshare(vm_instance_t *vm)
+{
+   struct vdevice *ram_dev;
+   cpu_gen_t *cpu;
+   int running,count;
+
+   if ((vm->status != VM_STATUS_RUNNING) &&
+       (vm->status != VM_STATUS_SUSPENDED))
+      return(-1);
+
+   if (!(ram_dev = dev_get_by_name(vm,"ram")))
+      return(-1);
+
+   running = (vm->status == VM_STATUS_RUNNING);
+   vm_suspend(vm);
+   vm_devices_pause(vm);
+
+   if (cpu_group_sync_state(vm->cpu_group) == -1) {
+      vm_error(vm,"unable to sync with system CPUs.\n");
+      count = -1;
+      goto done;
+   }
+
+   count = dev_ghost_reshare(vm,ram_dev);
+
+   /* Translated blocks keep pointers to the code pages */
+   if (count > 0) {
+      for(cpu=vm->cpu_group->cpu_list;cpu;cpu=cpu->next)
+         cpu_jit_tcb_flush_all(cpu);
+   }
+
+   /* Host addresses of pages have changed */
+   cpu_group_rebuild_mts(vm->cpu_group);
+
+   if (count != -1)
+      vm_log(vm,"GHOST","%d RAM pages given back to the ghost image.\n",
+             count);
+
+ done:
+   vm_devices_resume(vm);
+
+   if (running)
+      vm_resume(vm);
+   return(count);
+}
+
+/* 
+ * Give back to the host the RAM pages containing only zeroes, i.e. memory
+ * freed by IOS. Returns the number of pages released.
+ */
+int vm_ram_reclaim(vm_instance_t *vm)
+{
+   struct vdevice *ram_dev;
+   int running,count;
+
+   if ((vm->status != VM_STATUS_RUNNING) &&
+       (vm->status != VM_STATUS_SUSPENDED))
+      return(-1);
+
+   if (!(ram_dev = dev_get_by_name(vm,"ram")))
+      return(-1);
+
+   running = (vm->status == VM_STATUS_RUNNING);
+   vm_suspend(vm);
+   vm_devices_pause(vm);
+
+   if (cpu_group_sync_state(vm->cpu_group) == -1) {
+      vm_error(vm,"unable to sync with system CPUs.\n");
+      count = -1;
+      goto done;
+   }
+
+   count = dev_ram_reclaim(vm,ram_dev);
+
+   /* Host pages of sparse memory may have been released */
+   cpu_group_rebuild_mts(vm->cpu_group);
+
+   if (count != -1)
+      vm_log(vm,"RAM","%d zeroed RAM pages given back to the host.\n",count);
+
+ done:
+   vm_devices_resume(vm);
+
+   if (running)
+      vm_resume(vm);
+   return(count);
+}
+
 /* Initialize VTTY */
 int vm_init_vtty(vm_instance_t *vm)
 {
@@ -682,7 +825,7 @@ static vm_chunk_t *vm_chunk_create(vm_instance_t *vm)
 
    area_len = VM_CHUNK_AREA_SIZE * VM_PAGE_SIZE;
 
-   if (!(chunk->area = m_memalign(VM_PAGE_SIZE,area_len))) {
+   if (!(chunk->area = memzone_map_lazy(area_len))) {
       free(chunk);
       return NULL;
    }
@@ -692,13 +835,16 @@ static vm_chunk_t *vm_chunk_create(vm_instance_t *vm)
 
    chunk->next = vm->chunks;
    vm->chunks = chunk;
+
+   /* The first page is needed now, get the next ones in background */
+   dev_ram_prefault(vm,chunk->area + VM_PAGE_SIZE,area_len - VM_PAGE_SIZE);
    return chunk;
 }
 
 /* Free a chunk */
 static void vm_chunk_free(vm_chunk_t *chunk)
 {
-   free(chunk->area);
+   memzone_unmap(chunk->area,VM_CHUNK_AREA_SIZE * VM_PAGE_SIZE);
    free(chunk);
 }
 
@@ -713,24 +859,72 @@ static void vm_chunk_free_all(vm_instance_t *vm)
    }
 
    vm->chunks = NULL;
+
+   free(vm->free_pages);
+   vm->free_pages = NULL;
+   vm->free_pages_count = vm->free_pages_max = 0;
 }
 
 /* Allocate an host page */
 void *vm_alloc_host_page(vm_instance_t *vm)
 {
-   vm_chunk_t *chunk = vm->chunks;
+   vm_chunk_t *chunk;
    void *ptr;
 
+   pthread_mutex_lock(&vm->host_pages_lock);
+
+   /* Reuse a released page if possible */
+   if (vm->free_pages_count > 0) {
+      ptr = vm->free_pages[--vm->free_pages_count];
+      pthread_mutex_unlock(&vm->host_pages_lock);
+      return(ptr);
+   }
+
+   chunk = vm->chunks;
+
    if (!chunk || (chunk->page_alloc == chunk->page_total)) {
-      chunk = vm_chunk_create(vm);
-      if (!chunk) return NULL;
+      if (!(chunk = vm_chunk_create(vm))) {
+         pthread_mutex_unlock(&vm->host_pages_lock);
+         return NULL;
+      }
    }
 
    ptr = chunk->area + (chunk->page_alloc * VM_PAGE_SIZE);
    chunk->page_alloc++;
+   pthread_mutex_unlock(&vm->host_pages_lock);
    return(ptr);
 }
 
+/* 
+ * Free an host page. The page is kept for a future allocation, but its
+ * memory is given back to the system.
+ */
+void vm_free_host_page(vm_instance_t *vm,void *ptr)
+{
+   void **pages;
+   u_int max;
+
+   madvise(ptr,VM_PAGE_SIZE,MADV_DONTNEED);
+
+   pthread_mutex_lock(&vm->host_pages_lock);
+
+   if (vm->free_pages_count == vm->free_pages_max) {
+      max = vm->free_pages_max ? vm->free_pages_max * 2 : VM_CHUNK_AREA_SIZE;
+
+      /* If the page can't be recorded, it is simply lost until VM exit */
+      if (!(pages = realloc(vm->free_pages,max * sizeof(void *)))) {
+         pthread_mutex_unlock(&vm->host_pages_lock);
+         return;
+      }
+
+      vm->free_pages = pages;
+      vm->free_pages_max = max;
+   }
+
+   vm->free_pages[vm->free_pages_count++] = ptr;
+   pthread_mutex_unlock(&vm->host_pages_lock);
+}
+
 /* Free resources used by a ghost image */
 static void vm_ghost_image_free(vm_ghost_image_t *img)
 {
@@ -1058,6 +1252,21 @@ void vm_save_config(vm_instance_t *vm,FILE *fd)
       fprintf(fd,"vm set_aux_tcp_port %s %d\n",
               vm->name,vm->vtty_aux_tcp_port);
 
+   if (vm->cpu_affinity)
+      fprintf(fd,"vm set_cpu_affinity %s %s\n",vm->name,vm->cpu_affinity);
+
+   if (vm->numa_node != -1)
+      fprintf(fd,"vm set_numa_node %s %d\n",vm->name,vm->numa_node);
+
+   if (vm->huge_pages != MEMZONE_HUGE_NONE)
+      fprintf(fd,"vm set_huge_pages %s %d\n",vm->name,vm->huge_pages);
+
+   if (vm->timer_vclock)
+      fprintf(fd,"vm set_timer_vclock %s 1\n",vm->name);
+
+   if (vm->idle_pc_auto)
+      fprintf(fd,"vm set_idle_pc_auto %s 1\n",vm->name);
+
    /* Save slot config */
    vm_slot_save_all_config(vm,fd);
 }
@@ -1260,10 +1469,90 @@ int vm_rename_instance(vm_instance_t *vm, char *name)
    return(-1);
 }
 
-/* Initialize a VM instance */
+/* Set the host CPUs used by a VM */
+int vm_set_cpu_affinity(vm_instance_t *vm,char *cpu_list)
+{
+   affinity_set_t set;
+   char *str;
+
+   if ((affinity_parse(&set,cpu_list) == -1) || !(str = strdup(cpu_list)))
+      return(-1);
+
+   free(vm->cpu_affinity);
+   vm->cpu_affinity = str;
+   vm->cpu_set = set;
+
+   /* Move the threads of a running VM at once */
+   if (vm->status != VM_STATUS_HALTED)
+      vm_apply_affinity(vm);
+
+   return(0);
+}
+
+/* Get the NUMA node used for the memory of a VM (-1 if none) */
+int vm_get_numa_node(vm_instance_t *vm)
+{
+   if (vm->numa_node != -1)
+      return(vm->numa_node);
+
+   if (vm->cpu_affinity != NULL)
+      return(affinity_get_node(&vm->cpu_set));
+
+   return(-1);
+}
+
+/* Bind the CPU, ptask and RX listener threads of a VM to its CPU set */
+void vm_apply_affinity(vm_instance_t *vm)
+{
+   cpu_gen_t *cpu;
+
+   if (!vm->cpu_affinity)
+      return;
+
+   if (vm->cpu_group != NULL) {
+      for(cpu=vm->cpu_group->cpu_list;cpu;cpu=cpu->next)
+         if (affinity_set_thread(cpu->cpu_thread,&vm->cpu_set) == -1)
+            vm_log(vm,"VM","unable to bind CPU%u to CPUs %s\n",
+                   cpu->id,vm->cpu_affinity);
+   }
+
+   /* Tasks and NIO of the VM get their own pinned workers */
+   if (ptask_set_group_affinity(vm,&vm->cpu_set) == -1)
+      vm_log(vm,"VM","unable to bind periodic tasks to CPUs %s\n",
+             vm->cpu_affinity);
+
+   if (netio_rxl_set_group_affinity(vm,&vm->cpu_set) == -1)
+      vm_log(vm,"VM","unable to bind RX listeners to CPUs %s\n",
+             vm->cpu_affinity);
+}
+
+/* 
+ * Initialize a VM instance.
+ *
+ * The memory allocated during initialization, and later by the CPU threads
+ * created here, comes preferably from the NUMA node of the VM.
+ */
 int vm_init_instance(vm_instance_t *vm)
 {
-   return(vm->platform->init_instance(vm));
+   int node,res;
+
+   if (((node = vm_get_numa_node(vm)) != -1) && 
+       (affinity_set_mem_node(node) == -1)) 
+   {
+      vm_log(vm,"VM","unable to use NUMA node %d for memory (%s)\n",
+             node,strerror(errno));
+      node = -1;
+   }
+
+   res = vm->platform->init_instance(vm);
+
+   if (node != -1)
+      affinity_set_mem_node(-1);
+
+   if (res != -1)
+      vm_apply_affinity(vm);
+
+   return(res);
 }
 
 /* Stop a VM instance */
@@ -1328,5 +1617,21 @@ int vm_set_tsg(vm_instance_t *vm,int group)
    return(0);
 }
 
+/* Set the persistent translation cache file */
+int vm_set_tc_cache(vm_instance_t *vm,char *filename)
+{
+   char *str = NULL;
+
+   if (vm->status == VM_STATUS_RUNNING)
+      return(-1);
+
+   if (filename && *filename && !(str = strdup(filename)))
+      return(-1);
+
+   free(vm->tc_cache_filename);
+   vm->tc_cache_filename = str;
+   return(0);
+}
+
 
 